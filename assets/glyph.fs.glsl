@@ -1,11 +1,11 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec3 vCol;
-in vec2 vTex;
+in vec4 vCol;
+in vec3 vTex;
 
-uniform sampler2D tex0;
+uniform sampler2DArray tex0;
 
 void main() {
-  FragColor = vec4(vCol, 1.0) * texture(tex0, vTex);
+  FragColor = vCol * texture(tex0, vTex);
 }
@@ -1,16 +1,27 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aCol;
-layout (location = 2) in vec2 aTex;
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec2 aPos;
+layout (location = 2) in uint aGlyph;
+layout (location = 3) in vec4 aCol;
 
-out vec3 vCol;
-out vec2 vTex;
+out vec4 vCol;
+out vec3 vTex;
 
-uniform mat4 model;
 uniform mat4 proj;
+uniform vec2 origin;
+// Glyph quads are scaled around their pen position for sized text
+uniform float scale;
+uniform samplerBuffer glyphs;
 
 void main() {
-  gl_Position = model * proj * vec4(aPos, 1.0);
+  // Three texels per glyph: UV rect, size and offset, then atlas layer
+  vec4 uvRect = texelFetch(glyphs, int(aGlyph) * 3);
+  vec4 sizeOffset = texelFetch(glyphs, int(aGlyph) * 3 + 1);
+  float layer = texelFetch(glyphs, int(aGlyph) * 3 + 2).x;
+  vec2 pos =
+      origin + aPos + (sizeOffset.zw + aCorner * sizeOffset.xy) * scale;
+
+  gl_Position = proj * vec4(pos, 0.0, 1.0);
   vCol = aCol;
-  vTex = aTex;
+  vTex = vec3(mix(uvRect.xy, uvRect.zw, aCorner), layer);
 }
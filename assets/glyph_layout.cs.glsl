@@ -0,0 +1,451 @@
+#version 430 core
+// Lays out UTF-8 text into glyph instances, every invocation going through
+// a few bytes of text in order and the workgroup scanning their totals, in
+// passes over the same buffers:
+//   0. decode the characters, find their glyphs and count per workgroup the
+//      newlines, visible glyphs and the last glyph or newline
+//   1. scan the counts of the workgroups, set the instance count of the draw
+//   2. find the previous glyph of every glyph for its kerning, sum the
+//      advances of every line per workgroup
+//   3. scan the line advances of the workgroups
+//   4. place the visible glyphs, in text order
+layout (local_size_x = 256) in;
+
+#define GROUP_SIZE 256u
+#define INVOCATION_BYTES 16u
+#define NO_GLYPH 0u
+#define KERNING_EMPTY_KEY 0xFFFFFFFFu
+#define REPLACEMENT_CHARACTER 0xFFFDu
+#define MAX_CODEPOINT 0x10FFFFu
+
+#define PASS_DECODE 0u
+#define PASS_SCAN_COUNTS 1u
+#define PASS_ADVANCE 2u
+#define PASS_SCAN_ADVANCES 3u
+#define PASS_PLACE 4u
+
+// Character starts at the byte, a newline, a glyph with a quad
+#define FLAG_START 1u
+#define FLAG_NEWLINE 2u
+#define FLAG_VISIBLE 4u
+
+uniform uint pass;
+uniform uint textLen;
+uniform uint groupCount;
+uniform float top;
+uniform float lineHeight;
+uniform float scale;
+uniform uint color;
+// Tables in the font buffer, offsets in words
+uniform uint pageIndexOffset;
+uniform uint pagesOffset;
+uniform uint advancesOffset;
+uniform uint visibleOffset;
+uniform uint kerningFilterOffset;
+uniform uint kerningKeysOffset;
+uniform uint kerningAmountsOffset;
+uniform uint kerningMask;
+uniform uint kerningShift;
+
+struct Element {
+  uint glyph;
+  uint flags;
+  float kerning;
+  float advance;
+};
+
+// Exclusive prefix of the groups before, totals until scanned. The advance
+// is the sum since the last newline, lineBreak set when there is one.
+struct Group {
+  uint lastEvent;
+  uint lines;
+  uint visible;
+  uint lineBreak;
+  float advance;
+};
+
+struct Instance {
+  float x;
+  float y;
+  uint glyph;
+  uint color;
+};
+
+// Four bytes of text a word, the first in the lowest byte
+layout (std430, binding = 0) readonly buffer TextBuffer { uint text[]; };
+layout (std430, binding = 1) readonly buffer FontBuffer { uint font[]; };
+layout (std430, binding = 2) buffer ElementBuffer { Element elements[]; };
+layout (std430, binding = 3) buffer GroupBuffer { Group groups[]; };
+layout (std430, binding = 4) writeonly buffer InstanceBuffer {
+  Instance instances[];
+};
+layout (std430, binding = 5) writeonly buffer CommandBuffer {
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+} command;
+
+shared uint scanFlags[GROUP_SIZE];
+shared float scanSums[GROUP_SIZE];
+
+uint ReadByte(uint i) {
+  return (text[i >> 2] >> ((i & 3u) * 8u)) & 0xFFu;
+}
+
+// Length of the UTF-8 sequence at the byte, 1 for ASCII and malformed
+// sequences, which decode as U+FFFD one byte at a time
+uint DecodeUTF8(uint i, out uint codepoint) {
+  uint lead = ReadByte(i);
+  uint length =
+      lead >= 0xF0u ? 4u : lead >= 0xE0u ? 3u : lead >= 0xC0u ? 2u : 1u;
+  codepoint = lead < 0x80u ? lead : REPLACEMENT_CHARACTER;
+  if (length == 1u || lead > 0xF4u || textLen - i < length) {
+    return 1u;
+  }
+
+  uint value = lead & (0x7Fu >> length);
+  for (uint k = 1u; k < length; k++) {
+    uint next = ReadByte(i + k);
+    if ((next & 0xC0u) != 0x80u) {
+      return 1u;
+    }
+
+    value = value << 6 | (next & 0x3Fu);
+  }
+
+  uint minCodepoint = length == 2u ? 0x80u : length == 3u ? 0x800u : 0x10000u;
+  if (value < minCodepoint || value > MAX_CODEPOINT ||
+      (value >= 0xD800u && value <= 0xDFFFu)) {
+    return 1u;
+  }
+
+  codepoint = value;
+  return length;
+}
+
+// Continuation bytes of a well formed sequence never lead one, so a byte
+// starts a character unless one of the three before leads a sequence
+// covering it
+bool IsCharacterStart(uint i) {
+  uint codepoint;
+  for (uint back = 1u; back <= 3u && back <= i; back++) {
+    if (DecodeUTF8(i - back, codepoint) > back) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint GetGlyphIndex(uint codepoint) {
+  if (codepoint > MAX_CODEPOINT) {
+    return NO_GLYPH;
+  }
+
+  // Pages of 256 16 bit indices, two to a word
+  uint page = font[pageIndexOffset + codepoint / 512u];
+  page = (page >> ((codepoint / 256u & 1u) * 16u)) & 0xFFFFu;
+  uint entry = page * 256u + codepoint % 256u;
+  return (font[pagesOffset + entry / 2u] >> ((entry & 1u) * 16u)) & 0xFFFFu;
+}
+
+float GetKerning(uint first, uint second) {
+  uint seconds = font[kerningFilterOffset + first * 2u + ((second & 63u) >> 5)];
+  if (((seconds >> (second & 31u)) & 1u) == 0u) {
+    return 0.0;
+  }
+
+  uint key = (first << 16) | second;
+  uint slot = (key * 2654435761u) >> kerningShift;
+  while (font[kerningKeysOffset + slot] != KERNING_EMPTY_KEY) {
+    if (font[kerningKeysOffset + slot] == key) {
+      return uintBitsToFloat(font[kerningAmountsOffset + slot]);
+    }
+
+    slot = (slot + 1u) & kerningMask;
+  }
+
+  return 0.0;
+}
+
+// Workgroup scans, called by every invocation of the group. They return
+// the exclusive prefix of the invocation and the total of the group.
+uint ScanSum(uint value, out uint total) {
+  uint lane = gl_LocalInvocationID.x;
+  scanFlags[lane] = value;
+  barrier();
+  for (uint offset = 1u; offset < GROUP_SIZE; offset <<= 1) {
+    uint before = lane >= offset ? scanFlags[lane - offset] : 0u;
+    barrier();
+    scanFlags[lane] += before;
+    barrier();
+  }
+
+  uint prefix = scanFlags[lane] - value;
+  total = scanFlags[GROUP_SIZE - 1u];
+  barrier();
+  return prefix;
+}
+
+uint ScanMax(uint value, out uint total) {
+  uint lane = gl_LocalInvocationID.x;
+  scanFlags[lane] = value;
+  barrier();
+  for (uint offset = 1u; offset < GROUP_SIZE; offset <<= 1) {
+    uint before = lane >= offset ? scanFlags[lane - offset] : 0u;
+    barrier();
+    scanFlags[lane] = max(scanFlags[lane], before);
+    barrier();
+  }
+
+  uint prefix = lane > 0u ? scanFlags[lane - 1u] : 0u;
+  total = scanFlags[GROUP_SIZE - 1u];
+  barrier();
+  return prefix;
+}
+
+// Sums restarting after every break, the prefix break is set when there is
+// one before the invocation
+float ScanLines(uint lineBreak, float value, out uint prefixBreak,
+                out uint totalBreak, out float total) {
+  uint lane = gl_LocalInvocationID.x;
+  scanFlags[lane] = lineBreak;
+  scanSums[lane] = value;
+  barrier();
+  for (uint offset = 1u; offset < GROUP_SIZE; offset <<= 1) {
+    uint breakBefore = lane >= offset ? scanFlags[lane - offset] : 0u;
+    float before = lane >= offset ? scanSums[lane - offset] : 0.0;
+    barrier();
+    if (scanFlags[lane] == 0u) {
+      scanSums[lane] = before + scanSums[lane];
+    }
+
+    scanFlags[lane] |= breakBefore;
+    barrier();
+  }
+
+  prefixBreak = lane > 0u ? scanFlags[lane - 1u] : 0u;
+  float prefix = lane > 0u ? scanSums[lane - 1u] : 0.0;
+  totalBreak = scanFlags[GROUP_SIZE - 1u];
+  total = scanSums[GROUP_SIZE - 1u];
+  barrier();
+  return prefix;
+}
+
+// Counts two per word, neither gets past the bytes of a workgroup
+#define PACK_COUNTS(lines, visible) ((lines) << 16 | (visible))
+
+void Decode(uint first, uint group) {
+  uint lastEvent = 0u;
+  uint counts = 0u;
+  for (uint i = first; i < first + INVOCATION_BYTES && i < textLen; i++) {
+    uint id = NO_GLYPH;
+    uint flags = 0u;
+    if (IsCharacterStart(i)) {
+      uint codepoint;
+      DecodeUTF8(i, codepoint);
+      id = GetGlyphIndex(codepoint);
+      flags = FLAG_START;
+      if (id == NO_GLYPH && codepoint == 10u) {
+        flags |= FLAG_NEWLINE;
+        counts += PACK_COUNTS(1u, 0u);
+      } else if (id != NO_GLYPH && font[visibleOffset + id] != 0u) {
+        flags |= FLAG_VISIBLE;
+        counts += PACK_COUNTS(0u, 1u);
+      }
+    }
+
+    // Kerning pairs with the last glyph since the last newline, events
+    // being both, numbered from 1
+    if (id != NO_GLYPH || (flags & FLAG_NEWLINE) != 0u) {
+      lastEvent = i + 1u;
+    }
+
+    elements[i] = Element(id, flags, 0.0, 0.0);
+  }
+
+  uint eventTotal;
+  uint countTotal;
+  ScanMax(lastEvent, eventTotal);
+  ScanSum(counts, countTotal);
+  if (gl_LocalInvocationID.x == 0u) {
+    groups[group].lastEvent = eventTotal;
+    groups[group].lines = countTotal >> 16;
+    groups[group].visible = countTotal & 0xFFFFu;
+  }
+}
+
+// A single workgroup goes through the groups in order, carrying the
+// prefix from one chunk to the next
+void ScanCounts() {
+  uint lane = gl_LocalInvocationID.x;
+  uint lastEvent = 0u;
+  uint lines = 0u;
+  uint visible = 0u;
+  for (uint first = 0u; first < groupCount; first += GROUP_SIZE) {
+    uint group = first + lane;
+    Group counts = Group(0u, 0u, 0u, 0u, 0.0);
+    if (group < groupCount) {
+      counts = groups[group];
+    }
+
+    uint eventTotal;
+    uint lineTotal;
+    uint visibleTotal;
+    uint eventPrefix = ScanMax(counts.lastEvent, eventTotal);
+    uint linePrefix = ScanSum(counts.lines, lineTotal);
+    uint visiblePrefix = ScanSum(counts.visible, visibleTotal);
+    if (group < groupCount) {
+      groups[group].lastEvent = max(lastEvent, eventPrefix);
+      groups[group].lines = lines + linePrefix;
+      groups[group].visible = visible + visiblePrefix;
+    }
+
+    lastEvent = max(lastEvent, eventTotal);
+    lines += lineTotal;
+    visible += visibleTotal;
+  }
+
+  if (lane == 0u) {
+    command.count = 6u;
+    command.instanceCount = visible;
+    command.firstIndex = 0u;
+    command.baseVertex = 0;
+    command.baseInstance = 0u;
+  }
+}
+
+// The kerning and advance are computed as LayoutText does, precise keeps
+// the compiler from fusing them into different roundings
+void Advance(uint first, uint group) {
+  uint end = min(first + INVOCATION_BYTES, textLen);
+  uint lastEvent = 0u;
+  for (uint i = first; i < end; i++) {
+    if (elements[i].glyph != NO_GLYPH ||
+        (elements[i].flags & FLAG_NEWLINE) != 0u) {
+      lastEvent = i + 1u;
+    }
+  }
+
+  uint eventTotal;
+  lastEvent = max(groups[group].lastEvent, ScanMax(lastEvent, eventTotal));
+
+  // Lines restart after a newline, which adds nothing itself
+  uint lineBreak = 0u;
+  precise float advanceSum = 0.0;
+  for (uint i = first; i < end; i++) {
+    Element element = elements[i];
+    if ((element.flags & FLAG_NEWLINE) != 0u) {
+      lineBreak = 1u;
+      advanceSum = 0.0;
+      lastEvent = i + 1u;
+    } else if (element.glyph != NO_GLYPH) {
+      uint prevId = lastEvent > 0u ? elements[lastEvent - 1u].glyph : NO_GLYPH;
+      precise float kerning = GetKerning(prevId, element.glyph) * scale;
+      float xa = uintBitsToFloat(font[advancesOffset + element.glyph]);
+      precise float advance = kerning + xa * scale;
+      elements[i].kerning = kerning;
+      elements[i].advance = advance;
+      advanceSum += advance;
+      lastEvent = i + 1u;
+    }
+  }
+
+  uint prefixBreak;
+  uint totalBreak;
+  float total;
+  ScanLines(lineBreak, advanceSum, prefixBreak, totalBreak, total);
+  if (gl_LocalInvocationID.x == 0u) {
+    groups[group].lineBreak = totalBreak;
+    groups[group].advance = total;
+  }
+}
+
+void ScanAdvances() {
+  uint lane = gl_LocalInvocationID.x;
+  uint lineBreak = 0u;
+  float advance = 0.0;
+  for (uint first = 0u; first < groupCount; first += GROUP_SIZE) {
+    uint group = first + lane;
+    Group counts = Group(0u, 0u, 0u, 0u, 0.0);
+    if (group < groupCount) {
+      counts = groups[group];
+    }
+
+    uint prefixBreak;
+    uint totalBreak;
+    float total;
+    float prefix = ScanLines(counts.lineBreak, counts.advance, prefixBreak,
+                             totalBreak, total);
+    if (group < groupCount) {
+      groups[group].lineBreak = lineBreak | prefixBreak;
+      groups[group].advance = prefixBreak != 0u ? prefix : advance + prefix;
+    }
+
+    advance = totalBreak != 0u ? total : advance + total;
+    lineBreak |= totalBreak;
+  }
+}
+
+void Place(uint first, uint group) {
+  uint end = min(first + INVOCATION_BYTES, textLen);
+  uint lineBreak = 0u;
+  uint counts = 0u;
+  precise float advanceSum = 0.0;
+  for (uint i = first; i < end; i++) {
+    uint flags = elements[i].flags;
+    if ((flags & FLAG_NEWLINE) != 0u) {
+      lineBreak = 1u;
+      advanceSum = 0.0;
+      counts += PACK_COUNTS(1u, 0u);
+    } else {
+      advanceSum += elements[i].advance;
+      counts += (flags & FLAG_VISIBLE) != 0u ? PACK_COUNTS(0u, 1u) : 0u;
+    }
+  }
+
+  uint prefixBreak;
+  uint totalBreak;
+  uint countTotal;
+  float total;
+  float lineAdvance =
+      ScanLines(lineBreak, advanceSum, prefixBreak, totalBreak, total);
+  uint prefixCounts = ScanSum(counts, countTotal);
+  uint line = groups[group].lines + (prefixCounts >> 16);
+  uint index = groups[group].visible + (prefixCounts & 0xFFFFu);
+  precise float xOffset =
+      prefixBreak != 0u ? lineAdvance : groups[group].advance + lineAdvance;
+  for (uint i = first; i < end; i++) {
+    Element element = elements[i];
+    if ((element.flags & FLAG_NEWLINE) != 0u) {
+      line++;
+      xOffset = 0.0;
+    } else if ((element.flags & FLAG_VISIBLE) != 0u) {
+      precise float x = xOffset + element.kerning;
+      precise float y = top + float(line) * lineHeight;
+      instances[index++] = Instance(x, y, element.glyph, color);
+    }
+
+    xOffset += element.advance;
+  }
+}
+
+void main() {
+  // Groups past the dispatch width continue on the next row
+  uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+  uint first =
+      (group * GROUP_SIZE + gl_LocalInvocationID.x) * INVOCATION_BYTES;
+  if (pass == PASS_DECODE) {
+    Decode(first, group);
+  } else if (pass == PASS_SCAN_COUNTS) {
+    ScanCounts();
+  } else if (pass == PASS_ADVANCE) {
+    Advance(first, group);
+  } else if (pass == PASS_SCAN_ADVANCES) {
+    ScanAdvances();
+  } else {
+    Place(first, group);
+  }
+}
@@ -0,0 +1,56 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec4 vCol;
+in vec3 vTex;
+
+uniform sampler2DArray tex0;
+uniform float distanceRange;
+
+// Effect sizes are in screen pixels, a transparent color disables an effect
+uniform float outlineWidth;
+uniform vec4 outlineColor;
+uniform vec2 shadowOffset;
+uniform float shadowSoftness;
+uniform vec4 shadowColor;
+
+// Signed distance to the glyph edge in screen pixels, positive inside
+float ScreenDistance(vec3 tex, float pixelRange) {
+  return (texture(tex0, tex).a - 0.5) * pixelRange;
+}
+
+vec4 Over(vec4 top, vec4 bottom) {
+  float alpha = top.a + bottom.a * (1.0 - top.a);
+  vec3 color = top.rgb * top.a + bottom.rgb * bottom.a * (1.0 - top.a);
+  return vec4(alpha > 0.0 ? color / alpha : color, alpha);
+}
+
+void main() {
+  // Screen pixels covered by the whole distance range at this scale
+  vec2 texelsPerPixel = fwidth(vTex.xy) * vec2(textureSize(tex0, 0).xy);
+  float pixelRange =
+      max(distanceRange / max(0.5 * (texelsPerPixel.x + texelsPerPixel.y),
+                              1e-4),
+          1.0);
+
+  float distance = ScreenDistance(vTex, pixelRange);
+  vec4 color = vec4(vCol.rgb, vCol.a * clamp(distance + 0.5, 0.0, 1.0));
+  if (outlineWidth > 0.0 && outlineColor.a > 0.0) {
+    float outline = clamp(distance + outlineWidth + 0.5, 0.0, 1.0);
+    color = Over(color, vec4(outlineColor.rgb, outlineColor.a * outline));
+  }
+
+  // The shadow of this pixel comes from the glyph shadowOffset pixels back,
+  // screen y grows downwards while window y grows upwards
+  if (shadowColor.a > 0.0) {
+    vec2 shadowTex = vTex.xy - shadowOffset.x * dFdx(vTex.xy) +
+                     shadowOffset.y * dFdy(vTex.xy);
+    float shadowDistance =
+        ScreenDistance(vec3(shadowTex, vTex.z), pixelRange) + outlineWidth;
+    float shadow = smoothstep(-shadowSoftness - 0.5, shadowSoftness + 0.5,
+                              shadowDistance);
+    color = Over(color, vec4(shadowColor.rgb, shadowColor.a * shadow));
+  }
+
+  FragColor = color;
+}
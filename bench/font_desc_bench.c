@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "font_desc.h"
+
+#define BENCH_RUNS 20
+
+char *MakeSyntheticFontDesc(unsigned glyphCount, size_t *dataLen);
+
+// Writes a BMFont text descriptor shaped like a large CJK font: one char
+// record per glyph starting at U+4E00, and a kerning pair every ten glyphs
+char *MakeSyntheticFontDesc(unsigned glyphCount, size_t *dataLen) {
+  size_t capacity = 256 + (size_t)glyphCount * 160;
+  char *data = malloc(capacity);
+  if (data == NULL) {
+    return NULL;
+  }
+
+  size_t len = 0;
+  len += (size_t)snprintf(
+      data + len, capacity - len,
+      "info face=\"Synthetic\" size=32 bold=0 italic=0 charset=\"\" unicode=1 "
+      "stretchH=100 smooth=1 aa=1 padding=1,1,1,1 spacing=1,1\n"
+      "common lineHeight=40 base=32 scaleW=4096 scaleH=4096 pages=1 "
+      "packed=0\n"
+      "page id=0 file=\"synthetic.png\"\n"
+      "chars count=%u\n",
+      glyphCount);
+
+  for (unsigned i = 0; i < glyphCount; i++) {
+    len += (size_t)snprintf(
+        data + len, capacity - len,
+        "char id=%-5u x=%-5u y=%-5u width=%-4u height=%-4u xoffset=%-4d "
+        "yoffset=%-4d xadvance=%-4u page=0  chnl=15\n",
+        0x4E00 + i, (i % 128) * 32, (i / 128) * 32 % 4096, 30u, 31u,
+        (int)(i % 3) - 1, (int)(i % 5), 32u);
+  }
+
+  unsigned kerningCount = glyphCount / 10;
+  len += (size_t)snprintf(data + len, capacity - len, "kernings count=%u\n",
+                          kerningCount);
+  for (unsigned i = 0; i < kerningCount; i++) {
+    len += (size_t)snprintf(data + len, capacity - len,
+                            "kerning first=%u second=%u amount=-%u\n",
+                            0x4E00 + i * 10, 0x4E00 + i * 10 + 1, i % 4);
+  }
+
+  *dataLen = len;
+  return data;
+}
+
+int main() {
+  const unsigned glyphCounts[] = {1000, 5000, 10000, 50000};
+  int status = EXIT_SUCCESS;
+
+  printf("%8s %10s %12s %12s %10s\n", "glyphs", "bytes", "best us",
+         "ns/glyph", "MB/s");
+  for (size_t i = 0; i < sizeof(glyphCounts) / sizeof(glyphCounts[0]); i++) {
+    size_t dataLen = 0;
+    char *data = MakeSyntheticFontDesc(glyphCounts[i], &dataLen);
+    if (data == NULL) {
+      Log(LOG_ERROR, "BENCH: could not allocate descriptor");
+      return EXIT_FAILURE;
+    }
+
+    double best = 0.0;
+    for (unsigned run = 0; run < BENCH_RUNS; run++) {
+      double start = GetMonotonicTime();
+      FontDesc desc = ParseFontDesc("synthetic", data, dataLen);
+      double elapsed = GetMonotonicTime() - start;
+
+      if (desc.status != SUCCESS || desc.charCount != glyphCounts[i] ||
+          desc.kerningCount != glyphCounts[i] / 10) {
+        Log(LOG_ERROR, "BENCH: parsed %u chars and %u kernings out of %u",
+            desc.charCount, desc.kerningCount, glyphCounts[i]);
+        status = EXIT_FAILURE;
+      }
+
+      FreeFontDesc(&desc);
+      if (run == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+
+    printf("%8u %10zu %12.1f %12.1f %10.1f\n", glyphCounts[i], dataLen,
+           best * 1e6, best * 1e9 / glyphCounts[i], dataLen / best / 1e6);
+    free(data);
+  }
+
+  return status;
+}
@@ -0,0 +1,224 @@
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+// clang-format on
+
+#include "common.h"
+#include "font.h"
+#include "font_loader.h"
+#include "font_pack.h"
+#include "gfx.h"
+
+#define ASSETS_FONT_TXT "assets/cooper-hewitt-heavy.txt"
+#define BENCH_FONT_PACK "font_load_bench.sfp"
+#define BENCH_SHADER_CACHE "font_load_bench_programs"
+#define BENCH_RUNS 20
+#define BENCH_ASYNC_FONTS 30
+
+typedef BitmapFont (*FontLoadFn)(void);
+
+bool MakeBenchFontPack(const char *packFilename);
+BitmapFont LoadTextFont(void);
+BitmapFont LoadPackFont(void);
+BitmapFont LoadShaderOnly(void);
+bool TimeFontLoader(const char *name, FontLoadFn loader);
+bool TimeCachedShader(void);
+void RemoveShaderCache(const char *dir);
+bool TimeAsyncFontLoads(unsigned threadCount);
+
+// Compares startup font loading from the .txt descriptor and .png atlas with
+// mapping a precompiled font pack, and compiling the glyph shader with
+// loading it from the program cache, then loads many fonts at once through the
+// font loader with more and more threads. Run from the repository root.
+int main() {
+  GLFWwindow *window = NULL;
+  int status = EXIT_FAILURE;
+
+  if (!glfwInit()) {
+    Log(LOG_ERROR, "could not initialize GLFW");
+    return EXIT_FAILURE;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  window = glfwCreateWindow(64, 64, "font_load_bench", NULL, NULL);
+  if (window == NULL) {
+    Log(LOG_ERROR, "could not create window");
+    goto terminate;
+  }
+
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    Log(LOG_ERROR, "could not initialize GL");
+    goto terminate;
+  }
+
+  if (!MakeBenchFontPack(BENCH_FONT_PACK)) {
+    goto terminate;
+  }
+
+  printf("%-12s %10s %10s\n", "path", "best ms", "mean ms");
+  if (TimeFontLoader("shader only", LoadShaderOnly) && TimeCachedShader() &&
+      TimeFontLoader("txt + png", LoadTextFont) &&
+      TimeFontLoader("pack", LoadPackFont)) {
+    status = EXIT_SUCCESS;
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  printf("\n%u fonts (txt + png)\n%-12s %10s %10s\n", BENCH_ASYNC_FONTS,
+         "threads", "first ms", "all ms");
+  for (unsigned threadCount = 1; status == EXIT_SUCCESS &&
+                                 threadCount <= FONT_LOADER_MAX_THREADS &&
+                                 threadCount <= (unsigned)cores;
+       threadCount *= 2) {
+    if (!TimeAsyncFontLoads(threadCount)) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+  remove(BENCH_FONT_PACK);
+
+terminate:
+  if (window != NULL) {
+    glfwDestroyWindow(window);
+  }
+
+  glfwTerminate();
+  return status;
+}
+
+bool MakeBenchFontPack(const char *packFilename) {
+  BitmapFontData data = ReadBitmapFontData(ASSETS_FONT_TXT);
+  ReduceAtlasChannels(&data);
+  bool made = data.status == SUCCESS && WriteFontPack(packFilename, &data);
+  FreeBitmapFontData(&data);
+  return made;
+}
+
+BitmapFont LoadTextFont(void) {
+  return LoadBitmapFont(ASSETS_FONT_TXT);
+}
+
+BitmapFont LoadPackFont(void) { return LoadBitmapFontPack(BENCH_FONT_PACK); }
+
+BitmapFont LoadShaderOnly(void) {
+  // Common to both paths, shown apart since it does not depend on the files
+  BitmapFont font = {0};
+  if (!LoadGlyphShader(&font)) {
+    font.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
+  }
+
+  return font;
+}
+
+bool TimeFontLoader(const char *name, FontLoadFn loader) {
+  double best = 0.0;
+  double total = 0.0;
+  for (unsigned run = 0; run < BENCH_RUNS; run++) {
+    // Uploads are asynchronous, the load is done once GL is done with it
+    double start = GetMonotonicTime();
+    BitmapFont font = loader();
+    glFinish();
+    double elapsed = GetMonotonicTime() - start;
+
+    UnloadBitmapFont(font);
+    if (font.status != SUCCESS) {
+      Log(LOG_ERROR, "BENCH: %s: could not load font", name);
+      return false;
+    }
+
+    total += elapsed;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  printf("%-12s %10.3f %10.3f\n", name, best * 1e3, total * 1e3 / BENCH_RUNS);
+  return true;
+}
+
+// Program binaries of the first run are loaded by the next ones
+bool TimeCachedShader(void) {
+  if (!SetShaderCacheDir(BENCH_SHADER_CACHE)) {
+    return false;
+  }
+
+  ShaderStats before = GetShaderStats();
+  bool timed = TimeFontLoader("shader cache", LoadShaderOnly);
+  ShaderStats after = GetShaderStats();
+  SetShaderCacheDir(NULL);
+  RemoveShaderCache(BENCH_SHADER_CACHE);
+  if (timed && after.cached - before.cached < BENCH_RUNS - 1) {
+    Log(LOG_WARN, "BENCH: the driver does not load cached programs");
+  }
+
+  return timed;
+}
+
+void RemoveShaderCache(const char *dir) {
+  DIR *entries = opendir(dir);
+  if (entries == NULL) {
+    return;
+  }
+
+  struct dirent *entry = NULL;
+  while ((entry = readdir(entries)) != NULL) {
+    char path[1024];
+    if (entry->d_name[0] != '.') {
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      remove(path);
+    }
+  }
+
+  closedir(entries);
+  remove(dir);
+}
+
+bool TimeAsyncFontLoads(unsigned threadCount) {
+  bool loaded = true;
+  FontLoader loader = {0};
+  BitmapFont fonts[BENCH_ASYNC_FONTS] = {0};
+  if (StartFontLoader(&loader, threadCount) != SUCCESS) {
+    return false;
+  }
+
+  double start = GetMonotonicTime();
+  for (unsigned i = 0; i < BENCH_ASYNC_FONTS; i++) {
+    QueueFontLoad(&loader, &fonts[i], ASSETS_FONT_TXT);
+  }
+
+  // Stands for the render loop, uploading fonts as they complete
+  double first = 0.0;
+  while (GetPendingFontLoads(&loader) > 0) {
+    if (PollFontLoader(&loader, BENCH_ASYNC_FONTS) > 0 && first == 0.0) {
+      first = GetMonotonicTime() - start;
+    }
+
+    sched_yield();
+  }
+
+  glFinish();
+  double elapsed = GetMonotonicTime() - start;
+  StopFontLoader(&loader);
+
+  for (unsigned i = 0; i < BENCH_ASYNC_FONTS; i++) {
+    loaded = loaded && fonts[i].status == SUCCESS;
+    UnloadBitmapFont(fonts[i]);
+  }
+
+  if (!loaded) {
+    Log(LOG_ERROR, "BENCH: could not load every font");
+    return false;
+  }
+
+  printf("%-12u %10.3f %10.3f\n", threadCount, first * 1e3, elapsed * 1e3);
+  return true;
+}
@@ -0,0 +1,280 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+// clang-format on
+
+#include "common.h"
+#include "font.h"
+#include "gpu_layout.h"
+#include "text.h"
+
+#define ASSETS_FONT_TXT "assets/cooper-hewitt-heavy.txt"
+#define BENCH_TEXT_SIZE (4 << 20)
+#define BENCH_RUNS 5
+// Scaled advances are summed in another order on the GPU
+#define BENCH_MAX_ERROR 0.01f
+
+typedef struct {
+  const BitmapFont *font;
+  const char *text;
+  size_t textLen;
+  GlyphInstance *reference;
+  GlyphInstance *instances;
+} GpuLayoutBench;
+
+char *MakeLogText(size_t size, bool unicode);
+bool TimeGpuLayout(GpuLayoutBench *bench, const char *name,
+                   const TextLayout *layout);
+
+static unsigned randomState = 1;
+
+static unsigned NextRandom(void) {
+  randomState = randomState * 1103515245u + 12345u;
+  return (randomState >> 16) & 0x7FFF;
+}
+
+// Lays out a log of --size MB (4 by default), once ASCII and once with
+// accented words, malformed UTF-8, carriage returns and missing glyphs, on
+// the CPU with LayoutText and on the GPU with the layout compute shader,
+// unscaled, scaled and from the baseline. Checks that the GPU places the
+// same glyphs at the same positions and reports both times, the GPU one
+// being the time until the layout is done. Needs GL 4.3 compute shaders.
+// Run from the repository root.
+int main(int argc, char **argv) {
+  GLFWwindow *window = NULL;
+  int status = EXIT_FAILURE;
+  size_t textSize = BENCH_TEXT_SIZE;
+  BitmapFont font = {0};
+  GpuLayoutBench bench = {0};
+  char *texts[2] = {NULL};
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      textSize = strtoul(argv[++i], NULL, 10) << 20;
+    } else {
+      fprintf(stderr, "usage: %s [--size MB]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!glfwInit()) {
+    Log(LOG_ERROR, "could not initialize GLFW");
+    return EXIT_FAILURE;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  window = glfwCreateWindow(64, 64, "gpu_layout_bench", NULL, NULL);
+  if (window == NULL) {
+    Log(LOG_ERROR, "could not create window");
+    goto terminate;
+  }
+
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    Log(LOG_ERROR, "could not initialize GL");
+    goto terminate;
+  }
+
+  if (!CanLayoutTextOnGpu()) {
+    Log(LOG_ERROR, "BENCH: compute shaders are not supported");
+    goto terminate;
+  }
+
+  font = LoadBitmapFont(ASSETS_FONT_TXT);
+  if (font.status != SUCCESS) {
+    goto terminate;
+  }
+
+  texts[0] = MakeLogText(textSize, false);
+  texts[1] = MakeLogText(textSize, true);
+  bench.reference = malloc(textSize * sizeof(GlyphInstance));
+  bench.instances = malloc(textSize * sizeof(GlyphInstance));
+  if (texts[0] == NULL || texts[1] == NULL || bench.reference == NULL ||
+      bench.instances == NULL) {
+    Log(LOG_ERROR, "BENCH: could not allocate %zu MB of text", textSize >> 20);
+    goto terminate;
+  }
+
+  TextLayout layouts[] = {
+      {.color = COLOR_WHITE},
+      {.color = COLOR_WHITE, .size = 24.0f},
+      {.color = COLOR_WHITE, .baseline = true},
+  };
+  const char *textNames[] = {"ascii", "utf8"};
+  const char *layoutNames[] = {"plain", "sized", "baseline"};
+  bench.font = &font;
+  bench.textLen = textSize;
+  printf("%zu MB of text on %s\n", textSize >> 20,
+         (const char *)glGetString(GL_RENDERER));
+  printf("%-16s %10s %10s %10s %12s\n", "text", "glyphs", "cpu ms", "gpu ms",
+         "max error");
+
+  status = EXIT_SUCCESS;
+  for (size_t t = 0; t < sizeof(textNames) / sizeof(textNames[0]); t++) {
+    for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+      char name[32];
+      snprintf(name, sizeof(name), "%s %s", textNames[t], layoutNames[l]);
+      bench.text = texts[t];
+      if (!TimeGpuLayout(&bench, name, &layouts[l])) {
+        status = EXIT_FAILURE;
+      }
+    }
+  }
+
+terminate:
+  UnloadBitmapFont(font);
+  for (unsigned i = 0; i < 2; i++) {
+    if (texts[i] != NULL) {
+      free(texts[i]);
+    }
+  }
+
+  if (bench.reference != NULL) {
+    free(bench.reference);
+  }
+
+  if (bench.instances != NULL) {
+    free(bench.instances);
+  }
+
+  if (window != NULL) {
+    glfwDestroyWindow(window);
+  }
+
+  glfwTerminate();
+  return status;
+}
+
+// Lines of 20 to 200 characters of words and numbers, like a server log.
+// Unicode logs also have words the font has no glyphs for, bytes that are
+// not UTF-8 and Windows line endings.
+char *MakeLogText(size_t size, bool unicode) {
+  static const char *words[] = {
+      "INFO", "request", "served", "in", "ms", "cache", "miss", "for",
+      "user", "session", "WARN", "retrying", "connection", "to", "upstream",
+  };
+  static const char *unicodeWords[] = {
+      "café",     "naïve",        "Ærø",      "señor",        "€5",
+      "日本",     "AVATAR",       "Type",     "\t",           "\xE2\x28",
+      "\xC0\xAF", "\xF0\x9F\x98", "\xED\xA0\x80",
+  };
+  char *text = malloc(size);
+  if (text == NULL) {
+    return NULL;
+  }
+
+  size_t len = 0;
+  size_t lineEnd = 0;
+  while (len < size) {
+    if (len >= lineEnd) {
+      if (len > 1 && unicode) {
+        text[len - 2] = '\r';
+      }
+
+      if (len > 0) {
+        text[len - 1] = '\n';
+      }
+
+      lineEnd = len + 20 + NextRandom() % 180;
+    }
+
+    char word[32];
+    int wordLen = 0;
+    unsigned pick = NextRandom();
+    if (unicode && pick % 4 == 0) {
+      size_t count = sizeof(unicodeWords) / sizeof(unicodeWords[0]);
+      wordLen = snprintf(word, sizeof(word), "%s ",
+                         unicodeWords[NextRandom() % count]);
+    } else if (pick % 3 == 0) {
+      wordLen = snprintf(word, sizeof(word), "%u ", NextRandom());
+    } else {
+      size_t count = sizeof(words) / sizeof(words[0]);
+      wordLen =
+          snprintf(word, sizeof(word), "%s ", words[NextRandom() % count]);
+    }
+
+    for (int i = 0; i < wordLen && len < size; i++) {
+      text[len++] = word[i];
+    }
+  }
+
+  return text;
+}
+
+bool TimeGpuLayout(GpuLayoutBench *bench, const char *name,
+                   const TextLayout *layout) {
+  unsigned glyphCount = 0;
+  double cpuBest = 0.0;
+  for (unsigned run = 0; run < BENCH_RUNS; run++) {
+    double start = GetMonotonicTime();
+    glyphCount = LayoutText(bench->font, layout, 0.0f, 0.0f, bench->text,
+                            bench->textLen, bench->reference);
+    double elapsed = GetMonotonicTime() - start;
+    if (run == 0 || elapsed < cpuBest) {
+      cpuBest = elapsed;
+    }
+  }
+
+  GpuText object = CreateGpuText(bench->font, layout, 0.0f, 0.0f);
+  if (object.status != SUCCESS ||
+      !SetGpuText(&object, bench->text, bench->textLen)) {
+    DestroyGpuText(&object);
+    return false;
+  }
+
+  double gpuBest = 0.0;
+  for (unsigned run = 0; run < BENCH_RUNS; run++) {
+    double start = GetMonotonicTime();
+    LayoutGpuText(&object);
+    glFinish();
+    double elapsed = GetMonotonicTime() - start;
+    if (run == 0 || elapsed < gpuBest) {
+      gpuBest = elapsed;
+    }
+  }
+
+  unsigned gpuCount = ReadGpuTextGlyphs(&object, bench->instances,
+                                        (unsigned)bench->textLen);
+  DestroyGpuText(&object);
+
+  // Glyphs and lines must match, pen positions up to rounding
+  float maxError = 0.0f;
+  for (unsigned i = 0; i < glyphCount && i < gpuCount; i++) {
+    const GlyphInstance *expected = &bench->reference[i];
+    const GlyphInstance *actual = &bench->instances[i];
+    if (actual->glyph != expected->glyph || actual->color != expected->color ||
+        actual->y != expected->y) {
+      Log(LOG_ERROR,
+          "BENCH: %s: glyph %u is %u at %g, %g instead of %u at %g, %g", name,
+          i, actual->glyph, actual->x, actual->y, expected->glyph,
+          expected->x, expected->y);
+      return false;
+    }
+
+    float error = fabsf(actual->x - expected->x);
+    maxError = error > maxError ? error : maxError;
+  }
+
+  if (gpuCount != glyphCount || maxError > BENCH_MAX_ERROR) {
+    Log(LOG_ERROR, "BENCH: %s: %u glyphs off by up to %g, %u expected", name,
+        gpuCount, maxError, glyphCount);
+    return false;
+  }
+
+  char error[16] = "exact";
+  if (maxError > 0.0f) {
+    snprintf(error, sizeof(error), "%.2e", maxError);
+  }
+
+  printf("%-16s %10u %10.3f %10.3f %12s\n", name, glyphCount, cpuBest * 1e3,
+         gpuBest * 1e3, error);
+  return true;
+}
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "font.h"
+#include "layout_pool.h"
+#include "text.h"
+
+#define ASSETS_FONT_TXT "assets/cooper-hewitt-heavy.txt"
+#define BENCH_TEXT_SIZE (50 << 20)
+#define BENCH_RUNS 5
+#define BENCH_WRAP_WIDTH 1920.0f
+
+typedef struct {
+  const BitmapFont *font;
+  // Same font without its ASCII run table, laid out a glyph at a time
+  const BitmapFont *scalarFont;
+  const TextLayout *layout;
+  const char *text;
+  size_t textLen;
+  GlyphInstance *reference;
+  unsigned referenceCount;
+  GlyphInstance *instances;
+  double serialTime;
+} LayoutBench;
+
+char *MakeLogText(size_t size);
+bool TimeLayout(LayoutBench *bench, const char *name, unsigned threadCount,
+                bool scalar);
+
+static unsigned randomState = 1;
+
+static unsigned NextRandom(void) {
+  randomState = randomState * 1103515245u + 12345u;
+  return (randomState >> 16) & 0x7FFF;
+}
+
+// Lays out a log of --size MB (50 by default) on the render thread, a glyph
+// at a time without the ASCII run kernel and on layout pools of 1, 2, 4...
+// threads up to the core count, checks that every way places the glyphs
+// exactly as LayoutText and reports the speedup. Run from the repository
+// root.
+int main(int argc, char **argv) {
+  int status = EXIT_FAILURE;
+  size_t textSize = BENCH_TEXT_SIZE;
+  char *text = NULL;
+  LayoutBench bench = {0};
+  BitmapFontData font = {0};
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      textSize = strtoul(argv[++i], NULL, 10) << 20;
+    } else {
+      fprintf(stderr, "usage: %s [--size MB]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  font = ReadBitmapFontData(ASSETS_FONT_TXT);
+  if (font.status != SUCCESS) {
+    goto terminate;
+  }
+
+  text = MakeLogText(textSize);
+  bench.reference = malloc(textSize * sizeof(GlyphInstance));
+  bench.instances = malloc(textSize * sizeof(GlyphInstance));
+  if (text == NULL || bench.reference == NULL || bench.instances == NULL) {
+    Log(LOG_ERROR, "BENCH: could not allocate %zu MB of text", textSize >> 20);
+    goto terminate;
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  TextLayout layouts[] = {
+      {.color = COLOR_WHITE},
+      {.color = COLOR_WHITE,
+       .maxWidth = BENCH_WRAP_WIDTH,
+       .align = TEXT_ALIGN_CENTER},
+  };
+  const char *names[] = {"lines", "wrapped"};
+  BitmapFont scalarFont = font.font;
+  scalarFont.asciiRuns = NULL;
+  bench.font = &font.font;
+  bench.scalarFont = &scalarFont;
+  bench.text = text;
+  bench.textLen = textSize;
+  printf("%zu MB of text, %ld cores\n", textSize >> 20, cores);
+  printf("%-8s %8s %10s %10s %8s\n", "layout", "threads", "best ms", "MB/s",
+         "speedup");
+
+  status = EXIT_SUCCESS;
+  for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+    bench.layout = &layouts[i];
+    if (!TimeLayout(&bench, names[i], 0, false)) {
+      status = EXIT_FAILURE;
+      continue;
+    }
+
+    if (!TimeLayout(&bench, names[i], 0, true)) {
+      status = EXIT_FAILURE;
+    }
+
+    // Always try two threads, even on a single core, to check the output
+    for (unsigned threads = 1; threads <= (unsigned)cores || threads <= 2;
+         threads *= 2) {
+      if (!TimeLayout(&bench, names[i], threads, false)) {
+        status = EXIT_FAILURE;
+      }
+    }
+  }
+
+terminate:
+  FreeBitmapFontData(&font);
+  if (text != NULL) {
+    free(text);
+  }
+
+  if (bench.reference != NULL) {
+    free(bench.reference);
+  }
+
+  if (bench.instances != NULL) {
+    free(bench.instances);
+  }
+
+  return status;
+}
+
+// Lines of 20 to 200 characters of words and numbers, like a server log
+char *MakeLogText(size_t size) {
+  static const char *words[] = {
+      "INFO", "request", "served", "in", "ms", "cache", "miss", "for",
+      "user", "session", "WARN", "retrying", "connection", "to", "upstream",
+  };
+  char *text = malloc(size);
+  if (text == NULL) {
+    return NULL;
+  }
+
+  size_t len = 0;
+  size_t lineEnd = 0;
+  while (len < size) {
+    if (len >= lineEnd) {
+      if (len > 0) {
+        text[len - 1] = '\n';
+      }
+
+      lineEnd = len + 20 + NextRandom() % 180;
+    }
+
+    char word[32];
+    int wordLen =
+        NextRandom() % 3 == 0
+            ? snprintf(word, sizeof(word), "%u ", NextRandom())
+            : snprintf(word, sizeof(word), "%s ",
+                       words[NextRandom() % (sizeof(words) / sizeof(words[0]))]);
+    for (int i = 0; i < wordLen && len < size; i++) {
+      text[len++] = word[i];
+    }
+  }
+
+  return text;
+}
+
+// No threads times LayoutText and keeps its output as the reference, scalar
+// times it on the font without ASCII runs
+bool TimeLayout(LayoutBench *bench, const char *name, unsigned threadCount,
+                bool scalar) {
+  LayoutPool pool = {0};
+  if (threadCount > 0 && StartLayoutPool(&pool, threadCount) != SUCCESS) {
+    return false;
+  }
+
+  bool reference = threadCount == 0 && !scalar;
+  const BitmapFont *font = scalar ? bench->scalarFont : bench->font;
+  GlyphInstance *instances = reference ? bench->reference : bench->instances;
+  unsigned glyphCount = 0;
+  double best = 0.0;
+  for (unsigned run = 0; run < BENCH_RUNS; run++) {
+    double start = GetMonotonicTime();
+    glyphCount =
+        threadCount > 0
+            ? LayoutTextParallel(&pool, font, bench->layout, 0.0f, 0.0f,
+                                 bench->text, bench->textLen, instances)
+            : LayoutText(font, bench->layout, 0.0f, 0.0f, bench->text,
+                         bench->textLen, instances);
+    double elapsed = GetMonotonicTime() - start;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  if (threadCount > 0) {
+    StopLayoutPool(&pool);
+  }
+
+  bool matches = true;
+  if (reference) {
+    bench->referenceCount = glyphCount;
+    bench->serialTime = best;
+  } else {
+    matches = glyphCount == bench->referenceCount &&
+              memcmp(instances, bench->reference,
+                     glyphCount * sizeof(GlyphInstance)) == 0;
+    if (!matches) {
+      Log(LOG_ERROR, "BENCH: %s lays out %s differently",
+          scalar ? "scalar layout" : "layout pool", name);
+    }
+  }
+
+  char threads[16];
+  snprintf(threads, sizeof(threads), scalar ? "scalar" : "%u", threadCount);
+  printf("%-8s %8s %10.3f %10.1f %8.2f\n", name, threads, best * 1e3,
+         bench->textLen / best / (1 << 20), bench->serialTime / best);
+  return matches;
+}
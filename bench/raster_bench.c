@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "font.h"
+#include "raster.h"
+#include "text.h"
+
+#define ASSETS_FONT_TXT "assets/cooper-hewitt-heavy.txt"
+#define BENCH_IMAGE_WIDTH 1920
+#define BENCH_IMAGE_HEIGHT 1080
+#define BENCH_TEXT_SIZE 8192
+#define BENCH_RUNS 20
+#define BENCH_TEXT                                                             \
+  "Medea china inutil. The quick brown fox jumps over the lazy dog, "         \
+  "0123456789! "
+
+typedef struct {
+  const BitmapFontData *font;
+  const GlyphInstance *instances;
+  unsigned glyphCount;
+  double pixelCount;
+  unsigned char *reference;
+} RasterBench;
+
+unsigned FitGlyphs(const BitmapFontData *font, GlyphInstance *instances,
+                   unsigned glyphCount, double *pixelCount);
+bool TimeRasterKernel(RasterBench *bench, RasterFormat format,
+                      RasterKernel kernel, unsigned threadCount);
+
+// Composites a screen full of text into a CPU image with every blending
+// kernel, checks them against the scalar one and reports glyphs and
+// composited megapixels per second. Run from the repository root.
+int main() {
+  int status = EXIT_FAILURE;
+  char *text = NULL;
+  GlyphInstance *instances = NULL;
+  BitmapFontData font = ReadBitmapFontData(ASSETS_FONT_TXT);
+  RasterBench bench = {.font = &font};
+  if (font.status != SUCCESS) {
+    goto terminate;
+  }
+
+  text = malloc(BENCH_TEXT_SIZE);
+  instances = malloc(BENCH_TEXT_SIZE * sizeof(GlyphInstance));
+  if (text == NULL || instances == NULL) {
+    Log(LOG_ERROR, "BENCH: could not allocate text");
+    goto terminate;
+  }
+
+  size_t len = 0;
+  while (len + sizeof(BENCH_TEXT) <= BENCH_TEXT_SIZE) {
+    memcpy(text + len, BENCH_TEXT, sizeof(BENCH_TEXT));
+    len += sizeof(BENCH_TEXT) - 1;
+  }
+
+  TextLayout layout = {
+      .maxWidth = BENCH_IMAGE_WIDTH,
+      .color = PACK_RGBA(20, 40, 200, 230),
+  };
+  unsigned glyphCount =
+      LayoutText(&font.font, &layout, 0.0f, 0.0f, text, len, instances);
+  bench.instances = instances;
+  bench.glyphCount =
+      FitGlyphs(&font, instances, glyphCount, &bench.pixelCount);
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  RasterKernel bestKernel = GetBestRasterKernel();
+  printf("%u glyphs, %.2f megapixels into %u x %u\n", bench.glyphCount,
+         bench.pixelCount / 1e6, BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT);
+  printf("%-6s %-7s %8s %10s %12s %10s\n", "format", "kernel", "threads",
+         "best ms", "Mglyphs/s", "MP/s");
+
+  status = EXIT_SUCCESS;
+  RasterFormat formats[] = {RASTER_RGBA, RASTER_ALPHA};
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    for (RasterKernel kernel = RASTER_KERNEL_SCALAR; kernel <= bestKernel;
+         kernel++) {
+      if (!TimeRasterKernel(&bench, formats[i], kernel, 1) ||
+          (cores > 1 &&
+           !TimeRasterKernel(&bench, formats[i], kernel, (unsigned)cores))) {
+        status = EXIT_FAILURE;
+      }
+    }
+
+    free(bench.reference);
+    bench.reference = NULL;
+  }
+
+terminate:
+  FreeBitmapFontData(&font);
+  if (text != NULL) {
+    free(text);
+  }
+
+  if (instances != NULL) {
+    free(instances);
+  }
+
+  return status;
+}
+
+// Drops the lines that do not fit the image and counts the pixels left
+unsigned FitGlyphs(const BitmapFontData *font, GlyphInstance *instances,
+                   unsigned glyphCount, double *pixelCount) {
+  unsigned fitCount = 0;
+  *pixelCount = 0.0;
+  for (unsigned i = 0; i < glyphCount; i++) {
+    if (instances[i].y + font->font.lineHeight > BENCH_IMAGE_HEIGHT) {
+      continue;
+    }
+
+    const GlyphTableEntry *glyph = &font->font.glyphs[instances[i].glyph];
+    *pixelCount += glyph->size[0] * glyph->size[1];
+    instances[fitCount++] = instances[i];
+  }
+
+  return fitCount;
+}
+
+bool TimeRasterKernel(RasterBench *bench, RasterFormat format,
+                      RasterKernel kernel, unsigned threadCount) {
+  RasterImage image =
+      CreateRasterImage(BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT, format);
+  if (image.status != SUCCESS) {
+    return false;
+  }
+
+  size_t imageSize = (size_t)image.width * image.height *
+                     (format == RASTER_RGBA ? 4 : 1);
+  double best = 0.0;
+  for (unsigned run = 0; run < BENCH_RUNS; run++) {
+    ClearRasterImage(&image, PACK_RGBA(200, 200, 200, 128));
+    double start = GetMonotonicTime();
+    RasterGlyphs(&image, bench->font, bench->instances, bench->glyphCount,
+                 0.0f, 0.0f, kernel, threadCount);
+    double elapsed = GetMonotonicTime() - start;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  // The first kernel timed for a format is the scalar one
+  bool matches = true;
+  if (bench->reference == NULL) {
+    bench->reference = malloc(imageSize);
+    if (bench->reference != NULL) {
+      memcpy(bench->reference, image.pixels, imageSize);
+    }
+  } else if (memcmp(bench->reference, image.pixels, imageSize) != 0) {
+    Log(LOG_ERROR, "BENCH: %s kernel differs from the scalar one",
+        GetRasterKernelName(kernel));
+    matches = false;
+  }
+
+  printf("%-6s %-7s %8u %10.3f %12.2f %10.1f\n",
+         format == RASTER_RGBA ? "rgba" : "alpha", GetRasterKernelName(kernel),
+         threadCount, best * 1e3, bench->glyphCount / best / 1e6,
+         bench->pixelCount / best / 1e6);
+  DestroyRasterImage(&image);
+  return matches;
+}
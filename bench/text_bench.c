@@ -0,0 +1,711 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+// clang-format on
+
+#include "common.h"
+#include "files.h"
+#include "font.h"
+#include "text.h"
+
+#define ASSETS_FONT_TXT "assets/cooper-hewitt-heavy.txt"
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 100
+#define BENCH_WARMUP_FRAMES 10
+#define BENCH_MAX_GLYPHS 16384
+#define BENCH_LOG_SIZE (1 << 20)
+#define UNICODE_FONT_SIZE 32
+
+typedef struct {
+  size_t offset;
+  float x;
+  float y;
+  TextLayout layout;
+} BenchItem;
+
+// Text drawn every frame, one BatchText call per item
+typedef struct {
+  const char *name;
+  bool unicode;
+  char *text;
+  size_t textLen;
+  size_t textCapacity;
+  BenchItem *items;
+  unsigned itemCount;
+  unsigned itemCapacity;
+} BenchCorpus;
+
+typedef struct {
+  unsigned frames;
+  double glyphs;
+  double drawCalls;
+  double glCalls;
+  double bytesUploaded;
+  double totalTime;
+  double p50;
+  double p99;
+} BenchResult;
+
+typedef struct {
+  unsigned frames;
+  unsigned warmupFrames;
+  bool layoutOnly;
+  bool json;
+  const char *corpus;
+  const char *corpusFile;
+} BenchOptions;
+
+bool AppendCorpusItem(BenchCorpus *corpus, const char *text, size_t len,
+                      float x, float y, TextLayout layout);
+void FreeCorpus(BenchCorpus *corpus);
+bool MakeLabelCorpus(BenchCorpus *corpus);
+bool MakeParagraphCorpus(BenchCorpus *corpus);
+bool MakeLogCorpus(BenchCorpus *corpus);
+bool MakeUnicodeCorpus(BenchCorpus *corpus);
+bool MakeFileCorpus(BenchCorpus *corpus, const char *filename);
+BitmapFont MakeUnicodeFont(bool upload);
+void HookGLCalls(void);
+BenchResult RenderCorpus(const BenchOptions *options, TextBatch *batch,
+                         const BitmapFont *font, const BenchCorpus *corpus);
+BenchResult LayoutCorpus(const BenchOptions *options, const BitmapFont *font,
+                         const BenchCorpus *corpus);
+void PrintResult(const BenchOptions *options, const char *corpus,
+                 const BenchResult *result);
+
+static unsigned glCallCount = 0;
+static unsigned randomState = 0x12345678u;
+
+static const char *words[] = {
+    "medea",  "china",   "inutil", "render", "glyph",   "atlas",
+    "kerning", "layout", "batch",  "stream", "frame",   "buffer",
+    "shader", "texture", "pixel",  "quick",  "brown",   "fox",
+    "jumps",  "over",    "the",    "lazy",   "dog",     "AVATAR",
+    "Wave",   "To",      "42",     "1999",   "(beta)",  "v2.0",
+};
+
+static const char *unicodeWords[] = {
+    "Ελληνικά", "κείμενο", "Кириллица", "текст", "façade", "naïve",
+    "Ünïcödé",  "日本語",  "中文字体",  "ひらがな", "カタカナ", "plain",
+};
+
+// Deterministic so every run draws the same corpora
+static unsigned NextRandom(void) {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static size_t AppendWords(char *text, size_t capacity, const char **list,
+                          unsigned listLen, unsigned wordCount) {
+  size_t len = 0;
+  for (unsigned i = 0; i < wordCount; i++) {
+    const char *word = list[NextRandom() % listLen];
+    size_t wordLen = strlen(word);
+    if (len + wordLen + 2 > capacity) {
+      break;
+    }
+
+    if (i > 0) {
+      text[len++] = ' ';
+    }
+
+    memcpy(text + len, word, wordLen);
+    len += wordLen;
+  }
+
+  text[len] = '\0';
+  return len;
+}
+
+// Lays out and draws text corpora headlessly, through a hidden window, or
+// only lays them out with --layout-only, and reports glyph throughput, GL
+// work and frame times. --json prints one JSON object per corpus and line.
+int main(int argc, char **argv) {
+  GLFWwindow *window = NULL;
+  int status = EXIT_FAILURE;
+  BitmapFont font = {0};
+  BitmapFont unicodeFont = {0};
+  BitmapFontData fontData = {0};
+  TextBatch batch = {0};
+  BenchOptions options = {
+      .frames = BENCH_FRAMES,
+      .warmupFrames = BENCH_WARMUP_FRAMES,
+      .corpus = "all",
+  };
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--layout-only") == 0) {
+      options.layoutOnly = true;
+    } else if (strcmp(argv[i], "--json") == 0) {
+      options.json = true;
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      options.frames = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      options.warmupFrames = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+      options.corpus = argv[++i];
+    } else if (strcmp(argv[i], "--corpus-file") == 0 && i + 1 < argc) {
+      options.corpusFile = argv[++i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--layout-only] [--json] [--frames N] [--warmup N]\n"
+              "          [--corpus all|labels|paragraphs|log|unicode]\n"
+              "          [--corpus-file text.txt]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (options.frames == 0) {
+    options.frames = 1;
+  }
+
+  if (!options.layoutOnly) {
+    if (!glfwInit()) {
+      Log(LOG_ERROR, "could not initialize GLFW");
+      return EXIT_FAILURE;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window =
+        glfwCreateWindow(BENCH_WIDTH, BENCH_HEIGHT, "text_bench", NULL, NULL);
+    if (window == NULL) {
+      Log(LOG_ERROR, "could not create window");
+      goto terminate;
+    }
+
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+      Log(LOG_ERROR, "could not initialize GL");
+      goto terminate;
+    }
+
+    HookGLCalls();
+    font = LoadBitmapFont(ASSETS_FONT_TXT);
+    unicodeFont = MakeUnicodeFont(true);
+    batch = CreateTextBatch(BENCH_MAX_GLYPHS);
+    if (font.status != SUCCESS || unicodeFont.status != SUCCESS ||
+        batch.status != SUCCESS) {
+      goto terminate;
+    }
+
+    glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+    glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  } else {
+    // Layout never touches GL, the tables alone will do
+    fontData = ReadBitmapFontData(ASSETS_FONT_TXT);
+    font = fontData.font;
+    unicodeFont = MakeUnicodeFont(false);
+    if (fontData.status != SUCCESS || unicodeFont.status != SUCCESS) {
+      goto terminate;
+    }
+  }
+
+  if (!options.json) {
+    printf("%-11s %-7s %10s %12s %8s %9s %12s %9s %9s\n", "corpus", "mode",
+           "glyphs", "glyphs/s", "draws", "gl calls", "bytes", "p50 ms",
+           "p99 ms");
+  }
+
+  typedef bool (*CorpusMaker)(BenchCorpus *corpus);
+  const struct {
+    const char *name;
+    CorpusMaker make;
+  } corpora[] = {
+      {"labels", MakeLabelCorpus},
+      {"paragraphs", MakeParagraphCorpus},
+      {"log", MakeLogCorpus},
+      {"unicode", MakeUnicodeCorpus},
+  };
+
+  status = EXIT_SUCCESS;
+  for (size_t i = 0; i <= sizeof(corpora) / sizeof(corpora[0]); i++) {
+    BenchCorpus corpus = {0};
+    bool made = false;
+    if (i == sizeof(corpora) / sizeof(corpora[0])) {
+      if (options.corpusFile == NULL) {
+        break;
+      }
+
+      corpus.name = "file";
+      made = MakeFileCorpus(&corpus, options.corpusFile);
+    } else if (options.corpusFile == NULL &&
+               (strcmp(options.corpus, "all") == 0 ||
+                strcmp(options.corpus, corpora[i].name) == 0)) {
+      corpus.name = corpora[i].name;
+      made = corpora[i].make(&corpus);
+    } else {
+      continue;
+    }
+
+    if (!made) {
+      status = EXIT_FAILURE;
+      FreeCorpus(&corpus);
+      continue;
+    }
+
+    const BitmapFont *corpusFont = corpus.unicode ? &unicodeFont : &font;
+    BenchResult result =
+        options.layoutOnly
+            ? LayoutCorpus(&options, corpusFont, &corpus)
+            : RenderCorpus(&options, &batch, corpusFont, &corpus);
+    PrintResult(&options, corpus.name, &result);
+    FreeCorpus(&corpus);
+  }
+
+terminate:
+  if (options.layoutOnly) {
+    FreeBitmapFontData(&fontData);
+    FreeBitmapFontTables(&unicodeFont);
+  } else {
+    DestroyTextBatch(&batch);
+    UnloadBitmapFont(font);
+    UnloadBitmapFont(unicodeFont);
+  }
+
+  if (window != NULL) {
+    glfwDestroyWindow(window);
+  }
+
+  if (!options.layoutOnly) {
+    glfwTerminate();
+  }
+
+  return status;
+}
+
+bool AppendCorpusItem(BenchCorpus *corpus, const char *text, size_t len,
+                      float x, float y, TextLayout layout) {
+  if (corpus->itemCount == corpus->itemCapacity) {
+    unsigned capacity =
+        corpus->itemCapacity == 0 ? 64 : corpus->itemCapacity * 2;
+    BenchItem *items = realloc(corpus->items, capacity * sizeof(BenchItem));
+    if (items == NULL) {
+      return false;
+    }
+
+    corpus->items = items;
+    corpus->itemCapacity = capacity;
+  }
+
+  if (corpus->textLen + len + 1 > corpus->textCapacity) {
+    size_t capacity =
+        corpus->textCapacity == 0 ? 4096 : corpus->textCapacity * 2;
+    while (capacity < corpus->textLen + len + 1) {
+      capacity *= 2;
+    }
+
+    char *data = realloc(corpus->text, capacity);
+    if (data == NULL) {
+      return false;
+    }
+
+    corpus->text = data;
+    corpus->textCapacity = capacity;
+  }
+
+  // Items keep offsets, the text may still move while the corpus grows
+  memcpy(corpus->text + corpus->textLen, text, len);
+  corpus->text[corpus->textLen + len] = '\0';
+  corpus->items[corpus->itemCount++] = (BenchItem){
+      .offset = corpus->textLen,
+      .x = x,
+      .y = y,
+      .layout = layout,
+  };
+  corpus->textLen += len + 1;
+  return true;
+}
+
+void FreeCorpus(BenchCorpus *corpus) {
+  if (corpus->text != NULL) {
+    free(corpus->text);
+  }
+
+  if (corpus->items != NULL) {
+    free(corpus->items);
+  }
+}
+
+// Short UI labels scattered over the screen
+bool MakeLabelCorpus(BenchCorpus *corpus) {
+  char label[128];
+  for (unsigned i = 0; i < 400; i++) {
+    size_t len = AppendWords(label, sizeof(label), words,
+                             sizeof(words) / sizeof(words[0]),
+                             1 + NextRandom() % 3);
+    TextLayout layout = {.color = COLOR_WHITE};
+    if (!AppendCorpusItem(corpus, label, len,
+                          (float)(NextRandom() % BENCH_WIDTH),
+                          (float)(NextRandom() % BENCH_HEIGHT), layout)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Wrapped and aligned blocks of prose
+bool MakeParagraphCorpus(BenchCorpus *corpus) {
+  char paragraph[1024];
+  for (unsigned i = 0; i < 12; i++) {
+    size_t len = AppendWords(paragraph, sizeof(paragraph), words,
+                             sizeof(words) / sizeof(words[0]), 80);
+    TextLayout layout = {
+        .maxWidth = 600.0f,
+        .align = (TextAlign)(i % 3),
+        .color = COLOR_WHITE,
+    };
+    if (!AppendCorpusItem(corpus, paragraph, len, (float)(i % 3) * 640.0f,
+                          (float)(i / 3) * 270.0f, layout)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// One megabyte of log lines drawn as a single text, mostly off screen
+bool MakeLogCorpus(BenchCorpus *corpus) {
+  static const char *levels[] = {"INFO ", "WARN ", "ERROR"};
+  char *text = malloc(BENCH_LOG_SIZE + 256);
+  if (text == NULL) {
+    return false;
+  }
+
+  size_t len = 0;
+  for (unsigned line = 0; len < BENCH_LOG_SIZE; line++) {
+    len += (size_t)snprintf(
+        text + len, 256,
+        "2026-10-16 12:%02u:%02u.%03u %s worker-%u: request %u done in %u ms\n",
+        line / 60 % 60, line % 60, NextRandom() % 1000,
+        levels[NextRandom() % 3], NextRandom() % 8, NextRandom() % 100000,
+        NextRandom() % 500);
+  }
+
+  TextLayout layout = {.color = COLOR_WHITE};
+  bool appended = AppendCorpusItem(corpus, text, len, 0.0f, 0.0f, layout);
+  free(text);
+  return appended;
+}
+
+// Lines mixing Latin, Greek, Cyrillic and CJK, drawn with a synthetic font
+// that covers them all
+bool MakeUnicodeCorpus(BenchCorpus *corpus) {
+  char line[1024];
+  corpus->unicode = true;
+  for (unsigned i = 0; i < 30; i++) {
+    size_t len = AppendWords(line, sizeof(line), unicodeWords,
+                             sizeof(unicodeWords) / sizeof(unicodeWords[0]),
+                             16);
+    TextLayout layout = {.maxWidth = 900.0f, .color = COLOR_WHITE};
+    if (!AppendCorpusItem(corpus, line, len, (float)(i % 2) * 960.0f,
+                          (float)(i / 2) * 70.0f, layout)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Any text file, wrapped to the screen width
+bool MakeFileCorpus(BenchCorpus *corpus, const char *filename) {
+  size_t size = 0;
+  char *text = ReadFileData(filename, &size);
+  if (text == NULL) {
+    return false;
+  }
+
+  TextLayout layout = {.maxWidth = BENCH_WIDTH, .color = COLOR_WHITE};
+  bool appended = AppendCorpusItem(corpus, text, size, 0.0f, 0.0f, layout);
+  free(text);
+  return appended;
+}
+
+// Box glyphs for every code point of the Unicode corpus, drawn from a single
+// white texel when uploaded
+BitmapFont MakeUnicodeFont(bool upload) {
+  static const unsigned ranges[][2] = {
+      {0x20, 0x7E},     {0xA0, 0xFF},     {0x370, 0x3FF},
+      {0x400, 0x4FF},   {0x3040, 0x30FF}, {0x4E00, 0x9FFF},
+  };
+  static const unsigned char white[4] = {255, 255, 255, 255};
+  BitmapFont font = {0};
+  FontDescPage page = {0};
+  FontDesc desc = {
+      .fontSize = UNICODE_FONT_SIZE,
+      .lineHeight = UNICODE_FONT_SIZE,
+      .base = UNICODE_FONT_SIZE * 3 / 4,
+      .scaleW = 1,
+      .scaleH = 1,
+      .pages = &page,
+      .pageCount = 1,
+  };
+
+  for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+    desc.charCount += ranges[i][1] - ranges[i][0] + 1;
+  }
+
+  desc.chars = calloc(desc.charCount, sizeof(FontDescChar));
+  if (desc.chars == NULL) {
+    font.status = ERROR_OUT_OF_MEMORY;
+    return font;
+  }
+
+  unsigned count = 0;
+  for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+    for (unsigned codepoint = ranges[i][0]; codepoint <= ranges[i][1];
+         codepoint++) {
+      bool blank = codepoint == ' ' || codepoint == 0xA0;
+      desc.chars[count++] = (FontDescChar){
+          .id = codepoint,
+          .width = blank ? 0 : UNICODE_FONT_SIZE / 2,
+          .height = blank ? 0 : UNICODE_FONT_SIZE * 2 / 3,
+          .yOffset = UNICODE_FONT_SIZE / 12,
+          .xAdvance = codepoint >= 0x3040 ? UNICODE_FONT_SIZE
+                                          : UNICODE_FONT_SIZE * 5 / 8,
+      };
+    }
+  }
+
+  font.status = BuildBitmapFont(&font, &desc, "unicode");
+  free(desc.chars);
+  if (font.status == SUCCESS && upload) {
+    if (!LoadGlyphShader(&font)) {
+      font.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
+      return font;
+    }
+
+    UploadGlyphTable(&font);
+    font.textureId = MakeTextureArray(white, 1, 1, 1);
+  }
+
+  return font;
+}
+
+// Counts the GL calls made per frame by wrapping the loader entry points used
+// while drawing text
+#define COUNTED_GL(type, name, params, args)                                  \
+  static type counted_##name;                                                 \
+  static void APIENTRY Count_##name params {                                  \
+    glCallCount++;                                                            \
+    counted_##name args;                                                      \
+  }
+#define COUNTED_GL_RETURN(type, ret, name, params, args)                      \
+  static type counted_##name;                                                 \
+  static ret APIENTRY Count_##name params {                                   \
+    glCallCount++;                                                            \
+    return counted_##name args;                                               \
+  }
+#define HOOK_GL(name)                                                         \
+  counted_##name = glad_##name;                                               \
+  glad_##name = Count_##name
+
+COUNTED_GL(PFNGLACTIVETEXTUREPROC, glActiveTexture, (GLenum texture),
+           (texture))
+COUNTED_GL(PFNGLBINDBUFFERPROC, glBindBuffer, (GLenum target, GLuint buffer),
+           (target, buffer))
+COUNTED_GL(PFNGLBINDTEXTUREPROC, glBindTexture,
+           (GLenum target, GLuint texture), (target, texture))
+COUNTED_GL(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray, (GLuint array),
+           (array))
+COUNTED_GL(PFNGLBUFFERDATAPROC, glBufferData,
+           (GLenum target, GLsizeiptr size, const void *data, GLenum usage),
+           (target, size, data, usage))
+COUNTED_GL(PFNGLBUFFERSUBDATAPROC, glBufferSubData,
+           (GLenum target, GLintptr offset, GLsizeiptr size, const void *data),
+           (target, offset, size, data))
+COUNTED_GL(PFNGLCLEARPROC, glClear, (GLbitfield mask), (mask))
+COUNTED_GL(PFNGLDELETESYNCPROC, glDeleteSync, (GLsync sync), (sync))
+COUNTED_GL(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced,
+           (GLenum mode, GLsizei count, GLenum type, const void *indices,
+            GLsizei instances),
+           (mode, count, type, indices, instances))
+COUNTED_GL(PFNGLUNIFORM2FPROC, glUniform2f,
+           (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1))
+COUNTED_GL(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv,
+           (GLint location, GLsizei count, GLboolean transpose,
+            const GLfloat *value),
+           (location, count, transpose, value))
+COUNTED_GL(PFNGLUSEPROGRAMPROC, glUseProgram, (GLuint program), (program))
+COUNTED_GL(PFNGLVERTEXATTRIBIPOINTERPROC, glVertexAttribIPointer,
+           (GLuint index, GLint size, GLenum type, GLsizei stride,
+            const void *pointer),
+           (index, size, type, stride, pointer))
+COUNTED_GL(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer,
+           (GLuint index, GLint size, GLenum type, GLboolean normalized,
+            GLsizei stride, const void *pointer),
+           (index, size, type, normalized, stride, pointer))
+COUNTED_GL_RETURN(PFNGLCLIENTWAITSYNCPROC, GLenum, glClientWaitSync,
+                  (GLsync sync, GLbitfield flags, GLuint64 timeout),
+                  (sync, flags, timeout))
+COUNTED_GL_RETURN(PFNGLFENCESYNCPROC, GLsync, glFenceSync,
+                  (GLenum condition, GLbitfield flags), (condition, flags))
+COUNTED_GL_RETURN(PFNGLMAPBUFFERRANGEPROC, void *, glMapBufferRange,
+                  (GLenum target, GLintptr offset, GLsizeiptr length,
+                   GLbitfield access),
+                  (target, offset, length, access))
+COUNTED_GL_RETURN(PFNGLUNMAPBUFFERPROC, GLboolean, glUnmapBuffer,
+                  (GLenum target), (target))
+
+void HookGLCalls(void) {
+  HOOK_GL(glActiveTexture);
+  HOOK_GL(glBindBuffer);
+  HOOK_GL(glBindTexture);
+  HOOK_GL(glBindVertexArray);
+  HOOK_GL(glBufferData);
+  HOOK_GL(glBufferSubData);
+  HOOK_GL(glClear);
+  HOOK_GL(glDeleteSync);
+  HOOK_GL(glDrawElementsInstanced);
+  HOOK_GL(glUniform2f);
+  HOOK_GL(glUniformMatrix4fv);
+  HOOK_GL(glUseProgram);
+  HOOK_GL(glVertexAttribIPointer);
+  HOOK_GL(glVertexAttribPointer);
+  HOOK_GL(glClientWaitSync);
+  HOOK_GL(glFenceSync);
+  HOOK_GL(glMapBufferRange);
+  HOOK_GL(glUnmapBuffer);
+}
+
+static int CompareTimes(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void FinishResult(BenchResult *result, double *times) {
+  qsort(times, result->frames, sizeof(double), CompareTimes);
+  result->p50 = times[result->frames / 2];
+  result->p99 = times[result->frames * 99 / 100];
+  result->glyphs /= result->frames;
+  result->drawCalls /= result->frames;
+  result->glCalls /= result->frames;
+  result->bytesUploaded /= result->frames;
+}
+
+// Frames include the GPU work, glFinish waits for it before the clock stops
+BenchResult RenderCorpus(const BenchOptions *options, TextBatch *batch,
+                         const BitmapFont *font, const BenchCorpus *corpus) {
+  BenchResult result = {.frames = options->frames};
+  double *times = calloc(options->frames, sizeof(double));
+  if (times == NULL) {
+    return result;
+  }
+
+  for (unsigned frame = 0; frame < options->warmupFrames + options->frames;
+       frame++) {
+    unsigned glCalls = glCallCount;
+    double start = GetMonotonicTime();
+    glClear(GL_COLOR_BUFFER_BIT);
+    BeginTextBatch(batch, BENCH_WIDTH, BENCH_HEIGHT);
+    for (unsigned i = 0; i < corpus->itemCount; i++) {
+      const BenchItem *item = &corpus->items[i];
+      BatchText(batch, font, &item->layout, item->x, item->y,
+                corpus->text + item->offset);
+    }
+
+    EndTextBatch(batch);
+    glFinish();
+    double elapsed = GetMonotonicTime() - start;
+    if (frame < options->warmupFrames) {
+      continue;
+    }
+
+    times[frame - options->warmupFrames] = elapsed;
+    result.totalTime += elapsed;
+    result.glyphs += batch->lastFrameStats.glyphs;
+    result.drawCalls += batch->lastFrameStats.drawCalls;
+    result.glCalls += glCallCount - glCalls;
+    result.bytesUploaded += batch->stream.lastFrameStats.bytesWritten;
+  }
+
+  FinishResult(&result, times);
+  free(times);
+  return result;
+}
+
+BenchResult LayoutCorpus(const BenchOptions *options, const BitmapFont *font,
+                         const BenchCorpus *corpus) {
+  BenchResult result = {.frames = options->frames};
+  double *times = calloc(options->frames, sizeof(double));
+  size_t maxLen = 0;
+  for (unsigned i = 0; i < corpus->itemCount; i++) {
+    size_t len = strlen(corpus->text + corpus->items[i].offset);
+    maxLen = len > maxLen ? len : maxLen;
+  }
+
+  GlyphInstance *instances = malloc((maxLen + 1) * sizeof(GlyphInstance));
+  if (times == NULL || instances == NULL) {
+    goto terminate;
+  }
+
+  for (unsigned frame = 0; frame < options->warmupFrames + options->frames;
+       frame++) {
+    unsigned glyphs = 0;
+    double start = GetMonotonicTime();
+    for (unsigned i = 0; i < corpus->itemCount; i++) {
+      const BenchItem *item = &corpus->items[i];
+      const char *text = corpus->text + item->offset;
+      glyphs += LayoutText(font, &item->layout, item->x, item->y, text,
+                           strlen(text), instances);
+    }
+
+    double elapsed = GetMonotonicTime() - start;
+    if (frame >= options->warmupFrames) {
+      times[frame - options->warmupFrames] = elapsed;
+      result.totalTime += elapsed;
+      result.glyphs += glyphs;
+    }
+  }
+
+  FinishResult(&result, times);
+
+terminate:
+  if (times != NULL) {
+    free(times);
+  }
+
+  if (instances != NULL) {
+    free(instances);
+  }
+
+  return result;
+}
+
+void PrintResult(const BenchOptions *options, const char *corpus,
+                 const BenchResult *result) {
+  const char *mode = options->layoutOnly ? "layout" : "render";
+  double glyphsPerSecond =
+      result->totalTime > 0.0
+          ? result->glyphs * result->frames / result->totalTime
+          : 0.0;
+  if (options->json) {
+    printf("{\"corpus\":\"%s\",\"mode\":\"%s\",\"frames\":%u,"
+           "\"glyphs_per_frame\":%.0f,\"glyphs_per_sec\":%.0f,"
+           "\"draw_calls\":%.1f,\"gl_calls\":%.1f,\"bytes_uploaded\":%.0f,"
+           "\"frame_ms_p50\":%.4f,\"frame_ms_p99\":%.4f}\n",
+           corpus, mode, result->frames, result->glyphs, glyphsPerSecond,
+           result->drawCalls, result->glCalls, result->bytesUploaded,
+           result->p50 * 1e3, result->p99 * 1e3);
+    return;
+  }
+
+  printf("%-11s %-7s %10.0f %12.0f %8.1f %9.1f %12.0f %9.3f %9.3f\n", corpus,
+         mode, result->glyphs, glyphsPerSecond, result->drawCalls,
+         result->glCalls, result->bytesUploaded, result->p50 * 1e3,
+         result->p99 * 1e3);
+}
@@ -0,0 +1,257 @@
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+// clang-format on
+
+#include "common.h"
+#include "font.h"
+
+#define BENCH_FONT "texture_load_bench.txt"
+#define BENCH_IMAGE "texture_load_bench.png"
+#define BENCH_IMAGE_SIZE 8192
+#define BENCH_RUNS 3
+
+typedef BitmapFont (*FontLoadFn)(void);
+
+bool WriteBenchFont(unsigned size, bool color);
+bool WriteBenchImage(const char *filename, unsigned size, bool color);
+bool ResetPeakMemory(void);
+size_t ReadProcessMemory(const char *field);
+BitmapFont LoadStreamedFont(void);
+BitmapFont LoadDecodedFont(void);
+bool TimeFontLoad(const char *atlas, const char *name, FontLoadFn loader);
+
+// Loads a font whose atlas is a --size by --size (8192 by default) PNG page,
+// coverage only then in color, by decoding the page into a pixel unpack
+// buffer, and by decoding it into client memory then copying it, and reports
+// the load time and how much the peak resident memory of the process grows.
+// The texture storage of drivers that keep it in system memory counts in
+// both. Linux only, for the peak memory. Run it from the repository root.
+int main(int argc, char **argv) {
+  GLFWwindow *window = NULL;
+  BitmapFont placeholderFont = {0};
+  int status = EXIT_FAILURE;
+  unsigned size = BENCH_IMAGE_SIZE;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--size pixels]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!glfwInit()) {
+    Log(LOG_ERROR, "could not initialize GLFW");
+    return EXIT_FAILURE;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  window = glfwCreateWindow(64, 64, "texture_load_bench", NULL, NULL);
+  if (window == NULL) {
+    Log(LOG_ERROR, "could not create window");
+    goto terminate;
+  }
+
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    Log(LOG_ERROR, "could not initialize GL");
+    goto terminate;
+  }
+
+  // Keeps the glyph program between the loads
+  placeholderFont = LoadPlaceholderFont(16.0f);
+  if (placeholderFont.status != SUCCESS) {
+    goto terminate;
+  }
+
+  printf("%ux%u page, %zu MB decoded\n", size, size,
+         (size_t)size * size * 4 >> 20);
+  printf("%-9s %-9s %10s %10s %14s\n", "atlas", "path", "best ms",
+         "mean ms", "peak RSS MB");
+  status = EXIT_SUCCESS;
+  for (int color = 0; color <= 1 && status == EXIT_SUCCESS; color++) {
+    const char *atlas = color ? "color" : "coverage";
+    if (!WriteBenchFont(size, color) ||
+        !TimeFontLoad(atlas, "streamed", LoadStreamedFont) ||
+        !TimeFontLoad(atlas, "decoded", LoadDecodedFont)) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+  remove(BENCH_FONT);
+  remove(BENCH_IMAGE);
+
+terminate:
+  UnloadBitmapFont(placeholderFont);
+  if (window != NULL) {
+    glfwDestroyWindow(window);
+  }
+
+  glfwTerminate();
+  return status;
+}
+
+// A single glyph is enough, loading is all about the atlas
+bool WriteBenchFont(unsigned size, bool color) {
+  FILE *file = fopen(BENCH_FONT, "we");
+  if (file == NULL) {
+    Log(LOG_ERROR, "BENCH: could not write %s", BENCH_FONT);
+    return false;
+  }
+
+  fprintf(file,
+          "info face=\"bench\" size=64\n"
+          "common lineHeight=72 base=54 scaleW=%u scaleH=%u pages=1 "
+          "packed=0\n"
+          "page id=0 file=\"%s\"\n"
+          "chars count=1\n"
+          "char id=65 x=0 y=0 width=48 height=64 xoffset=0 yoffset=0 "
+          "xadvance=48 page=0 chnl=15\n",
+          size, size, BENCH_IMAGE);
+  bool written = fclose(file) == 0;
+  return written && WriteBenchImage(BENCH_IMAGE, size, color);
+}
+
+// Written a row at a time, the benchmark itself never holds the image
+bool WriteBenchImage(const char *filename, unsigned size, bool color) {
+  bool written = false;
+  png_structp png = NULL;
+  png_infop info = NULL;
+  unsigned char *row = malloc((size_t)size * 4);
+  FILE *file = fopen(filename, "wbe");
+  if (row == NULL || file == NULL) {
+    Log(LOG_ERROR, "BENCH: could not write %s", filename);
+    goto terminate;
+  }
+
+  png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info = png != NULL ? png_create_info_struct(png) : NULL;
+  if (info == NULL || setjmp(png_jmpbuf(png))) {
+    Log(LOG_ERROR, "BENCH: could not write %s", filename);
+    goto terminate;
+  }
+
+  png_init_io(png, file);
+  png_set_compression_level(png, 1);
+  png_set_IHDR(png, info, size, size, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+
+  // Glyph like blocks of coverage on a transparent background
+  for (unsigned y = 0; y < size; y++) {
+    for (unsigned x = 0; x < size; x++) {
+      unsigned char coverage = (x / 24 + y / 32) % 3 == 0 ? (x * y) & 0xFF : 0;
+      unsigned char *texel = row + x * 4;
+      texel[0] = color ? (unsigned char)x : 255;
+      texel[1] = color ? (unsigned char)y : 255;
+      texel[2] = 255;
+      texel[3] = coverage;
+    }
+
+    png_write_row(png, row);
+  }
+
+  png_write_end(png, NULL);
+  written = true;
+
+terminate:
+  if (png != NULL) {
+    png_destroy_write_struct(&png, info != NULL ? &info : NULL);
+  }
+
+  if (file != NULL) {
+    fclose(file);
+  }
+
+  if (row != NULL) {
+    free(row);
+  }
+
+  return written;
+}
+
+// Sets the peak resident memory of the process back to the current one
+bool ResetPeakMemory(void) {
+  FILE *file = fopen("/proc/self/clear_refs", "we");
+  if (file == NULL) {
+    return false;
+  }
+
+  bool reset = fputs("5", file) >= 0;
+  return fclose(file) == 0 && reset;
+}
+
+// Field of /proc/self/status in bytes, 0 if it is not there
+size_t ReadProcessMemory(const char *field) {
+  FILE *file = fopen("/proc/self/status", "re");
+  if (file == NULL) {
+    return 0;
+  }
+
+  char line[256];
+  size_t kilobytes = 0;
+  size_t fieldLen = strlen(field);
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (strncmp(line, field, fieldLen) == 0 && line[fieldLen] == ':') {
+      kilobytes = strtoul(line + fieldLen + 1, NULL, 10);
+      break;
+    }
+  }
+
+  fclose(file);
+  return kilobytes << 10;
+}
+
+BitmapFont LoadStreamedFont(void) { return LoadBitmapFont(BENCH_FONT); }
+
+BitmapFont LoadDecodedFont(void) {
+  BitmapFontData data = ReadBitmapFontData(BENCH_FONT);
+  return UploadBitmapFont(&data);
+}
+
+bool TimeFontLoad(const char *atlas, const char *name, FontLoadFn loader) {
+  double best = 0.0;
+  double total = 0.0;
+  size_t peak = 0;
+  for (unsigned run = 0; run < BENCH_RUNS; run++) {
+    bool resetPeak = ResetPeakMemory();
+    size_t resident = ReadProcessMemory("VmRSS");
+
+    // Uploads are asynchronous, the load is done once GL is done with it
+    double start = GetMonotonicTime();
+    BitmapFont font = loader();
+    glFinish();
+    double elapsed = GetMonotonicTime() - start;
+    size_t grown = ReadProcessMemory("VmHWM") - resident;
+    if (font.status != SUCCESS) {
+      Log(LOG_ERROR, "BENCH: %s %s: could not load font", atlas, name);
+      return false;
+    }
+
+    UnloadBitmapFont(font);
+    glFinish();
+    total += elapsed;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+
+    if (resetPeak && grown > peak) {
+      peak = grown;
+    }
+  }
+
+  printf("%-9s %-9s %10.3f %10.3f %14.1f\n", atlas, name, best * 1e3,
+         total * 1e3 / BENCH_RUNS, (double)peak / (1 << 20));
+  return true;
+}
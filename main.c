@@ -1,87 +1,207 @@
-#include <stdarg.h>
-#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 // clang-format off
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 // clang-format on
 
-#include <png.h>
+#include "asset_reload.h"
+#include "common.h"
+#include "files.h"
+#include "font.h"
+#include "font_loader.h"
+#include "gfx.h"
+#include "glyph_cache.h"
+#include "gpu_layout.h"
+#include "profiler.h"
+#include "sdf.h"
+#include "text.h"
+#include "text_queue.h"
+#include "text_run_cache.h"
+#include "text_view.h"
 
 #define WINDOW_TITLE "SimpleFontRendering"
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 800
 
-#define ASSETS_FONT_IMG "assets/cooper-hewitt-heavy.png"
 #define ASSETS_FONT_TXT "assets/cooper-hewitt-heavy.txt"
-#define ASSETS_GLYPH_VS "assets/glyph.vs.glsl"
-#define ASSETS_GLYPH_FS "assets/glyph.fs.glsl"
-
-typedef enum {
-  LOG_INFO,
-  LOG_WARN,
-  LOG_ERROR,
-} LogLevel;
-
-typedef enum {
-  SUCCESS,
-  ERROR_CANNOT_LOAD_DESC_FILE,
-  ERROR_CANNOT_LOAD_ATLAS_FILE,
-  ERROR_CANNOT_LOAD_GLYPH_SHADER,
-  ERROR_INVALID_DESCRIPTION,
-} StatusCode;
+#define ASSETS_FONT_PACK "assets/cooper-hewitt-heavy.sfp"
+
+#define TEXT_BATCH_MAX_GLYPHS 16384
+#define FONT_UPLOADS_PER_FRAME 2
+#define PLACEHOLDER_FONT_SIZE 72.0f
+#define OVERLAY_KEY GLFW_KEY_F3
+#define SCALED_TEXT_SIZE 160.0f
+#define VIEW_TEXT_SIZE 24.0f
+#define VIEW_TOP 130.0f
+#define VIEW_MARGIN 10.0f
+#define VIEW_SCROLL_LINES 3.0f
+#define DASHBOARD_ROWS 8
+#define DASHBOARD_LEFT 420.0f
+#define DASHBOARD_TOP 520.0f
+#define DASHBOARD_WIDTH 360.0f
+#define DASHBOARD_ROW_HEIGHT 30.0f
 
 typedef struct {
   float width;
   float height;
   float aspect;
+  TextBatch textBatch;
+  TextQueue textQueue;
+  Profiler profiler;
+  bool showOverlay;
+  TextView view;
+  GpuText gpuView;
 } AppState;
 
-typedef struct {
-  unsigned vao;
-  unsigned vbo;
-  unsigned ebo;
-} Mesh;
-
-typedef struct {
-  StatusCode status;
-  float fontSize;
-  float xos[256];
-  float yos[256];
-  float xas[256];
-  Mesh quads[256];
-  unsigned shaderProgramId;
-  unsigned textureId;
-} BitmapFont;
-
-void Log(LogLevel level, const char *fmt, ...);
-unsigned LoadShader(const char *vsFilename, const char *fsFilename);
-unsigned LoadTexture(const char *filename);
-BitmapFont LoadBitmapFont(const char *atlasFilename, const char *descFilename);
-void UnloadBitmapFont(BitmapFont font);
-char *ReadTextFile(const char *filename);
-unsigned char *ReadPNGFile(const char *filename, unsigned *width,
-                           unsigned *height);
-bool HasPrefix(const char *line, const char *prefix);
-int GetLineAttrInt(const char *line, unsigned attrId);
-char *GetNextLine(char *line);
-Mesh MakeGlyphQuad(float imgW, float imgH, float x, float y, float w, float h);
-void RenderText(BitmapFont font, float xPos, float yPos, const char *text);
-void WorldToViewport(float *vx, float *vy, float x, float y);
-void MakeOrthoProj(float m[16], float l, float r, float t, float b, float n,
-                   float f);
-void MakeGlyphTransform(float m[16], float x, float y);
+void HandleKey(GLFWwindow *window, int key, int scancode, int action,
+               int mods);
+void HandleScroll(GLFWwindow *window, double xOffset, double yOffset);
+void ScrollView(float scrollX, float scrollY);
+void QueueDashboard(TextQueue *queue, const BitmapFont *font,
+                    const BitmapFont *unitFont, unsigned long long frame);
 
 // warn: entire app state
 static AppState globalState = {0};
 
-int main() {
+// Pass --profile <file> to write the timings of every frame as JSON lines,
+// F3 toggles the timing overlay. With --sdf the font is turned into a
+// distance field while loading, and also drawn scaled up with effects. With
+// --glyph-cache <size> only the glyphs in use are uploaded, into a size by
+// size texture. --view <file> shows a text file below the label, scrolled
+// with the mouse wheel, Page Up, Page Down, Home and End. --run-cache <KB>
+// keeps the text drawn every frame laid out, within that many kilobytes.
+// --dashboard draws a panel of labels, values and units in several fonts
+// and sizes, queued in any order and drawn sorted by GL state. With
+// --shader-cache <dir> linked programs are kept in dir and loaded from there
+// on the next runs instead of being compiled. --gpu-layout lays out the
+// whole --view file with a compute shader instead, unscrolled, when the GL
+// context has compute shaders. --watch reloads the font and glyph shaders
+// when their files change.
+int main(int argc, char **argv) {
   GLFWwindow *window = NULL;
   int status = EXIT_SUCCESS;
+  FontLoader fontLoader = {0};
+  AssetReloader reloader = {0};
   BitmapFont font = {0};
+  BitmapFont placeholderFont = {0};
+  TextObject label = {0};
+  const char *profileFilename = NULL;
+  bool distanceField = false;
+  unsigned cacheSize = 0;
+  size_t runCacheBudget = 0;
+  TextRunCache *runCache = NULL;
+  bool dashboard = false;
+  const char *shaderCacheDir = NULL;
+  bool gpuLayout = false;
+  bool watch = false;
+  bool fontReady = false;
+  const char *viewFilename = NULL;
+  char *viewText = NULL;
+  size_t viewTextSize = 0;
+  TextLayout scaledLayout = {
+      .color = COLOR_WHITE,
+      .size = SCALED_TEXT_SIZE,
+      .effects =
+          {
+              .outlineWidth = 3.0f,
+              .outlineColor = PACK_RGBA(20, 40, 120, 255),
+              .shadowOffset = {6.0f, 6.0f},
+              .shadowSoftness = 4.0f,
+              .shadowColor = PACK_RGBA(0, 0, 0, 160),
+          },
+  };
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profileFilename = argv[++i];
+    } else if (strcmp(argv[i], "--sdf") == 0) {
+      distanceField = true;
+    } else if (strcmp(argv[i], "--glyph-cache") == 0 && i + 1 < argc) {
+      cacheSize = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--view") == 0 && i + 1 < argc) {
+      viewFilename = argv[++i];
+    } else if (strcmp(argv[i], "--run-cache") == 0 && i + 1 < argc) {
+      runCacheBudget = strtoul(argv[++i], NULL, 10) << 10;
+    } else if (strcmp(argv[i], "--dashboard") == 0) {
+      dashboard = true;
+    } else if (strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+      shaderCacheDir = argv[++i];
+    } else if (strcmp(argv[i], "--gpu-layout") == 0) {
+      gpuLayout = true;
+    } else if (strcmp(argv[i], "--watch") == 0) {
+      watch = true;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--profile timings.jsonl] [--sdf] "
+              "[--glyph-cache size] [--view file] [--run-cache KB] "
+              "[--dashboard] [--shader-cache dir] [--gpu-layout] "
+              "[--watch]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (shaderCacheDir != NULL && !SetShaderCacheDir(shaderCacheDir)) {
+    return EXIT_FAILURE;
+  }
+
+  if (viewFilename != NULL) {
+    viewText = MapFile(viewFilename, &viewTextSize);
+    if (viewText == NULL) {
+      Log(LOG_ERROR, "could not read %s", viewFilename);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Fonts are read while the window and GL are set up, and uploaded from the
+  // render loop once ready
+  if (StartFontLoader(&fontLoader, 0) != SUCCESS) {
+    status = EXIT_FAILURE;
+    goto terminate;
+  }
+
+  // Prefer the precompiled pack when it has been built with font_pack
+  bool fontQueued = false;
+  bool fontFromDesc = false;
+  if (distanceField) {
+    fontQueued = QueueDistanceFieldFontLoad(&fontLoader, &font,
+                                            ASSETS_FONT_TXT, SDF_DEFAULT_RANGE);
+  } else if (cacheSize > 0 && access(ASSETS_FONT_PACK, R_OK) == 0) {
+    fontQueued = QueueCachedFontPackLoad(&fontLoader, &font, ASSETS_FONT_PACK,
+                                         cacheSize);
+  } else if (cacheSize > 0) {
+    fontQueued =
+        QueueCachedFontLoad(&fontLoader, &font, ASSETS_FONT_TXT, cacheSize);
+  } else if (access(ASSETS_FONT_PACK, R_OK) == 0) {
+    fontQueued = QueueFontPackLoad(&fontLoader, &font, ASSETS_FONT_PACK);
+  } else {
+    fontQueued = QueueFontLoad(&fontLoader, &font, ASSETS_FONT_TXT);
+    fontFromDesc = true;
+  }
+
+  if (!fontQueued) {
+    status = EXIT_FAILURE;
+    goto terminate;
+  }
+
+  // The glyph programs are always reloaded, the font only when uploaded
+  // whole from its descriptor
+  if (watch) {
+    if (!fontFromDesc) {
+      Log(LOG_WARN, "RELOAD: packs, distance fields and glyph caches are not "
+                    "reloaded, only the glyph programs");
+    }
+
+    if (StartAssetReloader(&reloader, fontFromDesc ? &font : NULL,
+                           ASSETS_FONT_TXT) != SUCCESS) {
+      status = EXIT_FAILURE;
+      goto terminate;
+    }
+  }
 
   if (!glfwInit()) {
     const char *msg = NULL;
@@ -106,32 +226,131 @@ int main() {
   }
 
   glfwMakeContextCurrent(window);
+  glfwSetKeyCallback(window, HandleKey);
+  glfwSetScrollCallback(window, HandleScroll);
   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
     Log(LOG_ERROR, "could not initialize GL");
     status = EXIT_FAILURE;
     goto terminate;
   }
 
-  // Load font and other resources
+  // Load font and other resources, text shows in the placeholder font until
+  // the real one is uploaded
   {
-    font = LoadBitmapFont(ASSETS_FONT_IMG, ASSETS_FONT_TXT);
-    if (font.status != SUCCESS) {
-      Log(LOG_ERROR, "could not load font");
+    placeholderFont = LoadPlaceholderFont(PLACEHOLDER_FONT_SIZE);
+    if (placeholderFont.status != SUCCESS) {
+      Log(LOG_ERROR, "could not load placeholder font");
       status = EXIT_FAILURE;
       goto terminate;
     }
+
+    label = CreateTextObject(&placeholderFont,
+                             &(TextLayout){.color = COLOR_WHITE}, 10.0f, 100.0f,
+                             "Medea china inutil");
+    if (label.status != SUCCESS) {
+      Log(LOG_ERROR, "could not create label");
+      status = EXIT_FAILURE;
+      goto terminate;
+    }
+  }
+
+  globalState.textBatch = CreateTextBatch(TEXT_BATCH_MAX_GLYPHS);
+  if (globalState.textBatch.status != SUCCESS) {
+    Log(LOG_ERROR, "could not create text batch");
+    status = EXIT_FAILURE;
+    goto terminate;
   }
 
-  // Color and depth setup
+  globalState.textQueue = CreateTextQueue(&globalState.textBatch);
+  if (runCacheBudget > 0) {
+    runCache = CreateTextRunCache(runCacheBudget);
+    if (runCache == NULL) {
+      status = EXIT_FAILURE;
+      goto terminate;
+    }
+
+    globalState.textBatch.runCache = runCache;
+  }
+
+  globalState.profiler = CreateProfiler();
+  if (profileFilename != NULL &&
+      !StartProfilerDump(&globalState.profiler, profileFilename)) {
+    status = EXIT_FAILURE;
+    goto terminate;
+  }
+
+  // Color and depth setup, glyph quads share the same depth and may overlap
   glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
   glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LESS);
+  glDepthFunc(GL_LEQUAL);
 
   // Enable transparency
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+  double statsTime = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
+    // Upload the fonts read since the last frame
+    PollFontLoader(&fontLoader, FONT_UPLOADS_PER_FRAME);
+    if (font.status == SUCCESS) {
+      // Every program of the first frames is made by now
+      if (!fontReady) {
+        ShaderStats shaderStats = GetShaderStats();
+        Log(LOG_INFO,
+            "SHADER: %u programs compiled (%.2f ms), %u loaded from the "
+            "program cache (%.2f ms), %u rejected",
+            shaderStats.compiled, shaderStats.compileTime * 1e3,
+            shaderStats.cached, shaderStats.cacheTime * 1e3,
+            shaderStats.rejected);
+        fontReady = true;
+      }
+
+      SetTextObjectFont(&label, &font);
+      if (viewText != NULL && gpuLayout) {
+        // Falls back to the text view without compute shaders
+        gpuLayout = false;
+        if (CanLayoutTextOnGpu() && font.glyphCache == NULL) {
+          globalState.gpuView = CreateGpuText(
+              &font,
+              &(TextLayout){.color = COLOR_WHITE, .size = VIEW_TEXT_SIZE},
+              VIEW_MARGIN, VIEW_TOP);
+          if (globalState.gpuView.status != SUCCESS ||
+              !SetGpuText(&globalState.gpuView, viewText, viewTextSize)) {
+            Log(LOG_ERROR, "could not lay out %s on the GPU", viewFilename);
+            status = EXIT_FAILURE;
+            break;
+          }
+
+          Log(LOG_INFO, "GPU: %s: %zu bytes laid out by the GPU",
+              viewFilename, viewTextSize);
+        } else {
+          Log(LOG_WARN, "GPU: no compute shaders, %s is laid out on the CPU",
+              viewFilename);
+        }
+      }
+
+      if (viewText != NULL && globalState.gpuView.font == NULL &&
+          globalState.view.font == NULL) {
+        globalState.view =
+            CreateTextView(&font,
+                           &(TextLayout){.color = COLOR_WHITE,
+                                         .size = VIEW_TEXT_SIZE},
+                           viewText, viewTextSize);
+        if (globalState.view.status != SUCCESS) {
+          Log(LOG_ERROR, "could not index %s", viewFilename);
+          status = EXIT_FAILURE;
+          break;
+        }
+
+        Log(LOG_INFO, "VIEW: %s: %u lines", viewFilename,
+            globalState.view.lineCount);
+      }
+    } else if (font.status != PENDING) {
+      Log(LOG_ERROR, "could not load font");
+      status = EXIT_FAILURE;
+      break;
+    }
+
     // Prepare render
     int width = 0;
     int height = 0;
@@ -140,508 +359,232 @@ int main() {
     globalState.height = (float)height;
     globalState.aspect = globalState.width / globalState.height;
 
+    BeginProfilerFrame(&globalState.profiler);
+
+    // Files changed since the last frame are swapped in before it is drawn,
+    // the time it takes is part of the frame
+    if (watch) {
+      BitmapFont *const reloadFonts[] = {&font, &placeholderFont};
+      PollAssetReloader(&reloader, reloadFonts, 2);
+      AddProfilerReloadTime(&globalState.profiler, reloader.stats.pollTime);
+    }
+
     glViewport(0, 0, width, height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    BeginTextBatch(&globalState.textBatch, globalState.width,
+                   globalState.height);
     {
       // Render
-      RenderText(font, 10.0f, 100.0f, "Medea china inutil");
-    }
-    // Finish render
-    glfwPollEvents();
-    glfwSwapBuffers(window);
-  }
-
-terminate:
-  UnloadBitmapFont(font);
-
-  if (window != NULL) {
-    glfwDestroyWindow(window);
-    glfwTerminate();
-  }
-
-  return status;
-}
-
-void Log(LogLevel level, const char *fmt, ...) {
-  static const char *levels[] = {
-      [LOG_INFO] = "INFO",
-      [LOG_WARN] = "WARN",
-      [LOG_ERROR] = "ERROR",
-  };
-
-  printf("%s  | ", levels[level]);
-  va_list vaList;
-  va_start(vaList, fmt);
-  vprintf(fmt, vaList);
-  va_end(vaList);
-  printf("\n");
-}
-
-unsigned LoadShader(const char *vsFilename, const char *fsFilename) {
-  unsigned shaderProgramId = 0;
-  int shaderStatus = 0;
-  char shaderLog[512] = {0};
-  char *vsCode = NULL;
-  char *fsCode = NULL;
-  unsigned vShaderId = 0;
-  unsigned fShaderId = 0;
-
-  vsCode = ReadTextFile(vsFilename);
-  if (vsCode == NULL) {
-    Log(LOG_ERROR, "SHADER: could not load vertex shader: %s", vsFilename);
-    goto terminate;
-  }
-
-  vShaderId = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vShaderId, 1, (const char **)&vsCode, NULL);
-  glCompileShader(vShaderId);
-
-  glGetShaderiv(vShaderId, GL_COMPILE_STATUS, &shaderStatus);
-  if (!shaderStatus) {
-    glGetShaderInfoLog(vShaderId, 512, NULL, shaderLog);
-    Log(LOG_ERROR, "SHADER: could not compile vertex shader: %s", shaderLog);
-    goto terminate;
-  }
-
-  fsCode = ReadTextFile(fsFilename);
-  if (fsCode == NULL) {
-    Log(LOG_ERROR, "SHADER: could not load fragment shader: %s", fsFilename);
-    goto terminate;
-  }
-
-  fShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fShaderId, 1, (const char **)&fsCode, NULL);
-  glCompileShader(fShaderId);
-
-  glGetShaderiv(fShaderId, GL_COMPILE_STATUS, &shaderStatus);
-  if (!shaderStatus) {
-    glGetShaderInfoLog(fShaderId, 512, NULL, shaderLog);
-    Log(LOG_ERROR, "SHADER: could not compile fragment shader: %s", shaderLog);
-    goto terminate;
-  }
-
-  shaderProgramId = glCreateProgram();
-  glAttachShader(shaderProgramId, vShaderId);
-  glAttachShader(shaderProgramId, fShaderId);
-  glLinkProgram(shaderProgramId);
-
-  glGetShaderiv(shaderProgramId, GL_LINK_STATUS, &shaderStatus);
-  if (!shaderStatus) {
-    glGetProgramInfoLog(shaderProgramId, 512, NULL, shaderLog);
-    Log(LOG_ERROR, "SHADER: could not link shader program: %s", shaderLog);
-    goto terminate;
-  }
-
-terminate:
-  if (vShaderId != 0) {
-    glDeleteShader(vShaderId);
-  }
-
-  if (fShaderId != 0) {
-    glDeleteShader(fShaderId);
-  }
-
-  if (vsCode != NULL) {
-    free(vsCode);
-  }
-
-  if (fsCode != NULL) {
-    free(fsCode);
-  }
-
-  return shaderProgramId;
-}
-
-unsigned LoadTexture(const char *filename) {
-  unsigned textureId = 0;
-  unsigned imageWidth = 0;
-  unsigned imageHeight = 0;
-  unsigned char *imageData = ReadPNGFile(filename, &imageWidth, &imageHeight);
-  if (imageData == NULL) {
-    return 0;
-  }
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  glGenTextures(1, &textureId);
-  glBindTexture(GL_TEXTURE_2D, textureId);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (int)imageWidth, (int)imageHeight, 0,
-               GL_RGBA, GL_UNSIGNED_BYTE, imageData);
-  glGenerateMipmap(GL_TEXTURE_2D);
-  free(imageData);
-  return textureId;
-}
-
-BitmapFont LoadBitmapFont(const char *atlasFilename, const char *descFilename) {
-  char *fontDescData = NULL;
-  char *line = NULL;
-  BitmapFont font = {0};
+      DrawTextObject(&globalState.textBatch, &label);
 
-  font.shaderProgramId = LoadShader(ASSETS_GLYPH_VS, ASSETS_GLYPH_FS);
-  if (font.shaderProgramId == 0) {
-    font.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
-    goto terminate;
-  }
-
-  font.textureId = LoadTexture(atlasFilename);
-  if (font.textureId == 0) {
-    font.status = ERROR_CANNOT_LOAD_ATLAS_FILE;
-    goto terminate;
-  }
+      // Only the lines inside the view are laid out
+      if (globalState.view.font != NULL) {
+        DrawTextView(&globalState.textBatch, &globalState.view, VIEW_MARGIN,
+                     VIEW_TOP, globalState.width - VIEW_MARGIN * 2.0f,
+                     globalState.height - VIEW_TOP - VIEW_MARGIN);
+      }
 
-  fontDescData = ReadTextFile(descFilename);
-  if (fontDescData == NULL) {
-    font.status = ERROR_CANNOT_LOAD_DESC_FILE;
-    goto terminate;
-  }
+      if (globalState.gpuView.font != NULL) {
+        DrawGpuText(&globalState.textBatch, &globalState.gpuView);
+      }
 
-  line = fontDescData;
-  if (!HasPrefix(line, "info")) {
-    Log(LOG_ERROR, "invalid info section");
-    font.status = ERROR_INVALID_DESCRIPTION;
-    goto terminate;
-  }
+      // Distance fields stay sharp at any size
+      if (font.status == SUCCESS && font.distanceRange > 0.0f) {
+        BatchText(&globalState.textBatch, &font, &scaledLayout, 10.0f, 300.0f,
+                  "Medea china");
+      }
+      if (dashboard) {
+        QueueDashboard(&globalState.textQueue,
+                       font.status == SUCCESS ? &font : &placeholderFont,
+                       &placeholderFont, globalState.textBatch.frameIndex);
+      }
 
-  font.fontSize = (float)GetLineAttrInt(line, 1);
-  line = GetNextLine(line);
+      if (globalState.showOverlay) {
+        DrawProfilerOverlay(&globalState.profiler, &globalState.textBatch,
+                            font.status == SUCCESS ? &font : &placeholderFont,
+                            10.0f, 200.0f);
+      }
+    }
+    EndTextQueueFrame(&globalState.textQueue);
+    EndTextBatch(&globalState.textBatch);
+    EndProfilerFrame(&globalState.profiler,
+                     &globalState.textBatch.lastFrameStats);
+
+    // Report text stats once per second
+    if (glfwGetTime() - statsTime >= 1.0) {
+      TextStats stats = globalState.textBatch.lastFrameStats;
+      StreamStats streamStats = globalState.textBatch.stream.lastFrameStats;
+      Log(LOG_INFO,
+          "TEXT: %u glyphs, %u draw calls, %u state changes per frame",
+          stats.glyphs, stats.drawCalls, stats.stateChanges);
+      Log(LOG_INFO, "TEXT: %u object updates (%zu bytes) per frame",
+          stats.objectUpdates, stats.objectBytesUploaded);
+      Log(LOG_INFO, "STREAM: %zu bytes written, %u fence waits (%.3f ms)",
+          streamStats.bytesWritten, streamStats.fenceWaits,
+          streamStats.fenceWaitTime * 1000.0);
+      if (globalState.view.font != NULL) {
+        TextViewStats viewStats = globalState.view.lastDrawStats;
+        Log(LOG_INFO,
+            "VIEW: %u lines, %zu bytes laid out, %u glyphs drawn, %u culled "
+            "per frame",
+            viewStats.lines, viewStats.bytesLaidOut, viewStats.glyphs,
+            viewStats.culledGlyphs);
+      }
 
-  if (!HasPrefix(line, "common")) {
-    Log(LOG_ERROR, "invalid common section");
-    font.status = ERROR_INVALID_DESCRIPTION;
-    goto terminate;
-  }
-  float scaleW = (float)GetLineAttrInt(line, 2);
-  float scaleH = (float)GetLineAttrInt(line, 3);
+      if (font.status == SUCCESS && font.glyphCache != NULL) {
+        GlyphCacheStats cacheStats = font.glyphCache->lastFrameStats;
+        Log(LOG_INFO,
+            "CACHE: %u hits, %u misses, %u evictions, %u overflows, %u "
+            "uploads (%zu bytes) per frame",
+            cacheStats.hits, cacheStats.misses, cacheStats.evictions,
+            cacheStats.overflows, cacheStats.uploads,
+            cacheStats.bytesUploaded);
+      }
 
-  line = GetNextLine(line);
-  line = GetNextLine(line);
+      if (dashboard) {
+        TextQueueStats queueStats = globalState.textQueue.lastFrameStats;
+        Log(LOG_INFO,
+            "QUEUE: %u commands, %u draw calls, %u state changes per frame",
+            queueStats.commands, queueStats.drawCalls,
+            queueStats.stateChanges);
+      }
 
-  if (!HasPrefix(line, "chars")) {
-    Log(LOG_ERROR, "invalid chars section");
-    font.status = ERROR_INVALID_DESCRIPTION;
-    goto terminate;
-  }
+      if (watch) {
+        AssetReloadStats reloadStats = reloader.stats;
+        Log(LOG_INFO,
+            "RELOAD: %u table, %u atlas and %u program swaps, %u failed, "
+            "%.3f ms longest frame",
+            reloadStats.tableSwaps, reloadStats.atlasSwaps,
+            reloadStats.programSwaps, reloadStats.failures,
+            reloadStats.maxPollTime * 1e3);
+      }
 
-  unsigned charCount = (unsigned)GetLineAttrInt(line, 0);
-  for (unsigned i = 0; i < charCount; i++) {
-    line = GetNextLine(line);
-    if (!HasPrefix(line, "char")) {
-      break;
-    }
+      if (runCache != NULL) {
+        TextRunCacheStats runStats = runCache->lastFrameStats;
+        Log(LOG_INFO,
+            "RUNS: %u hits, %u misses, %u evictions per frame, %u runs (%zu "
+            "bytes)",
+            runStats.hits, runStats.misses, runStats.evictions,
+            runCache->runCount, runCache->bytes);
+      }
 
-    unsigned id = GetLineAttrInt(line, 0);
-    if (id > 255) {
-      Log(LOG_WARN, "unsupported character outside range: %d", id);
-      continue;
+      statsTime = glfwGetTime();
     }
 
-    float x = (float)GetLineAttrInt(line, 1);
-    float y = (float)GetLineAttrInt(line, 2);
-    float w = (float)GetLineAttrInt(line, 3);
-    float h = (float)GetLineAttrInt(line, 4);
-    float xo = (float)GetLineAttrInt(line, 5);
-    float yo = (float)GetLineAttrInt(line, 6);
-    float xa = (float)GetLineAttrInt(line, 7);
-    Mesh quad = MakeGlyphQuad(scaleW, scaleH, x, y, w, h);
-    font.quads[id] = quad;
-    font.xos[id] = xo;
-    font.yos[id] = yo;
-    font.xas[id] = xa;
+    // Finish render
+    glfwPollEvents();
+    glfwSwapBuffers(window);
   }
 
 terminate:
-  if (fontDescData != NULL) {
-    free(fontDescData);
+  StopFontLoader(&fontLoader);
+  StopAssetReloader(&reloader);
+  DestroyTextObject(&label);
+  DestroyTextView(&globalState.view);
+  DestroyGpuText(&globalState.gpuView);
+  DestroyProfiler(&globalState.profiler);
+  DestroyTextQueue(&globalState.textQueue);
+  DestroyTextBatch(&globalState.textBatch);
+  if (runCache != NULL) {
+    DestroyTextRunCache(runCache);
   }
 
-  return font;
-}
-
-void UnloadBitmapFont(BitmapFont font) {
-  if (font.shaderProgramId != 0) {
-    glDeleteProgram(font.shaderProgramId);
-  }
-
-  for (unsigned i = 0; i < 256; i++) {
-    Mesh quad = font.quads[i];
-    if (quad.vao != 0) {
-      glDeleteVertexArrays(1, &quad.vao);
-    }
-
-    if (quad.vbo != 0) {
-      glDeleteBuffers(1, &quad.vbo);
-    }
-
-    if (quad.ebo != 0) {
-      glDeleteBuffers(1, &quad.ebo);
-    }
-  }
-}
-
-char *ReadTextFile(const char *filename) {
-  FILE *file = fopen(filename, "re");
-  if (file == NULL) {
-    Log(LOG_ERROR, "FILE: could not read file: %s", filename);
-    return NULL;
+  UnloadBitmapFont(font);
+  UnloadBitmapFont(placeholderFont);
+  if (viewText != NULL) {
+    UnmapFile(viewText, viewTextSize);
   }
 
-  fseek(file, 0, SEEK_END);
-  size_t dataLen = ftell(file);
-  fseek(file, 0, SEEK_SET);
-
-  char *data = calloc(dataLen + 1, sizeof(char));
-  if (data == NULL) {
-    Log(LOG_ERROR, "FILE: could not allocate memory for file: %s", filename);
-    fclose(file);
-    return NULL;
+  if (window != NULL) {
+    glfwDestroyWindow(window);
+    glfwTerminate();
   }
 
-  fread(data, sizeof(char), dataLen, file);
-  fclose(file);
-  return data;
+  return status;
 }
 
-unsigned char *ReadPNGFile(const char *filename, unsigned *width,
-                           unsigned *height) {
-  unsigned char *imageData = NULL;
-  FILE *file = NULL;
-  png_byte header[8] = {0};
-  png_structp pngHandler = NULL;
-  png_bytepp rowPointers = NULL;
-  png_infop pngInfo = NULL;
-  size_t rowBytes;
-  unsigned tmpHeight;
-
-  file = fopen(filename, "rbe");
-  if (file == NULL) {
-    Log(LOG_ERROR, "PNG: could not open file: %s", filename);
-    goto terminate;
-  }
-
-  // Read header
-  if (fread(header, 1, sizeof(header), file) < 8) {
-    Log(LOG_ERROR, "PNG: file is too short to be an PNG file: %s", filename);
-    goto terminate;
-  }
-
-  if (!png_check_sig(header, 8)) {
-    Log(LOG_ERROR, "PNG: not a valid PNG file: %s", filename);
-    goto terminate;
-  }
-
-  // Create read struct
-  pngHandler = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (pngHandler == NULL) {
-    Log(LOG_ERROR, "PNG: cannot initialize the library for file: %s", filename);
-    goto terminate;
-  }
-
-  // Get info struct
-  pngInfo = png_create_info_struct(pngHandler);
-  if (pngInfo == NULL) {
-    Log(LOG_ERROR, "PNG: cannot initialize pngInfo for file: %s", filename);
-    goto terminate;
-  }
-
-  // Exception handling code
-  if (setjmp(png_jmpbuf(pngHandler))) {
-    Log(LOG_ERROR, "PNG: cannot initialize exceptions for file: %s", filename);
-    goto terminate;
-  }
-
-  png_init_io(pngHandler, file);
-  png_set_sig_bytes(pngHandler, sizeof(header)); // shift header
-  png_read_info(pngHandler, pngInfo);            // read info
-
-  // Get image width and height from info
-  png_get_IHDR(pngHandler, pngInfo, width, height, NULL, NULL, NULL, NULL,
-               NULL);
-  png_read_update_info(pngHandler, pngInfo);
-  Log(LOG_INFO, "PNG: %s: %u x %u", filename, *width, *height);
-
-  // Row size in bytes
-  rowBytes = png_get_rowbytes(pngHandler, pngInfo);
-  tmpHeight = *height;
-
-  // Allocate image block
-  imageData = calloc(rowBytes * tmpHeight, sizeof(unsigned char));
-  if (imageData == NULL) {
-    Log(LOG_ERROR, "PNG: could not allocate memory for file: %s (%ld bytes)",
-        filename, rowBytes * tmpHeight);
-    goto terminate;
-  }
-
-  // Allocate memory for all rowPointers to help decode data
-  rowPointers = calloc(tmpHeight, sizeof(png_bytep));
-  if (rowPointers == NULL) {
-    Log(LOG_ERROR, "PNG: could not allocate memory for file: %s (%ld bytes)",
-        filename, tmpHeight * sizeof(png_bytep));
-  }
-
-  // Prepare rowPointers to point into imageData.
-  for (unsigned i = 0; i < tmpHeight; i++) {
-    rowPointers[tmpHeight - 1 - i] = imageData + i * rowBytes;
-  }
-
-  // Read full image into rowPointers (and thus, imageData)
-  png_read_image(pngHandler, rowPointers);
-
-terminate:
-  if (file != NULL) {
-    fclose(file);
+void HandleKey(GLFWwindow *window, int key, int scancode, int action,
+               int mods) {
+  (void)window;
+  (void)scancode;
+  (void)mods;
+  if (key == OVERLAY_KEY && action == GLFW_PRESS) {
+    globalState.showOverlay = !globalState.showOverlay;
   }
 
-  if (pngHandler != NULL && pngInfo != NULL) {
-    png_destroy_read_struct(&pngHandler, &pngInfo, NULL);
+  if (action == GLFW_RELEASE || globalState.view.font == NULL) {
+    return;
   }
 
-  if (rowPointers != NULL) {
-    free(rowPointers);
+  TextView *view = &globalState.view;
+  float page = globalState.height - VIEW_TOP - VIEW_MARGIN;
+  if (key == GLFW_KEY_PAGE_DOWN) {
+    ScrollView(view->scrollX, view->scrollY + page);
+  } else if (key == GLFW_KEY_PAGE_UP) {
+    ScrollView(view->scrollX, view->scrollY - page);
+  } else if (key == GLFW_KEY_HOME) {
+    ScrollView(0.0f, 0.0f);
+  } else if (key == GLFW_KEY_END) {
+    ScrollView(view->scrollX, view->lineTops[view->lineCount]);
   }
-
-  return imageData;
 }
 
-bool HasPrefix(const char *line, const char *prefix) {
-  size_t headerPos;
-  size_t prefixLen = strlen(prefix);
-
-  for (headerPos = 0; headerPos < strlen(line); headerPos++) {
-    if (line[headerPos] == ' ') {
-      break;
-    }
+void HandleScroll(GLFWwindow *window, double xOffset, double yOffset) {
+  (void)window;
+  TextView *view = &globalState.view;
+  if (view->font == NULL) {
+    return;
   }
 
-  return headerPos == prefixLen && strncmp(line, prefix, headerPos) == 0;
+  float step = view->font->lineHeight *
+               GetTextScale(view->font, &view->layout) * VIEW_SCROLL_LINES;
+  ScrollView(view->scrollX - (float)xOffset * step,
+             view->scrollY - (float)yOffset * step);
 }
 
-int GetLineAttrInt(const char *line, unsigned attrId) {
-  unsigned off = 0;
-  for (unsigned i = 0; i < strlen(line); i++) {
-    if (line[i] == '=') {
-      if (off == attrId) {
-        return (int)strtol(line + i + 1, NULL, 10);
-      }
-
-      off++;
-    }
-  }
-
-  return 0;
+void ScrollView(float scrollX, float scrollY) {
+  ScrollTextView(&globalState.view, scrollX, scrollY,
+                 globalState.height - VIEW_TOP - VIEW_MARGIN);
 }
 
-char *GetNextLine(char *line) { return strchr(line, '\n') + 1; }
-
-Mesh MakeGlyphQuad(float imgW, float imgH, float x, float y, float w, float h) {
-  Mesh mesh = {0};
-  float relW = w / imgW;
-  float relH = h / imgH;
-  // clang-format off
-  float vertices[] = {
-      // pos            // col            // uvs
-      relW, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, (x + w) / imgW, 1.0f - (y / imgH),       // top right
-      relW, relH, 0.0f, 1.0f, 1.0f, 1.0f, (x + w) / imgW, 1.0f - ((y + h) / imgH), // bottom right
-      0.0f, relH, 0.0f, 1.0f, 1.0f, 1.0f, x/imgW,         1.0f - ((y + h) / imgH), // bottom left
-      0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, x/imgW,         1.0f - (y / imgH),       // top left
+// Queued row by row, alternating fonts and sizes, the queue draws every
+// label, value and unit together. Values are clipped to the panel.
+void QueueDashboard(TextQueue *queue, const BitmapFont *font,
+                    const BitmapFont *unitFont, unsigned long long frame) {
+  static const char *labels[DASHBOARD_ROWS] = {
+      "requests", "errors", "latency", "cache hits",
+      "queue",    "workers", "memory", "uptime",
   };
-  // clang-format on
-  const unsigned short indices[] = {
-      0, 1, 3, // First triangle
-      1, 2, 3, // Second triangle
+  static const char *units[DASHBOARD_ROWS] = {
+      "/s", "/s", "ms", "%", "", "", "MB", "s",
+  };
+  TextLayout labelLayout = {.color = PACK_RGBA(200, 200, 200, 255),
+                            .size = 20.0f};
+  TextLayout valueLayout = {.color = PACK_RGBA(40, 60, 160, 255),
+                            .size = 24.0f};
+  TextLayout unitLayout = {.color = PACK_RGBA(90, 90, 90, 255),
+                           .size = 16.0f};
+  TextLayout titleLayout = {.color = PACK_RGBA(120, 60, 20, 255),
+                            .size = 32.0f};
+  TextDrawOptions values = {
+      .clip = {DASHBOARD_LEFT, DASHBOARD_TOP,
+               DASHBOARD_LEFT + DASHBOARD_WIDTH,
+               DASHBOARD_TOP + DASHBOARD_ROWS * DASHBOARD_ROW_HEIGHT},
   };
 
-  glGenVertexArrays(1, &mesh.vao);
-  glGenBuffers(1, &mesh.vbo);
-  glGenBuffers(1, &mesh.ebo);
-  glBindVertexArray(mesh.vao);
-
-  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
-               GL_STATIC_DRAW);
-
-  GLsizei vertexStride = 8 * sizeof(float);
-  // Position
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexStride,
-                        (void *)(0 * sizeof(float)));
-  glEnableVertexAttribArray(0);
-
-  // Color
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertexStride,
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  // UVs
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vertexStride,
-                        (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
-  return mesh;
-}
-
-void RenderText(BitmapFont font, float xPos, float yPos, const char *text) {
-  size_t textLen = strlen(text);
-  float xOffset = xPos;
-  float yOffset = yPos;
-
-  float proj[16] = {0};
-  MakeOrthoProj(proj, -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 100.0f);
-
-  for (size_t i = 0; i < textLen; i++) {
-    unsigned id = (unsigned)text[i];
-    unsigned vao = font.quads[id].vao;
-    if (vao == 0) {
-      Log(LOG_WARN, "TEXT: do not have a glyph for '%c' (%d)", id, (int)id);
-      continue;
-    }
-
-    float model[16] = {0};
-    float xRel = 0, yRel = 0;
-    WorldToViewport(&xRel, &yRel, xOffset + font.xos[id],
-                    yOffset + font.yos[id]);
-    MakeGlyphTransform(model, xRel, yRel);
-
-    unsigned pid = font.shaderProgramId;
-    glUseProgram(pid);
-    glBindTexture(GL_TEXTURE_2D, font.textureId);
-
-    glBindVertexArray(vao);
-    glUniformMatrix4fv(glGetUniformLocation(pid, "model"), 1, GL_TRUE, model);
-    glUniformMatrix4fv(glGetUniformLocation(pid, "proj"), 1, GL_FALSE, proj);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, NULL);
-
-    glBindVertexArray(0);
-    glUseProgram(0);
-
-    xOffset += font.xas[id];
+  // Queued first, drawn over the rows
+  QueueText(queue, font, &titleLayout, &(TextDrawOptions){.depth = 1},
+            DASHBOARD_LEFT, DASHBOARD_TOP - 40.0f, "Dashboard");
+  for (unsigned row = 0; row < DASHBOARD_ROWS; row++) {
+    float y = DASHBOARD_TOP + (float)row * DASHBOARD_ROW_HEIGHT;
+    char value[32];
+    snprintf(value, sizeof(value), "%llu",
+             (frame * (row + 1) * 7919ull) % 100000ull);
+    QueueText(queue, font, &labelLayout, NULL, DASHBOARD_LEFT, y,
+              labels[row]);
+    QueueText(queue, font, &valueLayout, &values, DASHBOARD_LEFT + 160.0f, y,
+              value);
+    QueueText(queue, unitFont, &unitLayout, NULL, DASHBOARD_LEFT + 300.0f,
+              y + 8.0f, units[row]);
   }
 }
-
-void MakeOrthoProj(float m[16], float l, float r, float t, float b, float n,
-                   float f) {
-  m[0] = 2 / (r - l);
-  m[3] = -(r + l) / (r - l);
-  m[5] = 2 / (t - b);
-  m[7] = -(t + b) / (t - b);
-  m[10] = -2 / (f - n);
-  m[11] = -(f + n) / (f - n);
-  m[15] = 1.0f;
-}
-
-void MakeGlyphTransform(float m[16], float x, float y) {
-  m[0] = 1.0f;
-  m[3] = x;
-  m[5] = 1.0f;
-  m[7] = y;
-  m[10] = 1.0f;
-  m[15] = 1.0f;
-}
-
-void WorldToViewport(float *vx, float *vy, float x, float y) {
-  *vx = (x / WINDOW_WIDTH * 2.0f) - 1.0f;
-  *vy = (-y / WINDOW_HEIGHT * 2.0f) + 1.0f;
-}
@@ -0,0 +1,349 @@
+#include "asset_reload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "font_desc.h"
+
+static const char *glyphShaderNames[GLYPH_SHADER_COUNT] = {
+    [GLYPH_SHADER_COVERAGE] = "glyph program",
+    [GLYPH_SHADER_SDF] = "distance field glyph program",
+};
+
+// Page files are relative to the descriptor
+static void WatchFontPages(AssetReloader *reloader) {
+  const char *slash = strrchr(reloader->descFilename, '/');
+  int dirLen = slash != NULL ? (int)(slash - reloader->descFilename + 1) : 0;
+  for (unsigned i = 0; i < reloader->desc.pageCount; i++) {
+    const char *file = reloader->desc.pages[i].file;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%.*s%s", file[0] == '/' ? 0 : dirLen,
+             reloader->descFilename, file);
+    WatchAssetFile(&reloader->watch, path, ASSET_FONT_ATLAS);
+  }
+}
+
+static FontDesc ReadFontDescFile(const char *descFilename) {
+  size_t size = 0;
+  char *data = ReadFileData(descFilename, &size);
+  if (data == NULL) {
+    return (FontDesc){.status = ERROR_CANNOT_LOAD_DESC_FILE};
+  }
+
+  FontDesc desc = ParseFontDesc(descFilename, data, size);
+  free(data);
+  return desc;
+}
+
+// A broken file keeps the font as it is, it is read again once fixed
+static void ReadFontFiles(AssetReloader *reloader, unsigned changes) {
+  const char *descFilename = reloader->descFilename;
+  unsigned parts = changes & ASSET_FONT_ATLAS ? FONT_PART_ATLAS : 0;
+  if (changes & ASSET_FONT_DESC) {
+    FontDesc desc = ReadFontDescFile(descFilename);
+    if (desc.status != SUCCESS) {
+      Log(LOG_WARN, "RELOAD: %s: could not parse, keeping the loaded font",
+          descFilename);
+      FreeFontDesc(&desc);
+      return;
+    }
+
+    // New pages are decoded again and watched instead of the old ones
+    parts |= FONT_PART_TABLES;
+    if (!HasSameFontAtlas(&desc, &reloader->desc)) {
+      parts |= FONT_PART_ATLAS;
+      UnwatchAssetFiles(&reloader->watch, ASSET_FONT_ATLAS);
+      FreeFontDesc(&reloader->desc);
+      reloader->desc = desc;
+      WatchFontPages(reloader);
+    } else {
+      FreeFontDesc(&reloader->desc);
+      reloader->desc = desc;
+    }
+  }
+
+  // Parts read before and not swapped in yet are read again with these
+  pthread_mutex_lock(&reloader->mutex);
+  if (reloader->fontReady) {
+    parts |= reloader->fontData.pixels != NULL ? FONT_PART_ATLAS : 0;
+    parts |= reloader->fontData.font.glyphs != NULL ? FONT_PART_TABLES : 0;
+    FreeBitmapFontData(&reloader->fontData);
+    reloader->fontReady = false;
+  }
+  pthread_mutex_unlock(&reloader->mutex);
+
+  double start = GetMonotonicTime();
+  BitmapFontData data =
+      ReadBitmapFontParts(&reloader->desc, descFilename, parts);
+  if (data.status == SUCCESS && data.pixels != NULL) {
+    ReduceAtlasChannels(&data);
+  }
+
+  if (data.status != SUCCESS) {
+    Log(LOG_WARN, "RELOAD: %s: could not read, keeping the loaded font",
+        descFilename);
+    FreeBitmapFontData(&data);
+    return;
+  }
+
+  Log(LOG_INFO, "RELOAD: %s: read %s%s%s in %.2f ms", descFilename,
+      data.font.glyphs != NULL ? "glyph tables" : "",
+      data.font.glyphs != NULL && data.pixels != NULL ? " and " : "",
+      data.pixels != NULL ? "atlas" : "",
+      (GetMonotonicTime() - start) * 1e3);
+  pthread_mutex_lock(&reloader->mutex);
+  reloader->fontData = data;
+  reloader->fontReady = true;
+  pthread_mutex_unlock(&reloader->mutex);
+}
+
+static void ReadShaderFiles(AssetReloader *reloader, GlyphShaderKind kind) {
+  const char *filenames[2] = {NULL};
+  GetGlyphShaderFiles(kind, &filenames[0], &filenames[1]);
+  char *codes[2] = {NULL};
+  for (unsigned i = 0; i < 2; i++) {
+    codes[i] = ReadTextFile(filenames[i]);
+    if (codes[i] == NULL) {
+      Log(LOG_WARN, "RELOAD: %s: could not read, keeping the %s",
+          filenames[i], glyphShaderNames[kind]);
+      if (i > 0) {
+        free(codes[0]);
+      }
+
+      return;
+    }
+  }
+
+  pthread_mutex_lock(&reloader->mutex);
+  for (unsigned i = 0; i < 2; i++) {
+    if (reloader->shaderCodes[kind][i] != NULL) {
+      free(reloader->shaderCodes[kind][i]);
+    }
+
+    reloader->shaderCodes[kind][i] = codes[i];
+  }
+  pthread_mutex_unlock(&reloader->mutex);
+}
+
+static void *RunAssetReloader(void *arg) {
+  AssetReloader *reloader = arg;
+  if (reloader->descFilename != NULL) {
+    reloader->desc = ReadFontDescFile(reloader->descFilename);
+    WatchAssetFile(&reloader->watch, reloader->descFilename,
+                   ASSET_FONT_DESC);
+    WatchFontPages(reloader);
+  }
+
+  // Both kinds share the vertex shader, it is watched once for each
+  for (unsigned kind = 0; kind < GLYPH_SHADER_COUNT; kind++) {
+    const char *vsFilename = NULL;
+    const char *fsFilename = NULL;
+    GetGlyphShaderFiles(kind, &vsFilename, &fsFilename);
+    WatchAssetFile(&reloader->watch, vsFilename, ASSET_GLYPH_SHADER(kind));
+    WatchAssetFile(&reloader->watch, fsFilename, ASSET_GLYPH_SHADER(kind));
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&reloader->mutex);
+    bool stopping = reloader->stopping;
+    pthread_mutex_unlock(&reloader->mutex);
+    if (stopping) {
+      break;
+    }
+
+    unsigned changes = WaitAssetChanges(&reloader->watch, ASSET_RELOAD_POLL_MS);
+    if (changes == 0) {
+      continue;
+    }
+
+    unsigned more = 0;
+    while ((more = WaitAssetChanges(&reloader->watch,
+                                    ASSET_RELOAD_SETTLE_MS)) != 0) {
+      changes |= more;
+    }
+
+    if (reloader->descFilename != NULL &&
+        (changes & (ASSET_FONT_DESC | ASSET_FONT_ATLAS))) {
+      ReadFontFiles(reloader, changes);
+    }
+
+    for (unsigned kind = 0; kind < GLYPH_SHADER_COUNT; kind++) {
+      if (changes & ASSET_GLYPH_SHADER(kind)) {
+        ReadShaderFiles(reloader, kind);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+StatusCode StartAssetReloader(AssetReloader *reloader, BitmapFont *font,
+                              const char *descFilename) {
+  *reloader = (AssetReloader){0};
+  reloader->watch = CreateAssetWatch();
+  if (reloader->watch.status != SUCCESS) {
+    reloader->status = reloader->watch.status;
+    return reloader->status;
+  }
+
+  if (font != NULL) {
+    reloader->font = font;
+    reloader->descFilename = strdup(descFilename);
+    if (reloader->descFilename == NULL) {
+      Log(LOG_ERROR, "RELOAD: could not allocate memory to watch %s",
+          descFilename);
+      DestroyAssetWatch(&reloader->watch);
+      reloader->status = ERROR_OUT_OF_MEMORY;
+      return reloader->status;
+    }
+  }
+
+  pthread_mutex_init(&reloader->mutex, NULL);
+  if (pthread_create(&reloader->thread, NULL, RunAssetReloader, reloader) !=
+      0) {
+    Log(LOG_ERROR, "RELOAD: could not start the reload thread");
+    pthread_mutex_destroy(&reloader->mutex);
+    DestroyAssetWatch(&reloader->watch);
+    if (reloader->descFilename != NULL) {
+      free(reloader->descFilename);
+    }
+
+    *reloader = (AssetReloader){.status = ERROR_OUT_OF_MEMORY};
+    return reloader->status;
+  }
+
+  return SUCCESS;
+}
+
+// On the GL thread, builds in progress are dropped
+void StopAssetReloader(AssetReloader *reloader) {
+  if (reloader->watch.fd <= 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&reloader->mutex);
+  reloader->stopping = true;
+  pthread_mutex_unlock(&reloader->mutex);
+  pthread_join(reloader->thread, NULL);
+
+  for (unsigned kind = 0; kind < GLYPH_SHADER_COUNT; kind++) {
+    CancelShaderBuild(&reloader->builds[kind]);
+    for (unsigned i = 0; i < 2; i++) {
+      if (reloader->shaderCodes[kind][i] != NULL) {
+        free(reloader->shaderCodes[kind][i]);
+      }
+    }
+  }
+
+  FreeBitmapFontData(&reloader->fontData);
+  FreeFontDesc(&reloader->desc);
+  if (reloader->descFilename != NULL) {
+    free(reloader->descFilename);
+  }
+
+  pthread_mutex_destroy(&reloader->mutex);
+  DestroyAssetWatch(&reloader->watch);
+  *reloader = (AssetReloader){0};
+}
+
+static void SwapFontParts(AssetReloader *reloader, BitmapFontData *data) {
+  bool tables = data->font.glyphs != NULL;
+  bool atlas = data->pixels != NULL;
+  double start = GetMonotonicTime();
+  if (!ReplaceBitmapFontParts(reloader->font, data)) {
+    Log(LOG_ERROR, "RELOAD: %s: could not swap in, keeping the loaded font",
+        reloader->descFilename);
+    reloader->stats.failures++;
+    return;
+  }
+
+  reloader->stats.tableSwaps += tables;
+  reloader->stats.atlasSwaps += atlas;
+  Log(LOG_INFO, "RELOAD: %s: swapped in %s%s%s in %.2f ms",
+      reloader->descFilename, tables ? "glyph tables" : "",
+      tables && atlas ? " and " : "", atlas ? "atlas" : "",
+      (GetMonotonicTime() - start) * 1e3);
+}
+
+// Advances the program build of a kind, swapping it in once linked for the
+// fonts drawn with it
+static void PollGlyphShaderBuild(AssetReloader *reloader, GlyphShaderKind kind,
+                                 BitmapFont *const fonts[],
+                                 unsigned fontCount) {
+  ShaderBuild *build = &reloader->builds[kind];
+  ShaderBuildState state = PollShaderBuild(build);
+  if (state == SHADER_BUILD_LINKED) {
+    ReplaceGlyphShader(kind, build->programId);
+    for (unsigned i = 0; i < fontCount; i++) {
+      RefreshGlyphShader(fonts[i]);
+    }
+
+    reloader->stats.programSwaps++;
+    Log(LOG_INFO, "RELOAD: %s relinked in %.2f ms", glyphShaderNames[kind],
+        (GetMonotonicTime() - reloader->buildStarts[kind]) * 1e3);
+    *build = (ShaderBuild){0};
+  } else if (state == SHADER_BUILD_FAILED) {
+    Log(LOG_WARN, "RELOAD: keeping the %s", glyphShaderNames[kind]);
+    reloader->stats.failures++;
+    *build = (ShaderBuild){0};
+  }
+}
+
+// Swaps in what was read since the last poll and advances the program
+// builds, on the GL thread between frames. Fonts are the ones drawn with the
+// glyph programs, they are refreshed when a program is relinked. Returns the
+// parts and programs swapped in.
+unsigned PollAssetReloader(AssetReloader *reloader, BitmapFont *const fonts[],
+                           unsigned fontCount) {
+  double start = GetMonotonicTime();
+  BitmapFontData fontData = {0};
+  bool fontReady = false;
+  char *shaderCodes[GLYPH_SHADER_COUNT][2] = {{NULL}};
+  AssetReloadStats before = reloader->stats;
+
+  // Fonts still loading are reloaded once they are done
+  pthread_mutex_lock(&reloader->mutex);
+  if (reloader->fontReady && reloader->font->status == SUCCESS) {
+    fontData = reloader->fontData;
+    fontReady = true;
+    reloader->fontData = (BitmapFontData){0};
+    reloader->fontReady = false;
+  }
+
+  memcpy(shaderCodes, reloader->shaderCodes, sizeof(shaderCodes));
+  memset(reloader->shaderCodes, 0, sizeof(reloader->shaderCodes));
+  pthread_mutex_unlock(&reloader->mutex);
+
+  if (fontReady) {
+    SwapFontParts(reloader, &fontData);
+  }
+
+  // Newer sources replace a build in progress
+  for (unsigned kind = 0; kind < GLYPH_SHADER_COUNT; kind++) {
+    if (shaderCodes[kind][0] != NULL) {
+      if (IsGlyphShaderLoaded(kind)) {
+        CancelShaderBuild(&reloader->builds[kind]);
+        reloader->builds[kind] =
+            StartShaderBuild(shaderCodes[kind][0], shaderCodes[kind][1],
+                             glyphShaderNames[kind]);
+        reloader->buildStarts[kind] = GetMonotonicTime();
+      }
+
+      free(shaderCodes[kind][0]);
+      free(shaderCodes[kind][1]);
+    }
+
+    PollGlyphShaderBuild(reloader, kind, fonts, fontCount);
+  }
+
+  AssetReloadStats *stats = &reloader->stats;
+  stats->pollTime = GetMonotonicTime() - start;
+  if (stats->pollTime > stats->maxPollTime) {
+    stats->maxPollTime = stats->pollTime;
+  }
+
+  return stats->tableSwaps - before.tableSwaps + stats->atlasSwaps -
+         before.atlasSwaps + stats->programSwaps - before.programSwaps;
+}
@@ -0,0 +1,66 @@
+#ifndef SFR_ASSET_RELOAD_H
+#define SFR_ASSET_RELOAD_H
+
+#include <pthread.h>
+
+#include "asset_watch.h"
+#include "common.h"
+#include "font.h"
+#include "gfx.h"
+
+// How long the reload thread sleeps on the watch before checking whether it
+// is stopping
+#define ASSET_RELOAD_POLL_MS 100
+// Writers touch a file several times, or a descriptor and its pages one
+// after the other: files are read once nothing has changed for this long
+#define ASSET_RELOAD_SETTLE_MS 50
+
+// Masks of the watched files
+#define ASSET_FONT_DESC (1u << 0)
+#define ASSET_FONT_ATLAS (1u << 1)
+#define ASSET_GLYPH_SHADER(kind) (1u << (2 + (kind)))
+
+typedef struct {
+  unsigned tableSwaps;
+  unsigned atlasSwaps;
+  unsigned programSwaps;
+  unsigned failures;
+  // GL thread seconds of the last poll and of the longest one
+  double pollTime;
+  double maxPollTime;
+} AssetReloadStats;
+
+// Reloads the font and glyph program files while the app runs. A thread
+// waits for the files to change and reads them: a descriptor into new glyph
+// tables, and the atlas pages too only when the descriptor names other ones,
+// pages into new atlas pixels, shader files into sources. Polling on the GL
+// thread between frames swaps the font parts in, and builds the programs
+// without waiting for the driver when it compiles them in the background.
+typedef struct {
+  StatusCode status;
+  AssetWatch watch;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  bool stopping;
+  // Font loaded from descFilename, NULL to watch the glyph programs only
+  BitmapFont *font;
+  char *descFilename;
+  // Descriptor the font was last read from, reload thread only
+  FontDesc desc;
+  // Read and waiting for the next poll
+  BitmapFontData fontData;
+  bool fontReady;
+  char *shaderCodes[GLYPH_SHADER_COUNT][2];
+  // GL thread only
+  ShaderBuild builds[GLYPH_SHADER_COUNT];
+  double buildStarts[GLYPH_SHADER_COUNT];
+  AssetReloadStats stats;
+} AssetReloader;
+
+StatusCode StartAssetReloader(AssetReloader *reloader, BitmapFont *font,
+                              const char *descFilename);
+void StopAssetReloader(AssetReloader *reloader);
+unsigned PollAssetReloader(AssetReloader *reloader, BitmapFont *const fonts[],
+                           unsigned fontCount);
+
+#endif // SFR_ASSET_RELOAD_H
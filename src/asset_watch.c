@@ -0,0 +1,126 @@
+#include "asset_watch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Written once a writer closes the file or moves a new one over it
+#define ASSET_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+AssetWatch CreateAssetWatch(void) {
+  AssetWatch watch = {0};
+  watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch.fd < 0) {
+    Log(LOG_ERROR, "WATCH: could not create an inotify instance");
+    watch.status = ERROR_NOT_SUPPORTED;
+  }
+
+  return watch;
+}
+
+void DestroyAssetWatch(AssetWatch *watch) {
+  if (watch->fd > 0) {
+    close(watch->fd);
+  }
+
+  *watch = (AssetWatch){0};
+}
+
+bool WatchAssetFile(AssetWatch *watch, const char *filename, unsigned mask) {
+  if (watch->fileCount == ASSET_WATCH_MAX_FILES) {
+    Log(LOG_ERROR, "WATCH: more than %u files watched",
+        ASSET_WATCH_MAX_FILES);
+    return false;
+  }
+
+  char dir[PATH_MAX] = ".";
+  const char *name = filename;
+  const char *slash = strrchr(filename, '/');
+  if (slash != NULL) {
+    snprintf(dir, sizeof(dir), "%.*s",
+             slash == filename ? 1 : (int)(slash - filename), filename);
+    name = slash + 1;
+  }
+
+  // Adding a directory again returns its watch, no duplicates are made
+  int dirWatch = inotify_add_watch(watch->fd, dir, ASSET_WATCH_EVENTS);
+  if (dirWatch < 0) {
+    Log(LOG_ERROR, "WATCH: could not watch %s", dir);
+    return false;
+  }
+
+  WatchedAsset *file = &watch->files[watch->fileCount++];
+  file->dirWatch = dirWatch;
+  file->mask = mask;
+  snprintf(file->name, sizeof(file->name), "%s", name);
+  return true;
+}
+
+// Directories stay watched, their events are just not matched anymore
+void UnwatchAssetFiles(AssetWatch *watch, unsigned mask) {
+  unsigned kept = 0;
+  for (unsigned i = 0; i < watch->fileCount; i++) {
+    if ((watch->files[i].mask & mask) == 0) {
+      watch->files[kept++] = watch->files[i];
+    }
+  }
+
+  watch->fileCount = kept;
+}
+
+// Masks of the watched files changed since the last call, waiting up to
+// timeoutMs for the first change. Returns 0 on timeout.
+unsigned WaitAssetChanges(AssetWatch *watch, int timeoutMs) {
+  struct pollfd pollFd = {.fd = watch->fd, .events = POLLIN};
+  if (poll(&pollFd, 1, timeoutMs) <= 0) {
+    return 0;
+  }
+
+  unsigned changes = 0;
+  char events[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length = 0;
+  while ((length = read(watch->fd, events, sizeof(events))) > 0) {
+    const char *cursor = events;
+    while (cursor < events + length) {
+      const struct inotify_event *event = (const struct inotify_event *)cursor;
+      cursor += sizeof(struct inotify_event) + event->len;
+      if (event->len == 0) {
+        continue;
+      }
+
+      for (unsigned i = 0; i < watch->fileCount; i++) {
+        const WatchedAsset *file = &watch->files[i];
+        if (file->dirWatch == event->wd &&
+            strcmp(file->name, event->name) == 0) {
+          changes |= file->mask;
+        }
+      }
+    }
+  }
+
+  return changes;
+}
+
+#else
+
+AssetWatch CreateAssetWatch(void) {
+  Log(LOG_ERROR, "WATCH: file watching is only supported on Linux");
+  return (AssetWatch){.status = ERROR_NOT_SUPPORTED};
+}
+
+void DestroyAssetWatch(AssetWatch *watch) { *watch = (AssetWatch){0}; }
+
+bool WatchAssetFile(AssetWatch *watch, const char *filename, unsigned mask) {
+  return false;
+}
+
+void UnwatchAssetFiles(AssetWatch *watch, unsigned mask) {}
+
+unsigned WaitAssetChanges(AssetWatch *watch, int timeoutMs) { return 0; }
+
+#endif
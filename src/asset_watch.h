@@ -0,0 +1,35 @@
+#ifndef SFR_ASSET_WATCH_H
+#define SFR_ASSET_WATCH_H
+
+#include <limits.h>
+
+#include "common.h"
+
+#define ASSET_WATCH_MAX_FILES 64
+
+typedef struct {
+  // Watch descriptor of the directory of the file
+  int dirWatch;
+  char name[NAME_MAX + 1];
+  unsigned mask;
+} WatchedAsset;
+
+// Files watched for changes through their directories, as editors and
+// exporters often write a new file over the old one rather than into it.
+// Every file has a mask, waiting returns the masks of the files changed.
+// Linux only (inotify), elsewhere creating the watch fails with
+// ERROR_NOT_SUPPORTED.
+typedef struct {
+  StatusCode status;
+  int fd;
+  WatchedAsset files[ASSET_WATCH_MAX_FILES];
+  unsigned fileCount;
+} AssetWatch;
+
+AssetWatch CreateAssetWatch(void);
+void DestroyAssetWatch(AssetWatch *watch);
+bool WatchAssetFile(AssetWatch *watch, const char *filename, unsigned mask);
+void UnwatchAssetFiles(AssetWatch *watch, unsigned mask);
+unsigned WaitAssetChanges(AssetWatch *watch, int timeoutMs);
+
+#endif // SFR_ASSET_WATCH_H
@@ -0,0 +1,152 @@
+#include "common.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Messages are formatted by the caller and written to stdout by a logging
+// thread, so logging from the render loop never blocks on the terminal. When
+// the queue is full messages are dropped and counted instead.
+typedef struct {
+  pthread_once_t once;
+  pthread_mutex_t mutex;
+  pthread_cond_t queued;
+  pthread_cond_t drained;
+  pthread_t thread;
+  bool running;
+  bool stopping;
+  bool writing;
+  unsigned head;
+  unsigned count;
+  unsigned dropped;
+  char messages[LOG_QUEUE_SIZE][LOG_MESSAGE_SIZE];
+} LogQueue;
+
+static LogQueue logQueue = {
+    .once = PTHREAD_ONCE_INIT,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .queued = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static void *RunLogThread(void *arg) {
+  (void)arg;
+  char message[LOG_MESSAGE_SIZE];
+  pthread_mutex_lock(&logQueue.mutex);
+  for (;;) {
+    while (logQueue.count == 0 && logQueue.dropped == 0 &&
+           !logQueue.stopping) {
+      pthread_cond_wait(&logQueue.queued, &logQueue.mutex);
+    }
+
+    if (logQueue.count == 0 && logQueue.dropped == 0) {
+      break;
+    }
+
+    unsigned dropped = logQueue.dropped;
+    logQueue.dropped = 0;
+    if (logQueue.count > 0) {
+      memcpy(message, logQueue.messages[logQueue.head], LOG_MESSAGE_SIZE);
+      logQueue.head = (logQueue.head + 1) % LOG_QUEUE_SIZE;
+      logQueue.count--;
+    } else {
+      message[0] = '\0';
+    }
+
+    logQueue.writing = true;
+    pthread_mutex_unlock(&logQueue.mutex);
+
+    if (dropped > 0) {
+      printf("WARN  | LOG: dropped %u messages\n", dropped);
+    }
+
+    fputs(message, stdout);
+
+    pthread_mutex_lock(&logQueue.mutex);
+    logQueue.writing = false;
+    if (logQueue.count == 0) {
+      fflush(stdout);
+      pthread_cond_broadcast(&logQueue.drained);
+    }
+  }
+
+  pthread_mutex_unlock(&logQueue.mutex);
+  return NULL;
+}
+
+static void StopLogThread(void) {
+  pthread_mutex_lock(&logQueue.mutex);
+  logQueue.stopping = true;
+  pthread_cond_signal(&logQueue.queued);
+  pthread_mutex_unlock(&logQueue.mutex);
+  pthread_join(logQueue.thread, NULL);
+
+  pthread_mutex_lock(&logQueue.mutex);
+  logQueue.running = false;
+  pthread_mutex_unlock(&logQueue.mutex);
+}
+
+static void StartLogThread(void) {
+  // Without the thread messages are written right away
+  if (pthread_create(&logQueue.thread, NULL, RunLogThread, NULL) != 0) {
+    return;
+  }
+
+  logQueue.running = true;
+  atexit(StopLogThread);
+}
+
+void Log(LogLevel level, const char *fmt, ...) {
+  static const char *levels[] = {
+      [LOG_INFO] = "INFO",
+      [LOG_WARN] = "WARN",
+      [LOG_ERROR] = "ERROR",
+  };
+
+  char message[LOG_MESSAGE_SIZE];
+  int len = snprintf(message, sizeof(message), "%s  | ", levels[level]);
+  va_list vaList;
+  va_start(vaList, fmt);
+  vsnprintf(message + len, sizeof(message) - (size_t)len - 1, fmt, vaList);
+  va_end(vaList);
+  strcat(message, "\n");
+
+  pthread_once(&logQueue.once, StartLogThread);
+  pthread_mutex_lock(&logQueue.mutex);
+  if (!logQueue.running || logQueue.stopping) {
+    pthread_mutex_unlock(&logQueue.mutex);
+    fputs(message, stdout);
+    return;
+  }
+
+  if (logQueue.count == LOG_QUEUE_SIZE) {
+    logQueue.dropped++;
+  } else {
+    unsigned tail = (logQueue.head + logQueue.count) % LOG_QUEUE_SIZE;
+    memcpy(logQueue.messages[tail], message, sizeof(message));
+    logQueue.count++;
+  }
+
+  pthread_cond_signal(&logQueue.queued);
+  pthread_mutex_unlock(&logQueue.mutex);
+}
+
+void FlushLog(void) {
+  pthread_mutex_lock(&logQueue.mutex);
+  while (logQueue.running &&
+         (logQueue.count > 0 || logQueue.dropped > 0 || logQueue.writing)) {
+    pthread_cond_wait(&logQueue.drained, &logQueue.mutex);
+  }
+
+  pthread_mutex_unlock(&logQueue.mutex);
+  fflush(stdout);
+}
+
+double GetMonotonicTime(void) {
+  struct timespec now = {0};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
@@ -0,0 +1,34 @@
+#ifndef SFR_COMMON_H
+#define SFR_COMMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LOG_QUEUE_SIZE 256
+#define LOG_MESSAGE_SIZE 512
+
+typedef enum {
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR,
+} LogLevel;
+
+typedef enum {
+  SUCCESS,
+  PENDING,
+  ERROR_CANNOT_LOAD_DESC_FILE,
+  ERROR_CANNOT_LOAD_ATLAS_FILE,
+  ERROR_CANNOT_LOAD_GLYPH_SHADER,
+  ERROR_INVALID_DESCRIPTION,
+  ERROR_OUT_OF_MEMORY,
+  ERROR_CANNOT_LOAD_PACK_FILE,
+  ERROR_INVALID_PACK,
+  ERROR_NOT_SUPPORTED,
+} StatusCode;
+
+void Log(LogLevel level, const char *fmt, ...);
+// Waits until every queued message has been written
+void FlushLog(void);
+double GetMonotonicTime(void);
+
+#endif // SFR_COMMON_H
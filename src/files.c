@@ -0,0 +1,241 @@
+#include "files.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <png.h>
+
+#include "common.h"
+
+char *ReadTextFile(const char *filename) {
+  return ReadFileData(filename, NULL);
+}
+
+char *ReadFileData(const char *filename, size_t *size) {
+  FILE *file = fopen(filename, "rbe");
+  if (file == NULL) {
+    Log(LOG_ERROR, "FILE: could not read file: %s", filename);
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  size_t dataLen = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  // Always null terminated so text can be used as is
+  char *data = calloc(dataLen + 1, sizeof(char));
+  if (data == NULL) {
+    Log(LOG_ERROR, "FILE: could not allocate memory for file: %s", filename);
+    fclose(file);
+    return NULL;
+  }
+
+  dataLen = fread(data, sizeof(char), dataLen, file);
+  fclose(file);
+  if (size != NULL) {
+    *size = dataLen;
+  }
+
+  return data;
+}
+
+void *MapFile(const char *filename, size_t *size) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    Log(LOG_ERROR, "FILE: could not open file: %s", filename);
+    return NULL;
+  }
+
+  struct stat fileStat = {0};
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+    Log(LOG_ERROR, "FILE: could not map empty file: %s", filename);
+    close(fd);
+    return NULL;
+  }
+
+  // Private mapping: pages are only copied if the caller writes to them
+  void *data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    Log(LOG_ERROR, "FILE: could not map file: %s", filename);
+    return NULL;
+  }
+
+  *size = (size_t)fileStat.st_size;
+  return data;
+}
+
+void UnmapFile(void *data, size_t size) {
+  if (data != NULL) {
+    munmap(data, size);
+  }
+}
+
+// libpng reports errors by jumping back to the function that set the jump
+// buffer, each reader function sets its own
+bool OpenPNGFile(PNGReader *reader, const char *filename) {
+  png_byte header[8] = {0};
+  png_structp pngHandler = NULL;
+  png_infop pngInfo = NULL;
+  *reader = (PNGReader){0};
+
+  reader->file = fopen(filename, "rbe");
+  if (reader->file == NULL) {
+    Log(LOG_ERROR, "PNG: could not open file: %s", filename);
+    return false;
+  }
+
+  // Read header
+  if (fread(header, 1, sizeof(header), reader->file) < 8) {
+    Log(LOG_ERROR, "PNG: file is too short to be an PNG file: %s", filename);
+    goto fail;
+  }
+
+  if (!png_check_sig(header, 8)) {
+    Log(LOG_ERROR, "PNG: not a valid PNG file: %s", filename);
+    goto fail;
+  }
+
+  // Create read struct
+  pngHandler = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (pngHandler == NULL) {
+    Log(LOG_ERROR, "PNG: cannot initialize the library for file: %s", filename);
+    goto fail;
+  }
+
+  reader->png = pngHandler;
+
+  // Get info struct
+  pngInfo = png_create_info_struct(pngHandler);
+  if (pngInfo == NULL) {
+    Log(LOG_ERROR, "PNG: cannot initialize pngInfo for file: %s", filename);
+    goto fail;
+  }
+
+  reader->info = pngInfo;
+
+  // Exception handling code
+  if (setjmp(png_jmpbuf(pngHandler))) {
+    Log(LOG_ERROR, "PNG: could not read header of file: %s", filename);
+    goto fail;
+  }
+
+  png_init_io(pngHandler, reader->file);
+  png_set_sig_bytes(pngHandler, sizeof(header)); // shift header
+  png_read_info(pngHandler, pngInfo);            // read info
+
+  // Always decoded to 8-bit RGBA
+  png_set_expand(pngHandler);
+  png_set_strip_16(pngHandler);
+  png_set_gray_to_rgb(pngHandler);
+  png_set_add_alpha(pngHandler, 0xFF, PNG_FILLER_AFTER);
+  reader->passes = (unsigned)png_set_interlace_handling(pngHandler);
+
+  // Get image width and height from info
+  png_get_IHDR(pngHandler, pngInfo, &reader->width, &reader->height, NULL,
+               NULL, NULL, NULL, NULL);
+  png_read_update_info(pngHandler, pngInfo);
+  if (png_get_rowbytes(pngHandler, pngInfo) != (size_t)reader->width * 4) {
+    Log(LOG_ERROR, "PNG: could not decode file to RGBA: %s", filename);
+    goto fail;
+  }
+
+  Log(LOG_INFO, "PNG: %s: %u x %u", filename, reader->width, reader->height);
+  return true;
+
+fail:
+  ClosePNGFile(reader);
+  return false;
+}
+
+// The next rowCount rows, bottom up the way GL expects them, width * 4
+// bytes apart. Rows are decoded one at a time straight into pixels, so an
+// image can be read in bands, except interlaced images which are only
+// complete after their last pass and are read whole.
+bool ReadPNGRows(PNGReader *reader, unsigned char *pixels, unsigned rowCount) {
+  png_structp pngHandler = reader->png;
+  size_t rowBytes = (size_t)reader->width * 4;
+  if (rowCount > reader->height - reader->row ||
+      (reader->passes > 1 && rowCount != reader->height)) {
+    Log(LOG_ERROR, "PNG: cannot read %u rows from row %u", rowCount,
+        reader->row);
+    return false;
+  }
+
+  if (setjmp(png_jmpbuf(pngHandler))) {
+    Log(LOG_ERROR, "PNG: could not decode image data");
+    return false;
+  }
+
+  for (unsigned pass = 0; pass < reader->passes; pass++) {
+    for (unsigned i = 0; i < rowCount; i++) {
+      png_read_row(pngHandler, pixels + (rowCount - 1 - i) * rowBytes, NULL);
+    }
+  }
+
+  reader->row += rowCount;
+  return true;
+}
+
+void ClosePNGFile(PNGReader *reader) {
+  png_structp pngHandler = reader->png;
+  png_infop pngInfo = reader->info;
+  if (pngHandler != NULL) {
+    png_destroy_read_struct(&pngHandler, pngInfo != NULL ? &pngInfo : NULL,
+                            NULL);
+  }
+
+  if (reader->file != NULL) {
+    fclose(reader->file);
+  }
+
+  *reader = (PNGReader){0};
+}
+
+unsigned char *ReadPNGFile(const char *filename, unsigned *width,
+                           unsigned *height) {
+  PNGReader reader = {0};
+  if (!OpenPNGFile(&reader, filename)) {
+    return NULL;
+  }
+
+  // Allocate image block
+  size_t size = (size_t)reader.width * reader.height * 4;
+  unsigned char *imageData = malloc(size);
+  if (imageData == NULL) {
+    Log(LOG_ERROR, "PNG: could not allocate memory for file: %s (%zu bytes)",
+        filename, size);
+  } else if (!ReadPNGRows(&reader, imageData, reader.height)) {
+    free(imageData);
+    imageData = NULL;
+  }
+
+  *width = reader.width;
+  *height = reader.height;
+  ClosePNGFile(&reader);
+  return imageData;
+}
+
+bool WritePNGFile(const char *filename, const unsigned char *pixels,
+                  unsigned width, unsigned height, unsigned channels) {
+  // Rows are written top to bottom, as they are in memory
+  png_image image = {
+      .version = PNG_IMAGE_VERSION,
+      .width = width,
+      .height = height,
+      .format = channels == 1 ? PNG_FORMAT_GRAY : PNG_FORMAT_RGBA,
+  };
+
+  if (!png_image_write_to_file(&image, filename, 0, pixels, 0, NULL)) {
+    Log(LOG_ERROR, "PNG: could not write file: %s (%s)", filename,
+        image.message);
+    return false;
+  }
+
+  return true;
+}
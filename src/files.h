@@ -0,0 +1,34 @@
+#ifndef SFR_FILES_H
+#define SFR_FILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// PNG file read up to its pixels, decoded to 8-bit RGBA. The libpng structs
+// are kept opaque here.
+typedef struct {
+  FILE *file;
+  void *png;
+  void *info;
+  unsigned width;
+  unsigned height;
+  unsigned passes;
+  // Next row to decode
+  unsigned row;
+} PNGReader;
+
+char *ReadTextFile(const char *filename);
+char *ReadFileData(const char *filename, size_t *size);
+void *MapFile(const char *filename, size_t *size);
+void UnmapFile(void *data, size_t size);
+bool OpenPNGFile(PNGReader *reader, const char *filename);
+bool ReadPNGRows(PNGReader *reader, unsigned char *pixels,
+                 unsigned rowCount);
+void ClosePNGFile(PNGReader *reader);
+unsigned char *ReadPNGFile(const char *filename, unsigned *width,
+                           unsigned *height);
+bool WritePNGFile(const char *filename, const unsigned char *pixels,
+                  unsigned width, unsigned height, unsigned channels);
+
+#endif // SFR_FILES_H
@@ -0,0 +1,1396 @@
+#include "font.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include "files.h"
+#include "font_desc.h"
+#include "font_pack.h"
+#include "gfx.h"
+#include "glyph_cache.h"
+
+typedef struct {
+  char path[PATH_MAX];
+  unsigned char *pixels;
+  unsigned width;
+  unsigned height;
+} FontPageLoad;
+
+typedef struct {
+  FontPageLoad *loads;
+  unsigned count;
+  atomic_uint next;
+} FontPageQueue;
+
+// Fonts are built on the loader threads
+static atomic_uint nextFontId = 1;
+
+static void *LoadFontPages(void *arg) {
+  FontPageQueue *queue = arg;
+  unsigned layer = 0;
+  while ((layer = atomic_fetch_add(&queue->next, 1)) < queue->count) {
+    FontPageLoad *load = &queue->loads[layer];
+    load->pixels = ReadPNGFile(load->path, &load->width, &load->height);
+  }
+
+  return NULL;
+}
+
+// Byte of a BMFont channel (1 blue, 2 green, 4 red, 8 alpha) in an RGBA8
+// texel, glyphs in every channel are read from the alpha
+static int GetChannelByte(unsigned channel) {
+  switch (channel) {
+  case 1:
+    return 2;
+  case 2:
+    return 1;
+  case 4:
+    return 0;
+  case 8:
+  case 15:
+    return 3;
+  default:
+    return -1;
+  }
+}
+
+// Whether the glyphs are in single channels of the pages, the pages are
+// the layers of the atlas otherwise. Warns about unknown channels unless
+// descFilename is NULL.
+static bool IsFontAtlasPacked(const FontDesc *desc, const char *descFilename) {
+  bool packed = false;
+  for (unsigned i = 0; i < desc->charCount; i++) {
+    unsigned channel = desc->chars[i].channel;
+    if (GetChannelByte(channel) < 0) {
+      if (descFilename != NULL) {
+        Log(LOG_WARN, "FONT: %s: char %u is in channels %u, keeping RGBA",
+            descFilename, desc->chars[i].id, channel);
+      }
+
+      return false;
+    }
+
+    packed = packed || channel != 15;
+  }
+
+  return packed;
+}
+
+// Packed fonts (glyphs in a single channel) get an R8 layer for every page
+// channel holding glyphs, other fonts keep their RGBA atlas
+static StatusCode SplitAtlasChannels(BitmapFontData *data,
+                                     const FontDesc *desc,
+                                     const char *descFilename) {
+  BitmapFont *font = &data->font;
+  size_t layerTexels = (size_t)data->atlasWidth * data->atlasHeight;
+  if (!IsFontAtlasPacked(desc, descFilename)) {
+    return SUCCESS;
+  }
+
+  // Number the page channels in use, page by page
+  unsigned slotCount = data->atlasLayers * 4;
+  unsigned *layers = calloc(slotCount, sizeof(unsigned));
+  if (layers == NULL) {
+    Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u channels",
+        descFilename, slotCount);
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  for (unsigned i = 0; i < desc->charCount; i++) {
+    const FontDescChar *glyph = &desc->chars[i];
+    if (glyph->page >= data->atlasLayers) {
+      Log(LOG_ERROR, "FONT: %s: char %u is on missing page %u", descFilename,
+          glyph->id, glyph->page);
+      free(layers);
+      return ERROR_INVALID_DESCRIPTION;
+    }
+
+    layers[glyph->page * 4 + GetChannelByte(glyph->channel)] = 1;
+  }
+
+  unsigned layerCount = 0;
+  for (unsigned slot = 0; slot < slotCount; slot++) {
+    layers[slot] = layers[slot] ? ++layerCount : 0;
+  }
+
+  unsigned char *split = malloc(layerTexels * layerCount);
+  if (split == NULL) {
+    Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u layers",
+        descFilename, layerCount);
+    free(layers);
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  for (unsigned slot = 0; slot < slotCount; slot++) {
+    if (layers[slot] == 0) {
+      continue;
+    }
+
+    const unsigned char *src = data->pixels + layerTexels * 4 * (slot / 4);
+    unsigned char *dst = split + layerTexels * (layers[slot] - 1);
+    for (size_t i = 0; i < layerTexels; i++) {
+      dst[i] = src[i * 4 + slot % 4];
+    }
+  }
+
+  for (unsigned i = 0; i < desc->charCount; i++) {
+    const FontDescChar *glyph = &desc->chars[i];
+    unsigned index = GetGlyphIndex(font, glyph->id);
+    if (index != NO_GLYPH) {
+      unsigned slot = glyph->page * 4 + GetChannelByte(glyph->channel);
+      font->glyphs[index].layer = (float)(layers[slot] - 1);
+    }
+  }
+
+  free(layers);
+  free(data->pixels);
+  data->pixels = split;
+  data->atlasLayers = layerCount;
+  data->atlasFormat = ATLAS_R8;
+  data->atlasColor = ATLAS_COLOR_WHITE;
+  return SUCCESS;
+}
+
+// Pixels of pack fonts live in the mapping, those of opened fonts in their
+// buffer, which is deleted on the GL thread
+static void FreeFontAtlasData(BitmapFontData *data) {
+  if (data->atlasBufferId != 0) {
+    glDeleteBuffers(1, &data->atlasBufferId);
+  } else if (data->pixels != NULL && data->font.packData == NULL) {
+    free(data->pixels);
+  }
+
+  if (data->pageFiles != NULL) {
+    free(data->pageFiles);
+  }
+
+  data->pixels = NULL;
+  data->pageFiles = NULL;
+  data->atlasBufferId = 0;
+}
+
+// Texture for the atlas of any format, with mipmaps unless it is block
+// compressed. Returns 0 if the format is not supported.
+static unsigned MakeAtlasTexture(const BitmapFontData *data,
+                                 const unsigned char *pixels, size_t *memory) {
+  unsigned width = data->atlasWidth;
+  unsigned height = data->atlasHeight;
+  unsigned layers = data->atlasLayers;
+  bool compressed = data->atlasFormat == ATLAS_RGTC1;
+  if (compressed && !GLAD_GL_VERSION_3_0 &&
+      !GLAD_GL_ARB_texture_compression_rgtc) {
+    Log(LOG_ERROR, "FONT: RGTC compressed atlases are not supported");
+    return 0;
+  }
+
+  *memory = 0;
+  for (unsigned level = 0;; level++) {
+    unsigned levelWidth = width >> level > 0 ? width >> level : 1;
+    unsigned levelHeight = height >> level > 0 ? height >> level : 1;
+    *memory += GetAtlasSize(data->atlasFormat, levelWidth, levelHeight, layers);
+    if (compressed || (levelWidth == 1 && levelHeight == 1)) {
+      break;
+    }
+  }
+
+  if (data->atlasFormat == ATLAS_RGBA8) {
+    return MakeTextureArray(pixels, width, height, layers);
+  }
+
+  int color = data->atlasColor == ATLAS_COLOR_WHITE      ? GL_ONE
+              : data->atlasColor == ATLAS_COLOR_COVERAGE ? GL_RED
+                                                         : GL_ZERO;
+  int swizzle[4] = {color, color, color, GL_RED};
+  unsigned textureId = 0;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+  // Compressed mipmaps cannot be generated, those atlases are drawn from
+  // their full size only
+  if (compressed) {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glCompressedTexImage3D(
+        GL_TEXTURE_2D_ARRAY, 0, GL_COMPRESSED_RED_RGTC1, (int)width,
+        (int)height, (int)layers, 0,
+        (int)GetAtlasSize(ATLAS_RGTC1, width, height, layers), pixels);
+    return textureId;
+  }
+
+  // Single byte rows are not aligned to 4 bytes
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, (int)width, (int)height,
+               (int)layers, 0, GL_RED, GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  return textureId;
+}
+
+// Pages decoded into a pixel unpack buffer are copied by GL from it, the
+// buffer is released once the copy is done
+static unsigned UploadAtlas(BitmapFontData *data, size_t *memory) {
+  if (data->atlasBufferId == 0) {
+    return MakeAtlasTexture(data, data->pixels, memory);
+  }
+
+  unsigned textureId = 0;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, data->atlasBufferId);
+  data->pixels = NULL;
+
+  // The buffer contents are lost when unmapping fails
+  if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+    Log(LOG_ERROR, "FONT: atlas buffer lost before its upload");
+  } else {
+    textureId = MakeAtlasTexture(data, NULL, memory);
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glDeleteBuffers(1, &data->atlasBufferId);
+  data->atlasBufferId = 0;
+  return textureId;
+}
+
+// Page files are relative to the descriptor
+static void MakeFontPagePath(char *path, size_t size, const char *descFilename,
+                             const char *file) {
+  const char *slash = strrchr(descFilename, '/');
+  int dirLen = 0;
+  if (file[0] != '/' && slash != NULL) {
+    dirLen = (int)(slash - descFilename + 1);
+  }
+
+  snprintf(path, size, "%.*s%s", dirLen, descFilename, file);
+}
+
+// Page ids are the atlas layers, each one used once
+static bool AreFontPageIdsValid(const FontDesc *desc,
+                                const char *descFilename) {
+  unsigned layerCount = desc->pageCount;
+  if (layerCount == 0) {
+    Log(LOG_ERROR, "FONT: %s: no atlas pages", descFilename);
+    return false;
+  }
+
+  for (unsigned i = 0; i < layerCount; i++) {
+    bool repeated = false;
+    for (unsigned j = 0; j < i; j++) {
+      repeated = repeated || desc->pages[j].id == desc->pages[i].id;
+    }
+
+    if (desc->pages[i].id >= layerCount || repeated) {
+      Log(LOG_ERROR, "FONT: %s: page ids must go from 0 to %u", descFilename,
+          layerCount - 1);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+BitmapFont LoadBitmapFont(const char *descFilename) {
+  BitmapFontData data = OpenBitmapFontData(descFilename);
+
+  // Decoded again when the atlas turns out not to be single channel
+  while (data.status == SUCCESS && data.pageFiles != NULL &&
+         MapFontAtlasBuffer(&data)) {
+    DecodeFontPages(&data);
+  }
+
+  return UploadBitmapFont(&data);
+}
+
+BitmapFont LoadBitmapFontPack(const char *packFilename) {
+  BitmapFontData data = MapBitmapFontData(packFilename);
+  return UploadBitmapFont(&data);
+}
+
+// Page files are checked and opened for their size only, the pixels are
+// decoded by DecodeFontPages
+static StatusCode OpenFontPages(BitmapFontData *data, const FontDesc *desc,
+                                const char *descFilename) {
+  unsigned layerCount = desc->pageCount;
+  if (!AreFontPageIdsValid(desc, descFilename)) {
+    return ERROR_CANNOT_LOAD_ATLAS_FILE;
+  }
+
+  data->pageFiles = calloc(layerCount, sizeof(*data->pageFiles));
+  if (data->pageFiles == NULL) {
+    Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u pages",
+        descFilename, layerCount);
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  for (unsigned i = 0; i < layerCount; i++) {
+    const FontDescPage *page = &desc->pages[i];
+    char *path = data->pageFiles[page->id];
+    MakeFontPagePath(path, PATH_MAX, descFilename, page->file);
+
+    PNGReader reader = {0};
+    if (!OpenPNGFile(&reader, path)) {
+      return ERROR_CANNOT_LOAD_ATLAS_FILE;
+    }
+
+    unsigned width = reader.width;
+    unsigned height = reader.height;
+    ClosePNGFile(&reader);
+    if (i > 0 && (width != data->atlasWidth || height != data->atlasHeight)) {
+      Log(LOG_ERROR, "FONT: %s: page %u is %ux%u, page %u is %ux%u",
+          descFilename, page->id, width, height, desc->pages[0].id,
+          data->atlasWidth, data->atlasHeight);
+      return ERROR_CANNOT_LOAD_ATLAS_FILE;
+    }
+
+    data->atlasWidth = width;
+    data->atlasHeight = height;
+  }
+
+  // Most atlases are coverage only, they are decoded as such until a texel
+  // says otherwise
+  data->atlasLayers = layerCount;
+  data->atlasFormat = ATLAS_R8;
+  return SUCCESS;
+}
+
+// Whole, or with only the tables and the page sizes read when the atlas is
+// to be streamed
+static BitmapFontData ReadBitmapFontFile(const char *descFilename,
+                                         bool streamAtlas) {
+  char *fontDescData = NULL;
+  size_t fontDescSize = 0;
+  FontDesc desc = {0};
+  BitmapFontData data = {0};
+
+  fontDescData = ReadFileData(descFilename, &fontDescSize);
+  if (fontDescData == NULL) {
+    data.status = ERROR_CANNOT_LOAD_DESC_FILE;
+    goto terminate;
+  }
+
+  desc = ParseFontDesc(descFilename, fontDescData, fontDescSize);
+  if (desc.status != SUCCESS) {
+    data.status = desc.status;
+    goto terminate;
+  }
+
+  // Packed atlases are split on the CPU
+  if (streamAtlas && !IsFontAtlasPacked(&desc, NULL)) {
+    data = ReadBitmapFontParts(&desc, descFilename, FONT_PART_TABLES);
+    if (data.status == SUCCESS) {
+      data.status = OpenFontPages(&data, &desc, descFilename);
+    }
+  } else {
+    data = ReadBitmapFontParts(&desc, descFilename, FONT_PARTS_ALL);
+  }
+
+terminate:
+  FreeFontDesc(&desc);
+  if (fontDescData != NULL) {
+    free(fontDescData);
+  }
+
+  return data;
+}
+
+BitmapFontData ReadBitmapFontData(const char *descFilename) {
+  return ReadBitmapFontFile(descFilename, false);
+}
+
+// Reads the tables of a descriptor but leaves its atlas pages to be decoded
+// straight into a pixel unpack buffer, without the pixels ever being held in
+// client memory: MapFontAtlasBuffer maps the buffer on the GL thread, then
+// DecodeFontPages fills it on any thread. Packed atlases are read whole, as
+// by ReadBitmapFontData.
+BitmapFontData OpenBitmapFontData(const char *descFilename) {
+  return ReadBitmapFontFile(descFilename, true);
+}
+
+// Sized for the format the pages are decoded to, a buffer mapped before is
+// replaced. GL thread only.
+bool MapFontAtlasBuffer(BitmapFontData *data) {
+  size_t size = GetAtlasSize(data->atlasFormat, data->atlasWidth,
+                             data->atlasHeight, data->atlasLayers);
+  if (data->atlasBufferId == 0) {
+    glGenBuffers(1, &data->atlasBufferId);
+  }
+
+  // New storage unmaps the old one
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, data->atlasBufferId);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL,
+               GL_STREAM_DRAW);
+  data->pixels = glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (data->pixels == NULL) {
+    Log(LOG_ERROR, "FONT: could not map %zu bytes to decode the atlas into",
+        size);
+    data->status = ERROR_OUT_OF_MEMORY;
+    return false;
+  }
+
+  return true;
+}
+
+// Single channel atlases are decoded a band of rows at a time, only the
+// alpha of the band is written to the buffer. At the first texel that is
+// not coverage only, the atlas is left RGBA with no pixels: once the buffer
+// is mapped again at that size, pages are decoded whole straight into it.
+void DecodeFontPages(BitmapFontData *data) {
+  PNGReader reader = {0};
+  unsigned char *band = NULL;
+  unsigned bandCapacity = 0;
+  unsigned width = data->atlasWidth;
+  unsigned height = data->atlasHeight;
+  size_t rowBytes = (size_t)width * 4;
+  bool reduced = data->atlasFormat == ATLAS_R8;
+  bool black = true;
+  bool white = true;
+  bool coverage = true;
+
+  for (unsigned layer = 0; layer < data->atlasLayers; layer++) {
+    const char *path = data->pageFiles[layer];
+    unsigned char *layerPixels =
+        data->pixels + GetAtlasSize(data->atlasFormat, width, height, layer);
+    if (!OpenPNGFile(&reader, path)) {
+      data->status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+      goto terminate;
+    }
+
+    if (reader.width != width || reader.height != height) {
+      Log(LOG_ERROR, "FONT: %s changed size to %ux%u while loading", path,
+          reader.width, reader.height);
+      data->status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+      goto terminate;
+    }
+
+    if (!reduced) {
+      if (!ReadPNGRows(&reader, layerPixels, height)) {
+        data->status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+        goto terminate;
+      }
+
+      ClosePNGFile(&reader);
+      continue;
+    }
+
+    // Interlaced pages are only complete after their last pass, in one band
+    unsigned bandRows = (unsigned)(ATLAS_BAND_BYTES / rowBytes);
+    if (reader.passes > 1 || bandRows > height) {
+      bandRows = height;
+    } else if (bandRows == 0) {
+      bandRows = 1;
+    }
+
+    if (bandRows > bandCapacity) {
+      if (band != NULL) {
+        free(band);
+      }
+
+      band = malloc(bandRows * rowBytes);
+      bandCapacity = band != NULL ? bandRows : 0;
+      if (band == NULL) {
+        Log(LOG_ERROR, "FONT: could not allocate memory for %u rows of %s",
+            bandRows, path);
+        data->status = ERROR_OUT_OF_MEMORY;
+        goto terminate;
+      }
+    }
+
+    for (unsigned top = 0; top < height;) {
+      unsigned rows = height - top < bandRows ? height - top : bandRows;
+      if (!ReadPNGRows(&reader, band, rows)) {
+        data->status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+        goto terminate;
+      }
+
+      // Bands go bottom up like their rows
+      unsigned char *alpha =
+          layerPixels + (size_t)(height - top - rows) * width;
+      size_t texelCount = (size_t)rows * width;
+      for (size_t i = 0; i < texelCount; i++) {
+        const unsigned char *texel = band + i * 4;
+        bool gray = texel[0] == texel[1] && texel[1] == texel[2];
+        black = black && gray && texel[0] == 0;
+        white = white && gray && texel[0] == 255;
+        coverage = coverage && gray && texel[0] == texel[3];
+        alpha[i] = texel[3];
+      }
+
+      if (!black && !white && !coverage) {
+        data->atlasFormat = ATLAS_RGBA8;
+        data->pixels = NULL;
+        goto terminate;
+      }
+
+      top += rows;
+    }
+
+    ClosePNGFile(&reader);
+  }
+
+  if (reduced) {
+    data->atlasColor = black   ? ATLAS_COLOR_BLACK
+                       : white ? ATLAS_COLOR_WHITE
+                               : ATLAS_COLOR_COVERAGE;
+  }
+
+  free(data->pageFiles);
+  data->pageFiles = NULL;
+
+terminate:
+  ClosePNGFile(&reader);
+  if (band != NULL) {
+    free(band);
+  }
+}
+
+// Tables, atlas pixels or both of a parsed descriptor, the data holds only
+// the parts read. Packed atlases are split by the glyph channels, so their
+// tables and pixels are always read together.
+BitmapFontData ReadBitmapFontParts(const FontDesc *desc,
+                                   const char *descFilename, unsigned parts) {
+  BitmapFontData data = {0};
+  if (parts != FONT_PARTS_ALL && IsFontAtlasPacked(desc, NULL)) {
+    parts = FONT_PARTS_ALL;
+  }
+
+  if (parts & FONT_PART_TABLES) {
+    data.status = BuildBitmapFont(&data.font, desc, descFilename);
+    if (data.status != SUCCESS) {
+      return data;
+    }
+  }
+
+  if (parts & FONT_PART_ATLAS) {
+    data.pixels = ReadFontPages(desc, descFilename, &data.atlasWidth,
+                                &data.atlasHeight);
+    data.atlasLayers = desc->pageCount;
+    if (data.pixels == NULL) {
+      data.status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+      return data;
+    }
+  }
+
+  if (parts == FONT_PARTS_ALL) {
+    data.status = SplitAtlasChannels(&data, desc, descFilename);
+  }
+
+  return data;
+}
+
+// Whether the tables of either descriptor go with the atlas of the other:
+// same page files, and pages that are the atlas layers
+bool HasSameFontAtlas(const FontDesc *desc, const FontDesc *other) {
+  if (desc->pageCount != other->pageCount || IsFontAtlasPacked(desc, NULL) ||
+      IsFontAtlasPacked(other, NULL)) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < desc->pageCount; i++) {
+    if (desc->pages[i].id != other->pages[i].id ||
+        strcmp(desc->pages[i].file, other->pages[i].file) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+BitmapFontData MapBitmapFontData(const char *packFilename) {
+  BitmapFontData data = {0};
+  FontPack pack = MapFontPack(packFilename);
+  if (pack.status != SUCCESS) {
+    data.status = pack.status;
+    return data;
+  }
+
+  // The font owns the mapping from now on, it is released on unload. Glyph
+  // and kerning tables are used in place.
+  const FontPackHeader *header = pack.header;
+  BitmapFont *font = &data.font;
+  font->packData = pack.data;
+  font->packSize = pack.size;
+  font->id = atomic_fetch_add(&nextFontId, 1);
+  font->fontSize = header->fontSize;
+  font->lineHeight = header->lineHeight;
+  font->base = header->base;
+  font->distanceRange = header->distanceRange;
+  font->glyphCount = header->glyphCount;
+  font->glyphs = GetFontPackSection(&pack, header->glyphTable);
+  font->xas = GetFontPackSection(&pack, header->glyphAdvances);
+  font->visible = GetFontPackSection(&pack, header->glyphVisible);
+  font->glyphPageIndex = GetFontPackSection(&pack, header->glyphPageIndex);
+  font->glyphPages = GetFontPackSection(&pack, header->glyphPages);
+  font->glyphPageCount = header->glyphPageCount;
+  font->kerningFilter = GetFontPackSection(&pack, header->kerningFilter);
+  font->kerningKeys = GetFontPackSection(&pack, header->kerningKeys);
+  font->kerningAmounts = GetFontPackSection(&pack, header->kerningAmounts);
+  font->kerningMask = header->kerningSlots - 1;
+  font->kerningShift = header->kerningShift;
+  for (unsigned codepoint = 0; codepoint < 128; codepoint++) {
+    font->asciiGlyphs[codepoint] = GetGlyphIndex(font, codepoint);
+  }
+
+  MakeAsciiRunTable(font);
+
+  // The atlas is uploaded straight from the mapping
+  data.pixels = GetFontPackSection(&pack, header->atlasPixels);
+  data.atlasWidth = header->atlasWidth;
+  data.atlasHeight = header->atlasHeight;
+  data.atlasLayers = header->atlasLayers;
+  data.atlasFormat = (AtlasFormat)header->atlasFormat;
+  data.atlasColor = (AtlasColor)header->atlasColor;
+  return data;
+}
+
+BitmapFont UploadBitmapFont(BitmapFontData *data) {
+  if (data->status == SUCCESS && data->pageFiles != NULL) {
+    Log(LOG_ERROR, "FONT: atlas pages uploaded before they were decoded");
+    data->status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+  }
+
+  if (data->status == SUCCESS) {
+    ReduceAtlasChannels(data);
+  }
+
+  BitmapFont font = data->font;
+  font.status = data->status;
+  if (font.status == SUCCESS && !LoadGlyphShader(&font)) {
+    font.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
+  }
+
+  if (font.status == SUCCESS) {
+    UploadGlyphTable(&font);
+    font.textureId = UploadAtlas(data, &font.atlasMemory);
+    if (font.textureId == 0) {
+      font.status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+    }
+  }
+
+  if (font.status == SUCCESS) {
+    size_t rgbaMemory = GetAtlasSize(ATLAS_RGBA8, data->atlasWidth,
+                                     data->atlasHeight, data->atlasLayers) *
+                        4 / 3;
+    Log(LOG_INFO,
+        "FONT: %ux%u atlas, %u layers of %s: %zu KB of texture memory "
+        "(%zu KB as RGBA8), %zu KB of glyph table",
+        data->atlasWidth, data->atlasHeight, data->atlasLayers,
+        GetAtlasFormatName(data->atlasFormat), font.atlasMemory / 1024,
+        rgbaMemory / 1024,
+        font.glyphCount * sizeof(GlyphTableEntry) / 1024);
+  }
+
+  // The font takes the tables, only the pixels are left
+  FreeFontAtlasData(data);
+  *data = (BitmapFontData){0};
+  return font;
+}
+
+// Swaps the parts read by ReadBitmapFontParts into a font uploaded whole
+// from a descriptor, keeping its other GL objects: new pixels go to a new
+// atlas texture, new tables to the glyph table buffer. Tables come with a
+// new font id, so text laid out in the font is laid out again. Either both
+// parts are swapped or none. Takes the data.
+bool ReplaceBitmapFontParts(BitmapFont *font, BitmapFontData *data) {
+  bool replaced = false;
+  if (font->packData != NULL || font->glyphCache != NULL ||
+      font->distanceRange > 0.0f) {
+    Log(LOG_ERROR, "FONT: only fonts uploaded whole from a descriptor can "
+                   "be reloaded");
+    goto terminate;
+  }
+
+  if (data->status != SUCCESS) {
+    goto terminate;
+  }
+
+  if (data->pixels != NULL) {
+    size_t atlasMemory = 0;
+    unsigned textureId = UploadAtlas(data, &atlasMemory);
+    if (textureId == 0) {
+      goto terminate;
+    }
+
+    glDeleteTextures(1, &font->textureId);
+    font->textureId = textureId;
+    font->atlasMemory = atlasMemory;
+  }
+
+  // Everything but the GL objects comes from the new tables
+  if (data->font.glyphs != NULL) {
+    BitmapFont old = *font;
+    *font = data->font;
+    font->status = old.status;
+    font->distanceRange = old.distanceRange;
+    font->textureId = old.textureId;
+    font->atlasMemory = old.atlasMemory;
+    font->glyphTableBufferId = old.glyphTableBufferId;
+    font->glyphTableTextureId = old.glyphTableTextureId;
+    font->shaderProgramId = old.shaderProgramId;
+    font->projLocation = old.projLocation;
+    font->tex0Location = old.tex0Location;
+    font->glyphsLocation = old.glyphsLocation;
+    font->originLocation = old.originLocation;
+    font->styleLocations = old.styleLocations;
+    data->font = (BitmapFont){0};
+    FreeBitmapFontTables(&old);
+
+    // The buffer texture sees the new store of its buffer
+    glBindBuffer(GL_TEXTURE_BUFFER, font->glyphTableBufferId);
+    glBufferData(GL_TEXTURE_BUFFER,
+                 (GLsizeiptr)(font->glyphCount * sizeof(GlyphTableEntry)),
+                 font->glyphs, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  replaced = true;
+
+terminate:
+  FreeBitmapFontData(data);
+  return replaced;
+}
+
+// Keeps the atlas on the CPU and uploads only the glyphs in use into a
+// cacheSize square texture, for fonts whose atlas does not fit in memory
+BitmapFont UploadCachedBitmapFont(BitmapFontData *data, unsigned cacheSize) {
+  if (data->status == SUCCESS &&
+      (data->pageFiles != NULL || data->atlasBufferId != 0)) {
+    Log(LOG_ERROR, "FONT: glyph caches need the atlas in client memory");
+    data->status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+  }
+
+  if (data->status == SUCCESS) {
+    ReduceAtlasChannels(data);
+  }
+
+  BitmapFont font = data->font;
+  font.status = data->status;
+  if (font.status == SUCCESS && !LoadGlyphShader(&font)) {
+    font.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
+  }
+
+  if (font.status == SUCCESS) {
+    UploadGlyphTable(&font);
+    font.glyphCache = CreateGlyphCache(&font, data, cacheSize);
+    if (font.glyphCache == NULL) {
+      font.status = ERROR_CANNOT_LOAD_ATLAS_FILE;
+    }
+  }
+
+  if (font.status == SUCCESS) {
+    GlyphCache *cache = font.glyphCache;
+    font.textureId = cache->textureId;
+    font.atlasMemory = (size_t)cache->size * cache->size * cache->texelSize;
+    Log(LOG_INFO,
+        "FONT: %ux%u glyph cache of %s for a %ux%u atlas of %u layers: %zu "
+        "KB of texture memory",
+        cache->size, cache->size, GetAtlasFormatName(data->atlasFormat),
+        data->atlasWidth, data->atlasHeight, data->atlasLayers,
+        font.atlasMemory / 1024);
+  }
+
+  // Unless the cache took them
+  FreeFontAtlasData(data);
+  *data = (BitmapFontData){0};
+  return font;
+}
+
+// Coverage only atlases, whose color channels are black, white or the alpha
+// itself everywhere, keep just the alpha. Decoded atlases stay RGBA until
+// then, as the CPU rasterizer blends those fastest.
+void ReduceAtlasChannels(BitmapFontData *data) {
+  size_t texelCount =
+      (size_t)data->atlasWidth * data->atlasHeight * data->atlasLayers;
+  unsigned char *pixels = data->pixels;
+
+  // Streamed pages are reduced as they are decoded
+  if (data->atlasFormat != ATLAS_RGBA8 || data->font.packData != NULL ||
+      data->pageFiles != NULL || data->atlasBufferId != 0) {
+    return;
+  }
+
+  bool black = true;
+  bool white = true;
+  bool coverage = true;
+  for (size_t i = 0; i < texelCount; i++) {
+    const unsigned char *texel = pixels + i * 4;
+    bool gray = texel[0] == texel[1] && texel[1] == texel[2];
+    black = black && gray && texel[0] == 0;
+    white = white && gray && texel[0] == 255;
+    coverage = coverage && gray && texel[0] == texel[3];
+    if (!black && !white && !coverage) {
+      return;
+    }
+  }
+
+  // In place, every texel moves to a lower offset
+  for (size_t i = 0; i < texelCount; i++) {
+    pixels[i] = pixels[i * 4 + 3];
+  }
+
+  unsigned char *shrunk = realloc(pixels, texelCount);
+  data->pixels = shrunk != NULL ? shrunk : pixels;
+  data->atlasFormat = ATLAS_R8;
+  data->atlasColor = black   ? ATLAS_COLOR_BLACK
+                     : white ? ATLAS_COLOR_WHITE
+                             : ATLAS_COLOR_COVERAGE;
+}
+
+void FreeBitmapFontData(BitmapFontData *data) {
+  FreeFontAtlasData(data);
+  FreeBitmapFontTables(&data->font);
+  *data = (BitmapFontData){0};
+}
+
+// Stands in for fonts that are still loading, every printable ASCII
+// character is a box drawn from a single white texel
+BitmapFont LoadPlaceholderFont(float fontSize) {
+  static const unsigned char white[4] = {255, 255, 255, 255};
+  FontDescChar chars['~' - ' ' + 1] = {0};
+  FontDescPage page = {0};
+  int boxWidth = fontSize >= 2.0f ? (int)(fontSize * 0.5f) : 1;
+  int boxHeight = fontSize >= 2.0f ? (int)(fontSize * 0.6f) : 1;
+  FontDesc desc = {
+      .fontSize = (int)fontSize,
+      .lineHeight = (int)fontSize,
+      .base = (int)(fontSize * 0.8f),
+      .scaleW = boxWidth,
+      .scaleH = boxHeight,
+      .pages = &page,
+      .pageCount = 1,
+      .chars = chars,
+      .charCount = sizeof(chars) / sizeof(chars[0]),
+  };
+
+  for (unsigned i = 0; i < desc.charCount; i++) {
+    unsigned codepoint = ' ' + i;
+    bool space = codepoint == ' ';
+    chars[i] = (FontDescChar){
+        .id = codepoint,
+        .width = space ? 0 : boxWidth,
+        .height = space ? 0 : boxHeight,
+        .xOffset = (int)(fontSize * 0.05f),
+        .yOffset = desc.base - boxHeight,
+        .xAdvance = (int)(fontSize * 0.6f),
+    };
+  }
+
+  BitmapFont font = {0};
+  font.status = BuildBitmapFont(&font, &desc, "placeholder");
+  if (font.status == SUCCESS && !LoadGlyphShader(&font)) {
+    font.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
+  }
+
+  if (font.status == SUCCESS) {
+    UploadGlyphTable(&font);
+    font.textureId = MakeTextureArray(white, 1, 1, 1);
+    font.atlasMemory = sizeof(white);
+  }
+
+  return font;
+}
+
+void UnloadBitmapFont(BitmapFont font) {
+  ReleaseGlyphShader(&font);
+
+  if (font.textureId != 0) {
+    glDeleteTextures(1, &font.textureId);
+  }
+
+  if (font.glyphTableTextureId != 0) {
+    glDeleteTextures(1, &font.glyphTableTextureId);
+  }
+
+  if (font.glyphTableBufferId != 0) {
+    glDeleteBuffers(1, &font.glyphTableBufferId);
+  }
+
+  // Before the tables, the cache may read the atlas from the pack mapping
+  if (font.glyphCache != NULL) {
+    DestroyGlyphCache(font.glyphCache);
+  }
+
+  FreeBitmapFontTables(&font);
+}
+
+StatusCode BuildBitmapFont(BitmapFont *font, const FontDesc *desc,
+                           const char *name) {
+  font->id = atomic_fetch_add(&nextFontId, 1);
+  font->fontSize = (float)desc->fontSize;
+  font->lineHeight = (float)desc->lineHeight;
+  font->base = (float)desc->base;
+  float scaleW = (float)desc->scaleW;
+  float scaleH = (float)desc->scaleH;
+
+  // One more slot for the missing glyph
+  unsigned capacity = desc->charCount < MAX_GLYPHS ? desc->charCount + 1
+                                                   : MAX_GLYPHS + 1;
+  font->glyphs = calloc(capacity, sizeof(GlyphTableEntry));
+  font->xas = calloc(capacity, sizeof(float));
+  font->visible = calloc(capacity, sizeof(bool));
+  font->glyphPageIndex = calloc(GLYPH_PAGE_COUNT, sizeof(unsigned short));
+  if (font->glyphs == NULL || font->xas == NULL || font->visible == NULL ||
+      font->glyphPageIndex == NULL) {
+    Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u glyphs", name,
+        capacity);
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  // Number the pages in use first so the pool is allocated once, page 0
+  // stays empty for every other page
+  unsigned pageCount = 1;
+  for (unsigned i = 0; i < desc->charCount; i++) {
+    unsigned codepoint = desc->chars[i].id;
+    if (codepoint <= MAX_CODEPOINT &&
+        font->glyphPageIndex[codepoint / GLYPH_PAGE_SIZE] == 0) {
+      font->glyphPageIndex[codepoint / GLYPH_PAGE_SIZE] = pageCount++;
+    }
+  }
+
+  font->glyphPages = calloc(pageCount, sizeof(GlyphPage));
+  if (font->glyphPages == NULL) {
+    Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u glyph pages",
+        name, pageCount);
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  font->glyphPageCount = pageCount;
+  font->glyphCount = 1;
+
+  unsigned skipped = 0;
+  for (unsigned i = 0; i < desc->charCount; i++) {
+    const FontDescChar *glyph = &desc->chars[i];
+    unsigned codepoint = glyph->id;
+    // Checked before skipping, the atlas split reads the pages of all chars
+    if (glyph->page >= desc->pageCount) {
+      Log(LOG_ERROR, "FONT: %s: char %u is on missing page %u", name,
+          codepoint, glyph->page);
+      return ERROR_INVALID_DESCRIPTION;
+    }
+
+    if (codepoint > MAX_CODEPOINT) {
+      skipped++;
+      continue;
+    }
+
+    unsigned short *index =
+        &font->glyphPages[font->glyphPageIndex[codepoint / GLYPH_PAGE_SIZE]]
+                         [codepoint % GLYPH_PAGE_SIZE];
+    if (*index == NO_GLYPH) {
+      if (font->glyphCount == capacity) {
+        skipped++;
+        continue;
+      }
+
+      *index = (unsigned short)font->glyphCount++;
+    }
+
+    float x = (float)glyph->x;
+    float y = (float)glyph->y;
+    float w = (float)glyph->width;
+    float h = (float)glyph->height;
+    font->glyphs[*index] = (GlyphTableEntry){
+        .uvs = {x / scaleW, 1.0f - (y / scaleH), (x + w) / scaleW,
+                1.0f - ((y + h) / scaleH)},
+        .size = {w, h},
+        .offset = {(float)glyph->xOffset, (float)glyph->yOffset},
+        .layer = (float)glyph->page,
+    };
+    font->xas[*index] = (float)glyph->xAdvance;
+    font->visible[*index] = w > 0.0f && h > 0.0f;
+  }
+
+  if (skipped > 0) {
+    Log(LOG_WARN, "FONT: %s: skipped %u characters out of range", name,
+        skipped);
+  }
+
+  for (unsigned codepoint = 0; codepoint < 128; codepoint++) {
+    font->asciiGlyphs[codepoint] = GetGlyphIndex(font, codepoint);
+  }
+
+  if (!MakeKerningTable(font, desc->kerningCount)) {
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  for (unsigned i = 0; i < desc->kerningCount; i++) {
+    const FontDescKerning *kerning = &desc->kernings[i];
+    unsigned first = GetGlyphIndex(font, kerning->first);
+    unsigned second = GetGlyphIndex(font, kerning->second);
+    if (first == NO_GLYPH || second == NO_GLYPH) {
+      continue;
+    }
+
+    AddKerningPair(font, first, second, (float)kerning->amount);
+  }
+
+  MakeAsciiRunTable(font);
+  return SUCCESS;
+}
+
+void FreeBitmapFontTables(BitmapFont *font) {
+  if (font->asciiRuns != NULL) {
+    free(font->asciiRuns);
+    font->asciiRuns = NULL;
+  }
+
+  // Tables of packs live in the mapping
+  if (font->packData != NULL) {
+    UnmapFile(font->packData, font->packSize);
+    font->packData = NULL;
+    return;
+  }
+
+  void *tables[] = {
+      font->glyphs,        font->xas,         font->visible,
+      font->glyphPageIndex, font->glyphPages, font->kerningFilter,
+      font->kerningKeys,   font->kerningAmounts,
+  };
+  for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+    if (tables[i] != NULL) {
+      free(tables[i]);
+    }
+  }
+}
+
+// Decodes every page into one buffer of consecutive layers, page ids being
+// the layers. Decoding is spread over a few threads, the calling one included.
+unsigned char *ReadFontPages(const FontDesc *desc, const char *descFilename,
+                             unsigned *width, unsigned *height) {
+  unsigned char *pixels = NULL;
+  unsigned layerCount = desc->pageCount;
+  pthread_t threads[MAX_PAGE_LOAD_THREADS - 1];
+  unsigned threadCount = 0;
+  FontPageQueue queue = {0};
+
+  if (!AreFontPageIdsValid(desc, descFilename)) {
+    return NULL;
+  }
+
+  queue.loads = calloc(layerCount, sizeof(FontPageLoad));
+  queue.count = layerCount;
+  if (queue.loads == NULL) {
+    Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u pages",
+        descFilename, layerCount);
+    return NULL;
+  }
+
+  for (unsigned i = 0; i < layerCount; i++) {
+    const FontDescPage *page = &desc->pages[i];
+    MakeFontPagePath(queue.loads[page->id].path,
+                     sizeof(queue.loads[page->id].path), descFilename,
+                     page->file);
+  }
+
+  // A thread that cannot be started only makes the load slower
+  while (threadCount + 1 < layerCount &&
+         threadCount < MAX_PAGE_LOAD_THREADS - 1 &&
+         pthread_create(&threads[threadCount], NULL, LoadFontPages, &queue) ==
+             0) {
+    threadCount++;
+  }
+
+  LoadFontPages(&queue);
+  for (unsigned i = 0; i < threadCount; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  const FontPageLoad *first = &queue.loads[0];
+  for (unsigned i = 0; i < layerCount; i++) {
+    const FontPageLoad *load = &queue.loads[i];
+    if (load->pixels == NULL) {
+      goto terminate;
+    }
+
+    if (load->width != first->width || load->height != first->height) {
+      Log(LOG_ERROR, "FONT: %s: page %u is %ux%u, page 0 is %ux%u",
+          descFilename, i, load->width, load->height, first->width,
+          first->height);
+      goto terminate;
+    }
+  }
+
+  // Single page fonts keep the decoded page as it is
+  size_t layerSize = (size_t)first->width * first->height * 4;
+  if (layerCount == 1) {
+    pixels = queue.loads[0].pixels;
+    queue.loads[0].pixels = NULL;
+  } else {
+    pixels = malloc(layerSize * layerCount);
+    if (pixels == NULL) {
+      Log(LOG_ERROR, "FONT: %s: could not allocate memory for %u pages",
+          descFilename, layerCount);
+      goto terminate;
+    }
+
+    for (unsigned i = 0; i < layerCount; i++) {
+      memcpy(pixels + layerSize * i, queue.loads[i].pixels, layerSize);
+    }
+  }
+
+  *width = first->width;
+  *height = first->height;
+
+terminate:
+  for (unsigned i = 0; i < layerCount; i++) {
+    if (queue.loads[i].pixels != NULL) {
+      free(queue.loads[i].pixels);
+    }
+  }
+
+  free(queue.loads);
+  return pixels;
+}
+
+// Every font of a kind draws with the same program, so text in several fonts
+// only needs to bind their textures. Programs are made and deleted on the GL
+// thread, as the first font using them is uploaded and the last unloaded.
+static GlyphShader glyphShaders[GLYPH_SHADER_COUNT];
+
+static const char *glyphShaderFiles[GLYPH_SHADER_COUNT][2] = {
+    [GLYPH_SHADER_COVERAGE] = {ASSETS_GLYPH_VS, ASSETS_GLYPH_FS},
+    [GLYPH_SHADER_SDF] = {ASSETS_GLYPH_VS, ASSETS_GLYPH_SDF_FS},
+};
+
+static GlyphShaderKind GetGlyphShaderKind(const BitmapFont *font) {
+  return font->distanceRange > 0.0f ? GLYPH_SHADER_SDF : GLYPH_SHADER_COVERAGE;
+}
+
+static GlyphShader *GetGlyphShader(const BitmapFont *font) {
+  return &glyphShaders[GetGlyphShaderKind(font)];
+}
+
+// Caches the uniform locations, the atlas is always bound to the first unit
+// and the glyph table to the second one
+static GlyphShader MakeGlyphShader(unsigned program) {
+  GlyphShader shader = {
+      .programId = program,
+      .projLocation = glGetUniformLocation(program, "proj"),
+      .tex0Location = glGetUniformLocation(program, "tex0"),
+      .glyphsLocation = glGetUniformLocation(program, "glyphs"),
+      .originLocation = glGetUniformLocation(program, "origin"),
+      .styleLocations =
+          {
+              .scale = glGetUniformLocation(program, "scale"),
+              .distanceRange = glGetUniformLocation(program, "distanceRange"),
+              .outlineWidth = glGetUniformLocation(program, "outlineWidth"),
+              .outlineColor = glGetUniformLocation(program, "outlineColor"),
+              .shadowOffset = glGetUniformLocation(program, "shadowOffset"),
+              .shadowSoftness = glGetUniformLocation(program, "shadowSoftness"),
+              .shadowColor = glGetUniformLocation(program, "shadowColor"),
+          },
+  };
+  glUseProgram(program);
+  glUniform1i(shader.tex0Location, 0);
+  glUniform1i(shader.glyphsLocation, 1);
+  glUniform1f(shader.styleLocations.scale, 1.0f);
+  glUseProgram(0);
+  return shader;
+}
+
+static void SetFontGlyphShader(BitmapFont *font, const GlyphShader *shader) {
+  font->shaderProgramId = shader->programId;
+  font->projLocation = shader->projLocation;
+  font->tex0Location = shader->tex0Location;
+  font->glyphsLocation = shader->glyphsLocation;
+  font->originLocation = shader->originLocation;
+  font->styleLocations = shader->styleLocations;
+}
+
+bool LoadGlyphShader(BitmapFont *font) {
+  GlyphShader *shader = GetGlyphShader(font);
+  if (shader->programId == 0) {
+    const char **files = glyphShaderFiles[GetGlyphShaderKind(font)];
+    unsigned program = LoadShader(files[0], files[1]);
+    if (program == 0) {
+      return false;
+    }
+
+    *shader = MakeGlyphShader(program);
+  }
+
+  shader->users++;
+  SetFontGlyphShader(font, shader);
+  return true;
+}
+
+void ReleaseGlyphShader(BitmapFont *font) {
+  GlyphShader *shader = GetGlyphShader(font);
+  if (font->shaderProgramId == 0 || shader->programId != font->shaderProgramId) {
+    return;
+  }
+
+  if (--shader->users == 0) {
+    glDeleteProgram(shader->programId);
+    *shader = (GlyphShader){0};
+  }
+
+  font->shaderProgramId = 0;
+}
+
+void GetGlyphShaderFiles(GlyphShaderKind kind, const char **vsFilename,
+                         const char **fsFilename) {
+  *vsFilename = glyphShaderFiles[kind][0];
+  *fsFilename = glyphShaderFiles[kind][1];
+}
+
+bool IsGlyphShaderLoaded(GlyphShaderKind kind) {
+  return glyphShaders[kind].programId != 0;
+}
+
+// Swaps the program of a kind for one relinked from edited sources and
+// deletes the old one, taking the new one. Fonts drawn with the program
+// must be refreshed with RefreshGlyphShader before they are drawn again.
+void ReplaceGlyphShader(GlyphShaderKind kind, unsigned programId) {
+  GlyphShader *shader = &glyphShaders[kind];
+  if (shader->programId == 0) {
+    glDeleteProgram(programId);
+    return;
+  }
+
+  unsigned users = shader->users;
+  glDeleteProgram(shader->programId);
+  *shader = MakeGlyphShader(programId);
+  shader->users = users;
+}
+
+void RefreshGlyphShader(BitmapFont *font) {
+  const GlyphShader *shader = GetGlyphShader(font);
+  if (font->shaderProgramId != 0 && shader->programId != 0) {
+    SetFontGlyphShader(font, shader);
+  }
+}
+
+void UploadGlyphTable(BitmapFont *font) {
+  glGenBuffers(1, &font->glyphTableBufferId);
+  glBindBuffer(GL_TEXTURE_BUFFER, font->glyphTableBufferId);
+  glBufferData(GL_TEXTURE_BUFFER,
+               (GLsizeiptr)(font->glyphCount * sizeof(GlyphTableEntry)),
+               font->glyphs, GL_STATIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  glGenTextures(1, &font->glyphTableTextureId);
+  glBindTexture(GL_TEXTURE_BUFFER, font->glyphTableTextureId);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, font->glyphTableBufferId);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+bool MakeKerningTable(BitmapFont *font, unsigned pairCount) {
+  // Keep the load factor under one half so probes stay short
+  unsigned size = 16;
+  unsigned shift = 28;
+  while (size < pairCount * 2) {
+    size *= 2;
+    shift--;
+  }
+
+  font->kerningFilter = calloc(font->glyphCount, sizeof(unsigned long long));
+  font->kerningKeys = malloc(size * sizeof(unsigned));
+  font->kerningAmounts = calloc(size, sizeof(float));
+  if (font->kerningFilter == NULL || font->kerningKeys == NULL ||
+      font->kerningAmounts == NULL) {
+    Log(LOG_ERROR, "TEXT: could not allocate memory for %u kerning pairs",
+        pairCount);
+    return false;
+  }
+
+  memset(font->kerningKeys, 0xFF, size * sizeof(unsigned));
+  font->kerningMask = size - 1;
+  font->kerningShift = shift;
+  return true;
+}
+
+void AddKerningPair(BitmapFont *font, unsigned first, unsigned second,
+                    float amount) {
+  unsigned key = (first << 16) | second;
+  unsigned slot = HashKerningKey(key, font->kerningShift);
+  while (font->kerningKeys[slot] != KERNING_EMPTY_KEY &&
+         font->kerningKeys[slot] != key) {
+    slot = (slot + 1) & font->kerningMask;
+  }
+
+  font->kerningKeys[slot] = key;
+  font->kerningAmounts[slot] = amount;
+  font->kerningFilter[first] |= 1ull << (second & 63);
+}
+
+// Left NULL when a value is fractional or too large, text of the font is
+// then always laid out a glyph at a time
+void MakeAsciiRunTable(BitmapFont *font) {
+  AsciiRunTable *table = calloc(1, sizeof(AsciiRunTable));
+  if (table == NULL) {
+    return;
+  }
+
+  for (unsigned first = ' '; first < ASCII_RUN_COUNT; first++) {
+    unsigned firstId = font->asciiGlyphs[first];
+    if (firstId == NO_GLYPH) {
+      continue;
+    }
+
+    float advance = font->xas[firstId];
+    if (advance != (float)(int)advance || advance < -4096.0f ||
+        advance > 4096.0f) {
+      free(table);
+      return;
+    }
+
+    table->glyphs[first] = (AsciiRunGlyph){
+        .glyph = font->visible[firstId] ? firstId : firstId | ASCII_RUN_BLANK,
+        .advance = advance,
+    };
+    for (unsigned second = ' '; second < ASCII_RUN_COUNT; second++) {
+      unsigned secondId = font->asciiGlyphs[second];
+      if (secondId == NO_GLYPH) {
+        continue;
+      }
+
+      float kerning = GetKerning(font, firstId, secondId);
+      if (kerning != (float)(int)kerning || kerning < -128.0f ||
+          kerning > 127.0f) {
+        free(table);
+        return;
+      }
+
+      table->kernings[first * ASCII_RUN_COUNT + second] = (signed char)kerning;
+    }
+  }
+
+  font->asciiRuns = table;
+}
+
+// Bytes of the first level of an atlas, compressed blocks cover 4x4 texels
+size_t GetAtlasSize(AtlasFormat format, unsigned width, unsigned height,
+                    unsigned layers) {
+  switch (format) {
+  case ATLAS_R8:
+    return (size_t)width * height * layers;
+  case ATLAS_RGTC1:
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8 * layers;
+  default:
+    return (size_t)width * height * 4 * layers;
+  }
+}
+
+const char *GetAtlasFormatName(AtlasFormat format) {
+  switch (format) {
+  case ATLAS_R8:
+    return "R8";
+  case ATLAS_RGTC1:
+    return "RGTC1";
+  default:
+    return "RGBA8";
+  }
+}
@@ -0,0 +1,255 @@
+#ifndef SFR_FONT_H
+#define SFR_FONT_H
+
+#include <limits.h>
+
+#include "common.h"
+#include "font_desc.h"
+#include "utf8.h"
+
+#define ASSETS_GLYPH_VS "assets/glyph.vs.glsl"
+#define ASSETS_GLYPH_FS "assets/glyph.fs.glsl"
+#define ASSETS_GLYPH_SDF_FS "assets/glyph_sdf.fs.glsl"
+
+// Glyph 0 is the missing glyph, it never starts a kerning pair, so it
+// doubles as no previous glyph
+#define NO_GLYPH 0
+#define KERNING_EMPTY_KEY 0xFFFFFFFFu
+
+// Code points map to glyphs through pages of 256 entries, only the pages with
+// glyphs are allocated. Glyph indices are 16 bit, as are kerning pair halves.
+#define GLYPH_PAGE_SIZE 256
+#define GLYPH_PAGE_COUNT ((MAX_CODEPOINT + 1) / GLYPH_PAGE_SIZE)
+#define MAX_GLYPHS 0xFFFF
+
+// Characters laid out in runs, every ASCII character with a glyph
+#define ASCII_RUN_COUNT 0x80
+#define ASCII_RUN_BLANK 0x80000000u
+
+// Atlas pages are decoded in parallel, each page is a layer of the atlas
+#define MAX_PAGE_LOAD_THREADS 8
+// RGBA rows decoded at a time when single channel pages are streamed into a
+// pixel unpack buffer
+#define ATLAS_BAND_BYTES (4 << 20)
+
+typedef unsigned short GlyphPage[GLYPH_PAGE_SIZE];
+
+// Texel format of an atlas. Coverage only atlases keep a single channel, the
+// texture swizzles it back into RGBA so shaders sample every format alike.
+typedef enum {
+  ATLAS_RGBA8,
+  ATLAS_R8,
+  // RGTC1 (BC4) blocks of 4x4 single channel texels, half the size of R8
+  ATLAS_RGTC1,
+} AtlasFormat;
+
+// Color channels of a single channel atlas, its channel being the alpha
+typedef enum {
+  ATLAS_COLOR_BLACK,
+  ATLAS_COLOR_WHITE,
+  ATLAS_COLOR_COVERAGE,
+} AtlasColor;
+
+// Parts of a font read again when its files change
+typedef enum {
+  FONT_PART_TABLES = 1 << 0,
+  FONT_PART_ATLAS = 1 << 1,
+  FONT_PARTS_ALL = FONT_PART_TABLES | FONT_PART_ATLAS,
+} FontPart;
+
+// Glyph programs shared by the fonts, by atlas kind
+typedef enum {
+  GLYPH_SHADER_COVERAGE,
+  GLYPH_SHADER_SDF,
+  GLYPH_SHADER_COUNT,
+} GlyphShaderKind;
+
+// Glyph data read by the vertex shader, three RGBA32F texels per glyph
+typedef struct {
+  float uvs[4];
+  float size[2];
+  float offset[2];
+  float layer;
+  float padding[3];
+} GlyphTableEntry;
+
+// Uniforms set on every draw, -1 when the shader does not use them
+typedef struct {
+  int scale;
+  int distanceRange;
+  int outlineWidth;
+  int outlineColor;
+  int shadowOffset;
+  int shadowSoftness;
+  int shadowColor;
+} GlyphStyleLocations;
+
+typedef struct {
+  unsigned programId;
+  // Fonts uploaded with the program, it is deleted with the last one
+  unsigned users;
+  int projLocation;
+  int tex0Location;
+  int glyphsLocation;
+  int originLocation;
+  GlyphStyleLocations styleLocations;
+} GlyphShader;
+
+// Glyph of an ASCII character and its advance, the glyphs of blank
+// characters (i.e. spaces) are flagged with ASCII_RUN_BLANK
+typedef struct {
+  unsigned glyph;
+  float advance;
+} AsciiRunGlyph;
+
+// Glyphs and pair kernings of ASCII by character rather than by glyph, for
+// runs of ASCII text. Glyphs are indexed by byte, the bytes that end a run
+// (control characters, missing glyphs, UTF-8) have NO_GLYPH.
+typedef struct {
+  AsciiRunGlyph glyphs[256];
+  signed char kernings[ASCII_RUN_COUNT * ASCII_RUN_COUNT];
+} AsciiRunTable;
+
+// Glyphs are stored densely and referenced by index, index 0 being the
+// missing glyph. Pages hold the glyph index of every code point of a page,
+// page 0 of the pool is empty and shared by every page without glyphs.
+typedef struct {
+  StatusCode status;
+  // Unique to every loaded font and kept by copies of the struct, so text
+  // laid out in a font can be told apart from text of another
+  unsigned id;
+  float fontSize;
+  float lineHeight;
+  float base;
+  // Texels over which the atlas goes from 0 to 1 when it holds a signed
+  // distance field instead of coverage, 0 otherwise
+  float distanceRange;
+  unsigned glyphCount;
+  GlyphTableEntry *glyphs;
+  float *xas;
+  bool *visible;
+  unsigned short asciiGlyphs[128];
+  unsigned short *glyphPageIndex;
+  GlyphPage *glyphPages;
+  unsigned glyphPageCount;
+  // Open addressing table of (first << 16 | second) kerning pairs, with a
+  // 64 bit filter of the second glyphs paired with every first glyph
+  unsigned long long *kerningFilter;
+  unsigned kerningMask;
+  unsigned kerningShift;
+  unsigned *kerningKeys;
+  float *kerningAmounts;
+  // Set when every ASCII advance and kerning is a whole number of pixels,
+  // so unscaled ASCII runs add up exactly in any order
+  AsciiRunTable *asciiRuns;
+  // Program shared by every font with the same kind of atlas
+  unsigned shaderProgramId;
+  unsigned textureId;
+  // Bytes of the atlas texture with its mipmaps
+  size_t atlasMemory;
+  unsigned glyphTableBufferId;
+  unsigned glyphTableTextureId;
+  int projLocation;
+  int tex0Location;
+  int glyphsLocation;
+  int originLocation;
+  GlyphStyleLocations styleLocations;
+  // Font pack mapping the glyph and kerning tables point into, if loaded
+  // from one
+  void *packData;
+  size_t packSize;
+  // Texture of the glyphs in use, when the atlas is not uploaded whole
+  struct GlyphCache *glyphCache;
+} BitmapFont;
+
+// Tables and atlas pixels of a font, everything but its GL objects. Reading
+// them does not touch GL, so it may happen on any thread. Opened fonts keep
+// the files of their pages until they are decoded into a pixel unpack buffer,
+// pixels then map the buffer.
+typedef struct {
+  StatusCode status;
+  BitmapFont font;
+  unsigned char *pixels;
+  unsigned atlasWidth;
+  unsigned atlasHeight;
+  unsigned atlasLayers;
+  AtlasFormat atlasFormat;
+  AtlasColor atlasColor;
+  char (*pageFiles)[PATH_MAX];
+  unsigned atlasBufferId;
+} BitmapFontData;
+
+BitmapFont LoadBitmapFont(const char *descFilename);
+BitmapFont LoadBitmapFontPack(const char *packFilename);
+BitmapFontData ReadBitmapFontData(const char *descFilename);
+BitmapFontData MapBitmapFontData(const char *packFilename);
+BitmapFontData OpenBitmapFontData(const char *descFilename);
+bool MapFontAtlasBuffer(BitmapFontData *data);
+void DecodeFontPages(BitmapFontData *data);
+BitmapFontData ReadBitmapFontParts(const FontDesc *desc,
+                                   const char *descFilename, unsigned parts);
+bool HasSameFontAtlas(const FontDesc *desc, const FontDesc *other);
+BitmapFont UploadBitmapFont(BitmapFontData *data);
+bool ReplaceBitmapFontParts(BitmapFont *font, BitmapFontData *data);
+BitmapFont UploadCachedBitmapFont(BitmapFontData *data, unsigned cacheSize);
+void ReduceAtlasChannels(BitmapFontData *data);
+void FreeBitmapFontData(BitmapFontData *data);
+BitmapFont LoadPlaceholderFont(float fontSize);
+void UnloadBitmapFont(BitmapFont font);
+StatusCode BuildBitmapFont(BitmapFont *font, const FontDesc *desc,
+                           const char *name);
+void FreeBitmapFontTables(BitmapFont *font);
+unsigned char *ReadFontPages(const FontDesc *desc, const char *descFilename,
+                             unsigned *width, unsigned *height);
+bool LoadGlyphShader(BitmapFont *font);
+void ReleaseGlyphShader(BitmapFont *font);
+void GetGlyphShaderFiles(GlyphShaderKind kind, const char **vsFilename,
+                         const char **fsFilename);
+bool IsGlyphShaderLoaded(GlyphShaderKind kind);
+void ReplaceGlyphShader(GlyphShaderKind kind, unsigned programId);
+void RefreshGlyphShader(BitmapFont *font);
+void UploadGlyphTable(BitmapFont *font);
+bool MakeKerningTable(BitmapFont *font, unsigned pairCount);
+void MakeAsciiRunTable(BitmapFont *font);
+void AddKerningPair(BitmapFont *font, unsigned first, unsigned second,
+                    float amount);
+size_t GetAtlasSize(AtlasFormat format, unsigned width, unsigned height,
+                    unsigned layers);
+const char *GetAtlasFormatName(AtlasFormat format);
+
+static inline unsigned GetGlyphIndex(const BitmapFont *font,
+                                     unsigned codepoint) {
+  if (codepoint > MAX_CODEPOINT) {
+    return NO_GLYPH;
+  }
+
+  return font->glyphPages[font->glyphPageIndex[codepoint / GLYPH_PAGE_SIZE]]
+                         [codepoint % GLYPH_PAGE_SIZE];
+}
+
+// Fibonacci hashing, the top bits of the product mix both glyphs of a pair
+static inline unsigned HashKerningKey(unsigned key, unsigned shift) {
+  return (key * 2654435761u) >> shift;
+}
+
+static inline float GetKerning(const BitmapFont *font, unsigned first,
+                               unsigned second) {
+  // Most pairs are not kerned, skip the probe for them
+  if (((font->kerningFilter[first] >> (second & 63)) & 1) == 0) {
+    return 0.0f;
+  }
+
+  unsigned key = (first << 16) | second;
+  unsigned slot = HashKerningKey(key, font->kerningShift);
+  while (font->kerningKeys[slot] != KERNING_EMPTY_KEY) {
+    if (font->kerningKeys[slot] == key) {
+      return font->kerningAmounts[slot];
+    }
+
+    slot = (slot + 1) & font->kerningMask;
+  }
+
+  return 0.0f;
+}
+
+#endif // SFR_FONT_H
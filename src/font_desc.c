@@ -0,0 +1,653 @@
+#include "font_desc.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Enough for the longest block, char, whose values are stored in key order
+#define FONT_DESC_MAX_VALUES 10
+#define FONT_DESC_KEY(key) {key, sizeof(key) - 1}
+
+#define FONT_DESC_BINARY_VERSION 3
+#define FONT_DESC_BINARY_CHAR_SIZE 20
+#define FONT_DESC_BINARY_KERNING_SIZE 10
+
+enum {
+  FONT_DESC_BLOCK_INFO = 1,
+  FONT_DESC_BLOCK_COMMON,
+  FONT_DESC_BLOCK_PAGES,
+  FONT_DESC_BLOCK_CHARS,
+  FONT_DESC_BLOCK_KERNINGS,
+};
+
+typedef enum {
+  FONT_DESC_TAG_UNKNOWN,
+  FONT_DESC_TAG_INFO,
+  FONT_DESC_TAG_COMMON,
+  FONT_DESC_TAG_PAGE,
+  FONT_DESC_TAG_CHARS,
+  FONT_DESC_TAG_CHAR,
+  FONT_DESC_TAG_KERNINGS,
+  FONT_DESC_TAG_KERNING,
+} FontDescTag;
+
+typedef struct {
+  const char *name;
+  size_t len;
+} FontDescKey;
+
+// Integer attributes of the line being parsed, seen has one bit per key
+typedef struct {
+  int values[FONT_DESC_MAX_VALUES];
+  unsigned seen;
+  unsigned hint;
+  const char *file;
+  size_t fileLen;
+} FontDescLine;
+
+enum { INFO_SIZE };
+enum { COMMON_LINE_HEIGHT, COMMON_BASE, COMMON_SCALE_W, COMMON_SCALE_H };
+enum { PAGE_ID };
+enum { COUNT_COUNT };
+enum {
+  CHAR_ID,
+  CHAR_X,
+  CHAR_Y,
+  CHAR_WIDTH,
+  CHAR_HEIGHT,
+  CHAR_XOFFSET,
+  CHAR_YOFFSET,
+  CHAR_XADVANCE,
+  CHAR_PAGE,
+  CHAR_CHNL,
+};
+enum { KERNING_FIRST, KERNING_SECOND, KERNING_AMOUNT };
+
+static const FontDescKey infoKeys[] = {FONT_DESC_KEY("size")};
+static const FontDescKey commonKeys[] = {
+    FONT_DESC_KEY("lineHeight"),
+    FONT_DESC_KEY("base"),
+    FONT_DESC_KEY("scaleW"),
+    FONT_DESC_KEY("scaleH"),
+};
+static const FontDescKey pageKeys[] = {FONT_DESC_KEY("id")};
+static const FontDescKey countKeys[] = {FONT_DESC_KEY("count")};
+static const FontDescKey charKeys[] = {
+    FONT_DESC_KEY("id"),      FONT_DESC_KEY("x"),       FONT_DESC_KEY("y"),
+    FONT_DESC_KEY("width"),   FONT_DESC_KEY("height"),  FONT_DESC_KEY("xoffset"),
+    FONT_DESC_KEY("yoffset"), FONT_DESC_KEY("xadvance"), FONT_DESC_KEY("page"),
+    FONT_DESC_KEY("chnl"),
+};
+static const FontDescKey kerningKeys[] = {
+    FONT_DESC_KEY("first"),
+    FONT_DESC_KEY("second"),
+    FONT_DESC_KEY("amount"),
+};
+
+static bool IsDescToken(const char *token, size_t tokenLen,
+                        const FontDescKey *key) {
+  // Keys are a few bytes long, cheaper to compare inline than with memcmp
+  if (key->len != tokenLen) {
+    return false;
+  }
+
+  for (size_t i = 0; i < tokenLen; i++) {
+    if (token[i] != key->name[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool IsDescSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static FontDescTag GetFontDescTag(const char *tag, size_t tagLen) {
+  // Most frequent blocks first
+  static const struct {
+    FontDescKey key;
+    FontDescTag tag;
+  } tags[] = {
+      {FONT_DESC_KEY("char"), FONT_DESC_TAG_CHAR},
+      {FONT_DESC_KEY("kerning"), FONT_DESC_TAG_KERNING},
+      {FONT_DESC_KEY("info"), FONT_DESC_TAG_INFO},
+      {FONT_DESC_KEY("common"), FONT_DESC_TAG_COMMON},
+      {FONT_DESC_KEY("page"), FONT_DESC_TAG_PAGE},
+      {FONT_DESC_KEY("chars"), FONT_DESC_TAG_CHARS},
+      {FONT_DESC_KEY("kernings"), FONT_DESC_TAG_KERNINGS},
+  };
+
+  for (size_t i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) {
+    if (IsDescToken(tag, tagLen, &tags[i].key)) {
+      return tags[i].tag;
+    }
+  }
+
+  return FONT_DESC_TAG_UNKNOWN;
+}
+
+static const FontDescKey *GetFontDescKeys(FontDescTag tag, unsigned *count) {
+  switch (tag) {
+  case FONT_DESC_TAG_INFO:
+    *count = sizeof(infoKeys) / sizeof(infoKeys[0]);
+    return infoKeys;
+  case FONT_DESC_TAG_COMMON:
+    *count = sizeof(commonKeys) / sizeof(commonKeys[0]);
+    return commonKeys;
+  case FONT_DESC_TAG_PAGE:
+    *count = sizeof(pageKeys) / sizeof(pageKeys[0]);
+    return pageKeys;
+  case FONT_DESC_TAG_CHARS:
+  case FONT_DESC_TAG_KERNINGS:
+    *count = sizeof(countKeys) / sizeof(countKeys[0]);
+    return countKeys;
+  case FONT_DESC_TAG_CHAR:
+    *count = sizeof(charKeys) / sizeof(charKeys[0]);
+    return charKeys;
+  case FONT_DESC_TAG_KERNING:
+    *count = sizeof(kerningKeys) / sizeof(kerningKeys[0]);
+    return kerningKeys;
+  default:
+    *count = 0;
+    return NULL;
+  }
+}
+
+static bool ParseDescInt(const char *value, size_t valueLen, int *result) {
+  size_t i = 0;
+  bool negative = valueLen > 0 && value[0] == '-';
+  if (negative) {
+    i++;
+  }
+
+  if (i == valueLen) {
+    return false;
+  }
+
+  int number = 0;
+  for (; i < valueLen; i++) {
+    int digit = value[i] - '0';
+    if (digit < 0 || digit > 9 || number > (INT_MAX - digit) / 10) {
+      return false;
+    }
+
+    number = number * 10 + digit;
+  }
+
+  *result = negative ? -number : number;
+  return true;
+}
+
+// Attributes usually come in the same order on every line, so the search
+// starts right after the previous match and almost always hits at once
+static bool SetFontDescAttr(FontDescLine *line, FontDescTag tag,
+                            const char *key, size_t keyLen, const char *value,
+                            size_t valueLen) {
+  unsigned keyCount = 0;
+  const FontDescKey *keys = GetFontDescKeys(tag, &keyCount);
+  for (unsigned n = 0; n < keyCount; n++) {
+    unsigned i = line->hint + n < keyCount ? line->hint + n
+                                           : line->hint + n - keyCount;
+    if (IsDescToken(key, keyLen, &keys[i])) {
+      line->seen |= 1u << i;
+      line->hint = i + 1 < keyCount ? i + 1 : 0;
+      return ParseDescInt(value, valueLen, &line->values[i]);
+    }
+  }
+
+  // Unknown or unused attribute (e.g. face, padding or packed)
+  return true;
+}
+
+static void *GrowDescRecords(void *records, unsigned *capacity,
+                             unsigned count, size_t recordSize) {
+  if (count <= *capacity) {
+    return records;
+  }
+
+  unsigned newCapacity = *capacity > 0 ? *capacity : 64;
+  while (newCapacity < count) {
+    newCapacity *= 2;
+  }
+
+  void *grown = realloc(records, newCapacity * recordSize);
+  if (grown != NULL) {
+    *capacity = newCapacity;
+  }
+
+  return grown;
+}
+
+// Stores the record of a complete line, returns an error message if the line
+// is not valid
+static const char *AddFontDescLine(FontDesc *desc, FontDescTag tag,
+                                   const FontDescLine *line, size_t dataLen) {
+  const int *values = line->values;
+  switch (tag) {
+  case FONT_DESC_TAG_INFO:
+    desc->fontSize = values[INFO_SIZE];
+    return NULL;
+  case FONT_DESC_TAG_COMMON:
+    if (values[COMMON_SCALE_W] <= 0 || values[COMMON_SCALE_H] <= 0) {
+      return "scaleW and scaleH must be positive";
+    }
+
+    desc->lineHeight = values[COMMON_LINE_HEIGHT];
+    desc->base = values[COMMON_BASE];
+    desc->scaleW = values[COMMON_SCALE_W];
+    desc->scaleH = values[COMMON_SCALE_H];
+    return NULL;
+  case FONT_DESC_TAG_PAGE: {
+    if ((line->seen & 1u << PAGE_ID) == 0 || values[PAGE_ID] < 0) {
+      return "page needs a valid id";
+    }
+
+    if (line->file == NULL || line->fileLen >= FONT_DESC_MAX_PATH) {
+      return "page needs a file shorter than 256 bytes";
+    }
+
+    FontDescPage *pages = GrowDescRecords(desc->pages, &desc->pageCapacity,
+                                          desc->pageCount + 1,
+                                          sizeof(FontDescPage));
+    if (pages == NULL) {
+      desc->status = ERROR_OUT_OF_MEMORY;
+      return "could not allocate memory for page";
+    }
+
+    FontDescPage *page = &pages[desc->pageCount++];
+    page->id = (unsigned)values[PAGE_ID];
+    memcpy(page->file, line->file, line->fileLen);
+    page->file[line->fileLen] = '\0';
+    desc->pages = pages;
+    return NULL;
+  }
+  case FONT_DESC_TAG_CHARS:
+  case FONT_DESC_TAG_KERNINGS: {
+    // Declared counts are only a hint, bounded by what the data can hold
+    size_t count = values[COUNT_COUNT] > 0 ? (size_t)values[COUNT_COUNT] : 0;
+    if (count > dataLen / 8) {
+      count = dataLen / 8;
+    }
+
+    void *records = NULL;
+    if (tag == FONT_DESC_TAG_CHARS) {
+      records = GrowDescRecords(desc->chars, &desc->charCapacity,
+                                (unsigned)count, sizeof(FontDescChar));
+      desc->chars = records != NULL ? records : desc->chars;
+    } else {
+      records = GrowDescRecords(desc->kernings, &desc->kerningCapacity,
+                                (unsigned)count, sizeof(FontDescKerning));
+      desc->kernings = records != NULL ? records : desc->kernings;
+    }
+
+    if (records == NULL && count > 0) {
+      desc->status = ERROR_OUT_OF_MEMORY;
+      return "could not allocate memory for records";
+    }
+    return NULL;
+  }
+  case FONT_DESC_TAG_CHAR: {
+    if ((line->seen & 1u << CHAR_ID) == 0 || values[CHAR_ID] < 0) {
+      return "char needs a valid id";
+    }
+
+    FontDescChar *chars =
+        GrowDescRecords(desc->chars, &desc->charCapacity, desc->charCount + 1,
+                        sizeof(FontDescChar));
+    if (chars == NULL) {
+      desc->status = ERROR_OUT_OF_MEMORY;
+      return "could not allocate memory for char";
+    }
+
+    chars[desc->charCount++] = (FontDescChar){
+        .id = (unsigned)values[CHAR_ID],
+        .x = values[CHAR_X],
+        .y = values[CHAR_Y],
+        .width = values[CHAR_WIDTH],
+        .height = values[CHAR_HEIGHT],
+        .xOffset = values[CHAR_XOFFSET],
+        .yOffset = values[CHAR_YOFFSET],
+        .xAdvance = values[CHAR_XADVANCE],
+        .page = values[CHAR_PAGE] > 0 ? (unsigned)values[CHAR_PAGE] : 0,
+        .channel = line->seen & 1u << CHAR_CHNL ? (unsigned)values[CHAR_CHNL]
+                                                 : 15,
+    };
+    desc->chars = chars;
+    return NULL;
+  }
+  case FONT_DESC_TAG_KERNING: {
+    unsigned required =
+        1u << KERNING_FIRST | 1u << KERNING_SECOND | 1u << KERNING_AMOUNT;
+    if ((line->seen & required) != required || values[KERNING_FIRST] < 0 ||
+        values[KERNING_SECOND] < 0) {
+      return "kerning needs valid first, second and amount";
+    }
+
+    FontDescKerning *kernings =
+        GrowDescRecords(desc->kernings, &desc->kerningCapacity,
+                        desc->kerningCount + 1, sizeof(FontDescKerning));
+    if (kernings == NULL) {
+      desc->status = ERROR_OUT_OF_MEMORY;
+      return "could not allocate memory for kerning";
+    }
+
+    kernings[desc->kerningCount++] = (FontDescKerning){
+        .first = (unsigned)values[KERNING_FIRST],
+        .second = (unsigned)values[KERNING_SECOND],
+        .amount = values[KERNING_AMOUNT],
+    };
+    desc->kernings = kernings;
+    return NULL;
+  }
+  default:
+    return NULL;
+  }
+}
+
+FontDesc ParseFontDesc(const char *name, const void *data, size_t dataLen) {
+  const unsigned char *bytes = data;
+  if (dataLen >= 4 && bytes[0] == 'B' && bytes[1] == 'M' && bytes[2] == 'F') {
+    return ParseBinaryFontDesc(name, bytes, dataLen);
+  }
+
+  return ParseTextFontDesc(name, data, dataLen);
+}
+
+FontDesc ParseTextFontDesc(const char *name, const char *data,
+                           size_t dataLen) {
+  FontDesc desc = {0};
+  const char *cur = data;
+  const char *end = data + dataLen;
+  bool failed = false;
+  unsigned lineNumber = 0;
+  bool hasCommon = false;
+
+  // Every line is walked once: a tag followed by key=value attributes, where
+  // values are numbers, comma separated lists or quoted strings
+  while (cur < end && !failed) {
+    FontDescLine line = {0};
+    lineNumber++;
+
+    while (cur < end && IsDescSpace(*cur)) {
+      cur++;
+    }
+
+    const char *tag = cur;
+    while (cur < end && *cur != '\n' && !IsDescSpace(*cur)) {
+      cur++;
+    }
+
+    FontDescTag tagId = GetFontDescTag(tag, (size_t)(cur - tag));
+    if (tagId == FONT_DESC_TAG_UNKNOWN && cur != tag) {
+      Log(LOG_WARN, "FONT: %s:%u: skipping unknown block '%.*s'", name,
+          lineNumber, (int)(cur - tag), tag);
+    }
+
+    while (cur < end && *cur != '\n' && !failed) {
+      if (IsDescSpace(*cur)) {
+        cur++;
+        continue;
+      }
+
+      const char *key = cur;
+      while (cur < end && *cur != '=' && *cur != '\n' && !IsDescSpace(*cur)) {
+        cur++;
+      }
+
+      size_t keyLen = (size_t)(cur - key);
+      if (cur == end || *cur != '=') {
+        Log(LOG_ERROR, "FONT: %s:%u: expected '=' after '%.*s'", name,
+            lineNumber, (int)keyLen, key);
+        failed = true;
+        break;
+      }
+
+      const char *value = ++cur;
+      size_t valueLen = 0;
+      if (cur < end && *cur == '"') {
+        value = ++cur;
+        while (cur < end && *cur != '"' && *cur != '\n') {
+          cur++;
+        }
+
+        if (cur == end || *cur != '"') {
+          Log(LOG_ERROR, "FONT: %s:%u: unterminated string for '%.*s'", name,
+              lineNumber, (int)keyLen, key);
+          failed = true;
+          break;
+        }
+
+        valueLen = (size_t)(cur - value);
+        cur++;
+
+        if (tagId == FONT_DESC_TAG_PAGE && keyLen == 4 &&
+            memcmp(key, "file", 4) == 0) {
+          line.file = value;
+          line.fileLen = valueLen;
+          continue;
+        }
+      } else {
+        while (cur < end && *cur != '\n' && !IsDescSpace(*cur)) {
+          cur++;
+        }
+
+        valueLen = (size_t)(cur - value);
+      }
+
+      if (!SetFontDescAttr(&line, tagId, key, keyLen, value, valueLen)) {
+        Log(LOG_ERROR, "FONT: %s:%u: invalid number for '%.*s': '%.*s'", name,
+            lineNumber, (int)keyLen, key, (int)valueLen, value);
+        failed = true;
+      }
+    }
+
+    if (!failed) {
+      const char *error = AddFontDescLine(&desc, tagId, &line, dataLen);
+      if (error != NULL) {
+        Log(LOG_ERROR, "FONT: %s:%u: %s", name, lineNumber, error);
+        failed = true;
+      }
+
+      hasCommon = hasCommon || tagId == FONT_DESC_TAG_COMMON;
+    }
+
+    // Skip the line feed
+    if (cur < end) {
+      cur++;
+    }
+  }
+
+  if (!failed && !hasCommon) {
+    Log(LOG_ERROR, "FONT: %s: missing common block", name);
+    failed = true;
+  }
+
+  if (failed && desc.status == SUCCESS) {
+    desc.status = ERROR_INVALID_DESCRIPTION;
+  }
+
+  return desc;
+}
+
+static unsigned ReadDescU16(const unsigned char *data) {
+  return (unsigned)data[0] | (unsigned)data[1] << 8;
+}
+
+static int ReadDescS16(const unsigned char *data) {
+  return (short)ReadDescU16(data);
+}
+
+static unsigned ReadDescU32(const unsigned char *data) {
+  return ReadDescU16(data) | ReadDescU16(data + 2) << 16;
+}
+
+// Binary descriptors are a "BMF" tag, the version and then blocks of a type
+// byte, a 32 bit size and fixed size little endian records
+FontDesc ParseBinaryFontDesc(const char *name, const unsigned char *data,
+                             size_t dataLen) {
+  FontDesc desc = {0};
+  const char *error = NULL;
+  size_t offset = 4;
+  bool hasCommon = false;
+
+  if (data[3] != FONT_DESC_BINARY_VERSION) {
+    Log(LOG_ERROR, "FONT: %s: unsupported binary version %u", name, data[3]);
+    desc.status = ERROR_INVALID_DESCRIPTION;
+    return desc;
+  }
+
+  while (offset < dataLen && error == NULL) {
+    if (dataLen - offset < 5) {
+      error = "truncated block header";
+      break;
+    }
+
+    unsigned type = data[offset];
+    size_t size = ReadDescU32(data + offset + 1);
+    const unsigned char *block = data + offset + 5;
+    if (size > dataLen - offset - 5) {
+      error = "truncated block";
+      break;
+    }
+
+    switch (type) {
+    case FONT_DESC_BLOCK_INFO:
+      if (size < 2) {
+        error = "info block is too short";
+        break;
+      }
+
+      desc.fontSize = ReadDescS16(block);
+      break;
+    case FONT_DESC_BLOCK_COMMON:
+      if (size < 10) {
+        error = "common block is too short";
+        break;
+      }
+
+      desc.lineHeight = (int)ReadDescU16(block);
+      desc.base = (int)ReadDescU16(block + 2);
+      desc.scaleW = (int)ReadDescU16(block + 4);
+      desc.scaleH = (int)ReadDescU16(block + 6);
+      if (desc.scaleW == 0 || desc.scaleH == 0) {
+        error = "scaleW and scaleH must be positive";
+      }
+      hasCommon = true;
+      break;
+    case FONT_DESC_BLOCK_PAGES:
+      // Null terminated names, all of them with the same length
+      for (size_t pos = 0; pos < size && error == NULL;) {
+        const unsigned char *file = block + pos;
+        const unsigned char *fileEnd = memchr(file, '\0', size - pos);
+        size_t fileLen = fileEnd != NULL ? (size_t)(fileEnd - file) : 0;
+        if (fileEnd == NULL || fileLen >= FONT_DESC_MAX_PATH) {
+          error = "invalid page name";
+          break;
+        }
+
+        FontDescPage *pages =
+            GrowDescRecords(desc.pages, &desc.pageCapacity,
+                            desc.pageCount + 1, sizeof(FontDescPage));
+        if (pages == NULL) {
+          desc.status = ERROR_OUT_OF_MEMORY;
+          error = "could not allocate memory for page";
+          break;
+        }
+
+        pages[desc.pageCount].id = desc.pageCount;
+        memcpy(pages[desc.pageCount].file, file, fileLen + 1);
+        desc.pageCount++;
+        desc.pages = pages;
+        pos += fileLen + 1;
+      }
+      break;
+    case FONT_DESC_BLOCK_CHARS: {
+      unsigned count = (unsigned)(size / FONT_DESC_BINARY_CHAR_SIZE);
+      FontDescChar *chars =
+          GrowDescRecords(desc.chars, &desc.charCapacity,
+                          desc.charCount + count, sizeof(FontDescChar));
+      if (chars == NULL) {
+        desc.status = ERROR_OUT_OF_MEMORY;
+        error = "could not allocate memory for chars";
+        break;
+      }
+
+      for (unsigned i = 0; i < count; i++) {
+        const unsigned char *record = block + i * FONT_DESC_BINARY_CHAR_SIZE;
+        chars[desc.charCount++] = (FontDescChar){
+            .id = ReadDescU32(record),
+            .x = (int)ReadDescU16(record + 4),
+            .y = (int)ReadDescU16(record + 6),
+            .width = (int)ReadDescU16(record + 8),
+            .height = (int)ReadDescU16(record + 10),
+            .xOffset = ReadDescS16(record + 12),
+            .yOffset = ReadDescS16(record + 14),
+            .xAdvance = ReadDescS16(record + 16),
+            .page = record[18],
+            .channel = record[19],
+        };
+      }
+      desc.chars = chars;
+      break;
+    }
+    case FONT_DESC_BLOCK_KERNINGS: {
+      unsigned count = (unsigned)(size / FONT_DESC_BINARY_KERNING_SIZE);
+      FontDescKerning *kernings =
+          GrowDescRecords(desc.kernings, &desc.kerningCapacity,
+                          desc.kerningCount + count, sizeof(FontDescKerning));
+      if (kernings == NULL) {
+        desc.status = ERROR_OUT_OF_MEMORY;
+        error = "could not allocate memory for kernings";
+        break;
+      }
+
+      for (unsigned i = 0; i < count; i++) {
+        const unsigned char *record =
+            block + i * FONT_DESC_BINARY_KERNING_SIZE;
+        kernings[desc.kerningCount++] = (FontDescKerning){
+            .first = ReadDescU32(record),
+            .second = ReadDescU32(record + 4),
+            .amount = ReadDescS16(record + 8),
+        };
+      }
+      desc.kernings = kernings;
+      break;
+    }
+    default:
+      Log(LOG_WARN, "FONT: %s: skipping unknown block %u at offset %zu", name,
+          type, offset);
+      break;
+    }
+
+    offset += 5 + size;
+  }
+
+  if (error != NULL) {
+    Log(LOG_ERROR, "FONT: %s: offset %zu: %s", name, offset, error);
+  } else if (!hasCommon) {
+    Log(LOG_ERROR, "FONT: %s: missing common block", name);
+    error = "missing common block";
+  }
+
+  if (error != NULL && desc.status == SUCCESS) {
+    desc.status = ERROR_INVALID_DESCRIPTION;
+  }
+
+  return desc;
+}
+
+void FreeFontDesc(FontDesc *desc) {
+  if (desc->pages != NULL) {
+    free(desc->pages);
+  }
+
+  if (desc->chars != NULL) {
+    free(desc->chars);
+  }
+
+  if (desc->kernings != NULL) {
+    free(desc->kernings);
+  }
+
+  *desc = (FontDesc){0};
+}
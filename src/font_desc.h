@@ -0,0 +1,61 @@
+#ifndef SFR_FONT_DESC_H
+#define SFR_FONT_DESC_H
+
+#include "common.h"
+
+#define FONT_DESC_MAX_PATH 256
+
+typedef struct {
+  unsigned id;
+  int x;
+  int y;
+  int width;
+  int height;
+  int xOffset;
+  int yOffset;
+  int xAdvance;
+  unsigned page;
+  unsigned channel;
+} FontDescChar;
+
+typedef struct {
+  unsigned first;
+  unsigned second;
+  int amount;
+} FontDescKerning;
+
+typedef struct {
+  unsigned id;
+  char file[FONT_DESC_MAX_PATH];
+} FontDescPage;
+
+// Contents of an AngelCode BMFont text descriptor. Records keep the order of
+// the file and the counts are the records actually found, not the declared
+// ones.
+typedef struct {
+  StatusCode status;
+  int fontSize;
+  int lineHeight;
+  int base;
+  int scaleW;
+  int scaleH;
+  FontDescPage *pages;
+  unsigned pageCount;
+  unsigned pageCapacity;
+  FontDescChar *chars;
+  unsigned charCount;
+  unsigned charCapacity;
+  FontDescKerning *kernings;
+  unsigned kerningCount;
+  unsigned kerningCapacity;
+} FontDesc;
+
+// Text or binary (version 3) descriptor, told apart by the "BMF" tag
+FontDesc ParseFontDesc(const char *name, const void *data, size_t dataLen);
+FontDesc ParseTextFontDesc(const char *name, const char *data,
+                           size_t dataLen);
+FontDesc ParseBinaryFontDesc(const char *name, const unsigned char *data,
+                             size_t dataLen);
+void FreeFontDesc(FontDesc *desc);
+
+#endif // SFR_FONT_DESC_H
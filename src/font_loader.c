@@ -0,0 +1,242 @@
+#include "font_loader.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sdf.h"
+
+static void FreeFontLoadJobs(FontLoadJob *job) {
+  while (job != NULL) {
+    FontLoadJob *next = job->next;
+    FreeBitmapFontData(&job->data);
+    free(job->filename);
+    free(job);
+    job = next;
+  }
+}
+
+static void *RunFontLoadWorker(void *arg) {
+  FontLoader *loader = arg;
+  pthread_mutex_lock(&loader->mutex);
+  for (;;) {
+    while (!loader->stopping && loader->queued == NULL) {
+      pthread_cond_wait(&loader->jobQueued, &loader->mutex);
+    }
+
+    if (loader->stopping) {
+      break;
+    }
+
+    FontLoadJob *job = loader->queued;
+    loader->queued = job->next;
+    if (loader->queued == NULL) {
+      loader->queuedTail = &loader->queued;
+    }
+
+    // Files are read without the lock, other workers keep taking jobs
+    pthread_mutex_unlock(&loader->mutex);
+    if (job->data.pageFiles != NULL) {
+      DecodeFontPages(&job->data);
+    } else if (job->pack) {
+      job->data = MapBitmapFontData(job->filename);
+    } else if (job->distanceRange > 0.0f || job->cacheSize > 0) {
+      job->data = ReadBitmapFontData(job->filename);
+    } else {
+      job->data = OpenBitmapFontData(job->filename);
+    }
+
+    // Fields are made by this worker alone, others already use every core
+    if (job->data.status == SUCCESS && job->distanceRange > 0.0f) {
+      job->data.status =
+          MakeDistanceFieldFont(&job->data, job->distanceRange, 1);
+    }
+
+    // Atlases are made single channel here rather than on the GL thread
+    if (job->data.status == SUCCESS) {
+      ReduceAtlasChannels(&job->data);
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    job->next = NULL;
+    *loader->completedTail = job;
+    loader->completedTail = &job->next;
+  }
+
+  pthread_mutex_unlock(&loader->mutex);
+  return NULL;
+}
+
+static void QueueJob(FontLoader *loader, FontLoadJob *job) {
+  pthread_mutex_lock(&loader->mutex);
+  job->next = NULL;
+  *loader->queuedTail = job;
+  loader->queuedTail = &job->next;
+  pthread_cond_signal(&loader->jobQueued);
+  pthread_mutex_unlock(&loader->mutex);
+}
+
+static bool QueueFontLoadJob(FontLoader *loader, BitmapFont *font,
+                             const char *filename, bool pack,
+                             float distanceRange, unsigned cacheSize) {
+  FontLoadJob *job = calloc(1, sizeof(FontLoadJob));
+  char *copy = strdup(filename);
+  if (job == NULL || copy == NULL) {
+    Log(LOG_ERROR, "FONT: could not allocate memory to load %s", filename);
+    if (job != NULL) {
+      free(job);
+    }
+
+    if (copy != NULL) {
+      free(copy);
+    }
+
+    return false;
+  }
+
+  job->filename = copy;
+  job->pack = pack;
+  job->distanceRange = distanceRange;
+  job->cacheSize = cacheSize;
+  job->font = font;
+  *font = (BitmapFont){.status = PENDING};
+
+  pthread_mutex_lock(&loader->mutex);
+  loader->pendingCount++;
+  pthread_mutex_unlock(&loader->mutex);
+  QueueJob(loader, job);
+  return true;
+}
+
+StatusCode StartFontLoader(FontLoader *loader, unsigned threadCount) {
+  *loader = (FontLoader){0};
+  loader->queuedTail = &loader->queued;
+  loader->completedTail = &loader->completed;
+
+  // One worker per core unless told otherwise
+  if (threadCount == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? (unsigned)cores : 1;
+  }
+
+  if (threadCount > FONT_LOADER_MAX_THREADS) {
+    threadCount = FONT_LOADER_MAX_THREADS;
+  }
+
+  pthread_mutex_init(&loader->mutex, NULL);
+  pthread_cond_init(&loader->jobQueued, NULL);
+  while (loader->threadCount < threadCount &&
+         pthread_create(&loader->threads[loader->threadCount], NULL,
+                        RunFontLoadWorker, loader) == 0) {
+    loader->threadCount++;
+  }
+
+  if (loader->threadCount == 0) {
+    Log(LOG_ERROR, "FONT: could not start any loader thread");
+    loader->status = ERROR_OUT_OF_MEMORY;
+    pthread_cond_destroy(&loader->jobQueued);
+    pthread_mutex_destroy(&loader->mutex);
+  }
+
+  return loader->status;
+}
+
+void StopFontLoader(FontLoader *loader) {
+  if (loader->threadCount == 0) {
+    return;
+  }
+
+  // Workers finish the font they are reading, queued ones are dropped
+  pthread_mutex_lock(&loader->mutex);
+  loader->stopping = true;
+  pthread_cond_broadcast(&loader->jobQueued);
+  pthread_mutex_unlock(&loader->mutex);
+  for (unsigned i = 0; i < loader->threadCount; i++) {
+    pthread_join(loader->threads[i], NULL);
+  }
+
+  FreeFontLoadJobs(loader->queued);
+  FreeFontLoadJobs(loader->completed);
+  pthread_cond_destroy(&loader->jobQueued);
+  pthread_mutex_destroy(&loader->mutex);
+  *loader = (FontLoader){0};
+}
+
+bool QueueFontLoad(FontLoader *loader, BitmapFont *font,
+                   const char *descFilename) {
+  return QueueFontLoadJob(loader, font, descFilename, false, 0.0f, 0);
+}
+
+bool QueueDistanceFieldFontLoad(FontLoader *loader, BitmapFont *font,
+                                const char *descFilename,
+                                float distanceRange) {
+  return QueueFontLoadJob(loader, font, descFilename, false, distanceRange,
+                          0);
+}
+
+bool QueueFontPackLoad(FontLoader *loader, BitmapFont *font,
+                       const char *packFilename) {
+  return QueueFontLoadJob(loader, font, packFilename, true, 0.0f, 0);
+}
+
+bool QueueCachedFontLoad(FontLoader *loader, BitmapFont *font,
+                         const char *descFilename, unsigned cacheSize) {
+  return QueueFontLoadJob(loader, font, descFilename, false, 0.0f, cacheSize);
+}
+
+bool QueueCachedFontPackLoad(FontLoader *loader, BitmapFont *font,
+                             const char *packFilename, unsigned cacheSize) {
+  return QueueFontLoadJob(loader, font, packFilename, true, 0.0f, cacheSize);
+}
+
+unsigned PollFontLoader(FontLoader *loader, unsigned maxUploads) {
+  unsigned uploads = 0;
+  while (uploads < maxUploads) {
+    pthread_mutex_lock(&loader->mutex);
+    FontLoadJob *job = loader->completed;
+    if (job != NULL) {
+      loader->completed = job->next;
+      if (loader->completed == NULL) {
+        loader->completedTail = &loader->completed;
+      }
+    }
+    pthread_mutex_unlock(&loader->mutex);
+
+    if (job == NULL) {
+      break;
+    }
+
+    // Opened pages go back to a worker to be decoded into a buffer mapped
+    // here, a failed mapping fails the upload
+    if (job->data.status == SUCCESS && job->data.pageFiles != NULL &&
+        MapFontAtlasBuffer(&job->data)) {
+      QueueJob(loader, job);
+      continue;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    loader->pendingCount--;
+    pthread_mutex_unlock(&loader->mutex);
+
+    // Only this thread writes the fonts, layout never sees a partial one
+    *job->font = job->cacheSize > 0
+                     ? UploadCachedBitmapFont(&job->data, job->cacheSize)
+                     : UploadBitmapFont(&job->data);
+    if (job->font->status != SUCCESS) {
+      Log(LOG_ERROR, "FONT: could not load %s", job->filename);
+    }
+
+    free(job->filename);
+    free(job);
+    uploads++;
+  }
+
+  return uploads;
+}
+
+unsigned GetPendingFontLoads(FontLoader *loader) {
+  pthread_mutex_lock(&loader->mutex);
+  unsigned pendingCount = loader->pendingCount;
+  pthread_mutex_unlock(&loader->mutex);
+  return pendingCount;
+}
@@ -0,0 +1,59 @@
+#ifndef SFR_FONT_LOADER_H
+#define SFR_FONT_LOADER_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "font.h"
+
+#define FONT_LOADER_MAX_THREADS 16
+
+typedef struct FontLoadJob {
+  char *filename;
+  bool pack;
+  float distanceRange;
+  // Side of the glyph cache texture the font is uploaded with, 0 to upload
+  // the whole atlas
+  unsigned cacheSize;
+  BitmapFont *font;
+  BitmapFontData data;
+  struct FontLoadJob *next;
+} FontLoadJob;
+
+// Fonts are read by a pool of worker threads: file I/O, descriptor parsing
+// and PNG decoding. Finished fonts wait in the completion queue until the GL
+// thread polls it and uploads them, their status stays PENDING meanwhile.
+// Atlases uploaded whole from a descriptor take one more round: the GL thread
+// maps a pixel unpack buffer for the opened pages and a worker decodes them
+// into it.
+typedef struct {
+  StatusCode status;
+  pthread_t threads[FONT_LOADER_MAX_THREADS];
+  unsigned threadCount;
+  pthread_mutex_t mutex;
+  pthread_cond_t jobQueued;
+  FontLoadJob *queued;
+  FontLoadJob **queuedTail;
+  FontLoadJob *completed;
+  FontLoadJob **completedTail;
+  unsigned pendingCount;
+  bool stopping;
+} FontLoader;
+
+StatusCode StartFontLoader(FontLoader *loader, unsigned threadCount);
+void StopFontLoader(FontLoader *loader);
+bool QueueFontLoad(FontLoader *loader, BitmapFont *font,
+                   const char *descFilename);
+bool QueueDistanceFieldFontLoad(FontLoader *loader, BitmapFont *font,
+                                const char *descFilename,
+                                float distanceRange);
+bool QueueFontPackLoad(FontLoader *loader, BitmapFont *font,
+                       const char *packFilename);
+bool QueueCachedFontLoad(FontLoader *loader, BitmapFont *font,
+                         const char *descFilename, unsigned cacheSize);
+bool QueueCachedFontPackLoad(FontLoader *loader, BitmapFont *font,
+                             const char *packFilename, unsigned cacheSize);
+unsigned PollFontLoader(FontLoader *loader, unsigned maxUploads);
+unsigned GetPendingFontLoads(FontLoader *loader);
+
+#endif // SFR_FONT_LOADER_H
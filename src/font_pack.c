@@ -0,0 +1,363 @@
+#include "font_pack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+
+static uint64_t AddFontPackSection(FontPackSection *section, uint64_t offset,
+                                   uint64_t size) {
+  offset = (offset + FONT_PACK_ALIGNMENT - 1) &
+           ~(uint64_t)(FONT_PACK_ALIGNMENT - 1);
+  section->offset = offset;
+  section->size = size;
+  return offset + size;
+}
+
+static bool WriteFontPackSection(FILE *file, FontPackSection section,
+                                 const void *data) {
+  // Seeking past the end leaves the alignment padding zeroed
+  return fseek(file, (long)section.offset, SEEK_SET) == 0 &&
+         fwrite(data, 1, section.size, file) == section.size;
+}
+
+static bool IsFontPackSectionValid(const FontPack *pack,
+                                   FontPackSection section,
+                                   uint64_t expectedSize) {
+  return section.size == expectedSize &&
+         section.offset % FONT_PACK_ALIGNMENT == 0 &&
+         section.offset <= pack->size &&
+         section.size <= pack->size - section.offset;
+}
+
+// Lookups index the tables without checks, so every page and glyph index of
+// the map has to be in range
+static bool AreFontPackPagesValid(const FontPack *pack) {
+  const FontPackHeader *header = pack->header;
+  const unsigned short *pageIndex =
+      GetFontPackSection(pack, header->glyphPageIndex);
+  const GlyphPage *pages = GetFontPackSection(pack, header->glyphPages);
+  for (unsigned i = 0; i < GLYPH_PAGE_COUNT; i++) {
+    if (pageIndex[i] >= header->glyphPageCount) {
+      return false;
+    }
+  }
+
+  for (unsigned i = 0; i < header->glyphPageCount; i++) {
+    for (unsigned j = 0; j < GLYPH_PAGE_SIZE; j++) {
+      if (pages[i][j] >= header->glyphCount) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Glyphs sample their atlas layer and visibility is read as bool. A kerning
+// probe only stops at a key that is looked up or at an empty slot, so the key
+// table needs one.
+static bool AreFontPackTablesValid(const FontPack *pack) {
+  const FontPackHeader *header = pack->header;
+  const GlyphTableEntry *glyphs = GetFontPackSection(pack, header->glyphTable);
+  for (unsigned i = 0; i < header->glyphCount; i++) {
+    if (!(glyphs[i].layer >= 0.0f &&
+          glyphs[i].layer < (float)header->atlasLayers)) {
+      return false;
+    }
+  }
+
+  const unsigned char *visible = GetFontPackSection(pack, header->glyphVisible);
+  for (unsigned i = 0; i < header->glyphCount; i++) {
+    if (visible[i] > 1) {
+      return false;
+    }
+  }
+
+  const unsigned *keys = GetFontPackSection(pack, header->kerningKeys);
+  for (unsigned i = 0; i < header->kerningSlots; i++) {
+    if (keys[i] == KERNING_EMPTY_KEY) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool WriteFontPack(const char *filename, const BitmapFontData *data) {
+  const BitmapFont *font = &data->font;
+  bool written = false;
+  unsigned glyphCount = font->glyphCount;
+  unsigned kerningSlots = font->kerningMask + 1;
+  FontPackHeader header = {
+      .magic = FONT_PACK_MAGIC,
+      .version = FONT_PACK_VERSION,
+      .byteOrder = FONT_PACK_BYTE_ORDER,
+      .fontSize = font->fontSize,
+      .lineHeight = font->lineHeight,
+      .base = font->base,
+      .glyphCount = glyphCount,
+      .glyphPageCount = font->glyphPageCount,
+      .kerningSlots = kerningSlots,
+      .kerningShift = font->kerningShift,
+      .atlasWidth = data->atlasWidth,
+      .atlasHeight = data->atlasHeight,
+      .atlasLayers = data->atlasLayers,
+      .distanceRange = font->distanceRange,
+      .atlasFormat = data->atlasFormat,
+      .atlasColor = data->atlasColor,
+  };
+
+  uint64_t offset = sizeof(header);
+  offset = AddFontPackSection(&header.glyphTable, offset,
+                              glyphCount * sizeof(GlyphTableEntry));
+  offset = AddFontPackSection(&header.glyphAdvances, offset,
+                              glyphCount * sizeof(float));
+  offset = AddFontPackSection(&header.glyphVisible, offset,
+                              glyphCount * sizeof(bool));
+  offset = AddFontPackSection(&header.glyphPageIndex, offset,
+                              GLYPH_PAGE_COUNT * sizeof(unsigned short));
+  offset = AddFontPackSection(&header.glyphPages, offset,
+                              font->glyphPageCount * sizeof(GlyphPage));
+  offset = AddFontPackSection(&header.kerningFilter, offset,
+                              glyphCount * sizeof(unsigned long long));
+  offset = AddFontPackSection(&header.kerningKeys, offset,
+                              kerningSlots * sizeof(unsigned));
+  offset = AddFontPackSection(&header.kerningAmounts, offset,
+                              kerningSlots * sizeof(float));
+  AddFontPackSection(&header.atlasPixels, offset,
+                     GetAtlasSize(data->atlasFormat, data->atlasWidth,
+                                  data->atlasHeight, data->atlasLayers));
+
+  FILE *file = fopen(filename, "wbe");
+  if (file == NULL) {
+    Log(LOG_ERROR, "PACK: could not create file: %s", filename);
+    return false;
+  }
+
+  written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            WriteFontPackSection(file, header.glyphTable, font->glyphs) &&
+            WriteFontPackSection(file, header.glyphAdvances, font->xas) &&
+            WriteFontPackSection(file, header.glyphVisible, font->visible) &&
+            WriteFontPackSection(file, header.glyphPageIndex,
+                                 font->glyphPageIndex) &&
+            WriteFontPackSection(file, header.glyphPages, font->glyphPages) &&
+            WriteFontPackSection(file, header.kerningFilter,
+                                 font->kerningFilter) &&
+            WriteFontPackSection(file, header.kerningKeys, font->kerningKeys) &&
+            WriteFontPackSection(file, header.kerningAmounts,
+                                 font->kerningAmounts) &&
+            WriteFontPackSection(file, header.atlasPixels, data->pixels);
+  if (fclose(file) != 0) {
+    written = false;
+  }
+
+  if (!written) {
+    Log(LOG_ERROR, "PACK: could not write file: %s", filename);
+  }
+
+  return written;
+}
+
+// One RGTC1 block: two endpoints and a 3 bit palette index per texel. The
+// endpoints are the extremes of the block (eight levels between them) or of
+// the texels other than 0 and 255 (six levels plus exact 0 and 255),
+// whichever is closer. Coverage blocks usually mix empty, full and edge
+// texels, the second palette keeps those exact.
+static void CompressRGTC1Block(const unsigned char texels[16],
+                               unsigned char block[8]) {
+  unsigned lo = 255;
+  unsigned hi = 0;
+  unsigned innerLo = 255;
+  unsigned innerHi = 0;
+  for (unsigned i = 0; i < 16; i++) {
+    lo = texels[i] < lo ? texels[i] : lo;
+    hi = texels[i] > hi ? texels[i] : hi;
+    if (texels[i] > 0 && texels[i] < 255) {
+      innerLo = texels[i] < innerLo ? texels[i] : innerLo;
+      innerHi = texels[i] > innerHi ? texels[i] : innerHi;
+    }
+  }
+
+  innerLo = innerLo <= innerHi ? innerLo : innerHi;
+  unsigned endpoints[2][2] = {{hi, lo}, {innerLo, innerHi}};
+  unsigned long long bestBits = 0;
+  unsigned bestError = ~0u;
+  unsigned best = 0;
+  for (unsigned mode = 0; mode < 2; mode++) {
+    unsigned e0 = endpoints[mode][0];
+    unsigned e1 = endpoints[mode][1];
+    unsigned palette[8] = {e0, e1};
+    if (e0 > e1) {
+      for (unsigned i = 1; i < 7; i++) {
+        palette[i + 1] = ((7 - i) * e0 + i * e1 + 3) / 7;
+      }
+    } else {
+      for (unsigned i = 1; i < 5; i++) {
+        palette[i + 1] = ((5 - i) * e0 + i * e1 + 2) / 5;
+      }
+
+      palette[6] = 0;
+      palette[7] = 255;
+    }
+
+    unsigned long long bits = 0;
+    unsigned error = 0;
+    for (unsigned i = 0; i < 16; i++) {
+      unsigned index = 0;
+      unsigned indexError = ~0u;
+      for (unsigned j = 0; j < 8; j++) {
+        int delta = (int)texels[i] - (int)palette[j];
+        if ((unsigned)(delta * delta) < indexError) {
+          indexError = (unsigned)(delta * delta);
+          index = j;
+        }
+      }
+
+      bits |= (unsigned long long)index << (i * 3);
+      error += indexError;
+    }
+
+    if (error < bestError) {
+      bestError = error;
+      bestBits = bits;
+      best = mode;
+    }
+  }
+
+  block[0] = (unsigned char)endpoints[best][0];
+  block[1] = (unsigned char)endpoints[best][1];
+  for (unsigned i = 0; i < 6; i++) {
+    block[2 + i] = (unsigned char)(bestBits >> (i * 8));
+  }
+}
+
+// Packs are the place to compress atlases, this is too slow for load time.
+// Only single channel atlases can be compressed; texels past the edges of
+// the atlas repeat the last row and column.
+StatusCode CompressFontAtlas(BitmapFontData *data) {
+  if (data->atlasFormat == ATLAS_RGTC1) {
+    return SUCCESS;
+  }
+
+  if (data->atlasFormat != ATLAS_R8 || data->font.packData != NULL) {
+    Log(LOG_ERROR, "PACK: only single channel atlases can be compressed");
+    return ERROR_INVALID_DESCRIPTION;
+  }
+
+  unsigned width = data->atlasWidth;
+  unsigned height = data->atlasHeight;
+  unsigned char *blocks =
+      malloc(GetAtlasSize(ATLAS_RGTC1, width, height, data->atlasLayers));
+  if (blocks == NULL) {
+    Log(LOG_ERROR, "PACK: could not allocate memory for the atlas blocks");
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  unsigned char *block = blocks;
+  for (unsigned layer = 0; layer < data->atlasLayers; layer++) {
+    const unsigned char *pixels = data->pixels + (size_t)width * height * layer;
+    for (unsigned y = 0; y < height; y += 4) {
+      for (unsigned x = 0; x < width; x += 4, block += 8) {
+        unsigned char texels[16];
+        for (unsigned i = 0; i < 16; i++) {
+          unsigned texelX = x + i % 4 < width ? x + i % 4 : width - 1;
+          unsigned texelY = y + i / 4 < height ? y + i / 4 : height - 1;
+          texels[i] = pixels[(size_t)texelY * width + texelX];
+        }
+
+        CompressRGTC1Block(texels, block);
+      }
+    }
+  }
+
+  free(data->pixels);
+  data->pixels = blocks;
+  data->atlasFormat = ATLAS_RGTC1;
+  return SUCCESS;
+}
+
+FontPack MapFontPack(const char *filename) {
+  FontPack pack = {0};
+  pack.data = MapFile(filename, &pack.size);
+  if (pack.data == NULL) {
+    pack.status = ERROR_CANNOT_LOAD_PACK_FILE;
+    return pack;
+  }
+
+  const FontPackHeader *header = pack.data;
+  pack.header = header;
+  if (pack.size < sizeof(*header) ||
+      memcmp(header->magic, FONT_PACK_MAGIC, sizeof(header->magic)) != 0) {
+    Log(LOG_ERROR, "PACK: not a font pack: %s", filename);
+    pack.status = ERROR_INVALID_PACK;
+  } else if (header->version != FONT_PACK_VERSION ||
+             header->byteOrder != FONT_PACK_BYTE_ORDER) {
+    Log(LOG_ERROR, "PACK: %s was written for another version or machine",
+        filename);
+    pack.status = ERROR_INVALID_PACK;
+  } else if (header->glyphCount == 0 || header->glyphCount > MAX_GLYPHS + 1 ||
+             header->glyphPageCount == 0 || header->atlasWidth == 0 ||
+             header->atlasWidth > FONT_PACK_MAX_ATLAS_SIZE ||
+             header->atlasHeight == 0 ||
+             header->atlasHeight > FONT_PACK_MAX_ATLAS_SIZE ||
+             header->atlasLayers == 0 ||
+             header->atlasLayers > FONT_PACK_MAX_ATLAS_LAYERS ||
+             header->atlasFormat > ATLAS_RGTC1 ||
+             header->atlasColor > ATLAS_COLOR_COVERAGE ||
+             header->kerningSlots < 16 ||
+             (header->kerningSlots & (header->kerningSlots - 1)) != 0 ||
+             // The hash keeps as many top bits as index the slots, as
+             // MakeKerningTable sets it
+             header->kerningShift !=
+                 32u - (unsigned)__builtin_ctz(header->kerningSlots)) {
+    Log(LOG_ERROR, "PACK: invalid table sizes or atlas format: %s", filename);
+    pack.status = ERROR_INVALID_PACK;
+  } else if (!IsFontPackSectionValid(
+                 &pack, header->glyphTable,
+                 header->glyphCount * sizeof(GlyphTableEntry)) ||
+             !IsFontPackSectionValid(&pack, header->glyphAdvances,
+                                     header->glyphCount * sizeof(float)) ||
+             !IsFontPackSectionValid(&pack, header->glyphVisible,
+                                     header->glyphCount * sizeof(bool)) ||
+             !IsFontPackSectionValid(
+                 &pack, header->glyphPageIndex,
+                 GLYPH_PAGE_COUNT * sizeof(unsigned short)) ||
+             !IsFontPackSectionValid(
+                 &pack, header->glyphPages,
+                 header->glyphPageCount * sizeof(GlyphPage)) ||
+             !IsFontPackSectionValid(
+                 &pack, header->kerningFilter,
+                 header->glyphCount * sizeof(unsigned long long)) ||
+             !IsFontPackSectionValid(&pack, header->kerningKeys,
+                                     header->kerningSlots * sizeof(unsigned)) ||
+             !IsFontPackSectionValid(&pack, header->kerningAmounts,
+                                     header->kerningSlots * sizeof(float)) ||
+             !IsFontPackSectionValid(
+                 &pack, header->atlasPixels,
+                 GetAtlasSize((AtlasFormat)header->atlasFormat,
+                              header->atlasWidth, header->atlasHeight,
+                              header->atlasLayers))) {
+    Log(LOG_ERROR, "PACK: truncated or corrupted sections: %s", filename);
+    pack.status = ERROR_INVALID_PACK;
+  } else if (!AreFontPackPagesValid(&pack)) {
+    Log(LOG_ERROR, "PACK: glyph pages out of range: %s", filename);
+    pack.status = ERROR_INVALID_PACK;
+  } else if (!AreFontPackTablesValid(&pack)) {
+    Log(LOG_ERROR, "PACK: invalid glyph or kerning tables: %s", filename);
+    pack.status = ERROR_INVALID_PACK;
+  }
+
+  if (pack.status != SUCCESS) {
+    UnmapFile(pack.data, pack.size);
+    pack.data = NULL;
+    pack.header = NULL;
+  }
+
+  return pack;
+}
+
+void *GetFontPackSection(const FontPack *pack, FontPackSection section) {
+  return (unsigned char *)pack->data + section.offset;
+}
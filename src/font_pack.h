@@ -0,0 +1,68 @@
+#ifndef SFR_FONT_PACK_H
+#define SFR_FONT_PACK_H
+
+#include <stdint.h>
+
+#include "common.h"
+#include "font.h"
+
+#define FONT_PACK_MAGIC "SFRPACK"
+#define FONT_PACK_VERSION 5
+#define FONT_PACK_BYTE_ORDER 0x01020304u
+// Sections start on cache line boundaries of the mapping
+#define FONT_PACK_ALIGNMENT 64
+// Atlas dimensions a pack may declare, so its pixel size cannot overflow
+#define FONT_PACK_MAX_ATLAS_SIZE 16384
+#define FONT_PACK_MAX_ATLAS_LAYERS 256
+
+typedef struct {
+  uint64_t offset;
+  uint64_t size;
+} FontPackSection;
+
+// Precompiled font: every section is stored in the exact layout the loader
+// hands to GL or to the layout code, in the byte order of the machine that
+// wrote it. The atlas is in atlasFormat with its rows already flipped for GL,
+// one layer after the other, holding a distance field when distanceRange is
+// not zero.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  float fontSize;
+  float lineHeight;
+  float base;
+  uint32_t glyphCount;
+  uint32_t glyphPageCount;
+  uint32_t kerningSlots;
+  uint32_t kerningShift;
+  uint32_t atlasWidth;
+  uint32_t atlasHeight;
+  uint32_t atlasLayers;
+  float distanceRange;
+  uint32_t atlasFormat;
+  uint32_t atlasColor;
+  FontPackSection glyphTable;
+  FontPackSection glyphAdvances;
+  FontPackSection glyphVisible;
+  FontPackSection glyphPageIndex;
+  FontPackSection glyphPages;
+  FontPackSection kerningFilter;
+  FontPackSection kerningKeys;
+  FontPackSection kerningAmounts;
+  FontPackSection atlasPixels;
+} FontPackHeader;
+
+typedef struct {
+  StatusCode status;
+  void *data;
+  size_t size;
+  const FontPackHeader *header;
+} FontPack;
+
+bool WriteFontPack(const char *filename, const BitmapFontData *data);
+StatusCode CompressFontAtlas(BitmapFontData *data);
+FontPack MapFontPack(const char *filename);
+void *GetFontPackSection(const FontPack *pack, FontPackSection section);
+
+#endif // SFR_FONT_PACK_H
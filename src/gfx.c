@@ -0,0 +1,429 @@
+#include "gfx.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glad/glad.h>
+
+#include "common.h"
+#include "files.h"
+
+// Program binaries are kept in shaderCacheDir when it is set, leaving room
+// for the entry names in a path
+static char shaderCacheDir[PATH_MAX - 32];
+static ShaderStats shaderStats;
+
+// NULL turns the program cache off
+bool SetShaderCacheDir(const char *dir) {
+  if (dir == NULL) {
+    shaderCacheDir[0] = '\0';
+    return true;
+  }
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    Log(LOG_ERROR, "SHADER: could not create program cache: %s", dir);
+    return false;
+  }
+
+  snprintf(shaderCacheDir, sizeof(shaderCacheDir), "%s", dir);
+  return true;
+}
+
+ShaderStats GetShaderStats(void) { return shaderStats; }
+
+static unsigned long long HashShaderString(unsigned long long hash,
+                                           const char *text) {
+  // FNV-1a, the terminator included so strings cannot run into each other
+  do {
+    hash = (hash ^ (unsigned char)*text) * 0x100000001B3ull;
+  } while (*text++ != '\0');
+
+  return hash;
+}
+
+// Binaries only load on the same driver, so the key also covers it
+static unsigned long long HashShaderSources(char *const codes[],
+                                            unsigned shaderCount) {
+  const char *driver[] = {
+      (const char *)glGetString(GL_VENDOR),
+      (const char *)glGetString(GL_RENDERER),
+      (const char *)glGetString(GL_VERSION),
+  };
+  unsigned long long hash = 0xCBF29CE484222325ull;
+  for (unsigned i = 0; i < shaderCount; i++) {
+    hash = HashShaderString(hash, codes[i]);
+  }
+
+  for (unsigned i = 0; i < sizeof(driver) / sizeof(driver[0]); i++) {
+    hash = HashShaderString(hash, driver[i] != NULL ? driver[i] : "");
+  }
+
+  return hash;
+}
+
+static bool CanCacheShaders(void) {
+  if (shaderCacheDir[0] == '\0' ||
+      (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)) {
+    return false;
+  }
+
+  int formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  return formatCount > 0;
+}
+
+static void MakeShaderCachePath(char *path, size_t size,
+                                unsigned long long key) {
+  snprintf(path, size, "%s/%016llx.bin", shaderCacheDir, key);
+}
+
+// A binary the driver rejects, after an update for instance, is compiled
+// from source again and replaced
+static unsigned LoadProgramBinary(unsigned long long key) {
+  char path[PATH_MAX];
+  size_t size = 0;
+  MakeShaderCachePath(path, sizeof(path), key);
+  if (access(path, R_OK) != 0) {
+    return 0;
+  }
+
+  unsigned program = 0;
+  char *data = ReadFileData(path, &size);
+  const ShaderCacheHeader *header = (const ShaderCacheHeader *)data;
+  if (data == NULL || size < sizeof(ShaderCacheHeader) ||
+      memcmp(header->magic, SHADER_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SHADER_CACHE_VERSION || header->key != key ||
+      header->length != size - sizeof(ShaderCacheHeader)) {
+    Log(LOG_WARN, "SHADER: ignoring invalid program cache entry: %s", path);
+    goto terminate;
+  }
+
+  int linked = 0;
+  program = glCreateProgram();
+  glProgramBinary(program, header->format, header + 1,
+                  (GLsizei)header->length);
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    Log(LOG_WARN, "SHADER: driver rejected cached program: %s", path);
+    glDeleteProgram(program);
+    program = 0;
+    shaderStats.rejected++;
+  }
+
+terminate:
+  if (data != NULL) {
+    free(data);
+  }
+
+  return program;
+}
+
+// Written aside then renamed, so a reader never sees half an entry
+static void SaveProgramBinary(unsigned program, unsigned long long key) {
+  int length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  ShaderCacheHeader *header = malloc(sizeof(ShaderCacheHeader) + length);
+  if (header == NULL) {
+    return;
+  }
+
+  GLenum format = 0;
+  glGetProgramBinary(program, length, NULL, &format, header + 1);
+  memcpy(header->magic, SHADER_CACHE_MAGIC, sizeof(header->magic));
+  header->version = SHADER_CACHE_VERSION;
+  header->format = format;
+  header->key = key;
+  header->length = (uint64_t)length;
+
+  char path[PATH_MAX];
+  char tempPath[PATH_MAX + 8];
+  MakeShaderCachePath(path, sizeof(path), key);
+  snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+  FILE *file = fopen(tempPath, "wbe");
+  bool written = file != NULL &&
+                 fwrite(header, sizeof(ShaderCacheHeader) + length, 1, file) ==
+                     1;
+  if (file != NULL && fclose(file) != 0) {
+    written = false;
+  }
+
+  if (!written || rename(tempPath, path) != 0) {
+    Log(LOG_WARN, "SHADER: could not write program cache entry: %s", path);
+    remove(tempPath);
+  }
+
+  free(header);
+}
+
+static unsigned CompileShader(GLenum type, const char *code,
+                              const char *filename) {
+  int shaderStatus = 0;
+  char shaderLog[512] = {0};
+  unsigned shaderId = glCreateShader(type);
+  glShaderSource(shaderId, 1, &code, NULL);
+  glCompileShader(shaderId);
+
+  glGetShaderiv(shaderId, GL_COMPILE_STATUS, &shaderStatus);
+  if (!shaderStatus) {
+    glGetShaderInfoLog(shaderId, 512, NULL, shaderLog);
+    Log(LOG_ERROR, "SHADER: could not compile %s: %s", filename, shaderLog);
+    glDeleteShader(shaderId);
+    return 0;
+  }
+
+  return shaderId;
+}
+
+// Loads the program from the program cache when it has been compiled from
+// the same sources by the same driver, else compiles and links it and adds
+// it to the cache
+static unsigned LoadProgram(const GLenum types[], const char *filenames[],
+                            unsigned shaderCount, const char *name) {
+  double start = GetMonotonicTime();
+  unsigned shaderProgramId = 0;
+  int shaderStatus = 0;
+  char shaderLog[512] = {0};
+  char *codes[MAX_PROGRAM_SHADERS] = {NULL};
+  unsigned shaderIds[MAX_PROGRAM_SHADERS] = {0};
+  bool cache = false;
+  unsigned long long key = 0;
+
+  for (unsigned i = 0; i < shaderCount; i++) {
+    codes[i] = ReadTextFile(filenames[i]);
+    if (codes[i] == NULL) {
+      Log(LOG_ERROR, "SHADER: could not load shader: %s", filenames[i]);
+      goto terminate;
+    }
+  }
+
+  cache = CanCacheShaders();
+  if (cache) {
+    key = HashShaderSources(codes, shaderCount);
+    shaderProgramId = LoadProgramBinary(key);
+    if (shaderProgramId != 0) {
+      double elapsed = GetMonotonicTime() - start;
+      shaderStats.cached++;
+      shaderStats.cacheTime += elapsed;
+      Log(LOG_INFO, "SHADER: %s: loaded from the program cache in %.2f ms",
+          name, elapsed * 1e3);
+      goto terminate;
+    }
+  }
+
+  for (unsigned i = 0; i < shaderCount; i++) {
+    shaderIds[i] = CompileShader(types[i], codes[i], filenames[i]);
+    if (shaderIds[i] == 0) {
+      goto terminate;
+    }
+  }
+
+  shaderProgramId = glCreateProgram();
+  if (cache) {
+    glProgramParameteri(shaderProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  }
+
+  for (unsigned i = 0; i < shaderCount; i++) {
+    glAttachShader(shaderProgramId, shaderIds[i]);
+  }
+
+  glLinkProgram(shaderProgramId);
+
+  glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &shaderStatus);
+  if (!shaderStatus) {
+    glGetProgramInfoLog(shaderProgramId, 512, NULL, shaderLog);
+    Log(LOG_ERROR, "SHADER: could not link shader program: %s", shaderLog);
+    glDeleteProgram(shaderProgramId);
+    shaderProgramId = 0;
+    goto terminate;
+  }
+
+  if (cache) {
+    SaveProgramBinary(shaderProgramId, key);
+  }
+
+  double elapsed = GetMonotonicTime() - start;
+  shaderStats.compiled++;
+  shaderStats.compileTime += elapsed;
+  Log(LOG_INFO, "SHADER: %s: compiled in %.2f ms", name, elapsed * 1e3);
+
+terminate:
+  for (unsigned i = 0; i < shaderCount; i++) {
+    if (shaderIds[i] != 0) {
+      glDeleteShader(shaderIds[i]);
+    }
+
+    if (codes[i] != NULL) {
+      free(codes[i]);
+    }
+  }
+
+  return shaderProgramId;
+}
+
+unsigned LoadShader(const char *vsFilename, const char *fsFilename) {
+  char name[2 * PATH_MAX];
+  const GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+  const char *filenames[] = {vsFilename, fsFilename};
+  snprintf(name, sizeof(name), "%s + %s", vsFilename, fsFilename);
+  return LoadProgram(types, filenames, 2, name);
+}
+
+// Needs compute shaders, from GL 4.3 or ARB_compute_shader
+unsigned LoadComputeShader(const char *csFilename) {
+  const GLenum types[] = {GL_COMPUTE_SHADER};
+  const char *filenames[] = {csFilename};
+  return LoadProgram(types, filenames, 1, csFilename);
+}
+
+// The driver compiles and links on its own threads when it can, polling the
+// build then never waits for it. Otherwise every poll takes one step of the
+// build, a compile or the link.
+ShaderBuild StartShaderBuild(const char *vsCode, const char *fsCode,
+                             const char *name) {
+  static bool compilerThreadsSet = false;
+  const GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+  const char *codes[] = {vsCode, fsCode};
+  ShaderBuild build = {
+      .state = SHADER_BUILD_PENDING,
+      .name = name,
+      .shaderCount = 2,
+      .parallel = GLAD_GL_KHR_parallel_shader_compile ||
+                  GLAD_GL_ARB_parallel_shader_compile,
+  };
+
+  // As many threads as the driver likes
+  if (build.parallel && !compilerThreadsSet) {
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    } else {
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    }
+
+    compilerThreadsSet = true;
+  }
+
+  build.programId = glCreateProgram();
+  for (unsigned i = 0; i < build.shaderCount; i++) {
+    build.shaderIds[i] = glCreateShader(types[i]);
+    glShaderSource(build.shaderIds[i], 1, &codes[i], NULL);
+    glAttachShader(build.programId, build.shaderIds[i]);
+    if (build.parallel) {
+      glCompileShader(build.shaderIds[i]);
+    }
+  }
+
+  if (build.parallel) {
+    glLinkProgram(build.programId);
+    build.step = build.shaderCount + 1;
+  }
+
+  return build;
+}
+
+ShaderBuildState PollShaderBuild(ShaderBuild *build) {
+  if (build->state != SHADER_BUILD_PENDING) {
+    return build->state;
+  }
+
+  if (build->step < build->shaderCount) {
+    glCompileShader(build->shaderIds[build->step++]);
+    return SHADER_BUILD_PENDING;
+  }
+
+  if (build->step == build->shaderCount) {
+    glLinkProgram(build->programId);
+    build->step++;
+    return SHADER_BUILD_PENDING;
+  }
+
+  if (build->parallel) {
+    int done = 0;
+    glGetProgramiv(build->programId, GL_COMPLETION_STATUS_KHR, &done);
+    if (!done) {
+      return SHADER_BUILD_PENDING;
+    }
+  }
+
+  int linked = 0;
+  char shaderLog[512] = {0};
+  glGetProgramiv(build->programId, GL_LINK_STATUS, &linked);
+  if (linked) {
+    build->state = SHADER_BUILD_LINKED;
+  } else {
+    for (unsigned i = 0; i < build->shaderCount; i++) {
+      int compiled = 0;
+      glGetShaderiv(build->shaderIds[i], GL_COMPILE_STATUS, &compiled);
+      if (!compiled) {
+        glGetShaderInfoLog(build->shaderIds[i], 512, NULL, shaderLog);
+        Log(LOG_ERROR, "SHADER: %s: could not compile shader %u: %s",
+            build->name, i, shaderLog);
+      }
+    }
+
+    glGetProgramInfoLog(build->programId, 512, NULL, shaderLog);
+    Log(LOG_ERROR, "SHADER: %s: could not link shader program: %s",
+        build->name, shaderLog);
+    glDeleteProgram(build->programId);
+    build->programId = 0;
+    build->state = SHADER_BUILD_FAILED;
+  }
+
+  for (unsigned i = 0; i < build->shaderCount; i++) {
+    glDeleteShader(build->shaderIds[i]);
+    build->shaderIds[i] = 0;
+  }
+
+  return build->state;
+}
+
+// Drops a build in progress, or the program of a linked one
+void CancelShaderBuild(ShaderBuild *build) {
+  for (unsigned i = 0; i < build->shaderCount; i++) {
+    if (build->shaderIds[i] != 0) {
+      glDeleteShader(build->shaderIds[i]);
+    }
+  }
+
+  if (build->programId != 0) {
+    glDeleteProgram(build->programId);
+  }
+
+  *build = (ShaderBuild){0};
+}
+
+unsigned MakeTextureArray(const unsigned char *pixels, unsigned width,
+                          unsigned height, unsigned layers) {
+  unsigned textureId = 0;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, (int)width, (int)height,
+               (int)layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  return textureId;
+}
+
+void MakeOrthoProj(float m[16], float l, float r, float t, float b, float n,
+                   float f) {
+  m[0] = 2 / (r - l);
+  m[3] = -(r + l) / (r - l);
+  m[5] = 2 / (t - b);
+  m[7] = -(t + b) / (t - b);
+  m[10] = -2 / (f - n);
+  m[11] = -(f + n) / (f - n);
+  m[15] = 1.0f;
+}
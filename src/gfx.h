@@ -0,0 +1,72 @@
+#ifndef SFR_GFX_H
+#define SFR_GFX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SHADER_CACHE_MAGIC "SFRPROG"
+#define SHADER_CACHE_VERSION 1
+// Stages linked into one program at most
+#define MAX_PROGRAM_SHADERS 2
+
+typedef struct {
+  unsigned vao;
+  unsigned vbo;
+  unsigned ebo;
+} Mesh;
+
+// Program cache entry, the program binary follows. Entries are named after
+// the key, a hash of the shader sources and of the GL vendor, renderer and
+// version.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint64_t key;
+  uint64_t length;
+} ShaderCacheHeader;
+
+// Programs made by LoadShader since startup and the time spent on them
+typedef struct {
+  unsigned compiled;
+  unsigned cached;
+  // Cache entries the driver did not accept, compiled again
+  unsigned rejected;
+  double compileTime;
+  double cacheTime;
+} ShaderStats;
+
+typedef enum {
+  SHADER_BUILD_NONE,
+  SHADER_BUILD_PENDING,
+  SHADER_BUILD_LINKED,
+  SHADER_BUILD_FAILED,
+} ShaderBuildState;
+
+// Vertex and fragment program built over several frames, see
+// StartShaderBuild. The name is kept for the log and must outlive the build.
+typedef struct {
+  ShaderBuildState state;
+  const char *name;
+  unsigned programId;
+  unsigned shaderIds[MAX_PROGRAM_SHADERS];
+  unsigned shaderCount;
+  // Compiles and the link issued so far
+  unsigned step;
+  bool parallel;
+} ShaderBuild;
+
+bool SetShaderCacheDir(const char *dir);
+ShaderStats GetShaderStats(void);
+unsigned LoadShader(const char *vsFilename, const char *fsFilename);
+unsigned LoadComputeShader(const char *csFilename);
+ShaderBuild StartShaderBuild(const char *vsCode, const char *fsCode,
+                             const char *name);
+ShaderBuildState PollShaderBuild(ShaderBuild *build);
+void CancelShaderBuild(ShaderBuild *build);
+unsigned MakeTextureArray(const unsigned char *pixels, unsigned width,
+                          unsigned height, unsigned layers);
+void MakeOrthoProj(float m[16], float l, float r, float t, float b, float n,
+                   float f);
+
+#endif // SFR_GFX_H
@@ -0,0 +1,472 @@
+#include "glyph_cache.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+static void MarkGlyphDirty(GlyphCache *cache, unsigned glyph) {
+  if (glyph < cache->dirtyGlyphStart) {
+    cache->dirtyGlyphStart = glyph;
+  }
+
+  if (glyph + 1 > cache->dirtyGlyphEnd) {
+    cache->dirtyGlyphEnd = glyph + 1;
+  }
+}
+
+static void MarkRowsDirty(GlyphCache *cache, unsigned row, unsigned count) {
+  if (row < cache->dirtyRowStart) {
+    cache->dirtyRowStart = row;
+  }
+
+  if (row + count > cache->dirtyRowEnd) {
+    cache->dirtyRowEnd = row + count;
+  }
+}
+
+static void UnlinkGlyphSlot(GlyphCache *cache, unsigned slot) {
+  GlyphCacheSlot *slots = cache->slots;
+  slots[slots[slot].prev].next = slots[slot].next;
+  slots[slots[slot].next].prev = slots[slot].prev;
+}
+
+// Most recently used first, right after the list head
+static void LinkGlyphSlot(GlyphCache *cache, unsigned slot) {
+  GlyphCacheSlot *slots = cache->slots;
+  slots[slot].prev = 0;
+  slots[slot].next = slots[0].next;
+  slots[slots[0].next].prev = slot;
+  slots[0].next = slot;
+}
+
+// Slot records are reused from the pool first, indices stay valid but the
+// array may move
+static unsigned NewGlyphSlot(GlyphCache *cache) {
+  if (cache->poolSlots != 0) {
+    unsigned slot = cache->poolSlots;
+    cache->poolSlots = cache->slots[slot].next;
+    return slot;
+  }
+
+  if (cache->slotCount == cache->slotCapacity) {
+    unsigned capacity = cache->slotCapacity * 2;
+    GlyphCacheSlot *slots =
+        realloc(cache->slots, capacity * sizeof(GlyphCacheSlot));
+    if (slots == NULL) {
+      Log(LOG_ERROR, "CACHE: could not allocate memory for %u slots",
+          capacity);
+      return 0;
+    }
+
+    cache->slots = slots;
+    cache->slotCapacity = capacity;
+  }
+
+  return cache->slotCount++;
+}
+
+static void ReleaseGlyphSlot(GlyphCache *cache, unsigned slot) {
+  cache->slots[slot].next = cache->poolSlots;
+  cache->poolSlots = slot;
+}
+
+// First freed slot of the shelf wide enough, what is left of it stays free,
+// then the space never used at its end
+static unsigned PlaceInShelf(GlyphCache *cache, unsigned shelfIndex,
+                             unsigned width, unsigned height) {
+  GlyphCacheShelf *shelf = &cache->shelves[shelfIndex];
+  bool empty = shelf->residentCount == 0;
+  if (shelf->height != height && !(empty && shelf->height >= height)) {
+    return 0;
+  }
+
+  for (unsigned *link = &shelf->freeSlots; *link != 0;
+       link = &cache->slots[*link].next) {
+    unsigned slot = *link;
+    if (cache->slots[slot].width < width) {
+      continue;
+    }
+
+    *link = cache->slots[slot].next;
+    unsigned rest = cache->slots[slot].width - width;
+    if (rest > 0) {
+      unsigned restSlot = NewGlyphSlot(cache);
+      if (restSlot != 0) {
+        cache->slots[restSlot] = (GlyphCacheSlot){
+            .x = cache->slots[slot].x + width,
+            .width = rest,
+            .shelf = shelfIndex,
+            .next = shelf->freeSlots,
+        };
+        shelf->freeSlots = restSlot;
+        cache->slots[slot].width = width;
+      }
+    }
+
+    return slot;
+  }
+
+  if (shelf->end + width > cache->size) {
+    return 0;
+  }
+
+  unsigned slot = NewGlyphSlot(cache);
+  if (slot != 0) {
+    cache->slots[slot] = (GlyphCacheSlot){
+        .x = shelf->end,
+        .width = width,
+        .shelf = shelfIndex,
+    };
+    shelf->end += width;
+  }
+
+  return slot;
+}
+
+static unsigned PlaceInNewShelf(GlyphCache *cache, unsigned width,
+                                unsigned height) {
+  if (cache->shelvesTop + height > cache->size) {
+    return 0;
+  }
+
+  if (cache->shelfCount == cache->shelfCapacity) {
+    unsigned capacity = cache->shelfCapacity * 2;
+    GlyphCacheShelf *shelves =
+        realloc(cache->shelves, capacity * sizeof(GlyphCacheShelf));
+    if (shelves == NULL) {
+      Log(LOG_ERROR, "CACHE: could not allocate memory for %u shelves",
+          capacity);
+      return 0;
+    }
+
+    cache->shelves = shelves;
+    cache->shelfCapacity = capacity;
+  }
+
+  unsigned shelfIndex = cache->shelfCount++;
+  cache->shelves[shelfIndex] = (GlyphCacheShelf){
+      .y = cache->shelvesTop,
+      .height = height,
+  };
+  cache->shelvesTop += height;
+  return PlaceInShelf(cache, shelfIndex, width, height);
+}
+
+// Takes the glyph out of the cache, returns the shelf its slot was in. An
+// empty shelf forgets its slots and may take glyphs of any smaller height.
+static unsigned EvictGlyphSlot(GlyphCache *cache, unsigned slot) {
+  GlyphCacheSlot *record = &cache->slots[slot];
+  unsigned shelfIndex = record->shelf;
+  GlyphCacheShelf *shelf = &cache->shelves[shelfIndex];
+  UnlinkGlyphSlot(cache, slot);
+  cache->glyphSlots[record->glyph] = 0;
+  cache->table[record->glyph].size[0] = 0.0f;
+  cache->table[record->glyph].size[1] = 0.0f;
+  MarkGlyphDirty(cache, record->glyph);
+  cache->frameStats.evictions++;
+
+  shelf->residentCount--;
+  if (shelf->residentCount > 0) {
+    record->next = shelf->freeSlots;
+    shelf->freeSlots = slot;
+    return shelfIndex;
+  }
+
+  while (shelf->freeSlots != 0) {
+    unsigned next = cache->slots[shelf->freeSlots].next;
+    ReleaseGlyphSlot(cache, shelf->freeSlots);
+    shelf->freeSlots = next;
+  }
+
+  ReleaseGlyphSlot(cache, slot);
+  shelf->end = 0;
+  return shelfIndex;
+}
+
+static unsigned AllocateGlyphSlot(GlyphCache *cache, unsigned long long frame,
+                                  unsigned width, unsigned height) {
+  height = (height + GLYPH_CACHE_SHELF_STEP - 1) / GLYPH_CACHE_SHELF_STEP *
+           GLYPH_CACHE_SHELF_STEP;
+  if (width > cache->size || height > cache->size) {
+    return 0;
+  }
+
+  for (unsigned i = 0; i < cache->shelfCount; i++) {
+    unsigned slot = PlaceInShelf(cache, i, width, height);
+    if (slot != 0) {
+      return slot;
+    }
+  }
+
+  unsigned slot = PlaceInNewShelf(cache, width, height);
+  if (slot != 0) {
+    return slot;
+  }
+
+  // Evict from the least recently used end until the glyph fits where a
+  // glyph was, never a glyph of this frame
+  for (;;) {
+    unsigned victim = cache->slots[0].prev;
+    if (victim == 0 || cache->slots[victim].lastUsed == frame) {
+      return 0;
+    }
+
+    slot = PlaceInShelf(cache, EvictGlyphSlot(cache, victim), width, height);
+    if (slot != 0) {
+      return slot;
+    }
+  }
+}
+
+// Clears the padded slot and copies the glyph rows, atlas rows being stored
+// bottom up in both
+static void CopyGlyphToSlot(GlyphCache *cache, const GlyphCacheSlot *slot,
+                            unsigned srcX, unsigned srcTop, unsigned layer,
+                            unsigned width, unsigned height) {
+  const GlyphCacheShelf *shelf = &cache->shelves[slot->shelf];
+  unsigned texelSize = cache->texelSize;
+  unsigned padding = GLYPH_CACHE_PADDING;
+  unsigned paddedHeight = height + padding * 2;
+  size_t rowSize = (size_t)cache->size * texelSize;
+  for (unsigned row = 0; row < paddedHeight; row++) {
+    memset(cache->pixels + (shelf->y + row) * rowSize +
+               (size_t)slot->x * texelSize,
+           0, (size_t)slot->width * texelSize);
+  }
+
+  const unsigned char *source =
+      cache->sourcePixels + (size_t)layer * cache->sourceWidth *
+                                cache->sourceHeight * texelSize;
+  for (unsigned row = 0; row < height; row++) {
+    size_t srcRow = cache->sourceHeight - 1 - (srcTop + row);
+    size_t dstRow = shelf->y + padding + height - 1 - row;
+    memcpy(cache->pixels + dstRow * rowSize +
+               (size_t)(slot->x + padding) * texelSize,
+           source + (srcRow * cache->sourceWidth + srcX) * texelSize,
+           (size_t)width * texelSize);
+  }
+
+  MarkRowsDirty(cache, shelf->y, paddedHeight);
+}
+
+GlyphCache *CreateGlyphCache(const BitmapFont *font, BitmapFontData *source,
+                             unsigned size) {
+  GlyphCache *cache = NULL;
+  if (source->atlasFormat == ATLAS_RGTC1) {
+    Log(LOG_ERROR, "CACHE: compressed atlases cannot be cached");
+    return NULL;
+  }
+
+  size = size > 0 ? size : GLYPH_CACHE_DEFAULT_SIZE;
+  cache = calloc(1, sizeof(GlyphCache));
+  if (cache == NULL) {
+    Log(LOG_ERROR, "CACHE: could not allocate memory for a glyph cache");
+    return NULL;
+  }
+
+  *cache = (GlyphCache){
+      .size = size,
+      .texelSize = source->atlasFormat == ATLAS_R8 ? 1 : 4,
+      .glyphTableBufferId = font->glyphTableBufferId,
+      .sourceGlyphs = font->glyphs,
+      .glyphCount = font->glyphCount,
+      .sourceWidth = source->atlasWidth,
+      .sourceHeight = source->atlasHeight,
+      .sourceLayers = source->atlasLayers,
+      .dirtyRowStart = size,
+      .dirtyGlyphStart = font->glyphCount,
+      .shelfCapacity = 16,
+      .slotCapacity = 256,
+      // Slot 0 is the head of the LRU list
+      .slotCount = 1,
+  };
+  cache->pixels = calloc((size_t)size * size, cache->texelSize);
+  cache->table = malloc(font->glyphCount * sizeof(GlyphTableEntry));
+  cache->glyphSlots = calloc(font->glyphCount, sizeof(unsigned));
+  cache->shelves = malloc(cache->shelfCapacity * sizeof(GlyphCacheShelf));
+  cache->slots = calloc(cache->slotCapacity, sizeof(GlyphCacheSlot));
+  if (cache->pixels == NULL || cache->table == NULL ||
+      cache->glyphSlots == NULL || cache->shelves == NULL ||
+      cache->slots == NULL) {
+    Log(LOG_ERROR, "CACHE: could not allocate memory for a %ux%u cache", size,
+        size);
+    DestroyGlyphCache(cache);
+    return NULL;
+  }
+
+  // Nothing is cached yet, every glyph starts with an empty quad
+  memcpy(cache->table, font->glyphs,
+         font->glyphCount * sizeof(GlyphTableEntry));
+  for (unsigned i = 0; i < font->glyphCount; i++) {
+    cache->table[i].size[0] = 0.0f;
+    cache->table[i].size[1] = 0.0f;
+    cache->table[i].layer = 0.0f;
+  }
+
+  glBindBuffer(GL_TEXTURE_BUFFER, cache->glyphTableBufferId);
+  glBufferData(GL_TEXTURE_BUFFER,
+               (GLsizeiptr)(font->glyphCount * sizeof(GlyphTableEntry)),
+               cache->table, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  int color = source->atlasColor == ATLAS_COLOR_WHITE      ? GL_ONE
+              : source->atlasColor == ATLAS_COLOR_COVERAGE ? GL_RED
+                                                           : GL_ZERO;
+  int swizzle[4] = {color, color, color, GL_RED};
+  glGenTextures(1, &cache->textureId);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, cache->textureId);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+  if (cache->texelSize == 1) {
+    glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, cache->texelSize == 1 ? GL_R8 : GL_RGBA8,
+               (int)size, (int)size, 1, 0,
+               cache->texelSize == 1 ? GL_RED : GL_RGBA, GL_UNSIGNED_BYTE,
+               cache->pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  // The cache reads the atlas from now on
+  cache->sourcePixels = source->pixels;
+  cache->ownsSource = source->font.packData == NULL;
+  source->pixels = NULL;
+  return cache;
+}
+
+void DestroyGlyphCache(GlyphCache *cache) {
+  if (cache->ownsSource && cache->sourcePixels != NULL) {
+    free(cache->sourcePixels);
+  }
+
+  void *buffers[] = {cache->pixels, cache->table, cache->glyphSlots,
+                     cache->shelves, cache->slots};
+  for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+    if (buffers[i] != NULL) {
+      free(buffers[i]);
+    }
+  }
+
+  free(cache);
+}
+
+void TouchCachedGlyphs(GlyphCache *cache, unsigned long long frame,
+                       const GlyphInstance *instances, unsigned count) {
+  for (unsigned i = 0; i < count; i++) {
+    TouchCachedGlyph(cache, frame, instances[i].glyph);
+  }
+}
+
+// Makes sure the glyph is in the cache for this frame, copying it in if it
+// is not
+void TouchCachedGlyph(GlyphCache *cache, unsigned long long frame,
+                      unsigned glyph) {
+  if (frame != cache->frame) {
+    cache->lastFrameStats = cache->frameStats;
+    cache->frameStats = (GlyphCacheStats){0};
+    cache->frame = frame;
+  }
+
+  if (glyph >= cache->glyphCount) {
+    return;
+  }
+
+  unsigned slot = cache->glyphSlots[glyph];
+  if (slot != 0) {
+    cache->frameStats.hits++;
+    if (cache->slots[slot].lastUsed != frame) {
+      cache->slots[slot].lastUsed = frame;
+      UnlinkGlyphSlot(cache, slot);
+      LinkGlyphSlot(cache, slot);
+    }
+
+    return;
+  }
+
+  const GlyphTableEntry *entry = &cache->sourceGlyphs[glyph];
+  unsigned width = (unsigned)entry->size[0];
+  unsigned height = (unsigned)entry->size[1];
+  unsigned srcX = (unsigned)lroundf(entry->uvs[0] * (float)cache->sourceWidth);
+  unsigned srcTop =
+      (unsigned)lroundf((1.0f - entry->uvs[1]) * (float)cache->sourceHeight);
+  unsigned layer = (unsigned)entry->layer;
+  // Empty glyphs have nothing to cache
+  if (width == 0 || height == 0 || srcX + width > cache->sourceWidth ||
+      srcTop + height > cache->sourceHeight || layer >= cache->sourceLayers) {
+    return;
+  }
+
+  cache->frameStats.misses++;
+  unsigned padding = GLYPH_CACHE_PADDING;
+  slot = AllocateGlyphSlot(cache, frame, width + padding * 2,
+                           height + padding * 2);
+  if (slot == 0) {
+    cache->frameStats.overflows++;
+    return;
+  }
+
+  GlyphCacheSlot *record = &cache->slots[slot];
+  record->glyph = glyph;
+  record->lastUsed = frame;
+  LinkGlyphSlot(cache, slot);
+  cache->glyphSlots[glyph] = slot;
+  cache->shelves[record->shelf].residentCount++;
+  CopyGlyphToSlot(cache, record, srcX, srcTop, layer, width, height);
+
+  // Same quad, only the texture coordinates move to the slot
+  float size = (float)cache->size;
+  float left = (float)(record->x + padding);
+  float bottom = (float)(cache->shelves[record->shelf].y + padding);
+  GlyphTableEntry *cached = &cache->table[glyph];
+  *cached = *entry;
+  cached->uvs[0] = left / size;
+  cached->uvs[1] = (bottom + (float)height) / size;
+  cached->uvs[2] = (left + (float)width) / size;
+  cached->uvs[3] = bottom / size;
+  cached->layer = 0.0f;
+  MarkGlyphDirty(cache, glyph);
+}
+
+// Sends the rows and glyph table entries changed since the last upload, one
+// call each. Returns whether the texture binding changed.
+bool UploadGlyphCache(GlyphCache *cache) {
+  bool bound = false;
+  if (cache->dirtyRowEnd > cache->dirtyRowStart) {
+    unsigned rows = cache->dirtyRowEnd - cache->dirtyRowStart;
+    size_t rowSize = (size_t)cache->size * cache->texelSize;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache->textureId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, (int)cache->dirtyRowStart, 0,
+                    (int)cache->size, (int)rows, 1,
+                    cache->texelSize == 1 ? GL_RED : GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    cache->pixels + cache->dirtyRowStart * rowSize);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    cache->frameStats.uploads++;
+    cache->frameStats.bytesUploaded += rows * rowSize;
+    cache->dirtyRowStart = cache->size;
+    cache->dirtyRowEnd = 0;
+    bound = true;
+  }
+
+  if (cache->dirtyGlyphEnd > cache->dirtyGlyphStart) {
+    size_t offset = cache->dirtyGlyphStart * sizeof(GlyphTableEntry);
+    size_t size = (cache->dirtyGlyphEnd - cache->dirtyGlyphStart) *
+                  sizeof(GlyphTableEntry);
+    glBindBuffer(GL_TEXTURE_BUFFER, cache->glyphTableBufferId);
+    glBufferSubData(GL_TEXTURE_BUFFER, (GLintptr)offset, (GLsizeiptr)size,
+                    cache->table + cache->dirtyGlyphStart);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    cache->frameStats.bytesUploaded += size;
+    cache->dirtyGlyphStart = cache->glyphCount;
+    cache->dirtyGlyphEnd = 0;
+  }
+
+  return bound;
+}
@@ -0,0 +1,97 @@
+#ifndef SFR_GLYPH_CACHE_H
+#define SFR_GLYPH_CACHE_H
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+#define GLYPH_CACHE_DEFAULT_SIZE 1024
+// Empty texels around every glyph, so filtering never reads a neighbour
+#define GLYPH_CACHE_PADDING 1
+// Shelf heights are rounded up to this, glyphs of close heights share them
+#define GLYPH_CACHE_SHELF_STEP 4
+
+typedef struct {
+  unsigned hits;
+  unsigned misses;
+  unsigned evictions;
+  // Glyphs that did not fit even after evicting every glyph of past frames,
+  // they are not drawn
+  unsigned overflows;
+  unsigned uploads;
+  size_t bytesUploaded;
+} GlyphCacheStats;
+
+typedef struct {
+  unsigned y;
+  unsigned height;
+  // Start of the space never used by a slot
+  unsigned end;
+  unsigned residentCount;
+  unsigned freeSlots;
+} GlyphCacheShelf;
+
+// Resident slots are in the LRU list, freed ones in the free list of their
+// shelf, unused records in the pool list. Slot 0 is the head of the LRU list.
+typedef struct {
+  unsigned x;
+  unsigned width;
+  unsigned shelf;
+  unsigned glyph;
+  unsigned long long lastUsed;
+  unsigned prev;
+  unsigned next;
+} GlyphCacheSlot;
+
+// Glyphs of a font copied on demand from its CPU atlas (decoded pages or a
+// mapped pack, read as glyphs are first used) into a fixed size texture. The
+// glyph table uploaded for the font points at the cache slots, glyphs out of
+// the cache have an empty quad. Glyphs used in the current frame are never
+// evicted, the least recently used ones make room for new ones. The texture
+// and the glyph table buffer belong to the font.
+typedef struct GlyphCache {
+  unsigned size;
+  unsigned texelSize;
+  unsigned textureId;
+  unsigned glyphTableBufferId;
+  // Atlas the glyphs are copied from, owned by the cache unless it is in
+  // the font pack mapping
+  const GlyphTableEntry *sourceGlyphs;
+  unsigned glyphCount;
+  unsigned char *sourcePixels;
+  bool ownsSource;
+  unsigned sourceWidth;
+  unsigned sourceHeight;
+  unsigned sourceLayers;
+  // Copy of the texture and of the glyph table, the rows and glyphs changed
+  // since the last upload are sent at once
+  unsigned char *pixels;
+  GlyphTableEntry *table;
+  unsigned dirtyRowStart;
+  unsigned dirtyRowEnd;
+  unsigned dirtyGlyphStart;
+  unsigned dirtyGlyphEnd;
+  unsigned *glyphSlots;
+  GlyphCacheShelf *shelves;
+  unsigned shelfCount;
+  unsigned shelfCapacity;
+  unsigned shelvesTop;
+  GlyphCacheSlot *slots;
+  unsigned slotCount;
+  unsigned slotCapacity;
+  unsigned poolSlots;
+  unsigned long long frame;
+  GlyphCacheStats frameStats;
+  GlyphCacheStats lastFrameStats;
+} GlyphCache;
+
+GlyphCache *CreateGlyphCache(const BitmapFont *font, BitmapFontData *source,
+                             unsigned size);
+void DestroyGlyphCache(GlyphCache *cache);
+void TouchCachedGlyphs(GlyphCache *cache, unsigned long long frame,
+                       const GlyphInstance *instances, unsigned count);
+void TouchCachedGlyph(GlyphCache *cache, unsigned long long frame,
+                      unsigned glyph);
+bool UploadGlyphCache(GlyphCache *cache);
+
+#endif // SFR_GLYPH_CACHE_H
@@ -0,0 +1,389 @@
+#include "gpu_layout.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+static const char *fontTableUniforms[GPU_FONT_TABLE_COUNT] = {
+    "pageIndexOffset",   "pagesOffset",         "advancesOffset",
+    "visibleOffset",     "kerningFilterOffset", "kerningKeysOffset",
+    "kerningAmountsOffset",
+};
+
+// Program shared by every GPU text, it is deleted with the last one
+static struct {
+  unsigned programId;
+  unsigned users;
+  int passLocation;
+  int textLenLocation;
+  int groupCountLocation;
+  int topLocation;
+  int lineHeightLocation;
+  int scaleLocation;
+  int colorLocation;
+  int kerningMaskLocation;
+  int kerningShiftLocation;
+  int fontTableLocations[GPU_FONT_TABLE_COUNT];
+} layoutProgram;
+
+// Compute shaders and storage buffers come with GL 4.3, glad only loads
+// them through the extensions
+bool CanLayoutTextOnGpu(void) {
+  return GLAD_GL_ARB_compute_shader &&
+         GLAD_GL_ARB_shader_storage_buffer_object &&
+         GLAD_GL_ARB_draw_indirect && glMemoryBarrier != NULL;
+}
+
+static bool RetainLayoutProgram(void) {
+  if (layoutProgram.users > 0) {
+    layoutProgram.users++;
+    return true;
+  }
+
+  unsigned programId = LoadComputeShader(ASSETS_GLYPH_LAYOUT_CS);
+  if (programId == 0) {
+    return false;
+  }
+
+  layoutProgram.programId = programId;
+  layoutProgram.users = 1;
+  layoutProgram.passLocation = glGetUniformLocation(programId, "pass");
+  layoutProgram.textLenLocation = glGetUniformLocation(programId, "textLen");
+  layoutProgram.groupCountLocation =
+      glGetUniformLocation(programId, "groupCount");
+  layoutProgram.topLocation = glGetUniformLocation(programId, "top");
+  layoutProgram.lineHeightLocation =
+      glGetUniformLocation(programId, "lineHeight");
+  layoutProgram.scaleLocation = glGetUniformLocation(programId, "scale");
+  layoutProgram.colorLocation = glGetUniformLocation(programId, "color");
+  layoutProgram.kerningMaskLocation =
+      glGetUniformLocation(programId, "kerningMask");
+  layoutProgram.kerningShiftLocation =
+      glGetUniformLocation(programId, "kerningShift");
+  for (unsigned i = 0; i < GPU_FONT_TABLE_COUNT; i++) {
+    layoutProgram.fontTableLocations[i] =
+        glGetUniformLocation(programId, fontTableUniforms[i]);
+  }
+
+  return true;
+}
+
+static void ReleaseLayoutProgram(void) {
+  if (layoutProgram.users > 0 && --layoutProgram.users == 0) {
+    glDeleteProgram(layoutProgram.programId);
+    layoutProgram.programId = 0;
+  }
+}
+
+// The tables are uploaded as the CPU keeps them, but for the visible flags,
+// widened to words. Every table is a whole number of words.
+static bool UploadGpuFont(GpuText *object) {
+  const BitmapFont *font = object->font;
+  unsigned kerningSlots = font->kerningMask + 1;
+  unsigned *visible = malloc(font->glyphCount * sizeof(unsigned));
+  if (visible == NULL) {
+    Log(LOG_ERROR, "GPU: could not allocate memory for %u glyphs",
+        font->glyphCount);
+    return false;
+  }
+
+  for (unsigned i = 0; i < font->glyphCount; i++) {
+    visible[i] = font->visible[i];
+  }
+
+  const void *tables[GPU_FONT_TABLE_COUNT] = {
+      font->glyphPageIndex, font->glyphPages,    font->xas,
+      visible,              font->kerningFilter, font->kerningKeys,
+      font->kerningAmounts,
+  };
+  size_t sizes[GPU_FONT_TABLE_COUNT] = {
+      GLYPH_PAGE_COUNT * sizeof(unsigned short),
+      font->glyphPageCount * sizeof(GlyphPage),
+      font->glyphCount * sizeof(float),
+      font->glyphCount * sizeof(unsigned),
+      font->glyphCount * sizeof(unsigned long long),
+      kerningSlots * sizeof(unsigned),
+      kerningSlots * sizeof(float),
+  };
+
+  size_t bytes = 0;
+  for (unsigned i = 0; i < GPU_FONT_TABLE_COUNT; i++) {
+    object->fontOffsets[i] = (unsigned)(bytes / sizeof(unsigned));
+    bytes += sizes[i];
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, object->fontBufferId);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)bytes, NULL,
+               GL_STATIC_DRAW);
+  for (unsigned i = 0; i < GPU_FONT_TABLE_COUNT; i++) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                    (GLintptr)object->fontOffsets[i] * sizeof(unsigned),
+                    (GLsizeiptr)sizes[i], tables[i]);
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  free(visible);
+  object->fontId = font->id;
+  return true;
+}
+
+GpuText CreateGpuText(const BitmapFont *font, const TextLayout *layout,
+                      float xPos, float yPos) {
+  GpuText object = {0};
+  object.font = font;
+  object.layout = *layout;
+  object.xPos = xPos;
+  object.yPos = yPos;
+
+  if (!CanLayoutTextOnGpu()) {
+    Log(LOG_ERROR, "GPU: compute shaders are not supported");
+    object.status = ERROR_NOT_SUPPORTED;
+    return object;
+  }
+
+  if (font->glyphCache != NULL || layout->maxWidth > 0.0f ||
+      layout->align != TEXT_ALIGN_LEFT) {
+    Log(LOG_ERROR, "GPU: only unwrapped, left aligned text of fonts without "
+                   "a glyph cache is laid out on the GPU");
+    object.status = ERROR_NOT_SUPPORTED;
+    return object;
+  }
+
+  if (!RetainLayoutProgram()) {
+    object.status = ERROR_CANNOT_LOAD_GLYPH_SHADER;
+    return object;
+  }
+
+  glGenBuffers(1, &object.fontBufferId);
+  glGenBuffers(1, &object.textBufferId);
+  glGenBuffers(1, &object.elementBufferId);
+  glGenBuffers(1, &object.groupBufferId);
+  glGenBuffers(1, &object.instanceBufferId);
+  glGenBuffers(1, &object.commandBufferId);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, object.commandBufferId);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand),
+               NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  if (!UploadGpuFont(&object)) {
+    object.status = ERROR_OUT_OF_MEMORY;
+  }
+
+  return object;
+}
+
+// Rows of at most GPU_LAYOUT_MAX_GROUPS_X workgroups, for long text
+static unsigned GetLayoutGroups(size_t textLen, unsigned *columns,
+                                unsigned *rows) {
+  unsigned groupCount = (unsigned)((textLen + GPU_LAYOUT_GROUP_BYTES - 1) /
+                                   GPU_LAYOUT_GROUP_BYTES);
+  *columns = groupCount < GPU_LAYOUT_MAX_GROUPS_X ? groupCount
+                                                  : GPU_LAYOUT_MAX_GROUPS_X;
+  *rows = (groupCount + *columns - 1) / *columns;
+  return groupCount;
+}
+
+static void ResizeGpuBuffer(unsigned bufferId, size_t bytes) {
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferId);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)bytes, NULL,
+               GL_DYNAMIC_DRAW);
+}
+
+// Uploads the text, laid out the next time the object is drawn. Buffers
+// grow to twice the text they last held, every byte taking an element and
+// an instance, so the largest text is bound by the storage block size.
+bool SetGpuText(GpuText *object, const char *text, size_t textLen) {
+  if (textLen > object->textCapacity) {
+    size_t capacity = object->textCapacity > 0 ? object->textCapacity
+                                               : GPU_LAYOUT_GROUP_BYTES;
+    while (capacity < textLen) {
+      capacity *= 2;
+    }
+
+    GLint64 maxBlockSize = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+    size_t maxText = (size_t)maxBlockSize / sizeof(GpuLayoutElement);
+    if (textLen > maxText || textLen >= UINT_MAX - GPU_LAYOUT_GROUP_BYTES) {
+      Log(LOG_ERROR, "GPU: %zu bytes of text, at most %zu are laid out",
+          textLen, maxText);
+      return false;
+    }
+
+    if (capacity > maxText) {
+      capacity = maxText;
+    }
+
+    unsigned columns = 0;
+    unsigned rows = 0;
+    GetLayoutGroups(capacity, &columns, &rows);
+    object->textCapacity = capacity;
+    object->groupCapacity = columns * rows;
+    ResizeGpuBuffer(object->elementBufferId,
+                    capacity * sizeof(GpuLayoutElement));
+    ResizeGpuBuffer(object->instanceBufferId,
+                    capacity * sizeof(GlyphInstance));
+    ResizeGpuBuffer(object->groupBufferId,
+                    object->groupCapacity * sizeof(GpuLayoutGroup));
+  }
+
+  // Orphaned, the previous text may still be laid out. Words are read
+  // whole, bytes past the text are never used.
+  size_t textBytes = (object->textCapacity + 3) & ~(size_t)3;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, object->textBufferId);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)textBytes, NULL,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)textLen, text);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  object->textLen = textLen;
+  object->dirty = true;
+  return true;
+}
+
+void SetGpuTextPosition(GpuText *object, float xPos, float yPos) {
+  object->xPos = xPos;
+  object->yPos = yPos;
+}
+
+// Glyphs are placed from the origin, so moving the text does not lay it out
+// again. Leaves the layout program bound.
+void LayoutGpuText(GpuText *object) {
+  object->dirty = false;
+  if (object->textLen == 0) {
+    return;
+  }
+
+  double start = GetMonotonicTime();
+  const BitmapFont *font = object->font;
+  float scale = GetTextScale(font, &object->layout);
+  float top = object->layout.baseline ? 0.0f - font->base * scale : 0.0f;
+  unsigned columns = 0;
+  unsigned rows = 0;
+  unsigned groupCount = GetLayoutGroups(object->textLen, &columns, &rows);
+
+  glUseProgram(layoutProgram.programId);
+  glUniform1ui(layoutProgram.textLenLocation, (unsigned)object->textLen);
+  glUniform1ui(layoutProgram.groupCountLocation, groupCount);
+  glUniform1f(layoutProgram.topLocation, top);
+  glUniform1f(layoutProgram.lineHeightLocation, font->lineHeight * scale);
+  glUniform1f(layoutProgram.scaleLocation, scale);
+  glUniform1ui(layoutProgram.colorLocation, object->layout.color);
+  glUniform1ui(layoutProgram.kerningMaskLocation, font->kerningMask);
+  glUniform1ui(layoutProgram.kerningShiftLocation, font->kerningShift);
+  for (unsigned i = 0; i < GPU_FONT_TABLE_COUNT; i++) {
+    glUniform1ui(layoutProgram.fontTableLocations[i], object->fontOffsets[i]);
+  }
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object->textBufferId);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, object->fontBufferId);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, object->elementBufferId);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, object->groupBufferId);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, object->instanceBufferId);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, object->commandBufferId);
+
+  // The scans run on a single workgroup, every other pass on a workgroup
+  // per GPU_LAYOUT_GROUP_BYTES of text
+  for (unsigned pass = 0; pass < GPU_LAYOUT_PASS_COUNT; pass++) {
+    glUniform1ui(layoutProgram.passLocation, pass);
+    if (pass == GPU_LAYOUT_SCAN_COUNTS || pass == GPU_LAYOUT_SCAN_ADVANCES) {
+      glDispatchCompute(1, 1, 1);
+    } else {
+      glDispatchCompute(columns, rows, 1);
+    }
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+
+  glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT |
+                  GL_BUFFER_UPDATE_BARRIER_BIT);
+  object->layoutTime = GetMonotonicTime() - start;
+}
+
+// The glyph count stays on the GPU, it is not part of the batch stats
+void DrawGpuText(TextBatch *batch, GpuText *object) {
+  // Keep the order of the text batched before this object
+  FlushTextBatch(batch);
+
+  // A reloaded font has new tables
+  if (object->fontId != object->font->id && UploadGpuFont(object)) {
+    object->dirty = true;
+  }
+
+  if (object->dirty) {
+    LayoutGpuText(object);
+    batch->boundProgramId = 0;
+    batch->frameStats.layoutTime += object->layoutTime;
+  }
+
+  if (object->textLen == 0) {
+    return;
+  }
+
+  if (object->vao == 0) {
+    object->vao = MakeGlyphVertexArray(batch->quad, object->instanceBufferId);
+  }
+
+  double start = GetMonotonicTime();
+  const BitmapFont *font = object->font;
+  BindTextDrawState(batch, font->shaderProgramId, font->projLocation,
+                    font->textureId, font->glyphTableTextureId);
+  glUniform2f(font->originLocation, object->xPos, object->yPos);
+  SetGlyphStyle(&font->styleLocations, font->distanceRange,
+                GetTextScale(font, &object->layout), &object->layout.effects);
+
+  glBindVertexArray(object->vao);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, object->commandBufferId);
+  glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, NULL);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  batch->frameStats.submitTime += GetMonotonicTime() - start;
+  batch->frameStats.drawCalls++;
+}
+
+// Reads back up to maxGlyphs glyphs, relative to the object position, to
+// check them against LayoutText. Waits for the layout to finish.
+unsigned ReadGpuTextGlyphs(GpuText *object, GlyphInstance *instances,
+                           unsigned maxGlyphs) {
+  if (object->dirty) {
+    LayoutGpuText(object);
+  }
+
+  if (object->textLen == 0) {
+    return 0;
+  }
+
+  DrawElementsIndirectCommand command = {0};
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, object->commandBufferId);
+  glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  unsigned glyphCount =
+      command.instanceCount < maxGlyphs ? command.instanceCount : maxGlyphs;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, object->instanceBufferId);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                     (GLsizeiptr)glyphCount * sizeof(GlyphInstance), instances);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return glyphCount;
+}
+
+void DestroyGpuText(GpuText *object) {
+  if (object->vao != 0) {
+    glDeleteVertexArrays(1, &object->vao);
+  }
+
+  unsigned buffers[] = {
+      object->fontBufferId,     object->textBufferId,
+      object->elementBufferId,  object->groupBufferId,
+      object->instanceBufferId, object->commandBufferId,
+  };
+  for (unsigned i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+    if (buffers[i] != 0) {
+      glDeleteBuffers(1, &buffers[i]);
+    }
+  }
+
+  if (object->fontBufferId != 0) {
+    ReleaseLayoutProgram();
+  }
+
+  *object = (GpuText){0};
+}
@@ -0,0 +1,104 @@
+#ifndef SFR_GPU_LAYOUT_H
+#define SFR_GPU_LAYOUT_H
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+#define ASSETS_GLYPH_LAYOUT_CS "assets/glyph_layout.cs.glsl"
+
+// Bytes of text per workgroup of the layout shader, 256 invocations of 16
+// bytes each
+#define GPU_LAYOUT_GROUP_BYTES 4096
+#define GPU_LAYOUT_MAX_GROUPS_X 65535
+
+// Glyph and kerning tables of the font, in one storage buffer
+typedef enum {
+  GPU_FONT_PAGE_INDEX,
+  GPU_FONT_PAGES,
+  GPU_FONT_ADVANCES,
+  GPU_FONT_VISIBLE,
+  GPU_FONT_KERNING_FILTER,
+  GPU_FONT_KERNING_KEYS,
+  GPU_FONT_KERNING_AMOUNTS,
+  GPU_FONT_TABLE_COUNT,
+} GpuFontTable;
+
+// Layout shader passes, see the shader
+typedef enum {
+  GPU_LAYOUT_DECODE,
+  GPU_LAYOUT_SCAN_COUNTS,
+  GPU_LAYOUT_ADVANCE,
+  GPU_LAYOUT_SCAN_ADVANCES,
+  GPU_LAYOUT_PLACE,
+  GPU_LAYOUT_PASS_COUNT,
+} GpuLayoutPass;
+
+// Per byte state of the layout, as the shader declares it
+typedef struct {
+  unsigned glyph;
+  unsigned flags;
+  float kerning;
+  float advance;
+} GpuLayoutElement;
+
+// Per workgroup prefixes, as the shader declares it
+typedef struct {
+  unsigned lastEvent;
+  unsigned lines;
+  unsigned visible;
+  unsigned lineBreak;
+  float advance;
+} GpuLayoutGroup;
+
+typedef struct {
+  unsigned count;
+  unsigned instanceCount;
+  unsigned firstIndex;
+  int baseVertex;
+  unsigned baseInstance;
+} DrawElementsIndirectCommand;
+
+// Text laid out by a compute shader straight from its UTF-8 bytes into an
+// instance buffer, drawn with an indirect draw whose glyph count the shader
+// writes, so the CPU only uploads the text. Places the glyphs exactly as
+// LayoutText when the advances and kernings add up exactly (whole pixels),
+// within float rounding otherwise. Text is laid out relative to the object
+// position, without wrapping or alignment, and fonts with a glyph cache are
+// not supported.
+typedef struct {
+  StatusCode status;
+  const BitmapFont *font;
+  TextLayout layout;
+  float xPos;
+  float yPos;
+  bool dirty;
+  // Id of the font whose tables were uploaded, see TextObject
+  unsigned fontId;
+  size_t textLen;
+  size_t textCapacity;
+  unsigned groupCapacity;
+  unsigned fontBufferId;
+  unsigned fontOffsets[GPU_FONT_TABLE_COUNT];
+  unsigned textBufferId;
+  unsigned elementBufferId;
+  unsigned groupBufferId;
+  unsigned instanceBufferId;
+  unsigned commandBufferId;
+  unsigned vao;
+  // CPU seconds spent on the last layout, dispatching it
+  double layoutTime;
+} GpuText;
+
+bool CanLayoutTextOnGpu(void);
+GpuText CreateGpuText(const BitmapFont *font, const TextLayout *layout,
+                      float xPos, float yPos);
+bool SetGpuText(GpuText *object, const char *text, size_t textLen);
+void SetGpuTextPosition(GpuText *object, float xPos, float yPos);
+void LayoutGpuText(GpuText *object);
+void DrawGpuText(TextBatch *batch, GpuText *object);
+unsigned ReadGpuTextGlyphs(GpuText *object, GlyphInstance *instances,
+                           unsigned maxGlyphs);
+void DestroyGpuText(GpuText *object);
+
+#endif // SFR_GPU_LAYOUT_H
@@ -0,0 +1,243 @@
+#include "layout_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Lays the chunk out after the glyphs of the previous chunks taken by the
+// same thread, the y of every glyph being its line in the chunk
+static void LayoutChunkLines(LayoutPool *pool, LayoutChunk *chunk,
+                             unsigned thread) {
+  LayoutThreadGlyphs *glyphs = &pool->threadGlyphs[thread];
+  if (glyphs->count + chunk->len > glyphs->capacity) {
+    size_t capacity = glyphs->capacity > 0 ? glyphs->capacity * 2 : 4096;
+    while (capacity < glyphs->count + chunk->len) {
+      capacity *= 2;
+    }
+
+    GlyphInstance *instances =
+        realloc(glyphs->glyphs, capacity * sizeof(GlyphInstance));
+    if (instances == NULL) {
+      Log(LOG_ERROR, "LAYOUT: could not allocate memory for %zu glyphs",
+          capacity);
+      atomic_store(&pool->failed, true);
+      return;
+    }
+
+    glyphs->glyphs = instances;
+    glyphs->capacity = capacity;
+  }
+
+  chunk->thread = thread;
+  chunk->threadOffset = glyphs->count;
+  chunk->glyphCount = LayoutTextLines(
+      pool->font, pool->layout, pool->xPos, 0.0f, 1.0f,
+      pool->text + chunk->start, chunk->len, glyphs->glyphs + glyphs->count,
+      &chunk->lineCount);
+  glyphs->count += chunk->glyphCount;
+}
+
+// Same expression as LayoutTextLines for the y of a line, so positions match
+// to the bit
+static void CopyChunkGlyphs(LayoutPool *pool, const LayoutChunk *chunk) {
+  const GlyphInstance *source =
+      pool->threadGlyphs[chunk->thread].glyphs + chunk->threadOffset;
+  GlyphInstance *instances = pool->instances + chunk->firstGlyph;
+  for (unsigned i = 0; i < chunk->glyphCount; i++) {
+    unsigned line = chunk->firstLine + (unsigned)source[i].y;
+    instances[i] = source[i];
+    instances[i].y = pool->top + (float)line * pool->lineHeight;
+  }
+}
+
+static void RunLayoutPhase(LayoutPool *pool, unsigned thread) {
+  unsigned index = 0;
+  while ((index = atomic_fetch_add(&pool->nextChunk, 1)) < pool->chunkCount) {
+    if (pool->phase == LAYOUT_PHASE_LINES) {
+      LayoutChunkLines(pool, &pool->chunks[index], thread);
+    } else {
+      CopyChunkGlyphs(pool, &pool->chunks[index]);
+    }
+  }
+}
+
+static void *RunLayoutWorker(void *arg) {
+  LayoutPool *pool = arg;
+  // Workers take the arrays after the one of the calling thread
+  unsigned thread = atomic_fetch_add(&pool->workerCount, 1) + 1;
+  unsigned phaseIndex = 0;
+  pthread_mutex_lock(&pool->mutex);
+  for (;;) {
+    while (!pool->stopping && pool->phaseIndex == phaseIndex) {
+      pthread_cond_wait(&pool->phaseStarted, &pool->mutex);
+    }
+
+    if (pool->stopping) {
+      break;
+    }
+
+    phaseIndex = pool->phaseIndex;
+    pthread_mutex_unlock(&pool->mutex);
+    RunLayoutPhase(pool, thread);
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->busyCount == 0) {
+      pthread_cond_signal(&pool->phaseFinished);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+// Runs a phase on every thread and waits for all of them to be done with it
+static void RunLayoutPoolPhase(LayoutPool *pool, LayoutPhase phase) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->phase = phase;
+  atomic_store(&pool->nextChunk, 0);
+  pool->busyCount = pool->threadCount;
+  pool->phaseIndex++;
+  pthread_cond_broadcast(&pool->phaseStarted);
+  pthread_mutex_unlock(&pool->mutex);
+
+  RunLayoutPhase(pool, 0);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->busyCount > 0) {
+    pthread_cond_wait(&pool->phaseFinished, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+// Chunks end right after a line break, or at the end of the text
+static bool SplitLayoutChunks(LayoutPool *pool, const char *text,
+                              size_t textLen) {
+  pool->chunkCount = 0;
+  for (size_t start = 0; start < textLen;) {
+    size_t end = textLen;
+    if (textLen - start > LAYOUT_CHUNK_SIZE) {
+      const char *lineBreak = memchr(text + start + LAYOUT_CHUNK_SIZE, '\n',
+                                     textLen - start - LAYOUT_CHUNK_SIZE);
+      end = lineBreak != NULL ? (size_t)(lineBreak - text) + 1 : textLen;
+    }
+
+    if (pool->chunkCount == pool->chunkCapacity) {
+      unsigned capacity =
+          pool->chunkCapacity > 0 ? pool->chunkCapacity * 2 : 64;
+      LayoutChunk *chunks =
+          realloc(pool->chunks, capacity * sizeof(LayoutChunk));
+      if (chunks == NULL) {
+        Log(LOG_ERROR, "LAYOUT: could not allocate memory for %u chunks",
+            capacity);
+        return false;
+      }
+
+      pool->chunks = chunks;
+      pool->chunkCapacity = capacity;
+    }
+
+    pool->chunks[pool->chunkCount++] = (LayoutChunk){
+        .start = start,
+        .len = end - start,
+    };
+    start = end;
+  }
+
+  return true;
+}
+
+StatusCode StartLayoutPool(LayoutPool *pool, unsigned threadCount) {
+  *pool = (LayoutPool){0};
+
+  // One thread per core unless told otherwise, the calling one included
+  if (threadCount == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? (unsigned)cores : 1;
+  }
+
+  if (threadCount > LAYOUT_POOL_MAX_THREADS + 1) {
+    threadCount = LAYOUT_POOL_MAX_THREADS + 1;
+  }
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->phaseStarted, NULL);
+  pthread_cond_init(&pool->phaseFinished, NULL);
+
+  // A thread that cannot be started only makes layout slower
+  while (pool->threadCount + 1 < threadCount &&
+         pthread_create(&pool->threads[pool->threadCount], NULL,
+                        RunLayoutWorker, pool) == 0) {
+    pool->threadCount++;
+  }
+
+  return pool->status;
+}
+
+void StopLayoutPool(LayoutPool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->phaseStarted);
+  pthread_mutex_unlock(&pool->mutex);
+  for (unsigned i = 0; i < pool->threadCount; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  for (unsigned i = 0; i <= LAYOUT_POOL_MAX_THREADS; i++) {
+    if (pool->threadGlyphs[i].glyphs != NULL) {
+      free(pool->threadGlyphs[i].glyphs);
+    }
+  }
+
+  if (pool->chunks != NULL) {
+    free(pool->chunks);
+  }
+
+  pthread_cond_destroy(&pool->phaseFinished);
+  pthread_cond_destroy(&pool->phaseStarted);
+  pthread_mutex_destroy(&pool->mutex);
+  *pool = (LayoutPool){0};
+}
+
+// Same result as LayoutText, which it falls back to for short text, a pool
+// without workers or when memory runs out
+unsigned LayoutTextParallel(LayoutPool *pool, const BitmapFont *font,
+                            const TextLayout *layout, float xPos, float yPos,
+                            const char *text, size_t textLen,
+                            GlyphInstance *instances) {
+  if (textLen < LAYOUT_POOL_MIN_SIZE || pool->threadCount == 0 ||
+      !SplitLayoutChunks(pool, text, textLen)) {
+    return LayoutText(font, layout, xPos, yPos, text, textLen, instances);
+  }
+
+  float scale = GetTextScale(font, layout);
+  pool->font = font;
+  pool->layout = layout;
+  pool->text = text;
+  pool->xPos = xPos;
+  pool->top = layout->baseline ? yPos - font->base * scale : yPos;
+  pool->lineHeight = font->lineHeight * scale;
+  pool->instances = instances;
+  atomic_store(&pool->failed, false);
+  for (unsigned i = 0; i <= pool->threadCount; i++) {
+    pool->threadGlyphs[i].count = 0;
+  }
+
+  RunLayoutPoolPhase(pool, LAYOUT_PHASE_LINES);
+  if (atomic_load(&pool->failed)) {
+    return LayoutText(font, layout, xPos, yPos, text, textLen, instances);
+  }
+
+  // A chunk ends with a line break, so its last line is empty and is the
+  // first line of the next chunk
+  unsigned glyphCount = 0;
+  unsigned line = 0;
+  for (unsigned i = 0; i < pool->chunkCount; i++) {
+    LayoutChunk *chunk = &pool->chunks[i];
+    chunk->firstGlyph = glyphCount;
+    chunk->firstLine = line;
+    glyphCount += chunk->glyphCount;
+    line += chunk->lineCount - 1;
+  }
+
+  RunLayoutPoolPhase(pool, LAYOUT_PHASE_COPY);
+  return glyphCount;
+}
@@ -0,0 +1,82 @@
+#ifndef SFR_LAYOUT_POOL_H
+#define SFR_LAYOUT_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+#define LAYOUT_POOL_MAX_THREADS 16
+// Text is split at the first hard line break after every chunk of this size
+#define LAYOUT_CHUNK_SIZE (64 * 1024)
+// Shorter text is laid out on the calling thread
+#define LAYOUT_POOL_MIN_SIZE (256 * 1024)
+
+typedef enum {
+  LAYOUT_PHASE_LINES,
+  LAYOUT_PHASE_COPY,
+} LayoutPhase;
+
+// Part of the text made of whole lines. Its glyphs are first laid out with
+// line numbers for y into the array of the thread that took it, then moved
+// to their place in the output.
+typedef struct {
+  size_t start;
+  size_t len;
+  unsigned thread;
+  size_t threadOffset;
+  unsigned glyphCount;
+  unsigned lineCount;
+  unsigned firstGlyph;
+  unsigned firstLine;
+} LayoutChunk;
+
+typedef struct {
+  GlyphInstance *glyphs;
+  size_t count;
+  size_t capacity;
+} LayoutThreadGlyphs;
+
+// Worker threads laying out the chunks of long text. The calling thread
+// works too, every thread takes the next chunk left until there is none, so
+// threads finishing early keep taking work. Glyphs come out exactly as
+// LayoutText places them.
+typedef struct LayoutPool {
+  StatusCode status;
+  pthread_t threads[LAYOUT_POOL_MAX_THREADS];
+  unsigned threadCount;
+  atomic_uint workerCount;
+  pthread_mutex_t mutex;
+  pthread_cond_t phaseStarted;
+  pthread_cond_t phaseFinished;
+  unsigned phaseIndex;
+  unsigned busyCount;
+  bool stopping;
+  // Text of the current call
+  LayoutPhase phase;
+  const BitmapFont *font;
+  const TextLayout *layout;
+  const char *text;
+  float xPos;
+  float top;
+  float lineHeight;
+  GlyphInstance *instances;
+  LayoutChunk *chunks;
+  unsigned chunkCount;
+  unsigned chunkCapacity;
+  atomic_uint nextChunk;
+  atomic_bool failed;
+  // One per worker and one for the calling thread, kept between calls
+  LayoutThreadGlyphs threadGlyphs[LAYOUT_POOL_MAX_THREADS + 1];
+} LayoutPool;
+
+StatusCode StartLayoutPool(LayoutPool *pool, unsigned threadCount);
+void StopLayoutPool(LayoutPool *pool);
+unsigned LayoutTextParallel(LayoutPool *pool, const BitmapFont *font,
+                            const TextLayout *layout, float xPos, float yPos,
+                            const char *text, size_t textLen,
+                            GlyphInstance *instances);
+
+#endif // SFR_LAYOUT_POOL_H
@@ -0,0 +1,270 @@
+#include "profiler.h"
+
+#include <glad/glad.h>
+
+static void ReadTimerQueries(Profiler *profiler) {
+  while (profiler->queryCount > 0) {
+    unsigned slot = profiler->queryHead;
+    int available = 0;
+    glGetQueryObjectiv(profiler->queries[slot], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available) {
+      break;
+    }
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(profiler->queries[slot], GL_QUERY_RESULT, &elapsed);
+    unsigned long long index = profiler->queryFrames[slot];
+    FrameProfile *frame = &profiler->history[index % PROFILER_HISTORY];
+    if (frame->index == index) {
+      frame->gpuTime = (double)elapsed * 1e-9;
+      frame->gpuPending = false;
+    }
+
+    profiler->queryHead = (slot + 1) % PROFILER_QUERY_COUNT;
+    profiler->queryCount--;
+  }
+}
+
+static void DumpFrames(Profiler *profiler, unsigned long long endFrame,
+                       bool force) {
+  for (; profiler->dumpedFrames < endFrame; profiler->dumpedFrames++) {
+    unsigned long long index = profiler->dumpedFrames;
+    const FrameProfile *frame = &profiler->history[index % PROFILER_HISTORY];
+
+    // Frames about to be overwritten are written even without a GPU time
+    if (frame->gpuPending && !force &&
+        profiler->frameIndex - index < PROFILER_HISTORY) {
+      break;
+    }
+
+    if (profiler->dumpFile == NULL) {
+      continue;
+    }
+
+    fprintf(profiler->dumpFile,
+            "{\"frame\":%llu,\"frame_ms\":%.4f,\"cpu_ms\":%.4f,"
+            "\"layout_ms\":%.4f,\"upload_ms\":%.4f,\"submit_ms\":%.4f,"
+            "\"reload_ms\":%.4f,",
+            frame->index, frame->frameTime * 1e3, frame->cpuTime * 1e3,
+            frame->layoutTime * 1e3, frame->uploadTime * 1e3,
+            frame->submitTime * 1e3, frame->reloadTime * 1e3);
+    if (frame->gpuTime >= 0.0) {
+      fprintf(profiler->dumpFile, "\"gpu_ms\":%.4f,", frame->gpuTime * 1e3);
+    } else {
+      fprintf(profiler->dumpFile, "\"gpu_ms\":null,");
+    }
+
+    fprintf(profiler->dumpFile,
+            "\"glyphs\":%u,\"draw_calls\":%u,\"state_changes\":%u}\n",
+            frame->glyphs, frame->drawCalls, frame->stateChanges);
+  }
+}
+
+Profiler CreateProfiler(void) {
+  Profiler profiler = {0};
+  profiler.gpuTimers = GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query;
+  if (profiler.gpuTimers) {
+    glGenQueries(PROFILER_QUERY_COUNT, profiler.queries);
+  } else {
+    Log(LOG_WARN, "PROFILER: timer queries are not supported, no GPU times");
+  }
+
+  return profiler;
+}
+
+void DestroyProfiler(Profiler *profiler) {
+  if (profiler->queryActive) {
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+
+  if (profiler->dumpFile != NULL) {
+    DumpFrames(profiler, profiler->frameIndex, true);
+    fclose(profiler->dumpFile);
+  }
+
+  if (profiler->gpuTimers) {
+    glDeleteQueries(PROFILER_QUERY_COUNT, profiler->queries);
+  }
+
+  *profiler = (Profiler){0};
+}
+
+bool StartProfilerDump(Profiler *profiler, const char *filename) {
+  FILE *file = fopen(filename, "we");
+  if (file == NULL) {
+    Log(LOG_ERROR, "PROFILER: could not open %s", filename);
+    return false;
+  }
+
+  if (profiler->dumpFile != NULL) {
+    fclose(profiler->dumpFile);
+  }
+
+  // Frames are written as JSON lines once their GPU time is known
+  profiler->dumpFile = file;
+  profiler->dumpedFrames = profiler->frameIndex;
+  Log(LOG_INFO, "PROFILER: writing frame timings to %s", filename);
+  return true;
+}
+
+void BeginProfilerFrame(Profiler *profiler) {
+  double now = GetMonotonicTime();
+  if (profiler->frameIndex > 0) {
+    unsigned long long last = profiler->frameIndex - 1;
+    profiler->history[last % PROFILER_HISTORY].frameTime =
+        now - profiler->frameStart;
+  }
+
+  profiler->frameStart = now;
+  if (!profiler->gpuTimers) {
+    DumpFrames(profiler, profiler->frameIndex, false);
+    return;
+  }
+
+  ReadTimerQueries(profiler);
+  DumpFrames(profiler, profiler->frameIndex, false);
+
+  // Every query still in flight: skip this frame instead of waiting
+  if (profiler->queryCount < PROFILER_QUERY_COUNT) {
+    unsigned slot =
+        (profiler->queryHead + profiler->queryCount) % PROFILER_QUERY_COUNT;
+    glBeginQuery(GL_TIME_ELAPSED, profiler->queries[slot]);
+    profiler->queryFrames[slot] = profiler->frameIndex;
+    profiler->queryCount++;
+    profiler->queryActive = true;
+  }
+}
+
+// Time of the frame in progress spent on asset reloads, part of its CPU time
+void AddProfilerReloadTime(Profiler *profiler, double seconds) {
+  profiler->frameReloadTime += seconds;
+}
+
+void EndProfilerFrame(Profiler *profiler, const TextStats *stats) {
+  bool measured = profiler->queryActive;
+  if (profiler->queryActive) {
+    glEndQuery(GL_TIME_ELAPSED);
+    profiler->queryActive = false;
+  }
+
+  profiler->history[profiler->frameIndex % PROFILER_HISTORY] = (FrameProfile){
+      .index = profiler->frameIndex,
+      .cpuTime = GetMonotonicTime() - profiler->frameStart,
+      .layoutTime = stats->layoutTime,
+      .uploadTime = stats->uploadTime,
+      .submitTime = stats->submitTime,
+      .reloadTime = profiler->frameReloadTime,
+      .gpuTime = -1.0,
+      .gpuPending = measured,
+      .glyphs = stats->glyphs,
+      .drawCalls = stats->drawCalls,
+      .stateChanges = stats->stateChanges,
+  };
+  profiler->frameReloadTime = 0.0;
+  profiler->frameIndex++;
+}
+
+// Frames before the one in progress, their frame time is only known once the
+// next frame begins
+const FrameProfile *GetFrameProfile(const Profiler *profiler,
+                                    unsigned framesAgo) {
+  if (framesAgo >= PROFILER_HISTORY - 1 || framesAgo >= profiler->frameIndex) {
+    return NULL;
+  }
+
+  unsigned long long index = profiler->frameIndex - 1 - framesAgo;
+  return &profiler->history[index % PROFILER_HISTORY];
+}
+
+void DrawProfilerOverlay(const Profiler *profiler, TextBatch *batch,
+                         const BitmapFont *font, float xPos, float yPos) {
+  const FrameProfile *last = GetFrameProfile(profiler, 0);
+  if (last == NULL) {
+    return;
+  }
+
+  // GPU times arrive a few frames late, show the latest one
+  double gpuTime = -1.0;
+  for (unsigned i = 0; i <= PROFILER_QUERY_COUNT; i++) {
+    const FrameProfile *frame = GetFrameProfile(profiler, i);
+    if (frame != NULL && frame->gpuTime >= 0.0) {
+      gpuTime = frame->gpuTime;
+      break;
+    }
+  }
+
+  char gpu[32] = "n/a";
+  if (gpuTime >= 0.0) {
+    snprintf(gpu, sizeof(gpu), "%.2f", gpuTime * 1e3);
+  }
+
+  char text[256];
+  snprintf(text, sizeof(text),
+           "frame %.2f ms\ncpu %.2f gpu %s\nlayout %.2f ms\nupload %.2f ms\n"
+           "submit %.2f ms\n%u glyphs %u draws %u state changes",
+           last->frameTime * 1e3, last->cpuTime * 1e3, gpu,
+           last->layoutTime * 1e3, last->uploadTime * 1e3,
+           last->submitTime * 1e3, last->glyphs, last->drawCalls,
+           last->stateChanges);
+  TextLayout layout = {.color = PACK_RGBA(255, 255, 0, 255)};
+  BatchText(batch, font, &layout, xPos, yPos, text);
+
+  // The graph bars are stacks of the font's own '.' glyph
+  unsigned bar = font->asciiGlyphs['.'];
+  if (bar == NO_GLYPH || font->glyphs[bar].size[1] < 1.0f) {
+    return;
+  }
+
+  const GlyphTableEntry *glyph = &font->glyphs[bar];
+  float pieceHeight = glyph->size[1];
+  float step = glyph->size[0] * 0.5f;
+  float bottom = yPos + 6.0f * font->lineHeight + PROFILER_GRAPH_HEIGHT;
+  GlyphInstance pieces[64];
+  unsigned pieceCount = 0;
+
+  for (unsigned i = 0; i < PROFILER_GRAPH_SAMPLES; i++) {
+    const FrameProfile *frame =
+        GetFrameProfile(profiler, PROFILER_GRAPH_SAMPLES - 1 - i);
+    if (frame == NULL) {
+      continue;
+    }
+
+    float height = (float)(frame->frameTime / PROFILER_GRAPH_MAX_TIME) *
+                   PROFILER_GRAPH_HEIGHT;
+    height = height > PROFILER_GRAPH_HEIGHT ? PROFILER_GRAPH_HEIGHT : height;
+    height = height < pieceHeight ? pieceHeight : height;
+    unsigned color = frame->frameTime <= 1.0 / 60.0
+                         ? PACK_RGBA(60, 220, 60, 255)
+                     : frame->frameTime <= 1.0 / 30.0
+                         ? PACK_RGBA(240, 200, 40, 255)
+                         : PACK_RGBA(230, 50, 50, 255);
+
+    // Pieces stack up from the bottom, the last one overlaps to end exactly
+    // at the bar height
+    for (float top = bottom - pieceHeight;; top -= pieceHeight) {
+      bool lastPiece = top <= bottom - height;
+      if (lastPiece) {
+        top = bottom - height;
+      }
+
+      if (pieceCount == sizeof(pieces) / sizeof(pieces[0])) {
+        BatchGlyphs(batch, font, pieces, pieceCount);
+        pieceCount = 0;
+      }
+
+      pieces[pieceCount++] = (GlyphInstance){
+          .x = xPos + (float)i * step - glyph->offset[0],
+          .y = top - glyph->offset[1],
+          .glyph = bar,
+          .color = color,
+      };
+
+      if (lastPiece) {
+        break;
+      }
+    }
+  }
+
+  BatchGlyphs(batch, font, pieces, pieceCount);
+}
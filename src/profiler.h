@@ -0,0 +1,66 @@
+#ifndef SFR_PROFILER_H
+#define SFR_PROFILER_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+// GPU timer queries in flight, results are read a few frames late
+#define PROFILER_QUERY_COUNT 4
+#define PROFILER_HISTORY 240
+#define PROFILER_GRAPH_SAMPLES 60
+#define PROFILER_GRAPH_HEIGHT 150.0f
+// Frame time at the top of the graph
+#define PROFILER_GRAPH_MAX_TIME (1.0 / 30.0)
+
+typedef struct {
+  unsigned long long index;
+  double frameTime;
+  double cpuTime;
+  double layoutTime;
+  double uploadTime;
+  double submitTime;
+  // GL thread time spent swapping in reloaded assets
+  double reloadTime;
+  // Negative until the timer query is read, or when it could not be started
+  double gpuTime;
+  bool gpuPending;
+  unsigned glyphs;
+  unsigned drawCalls;
+  unsigned stateChanges;
+} FrameProfile;
+
+// Per frame CPU and GPU timings. GPU time comes from GL_TIME_ELAPSED queries
+// kept in a ring: results are only read once available, and a frame goes
+// unmeasured rather than waiting when every query is still in flight.
+typedef struct {
+  StatusCode status;
+  bool gpuTimers;
+  unsigned queries[PROFILER_QUERY_COUNT];
+  unsigned long long queryFrames[PROFILER_QUERY_COUNT];
+  unsigned queryHead;
+  unsigned queryCount;
+  bool queryActive;
+  unsigned long long frameIndex;
+  double frameStart;
+  double lastFrameStart;
+  double frameReloadTime;
+  FrameProfile history[PROFILER_HISTORY];
+  FILE *dumpFile;
+  unsigned long long dumpedFrames;
+} Profiler;
+
+Profiler CreateProfiler(void);
+void DestroyProfiler(Profiler *profiler);
+bool StartProfilerDump(Profiler *profiler, const char *filename);
+void BeginProfilerFrame(Profiler *profiler);
+void AddProfilerReloadTime(Profiler *profiler, double seconds);
+void EndProfilerFrame(Profiler *profiler, const TextStats *stats);
+const FrameProfile *GetFrameProfile(const Profiler *profiler,
+                                    unsigned framesAgo);
+void DrawProfilerOverlay(const Profiler *profiler, TextBatch *batch,
+                         const BitmapFont *font, float xPos, float yPos);
+
+#endif // SFR_PROFILER_H
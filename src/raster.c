@@ -0,0 +1,472 @@
+#include "raster.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define RASTER_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+  RasterImage *image;
+  const BitmapFontData *font;
+  const GlyphInstance *instances;
+  unsigned glyphCount;
+  float xPos;
+  float yPos;
+  RasterKernel kernel;
+  int top;
+  int bottom;
+} RasterBand;
+
+// x * y / 255 rounded to nearest, exact for 8 bit values. Every kernel uses
+// it, so all of them produce the same pixels.
+static inline unsigned Mul255(unsigned x, unsigned y) {
+  unsigned t = x * y + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+static void BlendRGBASpanScalar(unsigned char *dst, const unsigned char *src,
+                                unsigned count, unsigned color) {
+  for (unsigned i = 0; i < count; i++, dst += 4, src += 4) {
+    unsigned a = Mul255(src[3], color >> 24);
+    if (a == 0) {
+      continue;
+    }
+
+    for (unsigned c = 0; c < 3; c++) {
+      unsigned s = Mul255(src[c], (color >> (c * 8)) & 0xFF);
+      dst[c] = (unsigned char)(Mul255(s, a) + Mul255(dst[c], 255 - a));
+    }
+
+    dst[3] = (unsigned char)(a + Mul255(dst[3], 255 - a));
+  }
+}
+
+static void BlendAlphaSpanScalar(unsigned char *dst, const unsigned char *src,
+                                 unsigned count, unsigned color) {
+  for (unsigned i = 0; i < count; i++, dst++, src += 4) {
+    unsigned a = Mul255(src[3], color >> 24);
+    *dst = (unsigned char)(a + Mul255(*dst, 255 - a));
+  }
+}
+
+#ifdef RASTER_X86
+static inline __m128i Mul255SSE2(__m128i x, __m128i y) {
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Two pixels as 16 bit channels, alpha lanes take the source alpha as is
+static inline __m128i BlendRGBA16SSE2(__m128i t, __m128i d, __m128i color,
+                                      __m128i alphaLanes) {
+  __m128i s = Mul255SSE2(t, color);
+  __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+  __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+  return _mm_add_epi16(Mul255SSE2(s, _mm_or_si128(a, alphaLanes)),
+                       Mul255SSE2(d, inv));
+}
+
+static void BlendRGBASpanSSE2(unsigned char *dst, const unsigned char *src,
+                              unsigned count, unsigned color) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000u);
+  const __m128i alphaLanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+  unsigned i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i t = _mm_loadu_si128((const __m128i *)(src + i * 4));
+    // Most of an atlas is empty, leave those pixels alone
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(t, alphaMask),
+                                          zero)) == 0xFFFF) {
+      continue;
+    }
+
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i * 4));
+    __m128i lo = BlendRGBA16SSE2(_mm_unpacklo_epi8(t, zero),
+                                 _mm_unpacklo_epi8(d, zero), color16,
+                                 alphaLanes);
+    __m128i hi = BlendRGBA16SSE2(_mm_unpackhi_epi8(t, zero),
+                                 _mm_unpackhi_epi8(d, zero), color16,
+                                 alphaLanes);
+    _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_packus_epi16(lo, hi));
+  }
+
+  BlendRGBASpanScalar(dst + i * 4, src + i * 4, count - i, color);
+}
+
+static void BlendAlphaSpanSSE2(unsigned char *dst, const unsigned char *src,
+                               unsigned count, unsigned color) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i full = _mm_set1_epi16(255);
+  const __m128i colorAlpha = _mm_set1_epi16((short)(color >> 24));
+  unsigned i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i t0 = _mm_loadu_si128((const __m128i *)(src + i * 4));
+    __m128i t1 = _mm_loadu_si128((const __m128i *)(src + i * 4 + 16));
+    __m128i t = _mm_packs_epi32(_mm_srli_epi32(t0, 24), _mm_srli_epi32(t1, 24));
+    __m128i d = _mm_unpacklo_epi8(
+        _mm_loadl_epi64((const __m128i *)(dst + i)), zero);
+    __m128i a = Mul255SSE2(t, colorAlpha);
+    __m128i r = _mm_add_epi16(a, Mul255SSE2(d, _mm_sub_epi16(full, a)));
+    _mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(r, r));
+  }
+
+  BlendAlphaSpanScalar(dst + i, src + i * 4, count - i, color);
+}
+
+__attribute__((target("avx2"))) static inline __m256i Mul255AVX2(__m256i x,
+                                                                  __m256i y) {
+  __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, y), _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+BlendRGBA16AVX2(__m256i t, __m256i d, __m256i color, __m256i alphaLanes) {
+  __m256i s = Mul255AVX2(t, color);
+  __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+  __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+  return _mm256_add_epi16(Mul255AVX2(s, _mm256_or_si256(a, alphaLanes)),
+                          Mul255AVX2(d, inv));
+}
+
+__attribute__((target("avx2"))) static void
+BlendRGBASpanAVX2(unsigned char *dst, const unsigned char *src, unsigned count,
+                  unsigned color) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alphaMask = _mm256_set1_epi32((int)0xFF000000u);
+  const __m256i alphaLanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255,
+                                              0, 0, 0, 255, 0, 0, 0);
+  const __m256i color16 =
+      _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+  unsigned i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i t = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    if (_mm256_testz_si256(t, alphaMask)) {
+      continue;
+    }
+
+    // Unpacking works within 128 bit lanes and packing undoes it the same way
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i * 4));
+    __m256i lo = BlendRGBA16AVX2(_mm256_unpacklo_epi8(t, zero),
+                                 _mm256_unpacklo_epi8(d, zero), color16,
+                                 alphaLanes);
+    __m256i hi = BlendRGBA16AVX2(_mm256_unpackhi_epi8(t, zero),
+                                 _mm256_unpackhi_epi8(d, zero), color16,
+                                 alphaLanes);
+    _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_packus_epi16(lo, hi));
+  }
+
+  // Legacy SSE code runs slowly with dirty upper halves, and the compiler
+  // does not clear them before tail calls
+  _mm256_zeroupper();
+  BlendRGBASpanSSE2(dst + i * 4, src + i * 4, count - i, color);
+}
+
+__attribute__((target("avx2"))) static void
+BlendAlphaSpanAVX2(unsigned char *dst, const unsigned char *src, unsigned count,
+                   unsigned color) {
+  const __m256i full = _mm256_set1_epi16(255);
+  const __m256i colorAlpha = _mm256_set1_epi16((short)(color >> 24));
+  unsigned i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i t0 = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    __m256i t1 = _mm256_loadu_si256((const __m256i *)(src + i * 4 + 32));
+    // Packing interleaves the 64 bit quarters of both inputs, put them back
+    __m256i t = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(_mm256_srli_epi32(t0, 24),
+                           _mm256_srli_epi32(t1, 24)),
+        0xD8);
+    __m256i d = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128((const __m128i *)(dst + i)));
+    __m256i a = Mul255AVX2(t, colorAlpha);
+    __m256i r = _mm256_add_epi16(a, Mul255AVX2(d, _mm256_sub_epi16(full, a)));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), 0xD8);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm256_castsi256_si128(packed));
+  }
+
+  _mm256_zeroupper();
+  BlendAlphaSpanSSE2(dst + i, src + i * 4, count - i, color);
+}
+#endif
+
+// Single channel atlas texels as the RGBA ones the kernels blend
+static void ExpandCoverageSpan(unsigned char *dst, const unsigned char *src,
+                               unsigned count, AtlasColor color) {
+  unsigned char fill = color == ATLAS_COLOR_WHITE ? 255 : 0;
+  for (unsigned i = 0; i < count; i++, dst += 4) {
+    unsigned char rgb = color == ATLAS_COLOR_COVERAGE ? src[i] : fill;
+    dst[0] = rgb;
+    dst[1] = rgb;
+    dst[2] = rgb;
+    dst[3] = src[i];
+  }
+}
+
+// Moves the start of a span forward until both ends are inside their
+// bounds, then shortens it
+static bool ClipRasterSpan(int *dst, int *src, int *len, int dstMin,
+                           int dstMax, int srcSize) {
+  int skip = 0;
+  if (*dst < dstMin) {
+    skip = dstMin - *dst;
+  }
+
+  if (*src + skip < 0) {
+    skip = -*src;
+  }
+
+  *dst += skip;
+  *src += skip;
+  *len -= skip;
+  if (*dst + *len > dstMax) {
+    *len = dstMax - *dst;
+  }
+
+  if (*src + *len > srcSize) {
+    *len = srcSize - *src;
+  }
+
+  return *len > 0;
+}
+
+static void *RasterBandGlyphs(void *arg) {
+  const RasterBand *band = arg;
+  RasterImage *image = band->image;
+  const BitmapFontData *font = band->font;
+  int atlasWidth = (int)font->atlasWidth;
+  int atlasHeight = (int)font->atlasHeight;
+  size_t texelSize = font->atlasFormat == ATLAS_R8 ? 1 : 4;
+  size_t layerSize = (size_t)font->atlasWidth * font->atlasHeight * texelSize;
+  unsigned pixelSize = image->format == RASTER_RGBA ? 4 : 1;
+  unsigned char *expanded = NULL;
+  if (texelSize == 1) {
+    expanded = malloc((size_t)font->atlasWidth * 4);
+    if (expanded == NULL) {
+      Log(LOG_ERROR, "RASTER: could not allocate memory for a row");
+      return NULL;
+    }
+  }
+
+  void (*blendSpan)(unsigned char *, const unsigned char *, unsigned,
+                    unsigned) = image->format == RASTER_RGBA
+                                    ? BlendRGBASpanScalar
+                                    : BlendAlphaSpanScalar;
+#ifdef RASTER_X86
+  if (band->kernel == RASTER_KERNEL_SSE2) {
+    blendSpan = image->format == RASTER_RGBA ? BlendRGBASpanSSE2
+                                             : BlendAlphaSpanSSE2;
+  } else if (band->kernel == RASTER_KERNEL_AVX2) {
+    blendSpan = image->format == RASTER_RGBA ? BlendRGBASpanAVX2
+                                             : BlendAlphaSpanAVX2;
+  }
+#endif
+
+  for (unsigned i = 0; i < band->glyphCount; i++) {
+    const GlyphInstance *instance = &band->instances[i];
+    const GlyphTableEntry *glyph = &font->font.glyphs[instance->glyph];
+    unsigned layer = (unsigned)glyph->layer;
+    if ((instance->color >> 24) == 0 || layer >= font->atlasLayers) {
+      continue;
+    }
+
+    // Glyphs snap to whole pixels, the atlas rows are stored bottom up
+    int dstX = (int)lrintf(band->xPos + instance->x + glyph->offset[0]);
+    int dstY = (int)lrintf(band->yPos + instance->y + glyph->offset[1]);
+    int srcX = (int)lrintf(glyph->uvs[0] * (float)atlasWidth);
+    int srcY = (int)lrintf((1.0f - glyph->uvs[1]) * (float)atlasHeight);
+    int width = (int)glyph->size[0];
+    int height = (int)glyph->size[1];
+    if (!ClipRasterSpan(&dstX, &srcX, &width, 0, (int)image->width,
+                        atlasWidth) ||
+        !ClipRasterSpan(&dstY, &srcY, &height, band->top, band->bottom,
+                        atlasHeight)) {
+      continue;
+    }
+
+    const unsigned char *atlas = font->pixels + layerSize * layer;
+    for (int row = 0; row < height; row++) {
+      size_t srcRow = (size_t)(atlasHeight - 1 - (srcY + row));
+      size_t dstRow = (size_t)(dstY + row);
+      const unsigned char *src =
+          atlas + (srcRow * (size_t)atlasWidth + (size_t)srcX) * texelSize;
+      if (expanded != NULL) {
+        ExpandCoverageSpan(expanded, src, (unsigned)width, font->atlasColor);
+        src = expanded;
+      }
+
+      blendSpan(image->pixels + (dstRow * image->width + (size_t)dstX) *
+                                    pixelSize,
+                src, (unsigned)width, instance->color);
+    }
+  }
+
+  if (expanded != NULL) {
+    free(expanded);
+  }
+
+  return NULL;
+}
+
+RasterImage CreateRasterImage(unsigned width, unsigned height,
+                              RasterFormat format) {
+  RasterImage image = {0};
+  size_t pixelSize = format == RASTER_RGBA ? 4 : 1;
+  image.format = format;
+  image.width = width;
+  image.height = height;
+  image.pixels = calloc((size_t)width * height, pixelSize);
+  if (image.pixels == NULL) {
+    Log(LOG_ERROR, "RASTER: could not allocate memory for %u x %u image",
+        width, height);
+    image.status = ERROR_OUT_OF_MEMORY;
+  }
+
+  return image;
+}
+
+void DestroyRasterImage(RasterImage *image) {
+  if (image->pixels != NULL) {
+    free(image->pixels);
+    image->pixels = NULL;
+  }
+}
+
+void ClearRasterImage(RasterImage *image, unsigned color) {
+  size_t pixelCount = (size_t)image->width * image->height;
+  if (image->format == RASTER_ALPHA) {
+    memset(image->pixels, (int)(color >> 24), pixelCount);
+    return;
+  }
+
+  for (size_t i = 0; i < pixelCount; i++) {
+    memcpy(image->pixels + i * 4, &color, 4);
+  }
+}
+
+RasterKernel GetBestRasterKernel(void) {
+#ifdef RASTER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return RASTER_KERNEL_AVX2;
+  }
+
+  return RASTER_KERNEL_SSE2;
+#else
+  return RASTER_KERNEL_SCALAR;
+#endif
+}
+
+const char *GetRasterKernelName(RasterKernel kernel) {
+  switch (kernel) {
+  case RASTER_KERNEL_SSE2:
+    return "sse2";
+  case RASTER_KERNEL_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+unsigned RasterText(RasterImage *image, const BitmapFontData *font,
+                    const TextLayout *layout, float xPos, float yPos,
+                    const char *text) {
+  size_t textLen = strlen(text);
+  GlyphInstance *instances = malloc(textLen * sizeof(GlyphInstance));
+  if (instances == NULL && textLen > 0) {
+    Log(LOG_ERROR, "RASTER: could not allocate memory for %zu glyphs",
+        textLen);
+    return 0;
+  }
+
+  // Same layout as the GL path, only the compositing differs. Glyphs are
+  // composited at the atlas size.
+  TextLayout atlasLayout = *layout;
+  atlasLayout.size = 0.0f;
+  unsigned glyphCount = LayoutText(&font->font, &atlasLayout, 0.0f, 0.0f, text,
+                                   textLen, instances);
+  RasterGlyphs(image, font, instances, glyphCount, xPos, yPos,
+               GetBestRasterKernel(), 0);
+
+  if (instances != NULL) {
+    free(instances);
+  }
+
+  return glyphCount;
+}
+
+// Splits the image in horizontal bands, one per thread, every thread going
+// through all the glyphs and only writing the rows of its own band. The
+// calling thread takes the first band.
+void RasterGlyphs(RasterImage *image, const BitmapFontData *font,
+                  const GlyphInstance *instances, unsigned glyphCount,
+                  float xPos, float yPos, RasterKernel kernel,
+                  unsigned threadCount) {
+  RasterBand bands[RASTER_MAX_THREADS];
+  pthread_t threads[RASTER_MAX_THREADS];
+
+  if (font->font.distanceRange > 0.0f) {
+    Log(LOG_ERROR, "RASTER: distance field fonts are not supported");
+    return;
+  }
+
+  if (font->atlasFormat == ATLAS_RGTC1) {
+    Log(LOG_ERROR, "RASTER: compressed atlases are not supported");
+    return;
+  }
+
+  if (threadCount == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? (unsigned)cores : 1;
+    if (threadCount > glyphCount / RASTER_MIN_GLYPHS_PER_THREAD) {
+      threadCount = glyphCount / RASTER_MIN_GLYPHS_PER_THREAD;
+    }
+  }
+
+  if (threadCount > RASTER_MAX_THREADS) {
+    threadCount = RASTER_MAX_THREADS;
+  }
+
+  if (threadCount > image->height) {
+    threadCount = image->height;
+  }
+
+  if (threadCount == 0) {
+    threadCount = 1;
+  }
+
+  for (unsigned i = 0; i < threadCount; i++) {
+    bands[i] = (RasterBand){
+        .image = image,
+        .font = font,
+        .instances = instances,
+        .glyphCount = glyphCount,
+        .xPos = xPos,
+        .yPos = yPos,
+        .kernel = kernel,
+        .top = (int)((size_t)image->height * i / threadCount),
+        .bottom = (int)((size_t)image->height * (i + 1) / threadCount),
+    };
+  }
+
+  unsigned started = 1;
+  while (started < threadCount &&
+         pthread_create(&threads[started], NULL, RasterBandGlyphs,
+                        &bands[started]) == 0) {
+    started++;
+  }
+
+  // Bands of threads that could not be started are done on this one
+  RasterBandGlyphs(&bands[0]);
+  for (unsigned i = started; i < threadCount; i++) {
+    RasterBandGlyphs(&bands[i]);
+  }
+
+  for (unsigned i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef SFR_RASTER_H
+#define SFR_RASTER_H
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+#define RASTER_MAX_THREADS 16
+// Fewer glyphs than this per band are not worth a thread
+#define RASTER_MIN_GLYPHS_PER_THREAD 256
+
+typedef enum {
+  RASTER_RGBA,
+  RASTER_ALPHA,
+} RasterFormat;
+
+typedef enum {
+  RASTER_KERNEL_SCALAR,
+  RASTER_KERNEL_SSE2,
+  RASTER_KERNEL_AVX2,
+} RasterKernel;
+
+// CPU framebuffer with rows from top to bottom. RGBA images blend glyphs the
+// way the GL path does, alpha images only keep their coverage.
+typedef struct {
+  StatusCode status;
+  RasterFormat format;
+  unsigned width;
+  unsigned height;
+  unsigned char *pixels;
+} RasterImage;
+
+RasterImage CreateRasterImage(unsigned width, unsigned height,
+                              RasterFormat format);
+void DestroyRasterImage(RasterImage *image);
+void ClearRasterImage(RasterImage *image, unsigned color);
+RasterKernel GetBestRasterKernel(void);
+const char *GetRasterKernelName(RasterKernel kernel);
+unsigned RasterText(RasterImage *image, const BitmapFontData *font,
+                    const TextLayout *layout, float xPos, float yPos,
+                    const char *text);
+void RasterGlyphs(RasterImage *image, const BitmapFontData *font,
+                  const GlyphInstance *instances, unsigned glyphCount,
+                  float xPos, float yPos, RasterKernel kernel,
+                  unsigned threadCount);
+
+#endif // SFR_RASTER_H
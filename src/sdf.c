@@ -0,0 +1,364 @@
+#include "sdf.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SDF_FAR 1e20f
+
+// Source and destination rectangles of a glyph, in image rows from the top
+typedef struct {
+  unsigned index;
+  unsigned srcX;
+  unsigned srcY;
+  unsigned srcLayer;
+  unsigned dstX;
+  unsigned dstY;
+  unsigned width;
+  unsigned height;
+} DistanceFieldGlyph;
+
+typedef struct {
+  const unsigned char *srcPixels;
+  unsigned srcWidth;
+  unsigned srcHeight;
+  // Bytes per source texel, coverage is the last one
+  unsigned srcTexelSize;
+  unsigned char *dstPixels;
+  unsigned dstWidth;
+  unsigned dstHeight;
+  unsigned padding;
+  float distanceRange;
+  DistanceFieldGlyph *glyphs;
+  unsigned count;
+  atomic_uint next;
+  atomic_bool failed;
+} DistanceFieldJob;
+
+// Exact squared distance transform of a line (Felzenszwalb & Huttenlocher):
+// the lower envelope of the parabolas rooted at every sample
+static void TransformLine(const float *f, float *d, int *v, float *z, int n) {
+  int k = 0;
+  v[0] = 0;
+  z[0] = -INFINITY;
+  z[1] = INFINITY;
+  for (int q = 1; q < n; q++) {
+    float s = 0.0f;
+    for (;; k--) {
+      int r = v[k];
+      s = ((f[q] + (float)(q * q)) - (f[r] + (float)(r * r))) /
+          (float)(2 * q - 2 * r);
+      if (s > z[k]) {
+        break;
+      }
+    }
+
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = INFINITY;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < (float)q) {
+      k++;
+    }
+
+    float distance = (float)(q - v[k]);
+    d[q] = distance * distance + f[v[k]];
+  }
+}
+
+// Columns then rows, line buffers hold max(width, height) + 1 entries
+static void TransformGrid(float *grid, unsigned width, unsigned height,
+                          float *f, float *d, int *v, float *z) {
+  for (unsigned x = 0; x < width; x++) {
+    for (unsigned y = 0; y < height; y++) {
+      f[y] = grid[y * width + x];
+    }
+
+    TransformLine(f, d, v, z, (int)height);
+    for (unsigned y = 0; y < height; y++) {
+      grid[y * width + x] = d[y];
+    }
+  }
+
+  for (unsigned y = 0; y < height; y++) {
+    memcpy(f, grid + y * width, width * sizeof(float));
+    TransformLine(f, grid + y * width, v, z, (int)width);
+  }
+}
+
+static bool MakeGlyphField(DistanceFieldJob *job,
+                           const DistanceFieldGlyph *glyph) {
+  unsigned padding = job->padding;
+  unsigned width = glyph->width + padding * 2;
+  unsigned height = glyph->height + padding * 2;
+  unsigned lineSize = (width > height ? width : height) + 1;
+  size_t count = (size_t)width * height;
+  bool made = false;
+
+  unsigned char *coverage = malloc(count);
+  float *inside = malloc(count * sizeof(float));
+  float *outside = malloc(count * sizeof(float));
+  float *f = malloc(lineSize * sizeof(float));
+  float *d = malloc(lineSize * sizeof(float));
+  int *v = malloc(lineSize * sizeof(int));
+  float *z = malloc((lineSize + 1) * sizeof(float));
+  if (coverage == NULL || inside == NULL || outside == NULL || f == NULL ||
+      d == NULL || v == NULL || z == NULL) {
+    goto terminate;
+  }
+
+  // Coverage of the glyph with its padding, atlas rows are stored bottom up
+  unsigned texelSize = job->srcTexelSize;
+  const unsigned char *layer = job->srcPixels + (size_t)glyph->srcLayer *
+                                                    job->srcWidth *
+                                                    job->srcHeight * texelSize;
+  for (unsigned y = 0; y < height; y++) {
+    for (unsigned x = 0; x < width; x++) {
+      unsigned char alpha = 0;
+      if (x >= padding && x - padding < glyph->width && y >= padding &&
+          y - padding < glyph->height) {
+        unsigned srcX = glyph->srcX + x - padding;
+        unsigned srcY = job->srcHeight - 1 - (glyph->srcY + y - padding);
+        alpha = layer[((size_t)srcY * job->srcWidth + srcX) * texelSize +
+                      texelSize - 1];
+      }
+
+      size_t i = (size_t)y * width + x;
+      coverage[i] = alpha;
+      inside[i] = alpha >= 128 ? 0.0f : SDF_FAR;
+      outside[i] = alpha >= 128 ? SDF_FAR : 0.0f;
+    }
+  }
+
+  TransformGrid(inside, width, height, f, d, v, z);
+  TransformGrid(outside, width, height, f, d, v, z);
+
+  // Distances are positive outside and measured to the edge between pixels,
+  // anti-aliased pixels already tell how far the edge crosses them
+  for (unsigned y = 0; y < height; y++) {
+    unsigned dstY = job->dstHeight - 1 - (glyph->dstY + y);
+    unsigned char *row =
+        job->dstPixels + (size_t)dstY * job->dstWidth + glyph->dstX;
+    for (unsigned x = 0; x < width; x++) {
+      size_t i = (size_t)y * width + x;
+      float distance = 0.0f;
+      if (coverage[i] > 0 && coverage[i] < 255) {
+        distance = 0.5f - (float)coverage[i] / 255.0f;
+      } else if (coverage[i] >= 128) {
+        distance = 0.5f - sqrtf(outside[i]);
+      } else {
+        distance = sqrtf(inside[i]) - 0.5f;
+      }
+
+      float value = 0.5f - distance / job->distanceRange;
+      value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+      row[x] = (unsigned char)(value * 255.0f + 0.5f);
+    }
+  }
+
+  made = true;
+
+terminate:
+  free(coverage);
+  free(inside);
+  free(outside);
+  free(f);
+  free(d);
+  free(v);
+  free(z);
+  return made;
+}
+
+static void *MakeGlyphFields(void *arg) {
+  DistanceFieldJob *job = arg;
+  unsigned i = 0;
+  while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+    if (!MakeGlyphField(job, &job->glyphs[i])) {
+      atomic_store(&job->failed, true);
+    }
+  }
+
+  return NULL;
+}
+
+static int CompareGlyphHeights(const void *a, const void *b) {
+  const DistanceFieldGlyph *x = a;
+  const DistanceFieldGlyph *y = b;
+  return (int)y->height - (int)x->height;
+}
+
+// Replaces the coverage atlas of a font by a single layer, single channel
+// distance field. Glyphs are packed again with room for the distance range
+// around them, and their table entries grow by the same padding.
+StatusCode MakeDistanceFieldFont(BitmapFontData *data, float distanceRange,
+                                 unsigned threadCount) {
+  BitmapFont *font = &data->font;
+  StatusCode status = ERROR_OUT_OF_MEMORY;
+  pthread_t threads[SDF_MAX_THREADS - 1];
+  unsigned started = 0;
+  DistanceFieldJob job = {
+      .srcPixels = data->pixels,
+      .srcWidth = data->atlasWidth,
+      .srcHeight = data->atlasHeight,
+      .srcTexelSize = data->atlasFormat == ATLAS_R8 ? 1 : 4,
+      .distanceRange = distanceRange >= 1.0f ? distanceRange : 1.0f,
+  };
+  job.padding = (unsigned)ceilf(job.distanceRange * 0.5f);
+
+  if (font->distanceRange > 0.0f) {
+    return SUCCESS;
+  }
+
+  // Pack tables are read only, packs are converted when they are built
+  if (font->packData != NULL) {
+    Log(LOG_ERROR, "SDF: font packs must be built with a distance field");
+    return ERROR_INVALID_PACK;
+  }
+
+  if (data->atlasFormat == ATLAS_RGTC1) {
+    Log(LOG_ERROR, "SDF: compressed atlases cannot be converted");
+    return ERROR_INVALID_DESCRIPTION;
+  }
+
+  double start = GetMonotonicTime();
+  job.glyphs = calloc(font->glyphCount, sizeof(DistanceFieldGlyph));
+  if (job.glyphs == NULL) {
+    Log(LOG_ERROR, "SDF: could not allocate memory for %u glyphs",
+        font->glyphCount);
+    return ERROR_OUT_OF_MEMORY;
+  }
+
+  for (unsigned i = 0; i < font->glyphCount; i++) {
+    const GlyphTableEntry *entry = &font->glyphs[i];
+    if (!font->visible[i]) {
+      continue;
+    }
+
+    DistanceFieldGlyph glyph = {
+        .index = i,
+        .srcX = (unsigned)lroundf(entry->uvs[0] * (float)data->atlasWidth),
+        .srcY = (unsigned)lroundf((1.0f - entry->uvs[1]) *
+                                  (float)data->atlasHeight),
+        .srcLayer = (unsigned)entry->layer,
+        .width = (unsigned)entry->size[0],
+        .height = (unsigned)entry->size[1],
+    };
+    if (glyph.srcX + glyph.width > data->atlasWidth ||
+        glyph.srcY + glyph.height > data->atlasHeight ||
+        glyph.srcLayer >= data->atlasLayers) {
+      Log(LOG_ERROR, "SDF: glyph %u is outside of the atlas", i);
+      status = ERROR_INVALID_DESCRIPTION;
+      goto terminate;
+    }
+
+    job.glyphs[job.count++] = glyph;
+  }
+
+  // Shelves of glyphs sorted by height, as wide as the source atlas
+  qsort(job.glyphs, job.count, sizeof(DistanceFieldGlyph), CompareGlyphHeights);
+  job.dstWidth = data->atlasWidth;
+  for (unsigned i = 0; i < job.count; i++) {
+    unsigned width = job.glyphs[i].width + job.padding * 2;
+    job.dstWidth = width > job.dstWidth ? width : job.dstWidth;
+  }
+
+  unsigned x = 0;
+  unsigned shelfY = 0;
+  unsigned shelfHeight = 0;
+  for (unsigned i = 0; i < job.count; i++) {
+    DistanceFieldGlyph *glyph = &job.glyphs[i];
+    unsigned width = glyph->width + job.padding * 2;
+    if (x + width > job.dstWidth) {
+      shelfY += shelfHeight;
+      shelfHeight = 0;
+      x = 0;
+    }
+
+    glyph->dstX = x;
+    glyph->dstY = shelfY;
+    x += width;
+    if (glyph->height + job.padding * 2 > shelfHeight) {
+      shelfHeight = glyph->height + job.padding * 2;
+    }
+  }
+
+  job.dstHeight = shelfY + shelfHeight > 0 ? shelfY + shelfHeight : 1;
+  job.dstPixels = calloc((size_t)job.dstWidth * job.dstHeight, 1);
+  if (job.dstPixels == NULL) {
+    Log(LOG_ERROR, "SDF: could not allocate a %ux%u atlas", job.dstWidth,
+        job.dstHeight);
+    goto terminate;
+  }
+
+  if (threadCount == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount = cores > 0 ? (unsigned)cores : 1;
+  }
+
+  // A thread that cannot be started only makes the conversion slower
+  while (started + 1 < threadCount && started + 1 < job.count &&
+         started < SDF_MAX_THREADS - 1 &&
+         pthread_create(&threads[started], NULL, MakeGlyphFields, &job) ==
+             0) {
+    started++;
+  }
+
+  MakeGlyphFields(&job);
+  for (unsigned i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  if (atomic_load(&job.failed)) {
+    Log(LOG_ERROR, "SDF: could not allocate memory for glyph fields");
+    goto terminate;
+  }
+
+  float padding = (float)job.padding;
+  float dstWidth = (float)job.dstWidth;
+  float dstHeight = (float)job.dstHeight;
+  for (unsigned i = 0; i < job.count; i++) {
+    const DistanceFieldGlyph *glyph = &job.glyphs[i];
+    GlyphTableEntry *entry = &font->glyphs[glyph->index];
+    float left = (float)glyph->dstX;
+    float top = (float)glyph->dstY;
+    float width = entry->size[0] + padding * 2.0f;
+    float height = entry->size[1] + padding * 2.0f;
+    *entry = (GlyphTableEntry){
+        .uvs = {left / dstWidth, 1.0f - top / dstHeight,
+                (left + width) / dstWidth, 1.0f - (top + height) / dstHeight},
+        .size = {width, height},
+        .offset = {entry->offset[0] - padding, entry->offset[1] - padding},
+        .layer = 0.0f,
+    };
+  }
+
+  free(data->pixels);
+  data->pixels = job.dstPixels;
+  data->atlasWidth = job.dstWidth;
+  data->atlasHeight = job.dstHeight;
+  data->atlasLayers = 1;
+  data->atlasFormat = ATLAS_R8;
+  data->atlasColor = ATLAS_COLOR_WHITE;
+  font->distanceRange = job.distanceRange;
+  job.dstPixels = NULL;
+  status = SUCCESS;
+
+  Log(LOG_INFO, "SDF: %u glyphs into a %ux%u distance field in %.1f ms",
+      job.count, data->atlasWidth, data->atlasHeight,
+      (GetMonotonicTime() - start) * 1e3);
+
+terminate:
+  if (job.dstPixels != NULL) {
+    free(job.dstPixels);
+  }
+
+  free(job.glyphs);
+  return status;
+}
@@ -0,0 +1,15 @@
+#ifndef SFR_SDF_H
+#define SFR_SDF_H
+
+#include "common.h"
+#include "font.h"
+
+#define SDF_MAX_THREADS 16
+// Texels from a value of 0 to a value of 1, half of it on each side of the
+// glyph edge. Outlines and shadows can reach that far at the atlas size.
+#define SDF_DEFAULT_RANGE 8.0f
+
+StatusCode MakeDistanceFieldFont(BitmapFontData *data, float distanceRange,
+                                 unsigned threadCount);
+
+#endif // SFR_SDF_H
@@ -0,0 +1,149 @@
+#include "stream.h"
+
+#include <stdlib.h>
+
+StreamBuffer CreateStreamBuffer(size_t regionSize) {
+  StreamBuffer stream = {0};
+  size_t bufferSize = regionSize * STREAM_BUFFER_REGIONS;
+
+  stream.regionSize = regionSize;
+  stream.persistent = GLAD_GL_ARB_buffer_storage && glBufferStorage != NULL;
+
+  glGenBuffers(1, &stream.bufferId);
+  glBindBuffer(GL_ARRAY_BUFFER, stream.bufferId);
+  if (stream.persistent) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, (GLsizeiptr)bufferSize, NULL, flags);
+    stream.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0,
+                                     (GLsizeiptr)bufferSize, flags);
+    if (stream.mapped == NULL) {
+      Log(LOG_ERROR, "STREAM: could not map %zu bytes", bufferSize);
+      stream.status = ERROR_OUT_OF_MEMORY;
+    }
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)bufferSize, NULL,
+                 GL_STREAM_DRAW);
+    stream.staging = malloc(regionSize);
+    if (stream.staging == NULL) {
+      Log(LOG_ERROR, "STREAM: could not allocate %zu bytes", regionSize);
+      stream.status = ERROR_OUT_OF_MEMORY;
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  Log(LOG_INFO, "STREAM: %u x %zu bytes, %s", STREAM_BUFFER_REGIONS, regionSize,
+      stream.persistent ? "persistent mapping" : "orphaning fallback");
+  return stream;
+}
+
+void DestroyStreamBuffer(StreamBuffer *stream) {
+  for (unsigned i = 0; i < STREAM_BUFFER_REGIONS; i++) {
+    if (stream->fences[i] != NULL) {
+      glDeleteSync(stream->fences[i]);
+    }
+  }
+
+  if (stream->mapped != NULL) {
+    glBindBuffer(GL_ARRAY_BUFFER, stream->bufferId);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  if (stream->bufferId != 0) {
+    glDeleteBuffers(1, &stream->bufferId);
+  }
+
+  if (stream->staging != NULL) {
+    free(stream->staging);
+  }
+
+  *stream = (StreamBuffer){0};
+}
+
+void *MapStreamRange(StreamBuffer *stream, size_t minSize, size_t *available) {
+  if (minSize > stream->regionSize) {
+    return NULL;
+  }
+
+  if (stream->regionSize - stream->offset < minSize) {
+    AdvanceStreamRegion(stream);
+  }
+
+  *available = stream->regionSize - stream->offset;
+  if (stream->persistent) {
+    return stream->mapped + stream->region * stream->regionSize +
+           stream->offset;
+  }
+
+  return stream->staging + stream->offset;
+}
+
+size_t CommitStreamRange(StreamBuffer *stream, size_t size) {
+  size_t bufferOffset = stream->region * stream->regionSize + stream->offset;
+  if (!stream->persistent) {
+    glBindBuffer(GL_ARRAY_BUFFER, stream->bufferId);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)bufferOffset,
+                    (GLsizeiptr)size, stream->staging + stream->offset);
+  }
+
+  stream->offset += size;
+  stream->frameStats.bytesWritten += size;
+  return bufferOffset;
+}
+
+void AdvanceStreamRegion(StreamBuffer *stream) {
+  // Draws reading the current region complete before the fence signals
+  if (stream->persistent && stream->offset > 0) {
+    stream->fences[stream->region] =
+        glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  stream->region = (stream->region + 1) % STREAM_BUFFER_REGIONS;
+  stream->offset = 0;
+
+  // The fallback path never writes memory the GPU may be reading: instead of
+  // waiting it orphans the whole buffer whenever the ring wraps around
+  if (!stream->persistent) {
+    if (stream->region == 0) {
+      glBindBuffer(GL_ARRAY_BUFFER, stream->bufferId);
+      glBufferData(GL_ARRAY_BUFFER,
+                   (GLsizeiptr)(stream->regionSize * STREAM_BUFFER_REGIONS),
+                   NULL, GL_STREAM_DRAW);
+    }
+    return;
+  }
+
+  GLsync fence = stream->fences[stream->region];
+  if (fence == NULL) {
+    return;
+  }
+
+  GLenum waitStatus = glClientWaitSync(fence, 0, 0);
+  if (waitStatus == GL_TIMEOUT_EXPIRED) {
+    double waitStart = GetMonotonicTime();
+    do {
+      waitStatus = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    STREAM_FENCE_TIMEOUT_NS);
+    } while (waitStatus == GL_TIMEOUT_EXPIRED);
+    stream->frameStats.fenceWaitTime += GetMonotonicTime() - waitStart;
+    stream->frameStats.fenceWaits++;
+  }
+
+  if (waitStatus == GL_WAIT_FAILED) {
+    Log(LOG_WARN, "STREAM: could not wait for region %u", stream->region);
+  }
+
+  glDeleteSync(fence);
+  stream->fences[stream->region] = NULL;
+}
+
+void EndStreamFrame(StreamBuffer *stream) {
+  // Every frame starts on a fresh region so it never waits on itself
+  if (stream->offset > 0) {
+    AdvanceStreamRegion(stream);
+  }
+
+  stream->lastFrameStats = stream->frameStats;
+  stream->frameStats = (StreamStats){0};
+}
@@ -0,0 +1,42 @@
+#ifndef SFR_STREAM_H
+#define SFR_STREAM_H
+
+#include <glad/glad.h>
+
+#include "common.h"
+
+// Triple buffered streaming, each region holds one frame worth of data
+#define STREAM_BUFFER_REGIONS 3
+#define STREAM_FENCE_TIMEOUT_NS 1000000
+
+typedef struct {
+  size_t bytesWritten;
+  unsigned fenceWaits;
+  double fenceWaitTime;
+} StreamStats;
+
+// Ring of vertex data regions written by the CPU while the GPU still reads
+// the previous ones. Regions are persistently mapped when buffer storage is
+// available, otherwise the data is staged and uploaded with glBufferSubData.
+typedef struct {
+  StatusCode status;
+  bool persistent;
+  unsigned bufferId;
+  unsigned char *mapped;
+  unsigned char *staging;
+  size_t regionSize;
+  unsigned region;
+  size_t offset;
+  GLsync fences[STREAM_BUFFER_REGIONS];
+  StreamStats frameStats;
+  StreamStats lastFrameStats;
+} StreamBuffer;
+
+StreamBuffer CreateStreamBuffer(size_t regionSize);
+void DestroyStreamBuffer(StreamBuffer *stream);
+void *MapStreamRange(StreamBuffer *stream, size_t minSize, size_t *available);
+size_t CommitStreamRange(StreamBuffer *stream, size_t size);
+void AdvanceStreamRegion(StreamBuffer *stream);
+void EndStreamFrame(StreamBuffer *stream);
+
+#endif // SFR_STREAM_H
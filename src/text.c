@@ -0,0 +1,891 @@
+#include "text.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glyph_cache.h"
+#include "layout_pool.h"
+#include "text_run_cache.h"
+
+#if defined(__SSE2__)
+#define TEXT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// ASCII runs are laid out in blocks of this many glyphs, gathered a few at a
+// time, up to this far from the line start: sums of whole pixels stay exact
+// in any order below it
+#define ASCII_RUN_BLOCK 64
+#define ASCII_RUN_GATHER 16
+#define ASCII_RUN_MAX_OFFSET 4194304.0f
+
+// Code points already reported as missing, text is laid out every frame and
+// would otherwise repeat the warning each time
+static atomic_uint missingGlyphsWarned[(MAX_CODEPOINT + 1) / 32];
+
+// Batch between BeginTextBatch and EndTextBatch, RenderText draws into it
+static TextBatch *currentBatch = NULL;
+
+static void WarnMissingGlyph(unsigned codepoint) {
+  if (codepoint > MAX_CODEPOINT) {
+    codepoint = MAX_CODEPOINT;
+  }
+
+  unsigned bit = 1u << (codepoint % 32);
+  if ((atomic_fetch_or_explicit(&missingGlyphsWarned[codepoint / 32], bit,
+                                memory_order_relaxed) &
+       bit) == 0) {
+    Log(LOG_WARN, "TEXT: do not have a glyph for U+%04X", codepoint);
+  }
+}
+
+float GetTextScale(const BitmapFont *font, const TextLayout *layout) {
+  return layout->size > 0.0f && font->fontSize > 0.0f
+             ? layout->size / font->fontSize
+             : 1.0f;
+}
+
+#ifdef TEXT_SSE2
+// Shifts the lanes of v up by one, the first lane being zero
+static inline __m128 ShiftLanesUp(__m128 v) {
+  return _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4));
+}
+
+// Lays out the ASCII characters at the start of text, at most
+// ASCII_RUN_BLOCK, the way the loop of LayoutTextLines lays them out at
+// scale 1 without wrapping. Glyphs and kernings are gathered
+// ASCII_RUN_GATHER at a time, then the cursor before every glyph is the
+// running sum of their advances, 4 glyphs at a time, so no addition waits
+// for the previous one. Returns how many characters were laid out.
+static unsigned LayoutAsciiRun(const BitmapFont *font, const TextLayout *layout,
+                               float xPos, float yOffset,
+                               const unsigned char *text, size_t textLen,
+                               GlyphInstance *instances, unsigned *glyphCount,
+                               float *xOffset, unsigned *prevId) {
+  // Padded to whole groups of 4 lanes
+  AsciiRunGlyph glyphs[ASCII_RUN_BLOCK + 4];
+  int kernings[ASCII_RUN_BLOCK + 4];
+  const AsciiRunTable *runs = font->asciiRuns;
+  unsigned maxRun = textLen < ASCII_RUN_BLOCK ? (unsigned)textLen
+                                              : ASCII_RUN_BLOCK;
+  unsigned first = runs->glyphs[text[0]].glyph & ~ASCII_RUN_BLANK;
+  if (first == NO_GLYPH) {
+    return 0;
+  }
+
+  // Whole pixels add up exactly in any order, so does the kerning with the
+  // glyph before the run, which may be anything
+  float start = *xOffset;
+  float firstKerning = GetKerning(font, *prevId, first);
+  if (start != (float)(int)start || start > ASCII_RUN_MAX_OFFSET ||
+      start < -ASCII_RUN_MAX_OFFSET ||
+      firstKerning != (float)(int)firstKerning) {
+    return 0;
+  }
+
+  __m128i blankFlag = _mm_set1_epi32((int)ASCII_RUN_BLANK);
+  __m128 origin = _mm_set1_ps(xPos);
+  __m128 yLanes = _mm_set1_ps(yOffset);
+  __m128 colorLanes = _mm_castsi128_ps(_mm_set1_epi32((int)layout->color));
+  __m128 carry = _mm_set1_ps(start);
+  unsigned count = *glyphCount;
+  unsigned gathered = 0;
+  unsigned run = 0;
+  unsigned prev = 0;
+  bool ended = false;
+  for (;;) {
+    if (run == gathered) {
+      unsigned gatherEnd = gathered + ASCII_RUN_GATHER < maxRun
+                               ? gathered + ASCII_RUN_GATHER
+                               : maxRun;
+      for (; !ended && gathered < gatherEnd; gathered++) {
+        unsigned c = text[gathered];
+        if (runs->glyphs[c].glyph == NO_GLYPH) {
+          ended = true;
+          break;
+        }
+
+        glyphs[gathered] = runs->glyphs[c];
+        kernings[gathered] = runs->kernings[prev * ASCII_RUN_COUNT + c];
+        prev = c;
+      }
+
+      kernings[0] = run == 0 ? (int)firstKerning : kernings[0];
+      for (unsigned k = gathered; k < gathered + 4; k++) {
+        glyphs[k] = (AsciiRunGlyph){0};
+        kernings[k] = 0;
+      }
+
+      if (run == gathered) {
+        break;
+      }
+    }
+
+    __m128 pair0 = _mm_loadu_ps((const float *)(glyphs + run));
+    __m128 pair1 = _mm_loadu_ps((const float *)(glyphs + run + 2));
+    __m128i flaggedIds =
+        _mm_castps_si128(_mm_shuffle_ps(pair0, pair1, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128 kerning =
+        _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(kernings + run)));
+    __m128 advance = _mm_add_ps(
+        kerning, _mm_shuffle_ps(pair0, pair1, _MM_SHUFFLE(3, 1, 3, 1)));
+    __m128 sum = _mm_add_ps(advance, ShiftLanesUp(advance));
+    sum = _mm_add_ps(sum, ShiftLanesUp(ShiftLanesUp(sum)));
+    __m128 cursor = _mm_add_ps(carry, ShiftLanesUp(sum));
+
+    // Instances of the 4 lanes, each stored where the visible glyphs before
+    // it end
+    __m128 ids = _mm_castsi128_ps(_mm_andnot_si128(blankFlag, flaggedIds));
+    __m128 x = _mm_add_ps(_mm_add_ps(origin, cursor), kerning);
+    __m128 xy = _mm_unpacklo_ps(x, yLanes);
+    __m128 glyphColor = _mm_unpacklo_ps(ids, colorLanes);
+    __m128 rows[4] = {_mm_movelh_ps(xy, glyphColor),
+                      _mm_movehl_ps(glyphColor, xy)};
+    xy = _mm_unpackhi_ps(x, yLanes);
+    glyphColor = _mm_unpackhi_ps(ids, colorLanes);
+    rows[2] = _mm_movelh_ps(xy, glyphColor);
+    rows[3] = _mm_movehl_ps(glyphColor, xy);
+
+    unsigned visible =
+        ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(flaggedIds));
+    unsigned lanes = gathered - run < 4 ? gathered - run : 4;
+    if (lanes == 4) {
+      _mm_storeu_ps((float *)(instances + count), rows[0]);
+      count += visible & 1;
+      _mm_storeu_ps((float *)(instances + count), rows[1]);
+      count += (visible >> 1) & 1;
+      _mm_storeu_ps((float *)(instances + count), rows[2]);
+      count += (visible >> 2) & 1;
+      _mm_storeu_ps((float *)(instances + count), rows[3]);
+      count += (visible >> 3) & 1;
+    } else {
+      for (unsigned lane = 0; lane < lanes; lane++) {
+        _mm_storeu_ps((float *)(instances + count), rows[lane]);
+        count += (visible >> lane) & 1;
+      }
+    }
+
+    // Padding lanes add nothing, the last lane is the cursor after the run
+    carry = _mm_add_ps(cursor, advance);
+    carry = _mm_shuffle_ps(carry, carry, _MM_SHUFFLE(3, 3, 3, 3));
+    run += lanes;
+  }
+
+  *xOffset = _mm_cvtss_f32(carry);
+  *prevId = glyphs[run - 1].glyph & ~ASCII_RUN_BLANK;
+  *glyphCount = count;
+  return run;
+}
+#endif
+
+unsigned LayoutText(const BitmapFont *font, const TextLayout *layout,
+                    float xPos, float yPos, const char *text, size_t textLen,
+                    GlyphInstance *instances) {
+  float scale = GetTextScale(font, layout);
+  float top = layout->baseline ? yPos - font->base * scale : yPos;
+  unsigned lineCount = 0;
+  return LayoutTextLines(font, layout, xPos, top, font->lineHeight * scale,
+                         text, textLen, instances, &lineCount);
+}
+
+// Lines are placed at top + line * lineHeight rather than one line height
+// below the previous one, so text laid out in parts with a lineHeight of 1
+// (the line numbers) can be moved to the same positions afterwards.
+unsigned LayoutTextLines(const BitmapFont *font, const TextLayout *layout,
+                         float xPos, float top, float lineHeight,
+                         const char *text, size_t textLen,
+                         GlyphInstance *instances, unsigned *lineCount) {
+  unsigned glyphCount = 0;
+  unsigned lineStart = 0;
+  unsigned line = 0;
+  unsigned prevId = NO_GLYPH;
+  float scale = GetTextScale(font, layout);
+  float xOffset = 0.0f;
+  float yOffset = top;
+  bool wrap = layout->maxWidth > 0.0f;
+
+  // Last place where the current line can wrap: the glyph after a space, the
+  // cursor after it and the line width before it
+  bool hasBreak = false;
+  unsigned breakGlyph = 0;
+  float breakOffset = 0.0f;
+  float breakWidth = 0.0f;
+
+#ifdef TEXT_SSE2
+  bool asciiRuns = font->asciiRuns != NULL && scale == 1.0f && !wrap;
+#endif
+  for (size_t i = 0; i < textLen;) {
+#ifdef TEXT_SSE2
+    if (asciiRuns) {
+      unsigned run =
+          LayoutAsciiRun(font, layout, xPos, yOffset,
+                         (const unsigned char *)text + i, textLen - i,
+                         instances, &glyphCount, &xOffset, &prevId);
+      i += run;
+      if (run > 0) {
+        continue;
+      }
+    }
+#endif
+
+    // ASCII skips the decoder and the page lookup
+    unsigned codepoint = (unsigned char)text[i];
+    unsigned id = NO_GLYPH;
+    if (codepoint < 0x80) {
+      id = font->asciiGlyphs[codepoint];
+      i++;
+    } else {
+      codepoint = DecodeUTF8(text, textLen, &i);
+      id = GetGlyphIndex(font, codepoint);
+    }
+
+    if (id == NO_GLYPH) {
+      if (codepoint == '\n') {
+        AlignTextLine(layout, instances + lineStart, glyphCount - lineStart,
+                      xOffset);
+        line++;
+        yOffset = top + (float)line * lineHeight;
+        xOffset = 0.0f;
+        lineStart = glyphCount;
+        prevId = NO_GLYPH;
+        hasBreak = false;
+      } else if (codepoint != '\r') {
+        WarnMissingGlyph(codepoint);
+      }
+      continue;
+    }
+
+    // Folding the kerning into the advance keeps a single addition on the
+    // cursor dependency chain
+    float kerning = GetKerning(font, prevId, id) * scale;
+    float advance = kerning + font->xas[id] * scale;
+
+    // Spaces are too frequent to branch on, track the break with selects
+    bool space = codepoint == ' ';
+    hasBreak |= space;
+    breakGlyph = space ? glyphCount : breakGlyph;
+    breakOffset = space ? xOffset + advance : breakOffset;
+    breakWidth = space ? xOffset + kerning : breakWidth;
+    if (!space && wrap && xOffset + advance > layout->maxWidth &&
+        xOffset > 0.0f) {
+      // Move the current word to a new line, or break it right here when it
+      // is wider than the whole line
+      if (!hasBreak) {
+        breakGlyph = glyphCount;
+        breakOffset = xOffset;
+        breakWidth = xOffset;
+      }
+
+      AlignTextLine(layout, instances + lineStart, breakGlyph - lineStart,
+                    breakWidth);
+      line++;
+      yOffset = top + (float)line * lineHeight;
+      for (unsigned g = breakGlyph; g < glyphCount; g++) {
+        instances[g].x -= breakOffset;
+        instances[g].y = yOffset;
+      }
+
+      xOffset -= breakOffset;
+      lineStart = breakGlyph;
+      hasBreak = false;
+    }
+
+    // Blank glyphs (i.e. spaces) only advance the cursor: the slot is always
+    // written but only kept for visible glyphs. This stays within the buffer
+    // since there is room for one instance per byte of text
+    instances[glyphCount] = (GlyphInstance){
+        .x = xPos + xOffset + kerning,
+        .y = yOffset,
+        .glyph = id,
+        .color = layout->color,
+    };
+    glyphCount += font->visible[id];
+
+    xOffset += advance;
+    prevId = id;
+  }
+
+  AlignTextLine(layout, instances + lineStart, glyphCount - lineStart,
+                xOffset);
+  *lineCount = line + 1;
+  return glyphCount;
+}
+
+void AlignTextLine(const TextLayout *layout, GlyphInstance *instances,
+                   unsigned glyphCount, float lineWidth) {
+  float shift = 0.0f;
+  if (layout->align == TEXT_ALIGN_CENTER) {
+    shift = (layout->maxWidth - lineWidth) * 0.5f;
+  } else if (layout->align == TEXT_ALIGN_RIGHT) {
+    shift = layout->maxWidth - lineWidth;
+  } else {
+    return;
+  }
+
+  for (unsigned i = 0; i < glyphCount; i++) {
+    instances[i].x += shift;
+  }
+}
+
+// Keeps the glyphs whose quad, as the vertex shader places it, overlaps the
+// left, top, right and bottom edges of clip
+unsigned CullGlyphs(const BitmapFont *font, float scale, const float clip[4],
+                    GlyphInstance *instances, unsigned glyphCount) {
+  unsigned kept = 0;
+  for (unsigned i = 0; i < glyphCount; i++) {
+    const GlyphTableEntry *glyph = &font->glyphs[instances[i].glyph];
+    float left = instances[i].x + glyph->offset[0] * scale;
+    float top = instances[i].y + glyph->offset[1] * scale;
+    bool visible = left < clip[2] && left + glyph->size[0] * scale > clip[0] &&
+                   top < clip[3] && top + glyph->size[1] * scale > clip[1];
+    instances[kept] = instances[i];
+    kept += visible;
+  }
+
+  return kept;
+}
+
+unsigned MakeGlyphVertexArray(Mesh quad, unsigned instanceBufferId) {
+  unsigned vao = 0;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  // Corner
+  glBindBuffer(GL_ARRAY_BUFFER, quad.vbo);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), NULL);
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad.ebo);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBufferId);
+  BindGlyphInstanceAttribs(0);
+  EnableGlyphInstanceAttribs();
+  glBindVertexArray(0);
+  return vao;
+}
+
+TextBatch CreateTextBatch(unsigned maxGlyphs) {
+  TextBatch batch = {0};
+  // clang-format off
+  const float corners[] = {
+      1.0f, 0.0f, // top right
+      1.0f, 1.0f, // bottom right
+      0.0f, 1.0f, // bottom left
+      0.0f, 0.0f, // top left
+  };
+  // clang-format on
+  const unsigned short indices[] = {
+      0, 1, 3, // First triangle
+      1, 2, 3, // Second triangle
+  };
+
+  batch.stream = CreateStreamBuffer(maxGlyphs * sizeof(GlyphInstance));
+  if (batch.stream.status != SUCCESS) {
+    batch.status = batch.stream.status;
+    return batch;
+  }
+
+  // Unit quad shared by every glyph, expanded by the vertex shader
+  glGenBuffers(1, &batch.quad.vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, batch.quad.vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+  glGenBuffers(1, &batch.quad.ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.quad.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  batch.quad.vao = MakeGlyphVertexArray(batch.quad, batch.stream.bufferId);
+  return batch;
+}
+
+void DestroyTextBatch(TextBatch *batch) {
+  if (batch->quad.vao != 0) {
+    glDeleteVertexArrays(1, &batch->quad.vao);
+  }
+
+  if (batch->quad.vbo != 0) {
+    glDeleteBuffers(1, &batch->quad.vbo);
+  }
+
+  if (batch->quad.ebo != 0) {
+    glDeleteBuffers(1, &batch->quad.ebo);
+  }
+
+  if (batch->scratch != NULL) {
+    free(batch->scratch);
+  }
+
+  DestroyStreamBuffer(&batch->stream);
+  *batch = (TextBatch){0};
+}
+
+void EnableGlyphInstanceAttribs(void) {
+  for (unsigned attrib = 1; attrib <= 3; attrib++) {
+    glVertexAttribDivisor(attrib, 1);
+    glEnableVertexAttribArray(attrib);
+  }
+}
+
+void BindGlyphInstanceAttribs(size_t offset) {
+  GLsizei instanceStride = sizeof(GlyphInstance);
+  // Position
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, instanceStride,
+                        (void *)(offset + offsetof(GlyphInstance, x)));
+
+  // Glyph
+  glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, instanceStride,
+                         (void *)(offset + offsetof(GlyphInstance, glyph)));
+
+  // Color
+  glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, instanceStride,
+                        (void *)(offset + offsetof(GlyphInstance, color)));
+}
+
+void BeginTextBatch(TextBatch *batch, float width, float height) {
+  // Glyphs are laid out in framebuffer pixels with the origin at the top left
+  MakeOrthoProj(batch->proj, 0.0f, width, 0.0f, height, -1.0f, 1.0f);
+  batch->width = width;
+  batch->height = height;
+  batch->boundProgramId = 0;
+  batch->boundTextureId = 0;
+  batch->frameIndex++;
+  batch->scale = 1.0f;
+  batch->effects = (TextEffects){0};
+  batch->frameStats = (TextStats){0};
+  currentBatch = batch;
+}
+
+// Through the run cache or the layout pool of the batch, if it has them
+unsigned LayoutBatchText(TextBatch *batch, const BitmapFont *font,
+                         const TextLayout *layout, float xPos, float yPos,
+                         const char *text, size_t textLen,
+                         GlyphInstance *instances) {
+  if (batch->runCache != NULL && textLen <= TEXT_RUN_CACHE_MAX_TEXT) {
+    return LayoutCachedText(batch->runCache, batch->frameIndex, font, layout,
+                            xPos, yPos, text, textLen, instances);
+  }
+
+  if (batch->layoutPool != NULL) {
+    return LayoutTextParallel(batch->layoutPool, font, layout, xPos, yPos,
+                              text, textLen, instances);
+  }
+
+  return LayoutText(font, layout, xPos, yPos, text, textLen, instances);
+}
+
+void BatchText(TextBatch *batch, const BitmapFont *font,
+               const TextLayout *layout, float xPos, float yPos,
+               const char *text) {
+  size_t textLen = strlen(text);
+  SetTextBatchFont(batch, font);
+  SetTextBatchStyle(batch, GetTextScale(font, layout), &layout->effects);
+
+  // Every byte produces at most one glyph
+  if (textLen > batch->glyphCapacity - batch->glyphCount) {
+    FlushTextBatch(batch);
+    ReserveTextBatch(batch, textLen);
+  }
+
+  if (textLen <= batch->glyphCapacity - batch->glyphCount) {
+    double start = GetMonotonicTime();
+    GlyphInstance *instances = batch->instances + batch->glyphCount;
+    unsigned glyphCount = LayoutBatchText(batch, font, layout, xPos, yPos,
+                                          text, textLen, instances);
+    if (batch->glyphCache != NULL) {
+      TouchCachedGlyphs(batch->glyphCache, batch->frameIndex, instances,
+                        glyphCount);
+    }
+
+    batch->glyphCount += glyphCount;
+    batch->frameStats.layoutTime += GetMonotonicTime() - start;
+    return;
+  }
+
+  // Longer than a whole stream region: lay it out aside and copy it in parts
+  GlyphInstance *scratch = GetTextBatchScratch(batch, textLen);
+  if (scratch == NULL) {
+    return;
+  }
+
+  double start = GetMonotonicTime();
+  unsigned glyphCount = LayoutBatchText(batch, font, layout, xPos, yPos, text,
+                                        textLen, scratch);
+  batch->frameStats.layoutTime += GetMonotonicTime() - start;
+  BatchGlyphs(batch, font, scratch, glyphCount);
+}
+
+// White text at the default size into the batch of the current frame
+void RenderText(BitmapFont font, float xPos, float yPos, const char *text) {
+  if (currentBatch == NULL) {
+    Log(LOG_WARN, "TEXT: RenderText called outside of a text batch");
+    return;
+  }
+
+  BatchText(currentBatch, &font, &(TextLayout){.color = COLOR_WHITE}, xPos,
+            yPos, text);
+}
+
+// Glyphs already laid out, drawn with the style of the last batched text
+void BatchGlyphs(TextBatch *batch, const BitmapFont *font,
+                 const GlyphInstance *instances, unsigned glyphCount) {
+  SetTextBatchFont(batch, font);
+  if (batch->glyphCache != NULL) {
+    double start = GetMonotonicTime();
+    TouchCachedGlyphs(batch->glyphCache, batch->frameIndex, instances,
+                      glyphCount);
+    batch->frameStats.layoutTime += GetMonotonicTime() - start;
+  }
+
+  for (unsigned copied = 0; copied < glyphCount;) {
+    if (batch->glyphCount == batch->glyphCapacity) {
+      FlushTextBatch(batch);
+      ReserveTextBatch(batch, glyphCount - copied);
+    }
+
+    unsigned count = batch->glyphCapacity - batch->glyphCount;
+    if (count > glyphCount - copied) {
+      count = glyphCount - copied;
+    }
+
+    double start = GetMonotonicTime();
+    memcpy(batch->instances + batch->glyphCount, instances + copied,
+           count * sizeof(GlyphInstance));
+    batch->frameStats.uploadTime += GetMonotonicTime() - start;
+    batch->glyphCount += count;
+    copied += count;
+  }
+}
+
+void SetTextBatchFont(TextBatch *batch, const BitmapFont *font) {
+  if (batch->shaderProgramId != font->shaderProgramId ||
+      batch->textureId != font->textureId) {
+    FlushTextBatch(batch);
+    batch->shaderProgramId = font->shaderProgramId;
+    batch->textureId = font->textureId;
+    batch->glyphTableTextureId = font->glyphTableTextureId;
+    batch->projLocation = font->projLocation;
+    batch->originLocation = font->originLocation;
+    batch->styleLocations = font->styleLocations;
+    batch->distanceRange = font->distanceRange;
+    batch->glyphCache = font->glyphCache;
+  }
+}
+
+void SetTextBatchStyle(TextBatch *batch, float scale,
+                       const TextEffects *effects) {
+  if (batch->scale != scale ||
+      memcmp(&batch->effects, effects, sizeof(TextEffects)) != 0) {
+    FlushTextBatch(batch);
+    batch->scale = scale;
+    batch->effects = *effects;
+  }
+}
+
+static void SetColorUniform(int location, unsigned color) {
+  glUniform4f(location, (float)(color & 0xFF) / 255.0f,
+              (float)((color >> 8) & 0xFF) / 255.0f,
+              (float)((color >> 16) & 0xFF) / 255.0f,
+              (float)(color >> 24) / 255.0f);
+}
+
+void SetGlyphStyle(const GlyphStyleLocations *locations, float distanceRange,
+                   float scale, const TextEffects *effects) {
+  glUniform1f(locations->scale, scale);
+
+  // Coverage shaders have no effects
+  if (locations->distanceRange == -1) {
+    return;
+  }
+
+  glUniform1f(locations->distanceRange, distanceRange);
+  glUniform1f(locations->outlineWidth, effects->outlineWidth);
+  SetColorUniform(locations->outlineColor, effects->outlineColor);
+  glUniform2f(locations->shadowOffset, effects->shadowOffset[0],
+              effects->shadowOffset[1]);
+  glUniform1f(locations->shadowSoftness, effects->shadowSoftness);
+  SetColorUniform(locations->shadowColor, effects->shadowColor);
+}
+
+void ReserveTextBatch(TextBatch *batch, size_t glyphCount) {
+  size_t regionGlyphs = batch->stream.regionSize / sizeof(GlyphInstance);
+  size_t minGlyphs = glyphCount < regionGlyphs ? glyphCount : regionGlyphs;
+  size_t available = 0;
+
+  // Mapping may wait for the GPU to release a region
+  double start = GetMonotonicTime();
+  batch->instances = MapStreamRange(
+      &batch->stream, minGlyphs * sizeof(GlyphInstance), &available);
+  batch->glyphCapacity = (unsigned)(available / sizeof(GlyphInstance));
+  batch->frameStats.uploadTime += GetMonotonicTime() - start;
+}
+
+GlyphInstance *GetTextBatchScratch(TextBatch *batch, size_t glyphCount) {
+  if (glyphCount > batch->scratchCapacity) {
+    GlyphInstance *scratch =
+        realloc(batch->scratch, glyphCount * sizeof(GlyphInstance));
+    if (scratch == NULL) {
+      Log(LOG_ERROR, "TEXT: could not allocate memory for %zu glyphs",
+          glyphCount);
+      return NULL;
+    }
+
+    batch->scratch = scratch;
+    batch->scratchCapacity = glyphCount;
+  }
+
+  return batch->scratch;
+}
+
+// Glyphs copied into the cache since the last draw go to GL first. Uploading
+// binds the cache texture, so the next draw binds its textures again.
+static void UploadTextBatchCache(TextBatch *batch, GlyphCache *cache) {
+  if (cache != NULL && UploadGlyphCache(cache)) {
+    batch->boundTextureId = 0;
+  }
+}
+
+void FlushTextBatch(TextBatch *batch) {
+  if (batch->glyphCount == 0) {
+    return;
+  }
+
+  double start = GetMonotonicTime();
+  UploadTextBatchCache(batch, batch->glyphCache);
+  size_t offset = CommitStreamRange(
+      &batch->stream, batch->glyphCount * sizeof(GlyphInstance));
+  double committed = GetMonotonicTime();
+  batch->frameStats.uploadTime += committed - start;
+
+  BindTextDrawState(batch, batch->shaderProgramId, batch->projLocation,
+                    batch->textureId, batch->glyphTableTextureId);
+  glUniform2f(batch->originLocation, 0.0f, 0.0f);
+  SetGlyphStyle(&batch->styleLocations, batch->distanceRange, batch->scale,
+                &batch->effects);
+
+  glBindVertexArray(batch->quad.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, batch->stream.bufferId);
+  BindGlyphInstanceAttribs(offset);
+  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, NULL,
+                          (GLsizei)batch->glyphCount);
+  batch->frameStats.submitTime += GetMonotonicTime() - committed;
+
+  batch->frameStats.glyphs += batch->glyphCount;
+  batch->frameStats.drawCalls++;
+
+  // The rest of the mapped range is still available for the next glyphs
+  batch->instances += batch->glyphCount;
+  batch->glyphCapacity -= batch->glyphCount;
+  batch->glyphCount = 0;
+}
+
+void EndTextBatch(TextBatch *batch) {
+  FlushTextBatch(batch);
+  EndStreamFrame(&batch->stream);
+  batch->instances = NULL;
+  batch->glyphCapacity = 0;
+  batch->lastFrameStats = batch->frameStats;
+
+  glBindVertexArray(0);
+  glUseProgram(0);
+  batch->boundProgramId = 0;
+  batch->boundTextureId = 0;
+  if (currentBatch == batch) {
+    currentBatch = NULL;
+  }
+}
+
+void BindTextDrawState(TextBatch *batch, unsigned shaderProgramId,
+                       int projLocation, unsigned textureId,
+                       unsigned glyphTableTextureId) {
+  if (batch->boundProgramId != shaderProgramId) {
+    glUseProgram(shaderProgramId);
+    glUniformMatrix4fv(projLocation, 1, GL_TRUE, batch->proj);
+    batch->boundProgramId = shaderProgramId;
+    batch->frameStats.stateChanges++;
+  }
+
+  if (batch->boundTextureId != textureId) {
+    BindGlyphTextures(textureId, glyphTableTextureId);
+    batch->boundTextureId = textureId;
+    batch->frameStats.stateChanges++;
+  }
+}
+
+void BindGlyphTextures(unsigned textureId, unsigned glyphTableTextureId) {
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, glyphTableTextureId);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+}
+
+TextObject CreateTextObject(const BitmapFont *font, const TextLayout *layout,
+                            float xPos, float yPos, const char *text) {
+  TextObject object = {0};
+  object.font = font;
+  object.layout = *layout;
+  object.xPos = xPos;
+  object.yPos = yPos;
+  object.dirty = true;
+  object.text = strdup(text);
+  if (object.text == NULL) {
+    Log(LOG_ERROR, "TEXT: could not allocate memory for text object");
+    object.status = ERROR_OUT_OF_MEMORY;
+  }
+
+  return object;
+}
+
+void SetTextObjectText(TextObject *object, const char *text) {
+  if (object->text != NULL && strcmp(object->text, text) == 0) {
+    return;
+  }
+
+  char *copy = strdup(text);
+  if (copy == NULL) {
+    Log(LOG_ERROR, "TEXT: could not allocate memory for text object");
+    return;
+  }
+
+  free(object->text);
+  object->text = copy;
+  object->dirty = true;
+}
+
+void SetTextObjectFont(TextObject *object, const BitmapFont *font) {
+  if (object->font != font) {
+    object->font = font;
+    object->dirty = true;
+  }
+}
+
+void SetTextObjectLayout(TextObject *object, const TextLayout *layout) {
+  const TextLayout *current = &object->layout;
+  if (current->maxWidth != layout->maxWidth ||
+      current->align != layout->align ||
+      current->baseline != layout->baseline ||
+      current->color != layout->color || current->size != layout->size) {
+    object->layout = *layout;
+    object->dirty = true;
+  }
+
+  // Effects are uniforms, they need no new layout
+  object->layout.effects = layout->effects;
+}
+
+void SetTextObjectPosition(TextObject *object, float xPos, float yPos) {
+  // Glyphs are relative to the object origin, moving it needs no layout
+  object->xPos = xPos;
+  object->yPos = yPos;
+}
+
+void UpdateTextObject(TextBatch *batch, TextObject *object) {
+  size_t textLen = strlen(object->text);
+  GlyphInstance *scratch = GetTextBatchScratch(batch, textLen);
+  if (scratch == NULL && textLen > 0) {
+    return;
+  }
+
+  double start = GetMonotonicTime();
+  unsigned glyphCount = LayoutText(object->font, &object->layout, 0.0f, 0.0f,
+                                   object->text, textLen, scratch);
+  double laidOut = GetMonotonicTime();
+  batch->frameStats.layoutTime += laidOut - start;
+  if (object->vao == 0) {
+    glGenBuffers(1, &object->instanceVbo);
+    object->vao = MakeGlyphVertexArray(batch->quad, object->instanceVbo);
+  }
+
+  size_t size = glyphCount * sizeof(GlyphInstance);
+  glBindBuffer(GL_ARRAY_BUFFER, object->instanceVbo);
+  if (glyphCount > object->glyphCapacity) {
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)size, scratch, GL_STATIC_DRAW);
+    object->glyphCapacity = glyphCount;
+  } else if (glyphCount > 0) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)size, scratch);
+  }
+
+  if (object->font->glyphCache != NULL) {
+    if (glyphCount > 0) {
+      unsigned *glyphs =
+          realloc(object->cachedGlyphs, glyphCount * sizeof(unsigned));
+      if (glyphs == NULL) {
+        Log(LOG_ERROR, "TEXT: could not allocate memory for %u glyphs",
+            glyphCount);
+        glyphCount = 0;
+      } else {
+        object->cachedGlyphs = glyphs;
+      }
+    }
+
+    for (unsigned i = 0; i < glyphCount; i++) {
+      object->cachedGlyphs[i] = scratch[i].glyph;
+    }
+  }
+
+  batch->frameStats.uploadTime += GetMonotonicTime() - laidOut;
+  object->glyphCount = glyphCount;
+  object->fontId = object->font->id;
+  object->dirty = false;
+  batch->frameStats.objectUpdates++;
+  batch->frameStats.objectBytesUploaded += size;
+}
+
+void DrawTextObject(TextBatch *batch, TextObject *object) {
+  // Keep the order of the text batched before this object
+  FlushTextBatch(batch);
+
+  if (object->dirty || object->fontId != object->font->id) {
+    UpdateTextObject(batch, object);
+  }
+
+  if (object->glyphCount == 0) {
+    return;
+  }
+
+  double start = GetMonotonicTime();
+  const BitmapFont *font = object->font;
+  if (font->glyphCache != NULL) {
+    for (unsigned i = 0; i < object->glyphCount; i++) {
+      TouchCachedGlyph(font->glyphCache, batch->frameIndex,
+                       object->cachedGlyphs[i]);
+    }
+
+    UploadTextBatchCache(batch, font->glyphCache);
+  }
+
+  BindTextDrawState(batch, font->shaderProgramId, font->projLocation,
+                    font->textureId, font->glyphTableTextureId);
+  glUniform2f(font->originLocation, object->xPos, object->yPos);
+  SetGlyphStyle(&font->styleLocations, font->distanceRange,
+                GetTextScale(font, &object->layout), &object->layout.effects);
+
+  glBindVertexArray(object->vao);
+  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, NULL,
+                          (GLsizei)object->glyphCount);
+  batch->frameStats.submitTime += GetMonotonicTime() - start;
+
+  batch->frameStats.glyphs += object->glyphCount;
+  batch->frameStats.drawCalls++;
+}
+
+void DestroyTextObject(TextObject *object) {
+  if (object->vao != 0) {
+    glDeleteVertexArrays(1, &object->vao);
+  }
+
+  if (object->instanceVbo != 0) {
+    glDeleteBuffers(1, &object->instanceVbo);
+  }
+
+  if (object->text != NULL) {
+    free(object->text);
+  }
+
+  if (object->cachedGlyphs != NULL) {
+    free(object->cachedGlyphs);
+  }
+
+  *object = (TextObject){0};
+}
@@ -0,0 +1,179 @@
+#ifndef SFR_TEXT_H
+#define SFR_TEXT_H
+
+#include "common.h"
+#include "font.h"
+#include "gfx.h"
+#include "stream.h"
+
+// Colors are packed as 8-bit RGBA, red on the lowest byte
+#define PACK_RGBA(r, g, b, a)                                                  \
+  ((unsigned)(r) | ((unsigned)(g) << 8) | ((unsigned)(b) << 16) |              \
+   ((unsigned)(a) << 24))
+#define COLOR_WHITE PACK_RGBA(255, 255, 255, 255)
+
+typedef enum {
+  TEXT_ALIGN_LEFT,
+  TEXT_ALIGN_CENTER,
+  TEXT_ALIGN_RIGHT,
+} TextAlign;
+
+// Drawn by distance field fonts only, sizes and offsets in screen pixels. A
+// transparent color disables an effect.
+typedef struct {
+  float outlineWidth;
+  unsigned outlineColor;
+  float shadowOffset[2];
+  float shadowSoftness;
+  unsigned shadowColor;
+} TextEffects;
+
+// Lines are aligned inside maxWidth, which also enables word wrapping when it
+// is not zero. With baseline set, the position is the first line baseline
+// instead of its top. Text is drawn at size pixels per em, or at the font
+// size when it is zero.
+typedef struct {
+  float maxWidth;
+  TextAlign align;
+  bool baseline;
+  unsigned color;
+  float size;
+  TextEffects effects;
+} TextLayout;
+
+// Per glyph instance data, the quad size, offset and UVs are looked up by
+// the vertex shader in the font glyph table.
+typedef struct {
+  float x;
+  float y;
+  unsigned glyph;
+  unsigned color;
+} GlyphInstance;
+
+typedef struct {
+  unsigned glyphs;
+  unsigned drawCalls;
+  // Program, texture, blend and scissor changes between draws
+  unsigned stateChanges;
+  unsigned objectUpdates;
+  size_t objectBytesUploaded;
+  // CPU seconds spent laying out glyphs, writing them into GL buffers and
+  // issuing draw calls
+  double layoutTime;
+  double uploadTime;
+  double submitTime;
+} TextStats;
+
+// Collects the glyphs of consecutive RenderText/BatchText calls sharing the
+// same shader and atlas, and submits them with a single instanced draw call.
+// Instances are written straight into the streaming buffer.
+typedef struct {
+  StatusCode status;
+  Mesh quad;
+  StreamBuffer stream;
+  GlyphInstance *instances;
+  unsigned glyphCount;
+  unsigned glyphCapacity;
+  GlyphInstance *scratch;
+  size_t scratchCapacity;
+  unsigned shaderProgramId;
+  unsigned textureId;
+  unsigned glyphTableTextureId;
+  int projLocation;
+  int originLocation;
+  GlyphStyleLocations styleLocations;
+  float distanceRange;
+  float scale;
+  TextEffects effects;
+  unsigned boundProgramId;
+  unsigned boundTextureId;
+  // Glyph cache of the current font, its glyphs are touched as they are
+  // batched and uploaded before drawing
+  struct GlyphCache *glyphCache;
+  unsigned long long frameIndex;
+  // Lays out long text on several threads when set
+  struct LayoutPool *layoutPool;
+  // Keeps short text laid out between frames when set
+  struct TextRunCache *runCache;
+  // Framebuffer size of the frame
+  float width;
+  float height;
+  float proj[16];
+  TextStats frameStats;
+  TextStats lastFrameStats;
+} TextBatch;
+
+// Text laid out once into its own instance buffer, relative to the object
+// position, and drawn as is until its content changes.
+typedef struct {
+  StatusCode status;
+  const BitmapFont *font;
+  TextLayout layout;
+  char *text;
+  float xPos;
+  float yPos;
+  bool dirty;
+  // Id of the font the glyphs were laid out in, a reloaded font has a new
+  // one and the text is laid out again
+  unsigned fontId;
+  unsigned vao;
+  unsigned instanceVbo;
+  unsigned glyphCount;
+  unsigned glyphCapacity;
+  // Glyphs of the instances, touched in the glyph cache of the font every
+  // time the object is drawn
+  unsigned *cachedGlyphs;
+} TextObject;
+
+float GetTextScale(const BitmapFont *font, const TextLayout *layout);
+unsigned LayoutText(const BitmapFont *font, const TextLayout *layout,
+                    float xPos, float yPos, const char *text, size_t textLen,
+                    GlyphInstance *instances);
+unsigned LayoutTextLines(const BitmapFont *font, const TextLayout *layout,
+                         float xPos, float top, float lineHeight,
+                         const char *text, size_t textLen,
+                         GlyphInstance *instances, unsigned *lineCount);
+unsigned CullGlyphs(const BitmapFont *font, float scale, const float clip[4],
+                    GlyphInstance *instances, unsigned glyphCount);
+void AlignTextLine(const TextLayout *layout, GlyphInstance *instances,
+                   unsigned glyphCount, float lineWidth);
+unsigned MakeGlyphVertexArray(Mesh quad, unsigned instanceBufferId);
+TextBatch CreateTextBatch(unsigned maxGlyphs);
+void DestroyTextBatch(TextBatch *batch);
+void EnableGlyphInstanceAttribs(void);
+void BindGlyphInstanceAttribs(size_t offset);
+void BeginTextBatch(TextBatch *batch, float width, float height);
+unsigned LayoutBatchText(TextBatch *batch, const BitmapFont *font,
+                         const TextLayout *layout, float xPos, float yPos,
+                         const char *text, size_t textLen,
+                         GlyphInstance *instances);
+void BatchText(TextBatch *batch, const BitmapFont *font,
+               const TextLayout *layout, float xPos, float yPos,
+               const char *text);
+void RenderText(BitmapFont font, float xPos, float yPos, const char *text);
+void BatchGlyphs(TextBatch *batch, const BitmapFont *font,
+                 const GlyphInstance *instances, unsigned glyphCount);
+void SetTextBatchFont(TextBatch *batch, const BitmapFont *font);
+void SetTextBatchStyle(TextBatch *batch, float scale,
+                       const TextEffects *effects);
+void SetGlyphStyle(const GlyphStyleLocations *locations, float distanceRange,
+                   float scale, const TextEffects *effects);
+void ReserveTextBatch(TextBatch *batch, size_t glyphCount);
+GlyphInstance *GetTextBatchScratch(TextBatch *batch, size_t glyphCount);
+void FlushTextBatch(TextBatch *batch);
+void EndTextBatch(TextBatch *batch);
+void BindTextDrawState(TextBatch *batch, unsigned shaderProgramId,
+                       int projLocation, unsigned textureId,
+                       unsigned glyphTableTextureId);
+void BindGlyphTextures(unsigned textureId, unsigned glyphTableTextureId);
+TextObject CreateTextObject(const BitmapFont *font, const TextLayout *layout,
+                            float xPos, float yPos, const char *text);
+void SetTextObjectText(TextObject *object, const char *text);
+void SetTextObjectFont(TextObject *object, const BitmapFont *font);
+void SetTextObjectLayout(TextObject *object, const TextLayout *layout);
+void SetTextObjectPosition(TextObject *object, float xPos, float yPos);
+void UpdateTextObject(TextBatch *batch, TextObject *object);
+void DrawTextObject(TextBatch *batch, TextObject *object);
+void DestroyTextObject(TextObject *object);
+
+#endif // SFR_TEXT_H
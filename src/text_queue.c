@@ -0,0 +1,259 @@
+#include "text_queue.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+static void ResetTextQueue(TextQueue *queue) {
+  queue->commandCount = 0;
+  queue->glyphCount = 0;
+  queue->programCount = 0;
+  queue->atlasCount = 0;
+  queue->styleCount = 0;
+  memset(queue->clips[0], 0, sizeof(queue->clips[0]));
+  queue->clipCount = 1;
+}
+
+TextQueue CreateTextQueue(TextBatch *batch) {
+  TextQueue queue = {0};
+  queue.batch = batch;
+  ResetTextQueue(&queue);
+  return queue;
+}
+
+void DestroyTextQueue(TextQueue *queue) {
+  if (queue->commands != NULL) {
+    free(queue->commands);
+  }
+
+  if (queue->glyphs != NULL) {
+    free(queue->glyphs);
+  }
+
+  *queue = (TextQueue){0};
+}
+
+// Index of the value among the slots, added when new, or
+// TEXT_QUEUE_MAX_SLOTS when there is no room for it
+static unsigned FindQueueSlot(void *slots, unsigned *slotCount, size_t size,
+                              const void *value) {
+  for (unsigned i = 0; i < *slotCount; i++) {
+    if (memcmp((char *)slots + i * size, value, size) == 0) {
+      return i;
+    }
+  }
+
+  if (*slotCount == TEXT_QUEUE_MAX_SLOTS) {
+    return TEXT_QUEUE_MAX_SLOTS;
+  }
+
+  memcpy((char *)slots + *slotCount * size, value, size);
+  return (*slotCount)++;
+}
+
+static bool ReserveQueuedText(TextQueue *queue, size_t glyphCount) {
+  if (queue->commandCount == queue->commandCapacity) {
+    unsigned capacity =
+        queue->commandCapacity > 0 ? queue->commandCapacity * 2 : 64;
+    QueuedText *commands =
+        realloc(queue->commands, capacity * sizeof(QueuedText));
+    if (commands == NULL) {
+      Log(LOG_ERROR, "QUEUE: could not allocate memory for %u commands",
+          capacity);
+      return false;
+    }
+
+    queue->commands = commands;
+    queue->commandCapacity = capacity;
+  }
+
+  if (glyphCount > queue->glyphCapacity - queue->glyphCount) {
+    size_t capacity = queue->glyphCapacity > 0 ? queue->glyphCapacity : 1024;
+    while (capacity - queue->glyphCount < glyphCount) {
+      capacity *= 2;
+    }
+
+    GlyphInstance *glyphs =
+        realloc(queue->glyphs, capacity * sizeof(GlyphInstance));
+    if (glyphs == NULL) {
+      Log(LOG_ERROR, "QUEUE: could not allocate memory for %zu glyphs",
+          capacity);
+      return false;
+    }
+
+    queue->glyphs = glyphs;
+    queue->glyphCapacity = capacity;
+  }
+
+  return true;
+}
+
+void QueueText(TextQueue *queue, const BitmapFont *font,
+               const TextLayout *layout, const TextDrawOptions *options,
+               float xPos, float yPos, const char *text) {
+  TextDrawOptions draw = options != NULL ? *options : (TextDrawOptions){0};
+  float scale = GetTextScale(font, layout);
+  QueuedTextStyle style = {.scale = scale, .effects = layout->effects};
+  bool clipped = draw.clip[2] > draw.clip[0] && draw.clip[3] > draw.clip[1];
+  if (!clipped) {
+    memset(draw.clip, 0, sizeof(draw.clip));
+  }
+
+  // Out of slots, draw what is queued and start over
+  unsigned slots[4] = {0};
+  for (unsigned attempt = 0; attempt < 2; attempt++) {
+    slots[0] = FindQueueSlot(queue->programs, &queue->programCount,
+                             sizeof(unsigned), &font->shaderProgramId);
+    slots[1] = FindQueueSlot(queue->atlases, &queue->atlasCount,
+                             sizeof(unsigned), &font->textureId);
+    slots[2] = FindQueueSlot(queue->styles, &queue->styleCount,
+                             sizeof(QueuedTextStyle), &style);
+    slots[3] = FindQueueSlot(queue->clips, &queue->clipCount,
+                             sizeof(queue->clips[0]), draw.clip);
+    if (slots[0] < TEXT_QUEUE_MAX_SLOTS && slots[1] < TEXT_QUEUE_MAX_SLOTS &&
+        slots[2] < TEXT_QUEUE_MAX_SLOTS && slots[3] < TEXT_QUEUE_MAX_SLOTS) {
+      break;
+    }
+
+    FlushTextQueue(queue);
+  }
+
+  // Every byte produces at most one glyph
+  size_t textLen = strlen(text);
+  if (textLen == 0 || !ReserveQueuedText(queue, textLen)) {
+    return;
+  }
+
+  TextBatch *batch = queue->batch;
+  double start = GetMonotonicTime();
+  GlyphInstance *glyphs = queue->glyphs + queue->glyphCount;
+  unsigned glyphCount = LayoutBatchText(batch, font, layout, xPos, yPos, text,
+                                        textLen, glyphs);
+  if (clipped) {
+    glyphCount = CullGlyphs(font, scale, draw.clip, glyphs, glyphCount);
+  }
+
+  batch->frameStats.layoutTime += GetMonotonicTime() - start;
+  if (glyphCount == 0) {
+    return;
+  }
+
+  queue->commands[queue->commandCount] = (QueuedText){
+      .key = (unsigned long long)draw.depth << 40 |
+             (unsigned long long)draw.blend << 32 |
+             (unsigned long long)slots[0] << 24 | slots[1] << 16 |
+             slots[2] << 8 | slots[3],
+      .order = queue->commandCount,
+      .font = font,
+      .firstGlyph = (unsigned)queue->glyphCount,
+      .glyphCount = glyphCount,
+      .style = (unsigned char)slots[2],
+      .clip = (unsigned char)slots[3],
+      .blend = (unsigned char)draw.blend,
+  };
+  queue->commandCount++;
+  queue->glyphCount += glyphCount;
+  queue->frameStats.commands++;
+}
+
+static int CompareQueuedText(const void *a, const void *b) {
+  const QueuedText *first = a;
+  const QueuedText *second = b;
+  if (first->key != second->key) {
+    return first->key < second->key ? -1 : 1;
+  }
+
+  return first->order < second->order ? -1 : first->order > second->order;
+}
+
+static void SetTextBlend(TextBlend blend) {
+  if (blend == TEXT_BLEND_ADDITIVE) {
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+  } else {
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+}
+
+// Scissor boxes are in whole pixels from the bottom left, covering every
+// pixel the clip rect touches
+static void SetTextClip(const TextBatch *batch, const float clip[4]) {
+  if (clip[2] <= clip[0]) {
+    glDisable(GL_SCISSOR_TEST);
+    return;
+  }
+
+  int left = (int)floorf(clip[0]);
+  int bottom = (int)floorf(batch->height - clip[3]);
+  glScissor(left, bottom, (int)ceilf(clip[2]) - left,
+            (int)ceilf(batch->height - clip[1]) - bottom);
+  glEnable(GL_SCISSOR_TEST);
+}
+
+// Sorted by state, consecutive commands in the same state are merged by the
+// batch into one draw. Blending is left as alpha and scissoring off, as the
+// text batch expects them.
+void FlushTextQueue(TextQueue *queue) {
+  TextBatch *batch = queue->batch;
+  if (queue->commandCount == 0) {
+    ResetTextQueue(queue);
+    return;
+  }
+
+  // Text batched before the queue is drawn first
+  FlushTextBatch(batch);
+  unsigned drawCalls = batch->frameStats.drawCalls;
+  unsigned stateChanges = batch->frameStats.stateChanges;
+  qsort(queue->commands, queue->commandCount, sizeof(QueuedText),
+        CompareQueuedText);
+
+  unsigned blend = TEXT_BLEND_ALPHA;
+  unsigned clip = 0;
+  for (unsigned i = 0; i < queue->commandCount; i++) {
+    const QueuedText *command = &queue->commands[i];
+    if (command->blend != blend || command->clip != clip) {
+      FlushTextBatch(batch);
+      if (command->blend != blend) {
+        SetTextBlend(command->blend);
+        blend = command->blend;
+        batch->frameStats.stateChanges++;
+      }
+
+      if (command->clip != clip) {
+        SetTextClip(batch, queue->clips[command->clip]);
+        clip = command->clip;
+        batch->frameStats.stateChanges++;
+      }
+    }
+
+    const QueuedTextStyle *style = &queue->styles[command->style];
+    SetTextBatchFont(batch, command->font);
+    SetTextBatchStyle(batch, style->scale, &style->effects);
+    BatchGlyphs(batch, command->font, queue->glyphs + command->firstGlyph,
+                command->glyphCount);
+  }
+
+  FlushTextBatch(batch);
+  if (blend != TEXT_BLEND_ALPHA) {
+    SetTextBlend(TEXT_BLEND_ALPHA);
+    batch->frameStats.stateChanges++;
+  }
+
+  if (clip != 0) {
+    glDisable(GL_SCISSOR_TEST);
+    batch->frameStats.stateChanges++;
+  }
+
+  queue->frameStats.drawCalls += batch->frameStats.drawCalls - drawCalls;
+  queue->frameStats.stateChanges +=
+      batch->frameStats.stateChanges - stateChanges;
+  ResetTextQueue(queue);
+}
+
+// Draws the rest of the frame, before the batch ends
+void EndTextQueueFrame(TextQueue *queue) {
+  FlushTextQueue(queue);
+  queue->lastFrameStats = queue->frameStats;
+  queue->frameStats = (TextQueueStats){0};
+}
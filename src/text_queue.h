@@ -0,0 +1,84 @@
+#ifndef SFR_TEXT_QUEUE_H
+#define SFR_TEXT_QUEUE_H
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+// Distinct programs, atlases, styles and clip rects in the queue at once, a
+// queue that runs out of slots is flushed early
+#define TEXT_QUEUE_MAX_SLOTS 256
+
+typedef enum {
+  TEXT_BLEND_ALPHA,
+  TEXT_BLEND_ADDITIVE,
+} TextBlend;
+
+// Commands of a lower depth are drawn first, under those of a higher depth.
+// The clip rect holds the left, top, right and bottom edges in framebuffer
+// pixels, text is not clipped when it is empty.
+typedef struct {
+  unsigned short depth;
+  TextBlend blend;
+  float clip[4];
+} TextDrawOptions;
+
+typedef struct {
+  float scale;
+  TextEffects effects;
+} QueuedTextStyle;
+
+// Text laid out when queued, its glyphs kept in the queue until the flush.
+// The key packs depth, blend, program, atlas, style and clip slots, in this
+// order from the highest bits.
+typedef struct {
+  unsigned long long key;
+  unsigned order;
+  const BitmapFont *font;
+  unsigned firstGlyph;
+  unsigned glyphCount;
+  unsigned char style;
+  unsigned char clip;
+  unsigned char blend;
+} QueuedText;
+
+typedef struct {
+  unsigned commands;
+  unsigned drawCalls;
+  unsigned stateChanges;
+} TextQueueStats;
+
+// Text of a frame submitted in any order and drawn sorted by its GL state,
+// so text sharing a program, atlas and style is drawn together, with as many
+// draws as distinct states rather than changes of font between calls. Fonts
+// must stay loaded until the queue is flushed.
+typedef struct {
+  TextBatch *batch;
+  QueuedText *commands;
+  unsigned commandCount;
+  unsigned commandCapacity;
+  GlyphInstance *glyphs;
+  size_t glyphCount;
+  size_t glyphCapacity;
+  unsigned programs[TEXT_QUEUE_MAX_SLOTS];
+  unsigned programCount;
+  unsigned atlases[TEXT_QUEUE_MAX_SLOTS];
+  unsigned atlasCount;
+  QueuedTextStyle styles[TEXT_QUEUE_MAX_SLOTS];
+  unsigned styleCount;
+  // Slot 0 is the empty rect, no clipping
+  float clips[TEXT_QUEUE_MAX_SLOTS][4];
+  unsigned clipCount;
+  TextQueueStats frameStats;
+  TextQueueStats lastFrameStats;
+} TextQueue;
+
+TextQueue CreateTextQueue(TextBatch *batch);
+void DestroyTextQueue(TextQueue *queue);
+void QueueText(TextQueue *queue, const BitmapFont *font,
+               const TextLayout *layout, const TextDrawOptions *options,
+               float xPos, float yPos, const char *text);
+void FlushTextQueue(TextQueue *queue);
+void EndTextQueueFrame(TextQueue *queue);
+
+#endif // SFR_TEXT_QUEUE_H
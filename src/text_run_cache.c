@@ -0,0 +1,246 @@
+#include "text_run_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Glyphs then text, right after the run record
+static GlyphInstance *GetRunGlyphs(TextRun *run) {
+  return (GlyphInstance *)(run + 1);
+}
+
+static char *GetRunText(TextRun *run) {
+  return (char *)(GetRunGlyphs(run) + run->glyphCount);
+}
+
+static size_t GetRunBytes(size_t textLen, unsigned glyphCount) {
+  return sizeof(TextRun) + glyphCount * sizeof(GlyphInstance) + textLen;
+}
+
+static void MoveRunGlyphs(GlyphInstance *instances, const GlyphInstance *glyphs,
+                          unsigned glyphCount, float xPos, float yPos,
+                          unsigned color) {
+  for (unsigned i = 0; i < glyphCount; i++) {
+    instances[i] = (GlyphInstance){
+        .x = glyphs[i].x + xPos,
+        .y = glyphs[i].y + yPos,
+        .glyph = glyphs[i].glyph,
+        .color = color,
+    };
+  }
+}
+
+static unsigned long long MixRunHash(unsigned long long hash,
+                                     unsigned long long word) {
+  hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+  return hash ^ (hash >> 32);
+}
+
+// Eight bytes of text at a time, then the rest
+static unsigned long long HashTextRun(unsigned fontId,
+                                      const TextLayout *layout,
+                                      const char *text, size_t textLen) {
+  unsigned maxWidth = 0;
+  unsigned size = 0;
+  memcpy(&maxWidth, &layout->maxWidth, sizeof(maxWidth));
+  memcpy(&size, &layout->size, sizeof(size));
+  unsigned long long hash = MixRunHash(0x9E3779B97F4A7C15ull, fontId);
+  hash = MixRunHash(hash, (unsigned long long)maxWidth << 32 | size);
+  hash = MixRunHash(hash, (unsigned long long)layout->align << 1 |
+                              (layout->baseline ? 1 : 0));
+  hash = MixRunHash(hash, textLen);
+
+  size_t i = 0;
+  for (; i + 8 <= textLen; i += 8) {
+    unsigned long long word = 0;
+    memcpy(&word, text + i, sizeof(word));
+    hash = MixRunHash(hash, word);
+  }
+
+  if (i < textLen) {
+    unsigned long long word = 0;
+    memcpy(&word, text + i, textLen - i);
+    hash = MixRunHash(hash, word);
+  }
+
+  return hash;
+}
+
+static bool IsSameRun(TextRun *run, unsigned long long hash, unsigned fontId,
+                      const TextLayout *layout, const char *text,
+                      size_t textLen) {
+  return run->hash == hash && run->fontId == fontId &&
+         run->maxWidth == layout->maxWidth && run->align == layout->align &&
+         run->baseline == layout->baseline && run->size == layout->size &&
+         run->textLen == textLen &&
+         memcmp(GetRunText(run), text, textLen) == 0;
+}
+
+static void UnlinkRun(TextRun *run) {
+  run->prev->next = run->next;
+  run->next->prev = run->prev;
+}
+
+static void PushRun(TextRunCache *cache, TextRun *run) {
+  run->prev = &cache->lru;
+  run->next = cache->lru.next;
+  cache->lru.next->prev = run;
+  cache->lru.next = run;
+}
+
+static void EvictRun(TextRunCache *cache, TextRun *run) {
+  TextRun **link = &cache->buckets[run->hash & (cache->bucketCount - 1)];
+  while (*link != run) {
+    link = &(*link)->bucketNext;
+  }
+
+  *link = run->bucketNext;
+  UnlinkRun(run);
+  cache->bytes -= GetRunBytes(run->textLen, run->glyphCount);
+  cache->runCount--;
+  cache->frameStats.evictions++;
+  free(run);
+}
+
+// Twice the buckets once there are as many runs, a run that cannot be added
+// for lack of memory is only laid out again next time
+static bool GrowRunBuckets(TextRunCache *cache) {
+  unsigned bucketCount = cache->bucketCount * 2;
+  TextRun **buckets = calloc(bucketCount, sizeof(TextRun *));
+  if (buckets == NULL) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < cache->bucketCount; i++) {
+    TextRun *run = cache->buckets[i];
+    while (run != NULL) {
+      TextRun *next = run->bucketNext;
+      TextRun **bucket = &buckets[run->hash & (bucketCount - 1)];
+      run->bucketNext = *bucket;
+      *bucket = run;
+      run = next;
+    }
+  }
+
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->bucketCount = bucketCount;
+  return true;
+}
+
+static void AddRun(TextRunCache *cache, unsigned long long hash,
+                   unsigned fontId, const TextLayout *layout,
+                   const char *text, size_t textLen,
+                   const GlyphInstance *glyphs, unsigned glyphCount) {
+  size_t bytes = GetRunBytes(textLen, glyphCount);
+  if (bytes > cache->budget) {
+    return;
+  }
+
+  while (cache->bytes + bytes > cache->budget) {
+    EvictRun(cache, cache->lru.prev);
+  }
+
+  if (cache->runCount >= cache->bucketCount && !GrowRunBuckets(cache)) {
+    return;
+  }
+
+  TextRun *run = malloc(bytes);
+  if (run == NULL) {
+    return;
+  }
+
+  *run = (TextRun){
+      .hash = hash,
+      .fontId = fontId,
+      .maxWidth = layout->maxWidth,
+      .align = layout->align,
+      .baseline = layout->baseline,
+      .size = layout->size,
+      .textLen = textLen,
+      .glyphCount = glyphCount,
+  };
+  memcpy(GetRunGlyphs(run), glyphs, glyphCount * sizeof(GlyphInstance));
+  memcpy(GetRunText(run), text, textLen);
+
+  TextRun **bucket = &cache->buckets[hash & (cache->bucketCount - 1)];
+  run->bucketNext = *bucket;
+  *bucket = run;
+  PushRun(cache, run);
+  cache->bytes += bytes;
+  cache->runCount++;
+}
+
+TextRunCache *CreateTextRunCache(size_t budget) {
+  TextRunCache *cache = calloc(1, sizeof(TextRunCache));
+  if (cache == NULL) {
+    Log(LOG_ERROR, "RUNS: could not allocate memory for a text run cache");
+    return NULL;
+  }
+
+  cache->budget = budget > 0 ? budget : TEXT_RUN_CACHE_DEFAULT_BUDGET;
+  cache->bucketCount = TEXT_RUN_CACHE_MIN_BUCKETS;
+  cache->buckets = calloc(cache->bucketCount, sizeof(TextRun *));
+  if (cache->buckets == NULL) {
+    Log(LOG_ERROR, "RUNS: could not allocate memory for %u buckets",
+        cache->bucketCount);
+    free(cache);
+    return NULL;
+  }
+
+  cache->lru.prev = &cache->lru;
+  cache->lru.next = &cache->lru;
+  return cache;
+}
+
+void DestroyTextRunCache(TextRunCache *cache) {
+  TextRun *run = cache->lru.next;
+  while (run != &cache->lru) {
+    TextRun *next = run->next;
+    free(run);
+    run = next;
+  }
+
+  free(cache->buckets);
+  free(cache);
+}
+
+// Same glyphs as LayoutText placed from the origin then moved to the
+// position, whether the run was cached or not. Text of fonts without an id
+// is always laid out.
+unsigned LayoutCachedText(TextRunCache *cache, unsigned long long frame,
+                          const BitmapFont *font, const TextLayout *layout,
+                          float xPos, float yPos, const char *text,
+                          size_t textLen, GlyphInstance *instances) {
+  if (frame != cache->frame) {
+    cache->frame = frame;
+    cache->lastFrameStats = cache->frameStats;
+    cache->frameStats = (TextRunCacheStats){0};
+  }
+
+  if (font->id == 0 || textLen > TEXT_RUN_CACHE_MAX_TEXT) {
+    return LayoutText(font, layout, xPos, yPos, text, textLen, instances);
+  }
+
+  unsigned long long hash = HashTextRun(font->id, layout, text, textLen);
+  TextRun *run = cache->buckets[hash & (cache->bucketCount - 1)];
+  while (run != NULL &&
+         !IsSameRun(run, hash, font->id, layout, text, textLen)) {
+    run = run->bucketNext;
+  }
+
+  if (run != NULL) {
+    UnlinkRun(run);
+    PushRun(cache, run);
+    cache->frameStats.hits++;
+    MoveRunGlyphs(instances, GetRunGlyphs(run), run->glyphCount, xPos, yPos,
+                  layout->color);
+    return run->glyphCount;
+  }
+
+  cache->frameStats.misses++;
+  unsigned glyphCount =
+      LayoutText(font, layout, 0.0f, 0.0f, text, textLen, instances);
+  AddRun(cache, hash, font->id, layout, text, textLen, instances, glyphCount);
+  MoveRunGlyphs(instances, instances, glyphCount, xPos, yPos, layout->color);
+  return glyphCount;
+}
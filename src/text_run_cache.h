@@ -0,0 +1,61 @@
+#ifndef SFR_TEXT_RUN_CACHE_H
+#define SFR_TEXT_RUN_CACHE_H
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+#define TEXT_RUN_CACHE_DEFAULT_BUDGET (1 << 20)
+// Longer text is laid out every time, it is rarely drawn again unchanged
+#define TEXT_RUN_CACHE_MAX_TEXT 1024
+#define TEXT_RUN_CACHE_MIN_BUCKETS 256
+
+typedef struct {
+  unsigned hits;
+  unsigned misses;
+  unsigned evictions;
+} TextRunCacheStats;
+
+// Glyphs of a text laid out at the origin, followed in the same allocation
+// by the text itself. Runs are chained in their hash bucket and in the LRU
+// list, most recently used first.
+typedef struct TextRun {
+  unsigned long long hash;
+  unsigned fontId;
+  float maxWidth;
+  TextAlign align;
+  bool baseline;
+  float size;
+  size_t textLen;
+  unsigned glyphCount;
+  struct TextRun *bucketNext;
+  struct TextRun *prev;
+  struct TextRun *next;
+} TextRun;
+
+// Laid out text kept between frames, so labels and numbers drawn every frame
+// are only copied into the batch, moved where they are drawn. Runs are found
+// by a hash of the font, the text and the layout, and the least recently
+// used ones are dropped to stay within a byte budget. The color is not part
+// of the key, it is set on every glyph as runs are copied.
+typedef struct TextRunCache {
+  size_t budget;
+  size_t bytes;
+  TextRun **buckets;
+  unsigned bucketCount;
+  unsigned runCount;
+  // Head of the LRU list
+  TextRun lru;
+  unsigned long long frame;
+  TextRunCacheStats frameStats;
+  TextRunCacheStats lastFrameStats;
+} TextRunCache;
+
+TextRunCache *CreateTextRunCache(size_t budget);
+void DestroyTextRunCache(TextRunCache *cache);
+unsigned LayoutCachedText(TextRunCache *cache, unsigned long long frame,
+                          const BitmapFont *font, const TextLayout *layout,
+                          float xPos, float yPos, const char *text,
+                          size_t textLen, GlyphInstance *instances);
+
+#endif // SFR_TEXT_RUN_CACHE_H
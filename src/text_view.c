@@ -0,0 +1,192 @@
+#include "text_view.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Tops of the lines in the font of the view, again whenever the font is
+// reloaded with other metrics
+static StatusCode MeasureTextViewLines(TextView *view) {
+  const BitmapFont *font = view->font;
+  const TextLayout *layout = &view->layout;
+  GlyphInstance *scratch = NULL;
+  size_t longestLine = 0;
+  for (unsigned i = 0; i < view->lineCount; i++) {
+    size_t lineLen = view->lineStarts[i + 1] - 1 - view->lineStarts[i];
+    longestLine = lineLen > longestLine ? lineLen : longestLine;
+  }
+
+  // Wrapped lines are laid out once to count the rows they take
+  float lineHeight = font->lineHeight * GetTextScale(font, layout);
+  size_t rows = 0;
+  if (layout->maxWidth > 0.0f && longestLine > 0) {
+    scratch = malloc(longestLine * sizeof(GlyphInstance));
+    if (scratch == NULL) {
+      Log(LOG_ERROR, "TEXT: could not allocate memory for %zu glyphs",
+          longestLine);
+      return ERROR_OUT_OF_MEMORY;
+    }
+  }
+
+  for (unsigned i = 0; i < view->lineCount; i++) {
+    view->lineTops[i] = (float)rows * lineHeight;
+    unsigned lineRows = 1;
+    if (scratch != NULL) {
+      size_t start = view->lineStarts[i];
+      LayoutTextLines(font, layout, 0.0f, 0.0f, 1.0f, view->text + start,
+                      view->lineStarts[i + 1] - 1 - start, scratch,
+                      &lineRows);
+    }
+
+    rows += lineRows;
+  }
+
+  view->lineTops[view->lineCount] = (float)rows * lineHeight;
+  view->fontId = font->id;
+  if (scratch != NULL) {
+    free(scratch);
+  }
+
+  return SUCCESS;
+}
+
+TextView CreateTextView(const BitmapFont *font, const TextLayout *layout,
+                        const char *text, size_t textLen) {
+  TextView view = {0};
+  view.font = font;
+  view.layout = *layout;
+  view.text = text;
+  view.textLen = textLen;
+
+  view.lineCount = 1;
+  for (const char *c = text; (c = memchr(c, '\n', text + textLen - c));
+       c++) {
+    view.lineCount++;
+  }
+
+  view.lineStarts = malloc((view.lineCount + 1) * sizeof(size_t));
+  view.lineTops = malloc((view.lineCount + 1) * sizeof(float));
+  if (view.lineStarts == NULL || view.lineTops == NULL) {
+    Log(LOG_ERROR, "TEXT: could not allocate memory for %u lines",
+        view.lineCount);
+    view.status = ERROR_OUT_OF_MEMORY;
+    return view;
+  }
+
+  view.lineStarts[0] = 0;
+  for (unsigned i = 1; i <= view.lineCount; i++) {
+    const char *start = text + view.lineStarts[i - 1];
+    const char *end = memchr(start, '\n', text + textLen - start);
+    view.lineStarts[i] = (end != NULL ? (size_t)(end - text) : textLen) + 1;
+  }
+
+  view.status = MeasureTextViewLines(&view);
+  return view;
+}
+
+void DestroyTextView(TextView *view) {
+  if (view->lineStarts != NULL) {
+    free(view->lineStarts);
+  }
+
+  if (view->lineTops != NULL) {
+    free(view->lineTops);
+  }
+
+  *view = (TextView){0};
+}
+
+// Keeps the view inside the text, the last line at the bottom at most
+void ScrollTextView(TextView *view, float scrollX, float scrollY,
+                    float viewHeight) {
+  float maxScrollY = view->lineTops[view->lineCount] - viewHeight;
+  if (scrollY > maxScrollY) {
+    scrollY = maxScrollY;
+  }
+
+  view->scrollX = scrollX > 0.0f ? scrollX : 0.0f;
+  view->scrollY = scrollY > 0.0f ? scrollY : 0.0f;
+}
+
+// First line whose bottom is below y, or the last line
+unsigned FindTextViewLine(const TextView *view, float y) {
+  unsigned low = 0;
+  unsigned high = view->lineCount - 1;
+  while (low < high) {
+    unsigned mid = low + (high - low) / 2;
+    if (view->lineTops[mid + 1] > y) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+
+  return low;
+}
+
+// Lays out the visible lines into the batch scratch and batches the glyphs
+// inside the view. Lines without wrapping or alignment end where they leave
+// the view, the glyphs before stay where the whole line puts them.
+void DrawTextView(TextBatch *batch, TextView *view, float xPos, float yPos,
+                  float width, float height) {
+  TextViewStats stats = {0};
+  const BitmapFont *font = view->font;
+  const TextLayout *layout = &view->layout;
+  float scale = GetTextScale(font, layout);
+  float clip[4] = {xPos, yPos, xPos + width, yPos + height};
+  bool prefix = layout->maxWidth <= 0.0f && layout->align == TEXT_ALIGN_LEFT;
+  SetTextBatchFont(batch, font);
+  SetTextBatchStyle(batch, scale, &layout->effects);
+
+  // Lines keep their tops if they cannot be measured again
+  if (view->fontId != font->id && MeasureTextViewLines(view) == SUCCESS) {
+    ScrollTextView(view, view->scrollX, view->scrollY, height);
+  }
+
+  for (unsigned line = FindTextViewLine(view, view->scrollY);
+       line < view->lineCount && view->lineTops[line] - view->scrollY < height;
+       line++) {
+    const char *text = view->text + view->lineStarts[line];
+    size_t lineLen = view->lineStarts[line + 1] - 1 - view->lineStarts[line];
+    float lineX = xPos - view->scrollX;
+    float lineY = yPos + view->lineTops[line] - view->scrollY;
+    stats.lines++;
+    if (lineLen == 0) {
+      continue;
+    }
+
+    double start = GetMonotonicTime();
+    size_t len = prefix && lineLen > TEXT_VIEW_LINE_PREFIX
+                     ? TEXT_VIEW_LINE_PREFIX
+                     : lineLen;
+    GlyphInstance *scratch = NULL;
+    unsigned glyphCount = 0;
+    for (;;) {
+      // Never split a UTF-8 sequence
+      while (len < lineLen && ((unsigned char)text[len] & 0xC0) == 0x80) {
+        len++;
+      }
+
+      scratch = GetTextBatchScratch(batch, len);
+      if (scratch == NULL) {
+        return;
+      }
+
+      glyphCount = LayoutText(font, layout, lineX, lineY, text, len, scratch);
+      stats.bytesLaidOut += len;
+      if (len == lineLen ||
+          (glyphCount > 0 && scratch[glyphCount - 1].x >= clip[2])) {
+        break;
+      }
+
+      len = len * 2 < lineLen ? len * 2 : lineLen;
+    }
+
+    unsigned kept = CullGlyphs(font, scale, clip, scratch, glyphCount);
+    batch->frameStats.layoutTime += GetMonotonicTime() - start;
+    stats.glyphs += kept;
+    stats.culledGlyphs += glyphCount - kept;
+    BatchGlyphs(batch, font, scratch, kept);
+  }
+
+  view->lastDrawStats = stats;
+}
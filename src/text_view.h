@@ -0,0 +1,50 @@
+#ifndef SFR_TEXT_VIEW_H
+#define SFR_TEXT_VIEW_H
+
+#include "common.h"
+#include "font.h"
+#include "text.h"
+
+// Bytes of a line laid out at first when only its start can be visible,
+// doubled until the line passes the right edge of the view
+#define TEXT_VIEW_LINE_PREFIX 256
+
+typedef struct {
+  unsigned lines;
+  size_t bytesLaidOut;
+  unsigned glyphs;
+  unsigned culledGlyphs;
+} TextViewStats;
+
+// Scrollable view of a large text buffer. A line index holds where every
+// line starts in the text and how far down it is, so drawing only lays out
+// the lines inside the view and drops the glyphs outside it. The text is not
+// copied and must outlive the view.
+typedef struct {
+  StatusCode status;
+  const BitmapFont *font;
+  TextLayout layout;
+  const char *text;
+  size_t textLen;
+  // lineCount + 1 entries each, the last ones one byte past the text and the
+  // height of the whole text
+  size_t *lineStarts;
+  float *lineTops;
+  unsigned lineCount;
+  // Id of the font the lines were measured in, see TextObject
+  unsigned fontId;
+  float scrollX;
+  float scrollY;
+  TextViewStats lastDrawStats;
+} TextView;
+
+TextView CreateTextView(const BitmapFont *font, const TextLayout *layout,
+                        const char *text, size_t textLen);
+void DestroyTextView(TextView *view);
+void ScrollTextView(TextView *view, float scrollX, float scrollY,
+                    float viewHeight);
+unsigned FindTextViewLine(const TextView *view, float y);
+void DrawTextView(TextBatch *batch, TextView *view, float xPos, float yPos,
+                  float width, float height);
+
+#endif // SFR_TEXT_VIEW_H
@@ -0,0 +1,43 @@
+#ifndef SFR_UTF8_H
+#define SFR_UTF8_H
+
+#include <stddef.h>
+
+#define MAX_CODEPOINT 0x10FFFF
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+// Decodes the UTF-8 sequence at text[*pos] and moves past it. Malformed
+// sequences decode as U+FFFD one byte at a time.
+static inline unsigned DecodeUTF8(const char *text, size_t textLen,
+                                  size_t *pos) {
+  const unsigned char *bytes = (const unsigned char *)text + *pos;
+  size_t available = textLen - *pos;
+  unsigned lead = bytes[0];
+  unsigned length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+  unsigned codepoint = lead & (0x7F >> length);
+
+  *pos += 1;
+  if (length == 1 || lead > 0xF4 || available < length) {
+    return lead < 0x80 ? lead : REPLACEMENT_CHARACTER;
+  }
+
+  for (unsigned i = 1; i < length; i++) {
+    if ((bytes[i] & 0xC0) != 0x80) {
+      return REPLACEMENT_CHARACTER;
+    }
+
+    codepoint = codepoint << 6 | (bytes[i] & 0x3F);
+  }
+
+  // Reject overlong forms, surrogates and code points past the last plane
+  static const unsigned minCodepoint[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (codepoint < minCodepoint[length] || codepoint > MAX_CODEPOINT ||
+      (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+    return REPLACEMENT_CHARACTER;
+  }
+
+  *pos += length - 1;
+  return codepoint;
+}
+
+#endif // SFR_UTF8_H
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "font.h"
+#include "font_pack.h"
+#include "sdf.h"
+
+// Converts a BMFont descriptor (text or binary) and its PNG pages into a font
+// pack that the application maps at startup instead of parsing every file.
+// With --sdf the coverage atlas is replaced by a distance field first, with
+// --compress single channel atlases are stored as RGTC1 blocks.
+int main(int argc, char **argv) {
+  int status = EXIT_FAILURE;
+  bool distanceField = false;
+  bool compress = false;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "--sdf") == 0) {
+      distanceField = true;
+    } else if (strcmp(argv[arg], "--compress") == 0) {
+      compress = true;
+    } else {
+      break;
+    }
+  }
+
+  if (argc - arg != 2) {
+    fprintf(stderr,
+            "usage: %s [--sdf] [--compress] <descriptor.fnt|.txt> <out.sfp>\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const char *descFilename = argv[arg];
+  const char *packFilename = argv[arg + 1];
+  BitmapFontData data = ReadBitmapFontData(descFilename);
+  if (data.status != SUCCESS) {
+    goto terminate;
+  }
+
+  if (distanceField &&
+      MakeDistanceFieldFont(&data, SDF_DEFAULT_RANGE, 0) != SUCCESS) {
+    goto terminate;
+  }
+
+  ReduceAtlasChannels(&data);
+  if (compress && CompressFontAtlas(&data) != SUCCESS) {
+    goto terminate;
+  }
+
+  if (!WriteFontPack(packFilename, &data)) {
+    goto terminate;
+  }
+
+  Log(LOG_INFO, "PACK: wrote %s (%u glyphs, %u layers of %u x %u %s%s)",
+      packFilename, data.font.glyphCount - 1, data.atlasLayers,
+      data.atlasWidth, data.atlasHeight, GetAtlasFormatName(data.atlasFormat),
+      distanceField ? ", distance field" : "");
+  status = EXIT_SUCCESS;
+
+terminate:
+  FreeBitmapFontData(&data);
+  return status;
+}
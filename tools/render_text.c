@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "files.h"
+#include "font.h"
+#include "raster.h"
+#include "text.h"
+
+#define RENDER_MARGIN 4
+
+// Renders a label into a PNG without a GPU, on a transparent background,
+// cropped to the text and wrapped at the given width if any.
+int main(int argc, char **argv) {
+  int status = EXIT_FAILURE;
+  GlyphInstance *instances = NULL;
+  RasterImage image = {0};
+
+  if (argc != 4 && argc != 5) {
+    fprintf(stderr,
+            "usage: %s <descriptor.fnt|.txt> <out.png> <text> [max width]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  BitmapFontData font = ReadBitmapFontData(argv[1]);
+  if (font.status != SUCCESS) {
+    goto terminate;
+  }
+
+  const char *text = argv[3];
+  size_t textLen = strlen(text);
+  TextLayout layout = {
+      .maxWidth = argc == 5 ? strtof(argv[4], NULL) : 0.0f,
+      .color = COLOR_WHITE,
+  };
+  instances = malloc((textLen + 1) * sizeof(GlyphInstance));
+  if (instances == NULL) {
+    Log(LOG_ERROR, "RASTER: could not allocate memory for %zu glyphs",
+        textLen);
+    goto terminate;
+  }
+
+  unsigned glyphCount =
+      LayoutText(&font.font, &layout, 0.0f, 0.0f, text, textLen, instances);
+  float right = 1.0f;
+  float bottom = font.font.lineHeight;
+  for (unsigned i = 0; i < glyphCount; i++) {
+    const GlyphTableEntry *glyph = &font.font.glyphs[instances[i].glyph];
+    float glyphRight = instances[i].x + glyph->offset[0] + glyph->size[0];
+    float glyphBottom = instances[i].y + glyph->offset[1] + glyph->size[1];
+    right = glyphRight > right ? glyphRight : right;
+    bottom = glyphBottom > bottom ? glyphBottom : bottom;
+  }
+
+  image = CreateRasterImage((unsigned)right + RENDER_MARGIN * 2,
+                            (unsigned)bottom + RENDER_MARGIN * 2, RASTER_RGBA);
+  if (image.status != SUCCESS) {
+    goto terminate;
+  }
+
+  RasterGlyphs(&image, &font, instances, glyphCount, RENDER_MARGIN,
+               RENDER_MARGIN, GetBestRasterKernel(), 0);
+  if (!WritePNGFile(argv[2], image.pixels, image.width, image.height, 4)) {
+    goto terminate;
+  }
+
+  Log(LOG_INFO, "RASTER: wrote %s (%u glyphs, %u x %u)", argv[2], glyphCount,
+      image.width, image.height);
+  status = EXIT_SUCCESS;
+
+terminate:
+  DestroyRasterImage(&image);
+  FreeBitmapFontData(&font);
+  if (instances != NULL) {
+    free(instances);
+  }
+
+  return status;
+}